@@ -0,0 +1,136 @@
+#ifndef CAFFE_BATCH_PREPROCESSOR_HPP
+#define CAFFE_BATCH_PREPROCESSOR_HPP
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/util/thread_pool.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Turns a batch of images into the input blob of a Net, as
+ *        caffe.io.Transformer and caffe.Classifier do image by image in
+ *        Python, but in a pool of threads and without intermediate copies.
+ *
+ * Each image, of height x width x channels pixels in row-major order, is
+ * resized bilinearly to the image dims, then cropped to the height and width
+ * of the blob: the center crop, or the 4 corner crops, the center crop and
+ * their mirror images when oversampling, as caffe.io.oversample. The crops
+ * are written channel-first, after in this order: the channel swap, the raw
+ * scale, the mean subtraction and the input scale. uint8 pixels are taken as
+ * values in [0, 1], like the images of caffe.io.load_image.
+ *
+ * Images may instead be stored column-major, as MATLAB arrays are.
+ *
+ * PreprocessWindows() instead warps windows of the images to the size of the
+ * blob, one item per window, as caffe.Detector does for detection.
+ */
+template <typename Dtype>
+class BatchPreprocessor {
+ public:
+  /**
+   * @param num_threads
+   *    Number of threads preprocessing images, the caller included. 0 uses
+   *    one thread per hardware core.
+   */
+  explicit BatchPreprocessor(int num_threads);
+
+  /**
+   * @brief Sets the size images are resized to before cropping. 0 x 0, the
+   *        default, resizes them to the size of the crops.
+   */
+  void set_image_dims(int height, int width);
+  void set_oversample(bool oversample) { oversample_ = oversample; }
+  /**
+   * @brief Takes the images as column-major arrays, pixel (y, x, c) of an
+   *        image at y + height * (x + width * c), as MATLAB stores them.
+   */
+  void set_column_major(bool column_major) { column_major_ = column_major; }
+  /// @brief Channel c of the blob gets channel order[c] of the images.
+  void set_channel_swap(const vector<int>& order) { channel_swap_ = order; }
+  void set_raw_scale(Dtype scale) { raw_scale_ = scale; }
+  /**
+   * @brief Sets the mean subtracted after the raw scale: either one value
+   *        per channel, or one per value of a blob item.
+   */
+  void set_mean(const vector<Dtype>& mean) { mean_ = mean; }
+  void set_input_scale(Dtype scale) { input_scale_ = scale; }
+  /**
+   * @brief Sets the pixels of context PreprocessWindows() leaves around each
+   *        window in its item, as the context_pad of caffe.Detector.
+   */
+  void set_context_pad(int pad);
+
+  inline int crops_per_image() const { return oversample_ ? 10 : 1; }
+
+  /**
+   * @brief Preprocesses images[i], of heights[i] x widths[i] x
+   *        blob->channels() pixels, into the items [i * crops_per_image(),
+   *        (i + 1) * crops_per_image()) of blob.
+   *
+   * Pixel is uint8_t or float. blob must be 4-D with exactly
+   * images.size() * crops_per_image() items.
+   */
+  template <typename Pixel>
+  void Preprocess(const vector<const Pixel*>& images,
+      const vector<int>& heights, const vector<int>& widths,
+      Blob<Dtype>* blob);
+  /**
+   * @brief Warps windows[k] of images into item k of blob, as
+   *        caffe.Detector.crop, then preprocesses it as Preprocess().
+   *
+   * A window is (image index, ymin, xmin, ymax, xmax), and may be of any of
+   * the images, so that windows of several images fill a batch. With a
+   * context pad, the window is enlarged to keep that many pixels of context
+   * on each side once warped; the parts of it outside the image are filled
+   * with the mean. The image dims and oversampling do not apply.
+   */
+  template <typename Pixel>
+  void PreprocessWindows(const vector<const Pixel*>& images,
+      const vector<int>& heights, const vector<int>& widths,
+      const vector<vector<int> >& windows, Blob<Dtype>* blob);
+
+ protected:
+  void CheckBlob(const Blob<Dtype>& blob) const;
+  template <typename Pixel>
+  void PreprocessImage(const vector<const Pixel*>* images,
+      const vector<int>* heights, const vector<int>* widths,
+      const Blob<Dtype>* blob, Dtype* data, int i);
+  template <typename Pixel>
+  void PreprocessWindow(const vector<const Pixel*>* images,
+      const vector<int>* heights, const vector<int>* widths,
+      const vector<vector<int> >* windows, const Blob<Dtype>* blob,
+      Dtype* data, int k);
+  // Resizes the region [top, bottom) x [left, right) of image, with the raw
+  // scale, to out_height x out_width x channels values in row-major order.
+  template <typename Pixel>
+  void ResizeImage(const Pixel* image, int height, int width, int channels,
+      int top, int left, int bottom, int right, int out_height, int out_width,
+      Dtype* out) const;
+  // Writes the item of blob at (top, left) of image, a height x width x
+  // channels array of resized values, mirrored or not, as the channel swap,
+  // the mean and the input scale make it. Values outside image are the mean.
+  void WriteItem(const Dtype* image, int height, int width, int top,
+      int left, bool mirror, const Blob<Dtype>& blob, Dtype* item) const;
+
+  shared_ptr<ThreadPool> thread_pool_;
+  int image_height_;
+  int image_width_;
+  bool oversample_;
+  bool column_major_;
+  int context_pad_;
+  vector<int> channel_swap_;
+  Dtype raw_scale_;
+  vector<Dtype> mean_;
+  Dtype input_scale_;
+
+  DISABLE_COPY_AND_ASSIGN(BatchPreprocessor);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_BATCH_PREPROCESSOR_HPP
@@ -12,6 +12,7 @@
 #include "caffe/loss_layers.hpp"
 #include "caffe/neuron_layers.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/blob_views.hpp"
 
 namespace caffe {
 
@@ -73,6 +74,12 @@ class ArgMaxLayer : public Layer<Dtype> {
 /**
  * @brief Takes at least two Blob%s and concatenates them along either the num
  *        or channel dimension, outputting the result.
+ *
+ * With share_memory, in CPU mode, the bottoms are made views of their ranges
+ * of the top whenever these are contiguous, i.e. when all the axes before
+ * the concatenation axis have size 1, as for the num axis or a batch of one:
+ * the layers producing the bottoms then write the top directly, and nothing
+ * is copied.
  */
 template <typename Dtype>
 class ConcatLayer : public Layer<Dtype> {
@@ -141,6 +148,7 @@ class ConcatLayer : public Layer<Dtype> {
   int num_concats_;
   int concat_input_size_;
   int concat_axis_;
+  BlobViews<Dtype> bottom_views_;
 };
 
 /**
@@ -426,6 +434,10 @@ class SplitLayer : public Layer<Dtype> {
  * @brief Takes a Blob and slices it along either the num or channel dimension,
  *        outputting multiple sliced Blob results.
  *
+ * With share_memory, in CPU mode, the tops are made views of their ranges of
+ * the bottom whenever these are contiguous, as for ConcatLayer, and nothing
+ * is copied.
+ *
  * TODO(dox): thorough documentation for Forward, Backward, and proto params.
  */
 template <typename Dtype>
@@ -457,6 +469,7 @@ class SliceLayer : public Layer<Dtype> {
   int slice_size_;
   int slice_axis_;
   vector<int> slice_point_;
+  BlobViews<Dtype> top_views_;
 };
 
 }  // namespace caffe
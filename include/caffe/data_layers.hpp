@@ -16,10 +16,15 @@
 #include "caffe/layer.hpp"
 #include "caffe/net.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/blocking_queue.hpp"
 #include "caffe/util/db.hpp"
 
 namespace caffe {
 
+class ImageCache;
+class ImageDiskCache;
+class ThreadPool;
+
 /**
  * @brief Provides base for data layers that feed blobs to the Net.
  *
@@ -175,13 +180,89 @@ class HDF5DataLayer : public Layer<Dtype> {
   std::vector<unsigned int> file_permutation_;
 };
 
+/**
+ * @brief Provides data to the Net from HDF5 files like HDF5DataLayer, but
+ *        streams the rows from disk in a background thread instead of
+ *        loading whole files into memory.
+ *
+ * Rows are read chunk_rows at a time through hyperslab selections, so files
+ * may be larger than memory, and the next batch, including opening the next
+ * file, is read while the net computes on the current one. With shuffle,
+ * the files and the chunks of every file are read in a random order, and
+ * rows are drawn at random from a buffer of shuffle_buffer_rows rows.
+ */
+template <typename Dtype>
+class HDF5StreamDataLayer : public Layer<Dtype>, public InternalThread {
+ public:
+  explicit HDF5StreamDataLayer(const LayerParameter& param)
+      : Layer<Dtype>(param), file_id_(-1) {}
+  virtual ~HDF5StreamDataLayer();
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  // Data layers have no bottoms, so reshaping is trivial.
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {}
+
+  virtual inline const char* type() const { return "HDF5StreamData"; }
+  virtual inline int ExactNumBottomBlobs() const { return 0; }
+  virtual inline int MinTopBlobs() const { return 1; }
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {}
+  virtual void InternalThreadEntry();
+
+  // Opens the current file and its datasets, and plans the order of its
+  // chunks.
+  void OpenFile();
+  void CloseFile();
+  // Reads the next chunk of rows into chunk_blobs_, moving on to the next
+  // file once all chunks of the current one are read.
+  void ReadChunk();
+  int PrefetchRand(int n);
+
+  std::vector<std::string> hdf_filenames_;
+  std::vector<unsigned int> file_permutation_;
+  unsigned int current_file_;
+  hid_t file_id_;
+  std::vector<hid_t> datasets_;
+  hsize_t file_rows_;
+  std::vector<unsigned int> chunk_order_;
+  int current_chunk_;
+  // The shape of a row of every top, and its number of values.
+  std::vector<std::vector<int> > row_shapes_;
+  std::vector<int> row_dims_;
+  std::vector<shared_ptr<Blob<Dtype> > > chunk_blobs_;
+  int chunk_size_;
+  int chunk_row_;
+  std::vector<shared_ptr<Blob<Dtype> > > shuffle_blobs_;
+  int shuffle_size_;
+  std::vector<shared_ptr<Blob<Dtype> > > prefetch_blobs_;
+  shared_ptr<Caffe::RNG> prefetch_rng_;
+};
+
+/**
+ * @brief A batch of data and labels, handed over between threads.
+ */
+template <typename Dtype>
+class Batch {
+ public:
+  Blob<Dtype> data_, label_;
+};
+
 /**
  * @brief Write blobs to disk as HDF5 files.
  *
+ * In append mode, the batches are queued and appended to extensible
+ * datasets by a background thread, which writes the remaining batches when
+ * the layer is destroyed.
+ *
  * TODO(dox): thorough documentation for Forward and proto params.
  */
 template <typename Dtype>
-class HDF5OutputLayer : public Layer<Dtype> {
+class HDF5OutputLayer : public Layer<Dtype>, public InternalThread {
  public:
   explicit HDF5OutputLayer(const LayerParameter& param)
       : Layer<Dtype>(param), file_opened_(false) {}
@@ -209,12 +290,18 @@ class HDF5OutputLayer : public Layer<Dtype> {
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual void SaveBlobs();
+  // Appends the batches of full_ to the file, until it pops a NULL batch.
+  virtual void InternalThreadEntry();
 
   bool file_opened_;
   std::string file_name_;
   hid_t file_id_;
   Blob<Dtype> data_blob_;
   Blob<Dtype> label_blob_;
+  // Append mode: batches ready to be filled, and batches to be written.
+  vector<shared_ptr<Batch<Dtype> > > batches_;
+  BlockingQueue<Batch<Dtype>*> free_;
+  BlockingQueue<Batch<Dtype>*> full_;
 };
 
 /**
@@ -239,9 +326,14 @@ class ImageDataLayer : public BasePrefetchingDataLayer<Dtype> {
   shared_ptr<Caffe::RNG> prefetch_rng_;
   virtual void ShuffleImages();
   virtual void InternalThreadEntry();
+  // Reads root_folder + filename, resized to new_height x new_width, going
+  // through disk_cache_ when cache_dir is set.
+  virtual void LoadImage(const string& filename, cv::Mat* cv_img);
 
   vector<std::pair<std::string, int> > lines_;
   int lines_id_;
+  shared_ptr<ImageDiskCache> disk_cache_;
+  shared_ptr<ThreadPool> thread_pool_;
 };
 
 /**
@@ -311,6 +403,15 @@ class WindowDataLayer : public BasePrefetchingDataLayer<Dtype> {
  protected:
   virtual unsigned int PrefetchRand();
   virtual void InternalThreadEntry();
+  // Decodes the image image_database_[image_index], going through
+  // image_cache_ when the decoded cache is enabled.
+  virtual void LoadImage(int image_index, cv::Mat* cv_img);
+  // Crops window out of cv_img with context padding, warps it to crop_size,
+  // randomly mirrors it and writes it, mean subtracted and scaled, to
+  // top_data. Runs on the batch threads: rng is the window's own stream
+  // when mirroring, and NULL otherwise.
+  virtual void WarpWindow(const cv::Mat& cv_img, const vector<float>& window,
+      Caffe::RNG* rng, Dtype* top_data);
 
   shared_ptr<Caffe::RNG> prefetch_rng_;
   vector<std::pair<std::string, vector<int> > > image_database_;
@@ -323,6 +424,8 @@ class WindowDataLayer : public BasePrefetchingDataLayer<Dtype> {
   bool has_mean_values_;
   bool cache_images_;
   vector<std::pair<std::string, Datum > > image_database_cache_;
+  shared_ptr<ImageCache> image_cache_;
+  shared_ptr<ThreadPool> thread_pool_;
 };
 
 }  // namespace caffe
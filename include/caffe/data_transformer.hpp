@@ -1,6 +1,7 @@
 #ifndef CAFFE_DATA_TRANSFORMER_HPP
 #define CAFFE_DATA_TRANSFORMER_HPP
 
+#include <string>
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -9,6 +10,8 @@
 
 namespace caffe {
 
+class ImageCache;
+
 /**
  * @brief Applies common transformations to the input data, such as
  * scaling, mirroring, substracting the image mean...
@@ -87,6 +90,33 @@ class DataTransformer {
    */
   void Transform(Blob<Dtype>* input_blob, Blob<Dtype>* transformed_blob);
 
+  /**
+   * @brief Applies the online augmentation defined in the data layer's
+   * transform_param block (background compositing, random-resized crop and
+   * color jitter) to an 8-bit image, ahead of Transform(). It only reads the
+   * transformer's state and draws its random numbers from rng, so several
+   * threads can augment images at once, each with its own rng.
+   *
+   * @param cv_img
+   *    cv::Mat containing the image to augment.
+   * @param rng
+   *    Random number generator of this image, e.g. seeded with RandSeed().
+   * @param augmented
+   *    The augmented image. It may share data with cv_img.
+   */
+  void Augment(const cv::Mat& cv_img, Caffe::RNG* rng,
+      cv::Mat* augmented) const;
+
+  /// @brief Whether Augment() may change the images of this phase.
+  bool needs_augmentation() const;
+
+  /**
+   * @brief Draws a seed for the random number generator of one image passed
+   * to Augment(), so that images are augmented the same way however many
+   * threads augment them.
+   */
+  unsigned int RandSeed();
+
  protected:
    /**
    * @brief Generates a random integer from Uniform({0, 1, ..., n-1}).
@@ -99,6 +129,14 @@ class DataTransformer {
   virtual int Rand(int n);
 
   void Transform(const Datum& datum, Dtype* transformed_data);
+  void Transform(const cv::Mat& cv_img, Dtype* transformed_data);
+  // Checks that an input of the given shape transforms into transformed_blob.
+  void CheckShape(const int input_channels, const int input_height,
+      const int input_width, const Blob<Dtype>* transformed_blob) const;
+  // Lookup tables of (pixel - mean) * scale for 8-bit pixels, 256 entries per
+  // channel, built on first use.
+  const Dtype* PixelTables(const int channels);
+
   // Tranformation parameters
   TransformationParameter param_;
 
@@ -107,6 +145,10 @@ class DataTransformer {
   Phase phase_;
   Blob<Dtype> data_mean_;
   vector<Dtype> mean_values_;
+  vector<Dtype> pixel_tables_;
+  // Images to composite images with an alpha channel over.
+  vector<string> background_images_;
+  shared_ptr<ImageCache> background_cache_;
 };
 
 }  // namespace caffe
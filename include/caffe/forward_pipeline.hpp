@@ -0,0 +1,93 @@
+#ifndef CAFFE_FORWARD_PIPELINE_HPP_
+#define CAFFE_FORWARD_PIPELINE_HPP_
+
+#include <string>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/internal_thread.hpp"
+#include "caffe/net.hpp"
+#include "caffe/util/blocking_queue.hpp"
+
+namespace caffe {
+
+/**
+ * @brief The inputs and outputs of a Net for one batch, handed over between
+ *        threads by ForwardPipeline.
+ */
+template <typename Dtype>
+class PipelineBatch {
+ public:
+  vector<shared_ptr<Blob<Dtype> > > inputs_, outputs_;
+  bool failed_;
+};
+
+/**
+ * @brief Runs a Net forward on a stream of batches in a background thread,
+ *        so that the caller assembles the next batches and reads the outputs
+ *        of the previous ones meanwhile.
+ *
+ * The caller fills the blobs of NextInputs(), one per net input, shaped as
+ * it needs, and queues them with Push(). The thread makes them the storage of
+ * the net inputs, reshaping the net if their shapes changed, runs the net
+ * forward and copies the output blobs out. Pop() returns these copies in the
+ * order of the pushes. Up to depth batches are in flight at a time; the net
+ * must not be used otherwise until Stop().
+ */
+template <typename Dtype>
+class ForwardPipeline : public InternalThread {
+ public:
+  /**
+   * @param output_names
+   *    The blobs of the net returned by Pop().
+   * @param depth
+   *    The number of batches being filled, queued, run or read at a time.
+   */
+  ForwardPipeline(const shared_ptr<Net<Dtype> >& net,
+      const vector<string>& output_names, int depth);
+  virtual ~ForwardPipeline();
+
+  /**
+   * @brief Returns the input blobs of the next batch to fill, in the order of
+   *        the net inputs. Waits for a batch to be released if depth batches
+   *        are in flight.
+   */
+  const vector<shared_ptr<Blob<Dtype> > >& NextInputs();
+  /// @brief Queues the batch of NextInputs() for the forward pass.
+  void Push();
+  /**
+   * @brief Waits for the forward pass of the oldest queued batch and returns
+   *        its output blobs, in the order of output_names, until Release().
+   *        Throws if the forward pass threw.
+   */
+  const vector<shared_ptr<Blob<Dtype> > >& Pop();
+  /// @brief Hands the batch of Pop() back for NextInputs() to reuse.
+  void Release();
+  /// @brief Runs the queued batches and stops the thread.
+  void Stop();
+
+ protected:
+  virtual void InternalThreadEntry();
+  void Forward(PipelineBatch<Dtype>* batch);
+
+  shared_ptr<Net<Dtype> > net_;
+  // The device of the creating thread, which the thread runs the net on.
+  int device_;
+  vector<shared_ptr<Blob<Dtype> > > output_blobs_;
+  // Blobs giving the net inputs their own storage back after each pass.
+  vector<shared_ptr<Blob<Dtype> > > input_storage_;
+  vector<shared_ptr<PipelineBatch<Dtype> > > batches_;
+  // Batches to fill, to run and to read.
+  BlockingQueue<PipelineBatch<Dtype>*> free_;
+  BlockingQueue<PipelineBatch<Dtype>*> full_;
+  BlockingQueue<PipelineBatch<Dtype>*> done_;
+  PipelineBatch<Dtype>* filling_;
+  PipelineBatch<Dtype>* reading_;
+
+  DISABLE_COPY_AND_ASSIGN(ForwardPipeline);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_FORWARD_PIPELINE_HPP_
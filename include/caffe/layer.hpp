@@ -263,6 +263,43 @@ class Layer {
     return true;
   }
 
+  /**
+   * @brief Return whether Backward can add the gradient w.r.t. the bottom blob
+   *        at bottom_index to its diff, rather than overwrite the diff.
+   *
+   * Net::Init lets the layers using a blob as input accumulate its gradient
+   * without a SplitLayer when all of them can, see
+   * NetParameter.accumulate_diffs. The answer is that of the layer type, see
+   * LayerTypeAllowsAccumulateBottomDiff, so that InsertSplits gets it without
+   * creating layers.
+   */
+  inline bool AllowAccumulateBottomDiff(const int bottom_index) const {
+    return LayerTypeAllowsAccumulateBottomDiff(type(), bottom_index);
+  }
+
+  /**
+   * @brief Returns whether Backward adds the gradient w.r.t. the bottom blob
+   *        at bottom_index to its diff.
+   */
+  inline bool accumulate_bottom_diff(const int bottom_index) const {
+    return (accumulate_bottom_diff_.size() > bottom_index) ?
+        accumulate_bottom_diff_[bottom_index] : false;
+  }
+  /**
+   * @brief Sets whether Backward should add the gradient w.r.t. the bottom
+   *        blob at bottom_index to its diff, which the layer must allow.
+   */
+  inline void set_accumulate_bottom_diff(const int bottom_index,
+      const bool value) {
+    CHECK(!value || AllowAccumulateBottomDiff(bottom_index))
+        << type() << " Layer cannot accumulate the diff of bottom "
+        << bottom_index;
+    if (accumulate_bottom_diff_.size() <= bottom_index) {
+      accumulate_bottom_diff_.resize(bottom_index + 1, false);
+    }
+    accumulate_bottom_diff_[bottom_index] = value;
+  }
+
   /**
    * @brief Specifies whether the layer should compute gradients w.r.t. a
    *        parameter at a particular index given by param_id.
@@ -295,6 +332,8 @@ class Layer {
   vector<shared_ptr<Blob<Dtype> > > blobs_;
   /** Vector indicating whether to compute the diff of each param blob. */
   vector<bool> param_propagate_down_;
+  /** Vector indicating whether to add to the diff of each bottom blob. */
+  vector<bool> accumulate_bottom_diff_;
 
   /** The vector that indicates whether each top blob has a non-zero weight in
    *  the objective function. */
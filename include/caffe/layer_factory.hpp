@@ -99,6 +99,13 @@ class LayerRegistry {
 };
 
 
+// Returns whether Backward of the layers of type can add the gradient w.r.t.
+// their bottom bottom_index to its diff, rather than overwrite the diff (see
+// Layer::accumulate_bottom_diff). Layers honouring it are listed in
+// layer_factory.cpp.
+bool LayerTypeAllowsAccumulateBottomDiff(const string& type,
+    const int bottom_index);
+
 template <typename Dtype>
 class LayerRegisterer {
  public:
@@ -765,6 +765,103 @@ class SoftmaxWithLossLayer : public LossLayer<Dtype> {
   int softmax_axis_, outer_num_, inner_num_;
 };
 
+class ThreadPool;
+
+/**
+ * @brief Computes the multinomial logistic loss of the softmax of each
+ *        instance over a group of its classes, selected per instance, e.g.
+ *        the viewpoint bins of the object category of a detection.
+ *
+ * This is the loss of a SliceLayer splitting the predictions into groups
+ * followed by a SoftmaxWithLossLayer per group, for instances labeled in one
+ * of the groups only, without the intermediate blobs, and without the
+ * softmax of the other groups. The instances are computed in parallel.
+ *
+ * @param bottom input Blob vector (length 3)
+ *   -# @f$ (N 	imes GK 	imes H 	imes W) @f$
+ *      the predictions @f$ x @f$ of @f$ G @f$ groups of @f$ K @f$ classes,
+ *      group @f$ g @f$ holding classes @f$ gK @f$ to @f$ gK + K - 1 @f$
+ *   -# @f$ (N 	imes 1 	imes H 	imes W) @f$
+ *      the labels @f$ l @f$, in @f$ [0, 1, ..., K - 1] @f$ within the group
+ *   -# @f$ (N 	imes 1 	imes H 	imes W) @f$
+ *      the group indices @f$ g @f$, in @f$ [0, 1, ..., G - 1] @f$
+ * @param top output Blob vector (length 1)
+ *   -# @f$ (1 	imes 1 	imes 1 	imes 1) @f$
+ *      the computed cross-entropy classification loss: @f$ E =
+ *        rac{-1}{N} \sum\limits_{n=1}^N \log(\hat{p}_{n,g_nK + l_n})
+ *      @f$, for the probabilities @f$ \hat{p} @f$ of the softmax of each
+ *      instance over its group
+ */
+template <typename Dtype>
+class GroupedSoftmaxWithLossLayer : public LossLayer<Dtype> {
+ public:
+   /**
+    * @param param provides GroupedSoftmaxLossParameter
+    *     grouped_softmax_loss_param, with options:
+    *  - group_size. The number of classes @f$ K @f$ of each group.
+    *  - num_threads (optional, default 0). The number of threads computing
+    *    the instances, 0 for one per core.
+    *
+    *  and, as SoftmaxWithLossLayer, the softmax_param axis, and the
+    *  loss_param ignore_label and normalize.
+    */
+  explicit GroupedSoftmaxWithLossLayer(const LayerParameter& param)
+      : LossLayer<Dtype>(param) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  virtual inline const char* type() const { return "GroupedSoftmaxWithLoss"; }
+  virtual inline int ExactNumBottomBlobs() const { return 3; }
+  /// We cannot backpropagate to the labels or to the group indices.
+  virtual inline bool AllowForceBackward(const int bottom_index) const {
+    return bottom_index == 0;
+  }
+
+ protected:
+  /// @copydoc GroupedSoftmaxWithLossLayer
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  /**
+   * @brief Computes the error gradient w.r.t. the predictions, which is 0
+   *        outside of the group of each instance.
+   *
+   * Gradients cannot be computed with respect to the labels or the group
+   * indices, so this method requires !propagate_down[1] and
+   * !propagate_down[2], crashing otherwise.
+   */
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+
+  // Computes the probabilities and the loss of the instances of outer index
+  // i, and counts those not ignored.
+  void ForwardInstances(const Dtype* bottom_data, const Dtype* label,
+      const Dtype* group, Dtype* prob_data, Dtype* loss_data, int* count_data,
+      int i);
+  // Computes the gradients of the instances of outer index i, scaled by
+  // scale.
+  void BackwardInstances(const Dtype* prob_data, const Dtype* label,
+      const Dtype* group, Dtype scale, Dtype* bottom_diff, int i);
+
+  /// The softmax probabilities of the classes of the group of each instance.
+  Blob<Dtype> prob_;
+  /// The loss and the number of instances not ignored, per outer index.
+  Blob<Dtype> outer_loss_;
+  Blob<int> outer_count_;
+  /// Whether to ignore instances with a certain label.
+  bool has_ignore_label_;
+  /// The label indicating that an instance should be ignored.
+  int ignore_label_;
+  /// Whether to normalize the loss by the total number of values present
+  /// (otherwise just by the batch size).
+  bool normalize_;
+
+  int softmax_axis_, outer_num_, inner_num_;
+  int group_size_, num_groups_;
+  shared_ptr<ThreadPool> thread_pool_;
+};
+
 }  // namespace caffe
 
 #endif  // CAFFE_LOSS_LAYERS_HPP_
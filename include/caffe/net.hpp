@@ -10,6 +10,7 @@
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/layer.hpp"
+#include "caffe/net_profiler.hpp"
 #include "caffe/proto/caffe.pb.h"
 
 namespace caffe {
@@ -171,6 +172,16 @@ class Net {
   const shared_ptr<Layer<Dtype> > layer_by_name(const string& layer_name) const;
 
   void set_debug_info(const bool value) { debug_info_ = value; }
+  /**
+   * @brief Records every layer pass of ForwardFromTo and BackwardFromTo in
+   *        profiler, or stops profiling if it is NULL.
+   */
+  void set_profiler(const shared_ptr<NetProfiler<Dtype> >& profiler) {
+    profiler_ = profiler;
+  }
+  inline const shared_ptr<NetProfiler<Dtype> >& profiler() const {
+    return profiler_;
+  }
 
   // Helpers for Init.
   /**
@@ -255,6 +266,8 @@ class Net {
   size_t memory_used_;
   /// Whether to compute and display debug info for the net.
   bool debug_info_;
+  /// The profiler recording the layer passes, if any.
+  shared_ptr<NetProfiler<Dtype> > profiler_;
 
   DISABLE_COPY_AND_ASSIGN(Net);
 };
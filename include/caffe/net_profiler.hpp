@@ -0,0 +1,96 @@
+#ifndef CAFFE_NET_PROFILER_HPP_
+#define CAFFE_NET_PROFILER_HPP_
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <string>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/util/benchmark.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Records the forward and backward passes of every layer of a Net.
+ *
+ * Once attached with Net::set_profiler(), the net reports each layer pass it
+ * runs, during training and testing alike, with real data layers. For every
+ * pass the profiler records its wall time (device time in GPU mode), an
+ * estimate of its floating point operations, the bytes of blobs it touches
+ * and the SyncedMemory bytes it allocated or freed. The events can be
+ * exported as a Chrome trace (chrome://tracing) or summarized per layer with
+ * percentiles of their durations.
+ *
+ * Timing a pass synchronizes the device, so profiling a GPU net slows it
+ * down. Recording stops once max_events events have been recorded.
+ */
+template <typename Dtype>
+class NetProfiler {
+ public:
+  enum Pass { FORWARD, BACKWARD };
+
+  struct Event {
+    int layer_id;
+    Pass pass;
+    double start_us;  // since the profiler was created or cleared
+    float duration_us;
+    int64_t flops;
+    int64_t bytes;
+    int64_t allocated_bytes;
+  };
+
+  explicit NetProfiler(int max_events = 1000000);
+
+  /// @brief Called by the Net before a layer pass.
+  void Start();
+  /// @brief Called by the Net after a layer pass, to record it.
+  void Stop(Pass pass, int layer_id, Layer<Dtype>* layer,
+      const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top);
+  void Clear();
+
+  inline const vector<Event>& events() const { return events_; }
+  inline const string& layer_name(int layer_id) const {
+    return layer_names_[layer_id];
+  }
+  inline const string& layer_type(int layer_id) const {
+    return layer_types_[layer_id];
+  }
+
+  /**
+   * @brief Returns one line per layer and pass with the number of calls, the
+   *        mean, median, 90th and 99th percentile and maximum durations, the
+   *        achieved GFLOP/s and GB/s and the mean allocation per call.
+   */
+  string Summary() const;
+  /// @brief Writes the events in the Chrome trace event JSON format.
+  void WriteChromeTrace(const string& filename) const;
+
+  /**
+   * @brief Estimates the floating point operations of a layer pass:
+   *        multiply-adds count as two for convolution, deconvolution and
+   *        inner product layers, whose backward pass costs twice the forward
+   *        one (input and weight gradients); other layers count one
+   *        operation per top element (per window element for pooling).
+   */
+  static int64_t EstimateFlops(Pass pass, const Layer<Dtype>& layer,
+      const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top);
+
+ protected:
+  int max_events_;
+  vector<Event> events_;
+  vector<string> layer_names_;
+  vector<string> layer_types_;
+  boost::posix_time::ptime epoch_;
+  Timer timer_;
+  double start_us_;
+  int64_t start_allocated_bytes_;
+
+  DISABLE_COPY_AND_ASSIGN(NetProfiler);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_NET_PROFILER_HPP_
@@ -10,6 +10,23 @@ namespace bp = boost::python;
 
 namespace caffe {
 
+/**
+ * @brief Holds the Python GIL for its lifetime.
+ *
+ * pycaffe releases the GIL while a Net computes, so a Python layer must take
+ * it back before calling into Python, from whatever thread runs the Net.
+ */
+class ScopedGILAcquire {
+ public:
+  ScopedGILAcquire() : state_(PyGILState_Ensure()) {}
+  ~ScopedGILAcquire() { PyGILState_Release(state_); }
+
+ private:
+  PyGILState_STATE state_;
+
+  DISABLE_COPY_AND_ASSIGN(ScopedGILAcquire);
+};
+
 template <typename Dtype>
 class PythonLayer : public Layer<Dtype> {
  public:
@@ -18,6 +35,7 @@ class PythonLayer : public Layer<Dtype> {
 
   virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+    ScopedGILAcquire gil;
     try {
       bp::call_method<bp::object>(self_, "setup", bottom, top);
     } catch (bp::error_already_set) {
@@ -28,6 +46,7 @@ class PythonLayer : public Layer<Dtype> {
 
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+    ScopedGILAcquire gil;
     try {
       bp::call_method<bp::object>(self_, "reshape", bottom, top);
     } catch (bp::error_already_set) {
@@ -41,6 +60,7 @@ class PythonLayer : public Layer<Dtype> {
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+    ScopedGILAcquire gil;
     try {
       bp::call_method<bp::object>(self_, "forward", bottom, top);
     } catch (bp::error_already_set) {
@@ -50,6 +70,7 @@ class PythonLayer : public Layer<Dtype> {
   }
   virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+    ScopedGILAcquire gil;
     try {
       bp::call_method<bp::object>(self_, "backward", top, propagate_down,
           bottom);
@@ -56,6 +56,13 @@ class SyncedMemory {
   SyncedHead head() { return head_; }
   size_t size() { return size_; }
 
+  /**
+   * @brief The number of bytes currently allocated by all SyncedMemory
+   *        objects, on the host and the device together. The difference
+   *        between two calls gives the net allocations made in between.
+   */
+  static int64_t allocated_bytes();
+
  private:
   void to_cpu();
   void to_gpu();
@@ -0,0 +1,56 @@
+#ifndef CAFFE_UTIL_BLOB_VIEWS_H_
+#define CAFFE_UTIL_BLOB_VIEWS_H_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/syncedmem.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Makes blobs views of consecutive ranges of a parent blob, in CPU
+ *        memory, so that layers joining or splitting blobs, like ConcatLayer
+ *        and SliceLayer, need not copy them.
+ *
+ * The data and diff of the parent and of the views are moved to storage
+ * owned by this object. No memory any of them may still point to is freed
+ * while the object lives, so blobs made views of others later on, e.g. by
+ * nested concatenations, just stop being views. Layers check that a view
+ * is in place before skipping its copy; caffe_copy does so already.
+ */
+template <typename Dtype>
+class BlobViews {
+ public:
+  BlobViews() {}
+
+  /**
+   * @brief Makes blobs, in order, views of the whole of parent, keeping the
+   *        data of blobs if keep_values, and that of parent otherwise.
+   *
+   * Returns false, having undone the views as Unshare() does, if they cannot
+   * be made: outside of CPU mode, or if a blob holds more memory than its
+   * count, which a sync with the GPU would copy beyond its range.
+   */
+  bool Share(const vector<Blob<Dtype>*>& blobs, Blob<Dtype>* parent,
+      bool keep_values);
+  /// @brief Gives the views memory of their own, with their data if
+  ///        keep_values.
+  void Unshare(bool keep_values);
+
+ protected:
+  // Whether blob holds exactly its count in memory.
+  static bool HoldsCount(const Blob<Dtype>& blob);
+
+  shared_ptr<SyncedMemory> data_, diff_;
+  vector<Blob<Dtype>*> views_;
+  // Memory given to former views.
+  vector<shared_ptr<SyncedMemory> > memory_;
+
+  DISABLE_COPY_AND_ASSIGN(BlobViews);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_BLOB_VIEWS_H_
@@ -0,0 +1,72 @@
+#ifndef CAFFE_UTIL_BLOCKING_QUEUE_HPP_
+#define CAFFE_UTIL_BLOCKING_QUEUE_HPP_
+
+#include <queue>
+#include <string>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief A queue of untyped pointers shared between threads, whose pop()
+ *        waits for an element; see BlockingQueue for the typed interface.
+ *
+ * The synchronization primitives are hidden in the .cpp file, as this header
+ * is included by CUDA sources which cannot include boost/thread.hpp.
+ */
+class PointerBlockingQueue {
+ public:
+  PointerBlockingQueue();
+
+  void push(void* t);
+  bool try_pop(void** t);
+  // Logs log_on_wait, if not empty, when the queue is empty and pop() has to
+  // wait, e.g. to detect that the consumer is faster than the producer.
+  void* pop(const string& log_on_wait = "");
+  size_t size() const;
+
+ protected:
+  class sync;
+
+  std::queue<void*> queue_;
+  shared_ptr<sync> sync_;
+
+  DISABLE_COPY_AND_ASSIGN(PointerBlockingQueue);
+};
+
+/**
+ * @brief A queue of pointers T shared between threads, whose pop() waits for
+ *        an element.
+ *
+ * All the queues share the one PointerBlockingQueue implementation, so that
+ * it needs not know the types queued.
+ */
+template <typename T>
+class BlockingQueue {
+ public:
+  BlockingQueue() {}
+
+  void push(const T& t) { queue_.push(t); }
+  bool try_pop(T* t) {
+    void* p;
+    if (!queue_.try_pop(&p)) {
+      return false;
+    }
+    *t = static_cast<T>(p);
+    return true;
+  }
+  T pop(const string& log_on_wait = "") {
+    return static_cast<T>(queue_.pop(log_on_wait));
+  }
+  size_t size() const { return queue_.size(); }
+
+ protected:
+  PointerBlockingQueue queue_;
+
+  DISABLE_COPY_AND_ASSIGN(BlockingQueue);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_BLOCKING_QUEUE_HPP_
@@ -0,0 +1,56 @@
+#ifndef CAFFE_UTIL_CONV_TUNER_H_
+#define CAFFE_UTIL_CONV_TUNER_H_
+
+#include <map>
+#include <string>
+
+#include "caffe/common.hpp"
+
+namespace boost { class mutex; }
+
+namespace caffe {
+
+/**
+ * @brief The process-wide record of the fastest CPU convolution algorithm
+ *        found for each convolution shape, shared by all the layers whose
+ *        cpu_algorithm is AUTO.
+ *
+ * If the CAFFE_CONV_TUNING_CACHE environment variable names a file, the
+ * results are loaded from it on first use and every new result is appended
+ * to it, so that a shape is only benchmarked once per machine. Keys contain a
+ * description of the machine (CPU model and number of hardware threads), so
+ * one file can be shared by different machines. Each line of the file holds
+ * a key, an algorithm name and the time it took, separated by tabs.
+ */
+class ConvolutionTuner {
+ public:
+  static ConvolutionTuner& Get();
+
+  /**
+   * @brief Replaces the results recorded so far with those of cache_file,
+   *        where new results are appended from now on ("" for none).
+   */
+  void Load(const string& cache_file);
+  /// @brief Looks up the algorithm recorded for key, if any.
+  bool Lookup(const string& key, string* algorithm);
+  /// @brief Records the algorithm found fastest for key.
+  void Record(const string& key, const string& algorithm, double time_us);
+
+  /// @brief The description of this machine that prefixes every key.
+  static string MachineKey();
+
+  inline const string& cache_file() const { return cache_file_; }
+
+ private:
+  ConvolutionTuner();
+
+  string cache_file_;
+  map<string, string> algorithms_;
+  shared_ptr<boost::mutex> mutex_;
+
+  DISABLE_COPY_AND_ASSIGN(ConvolutionTuner);
+};
+
+}  // namespace caffe
+
+#endif   // CAFFE_UTIL_CONV_TUNER_H_
@@ -0,0 +1,39 @@
+#ifndef CAFFE_UTIL_CPU_DISPATCH_H_
+#define CAFFE_UTIL_CPU_DISPATCH_H_
+
+#include <string>
+
+namespace caffe {
+
+using std::string;
+
+/**
+ * @brief The instruction sets the hot CPU kernels are built for, from the
+ *        oldest to the newest. A binary built for the oldest CPU of a fleet
+ *        thus runs the kernels at full speed on the newer ones too.
+ */
+enum CPUInstructionSet {
+  CPU_GENERIC = 0,  // Whatever the compiler flags of the build allow.
+  CPU_AVX2 = 1,     // AVX2 and FMA (Haswell and later).
+  CPU_AVX512 = 2    // AVX-512F and FMA (Skylake-SP and later).
+};
+
+/// @brief The newest instruction set this CPU and OS support.
+CPUInstructionSet SupportedCPUInstructionSet();
+
+/**
+ * @brief The instruction set the hot CPU kernels should use.
+ *
+ * This is SupportedCPUInstructionSet(), unless the CAFFE_CPU_ISA environment
+ * variable names an older one ("generic", "avx2" or "avx512"), e.g. to
+ * compare the variants. The choice is made, and logged, on the first call.
+ */
+CPUInstructionSet SelectedCPUInstructionSet();
+
+const char* CPUInstructionSetName(CPUInstructionSet instruction_set);
+bool ParseCPUInstructionSet(const string& name,
+    CPUInstructionSet* instruction_set);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_CPU_DISPATCH_H_
@@ -0,0 +1,60 @@
+#ifndef CAFFE_UTIL_IMAGE_CACHE_H_
+#define CAFFE_UTIL_IMAGE_CACHE_H_
+
+#include <opencv2/core/core.hpp>
+
+#include <list>
+#include <map>
+#include <string>
+#include <utility>
+
+#include "caffe/common.hpp"
+
+namespace boost { class mutex; }
+
+namespace caffe {
+
+/**
+ * @brief A thread-safe least-recently-used cache of decoded images, bounded
+ *        by the total number of bytes of pixel data it holds.
+ *
+ * Images are reference counted cv::Mats, so an image returned by Get() stays
+ * valid after the cache evicts it. Images larger than the whole capacity are
+ * never cached.
+ */
+class ImageCache {
+ public:
+  explicit ImageCache(size_t capacity_bytes);
+
+  /// @brief Looks up key, marking it as most recently used on a hit.
+  bool Get(const string& key, cv::Mat* image);
+  /// @brief Inserts (or replaces) key, evicting old images to stay in budget.
+  void Put(const string& key, const cv::Mat& image);
+
+  inline size_t capacity_bytes() const { return capacity_bytes_; }
+  size_t size_bytes() const;
+  size_t num_images() const;
+  size_t hits() const;
+  size_t misses() const;
+
+ private:
+  typedef std::list<std::pair<string, cv::Mat> > EntryList;
+
+  static size_t ImageBytes(const cv::Mat& image);
+  void EvictToFit(size_t incoming_bytes);
+
+  // Entries ordered from the most to the least recently used.
+  EntryList entries_;
+  map<string, EntryList::iterator> index_;
+  size_t capacity_bytes_;
+  size_t size_bytes_;
+  size_t hits_;
+  size_t misses_;
+  shared_ptr<boost::mutex> mutex_;
+
+  DISABLE_COPY_AND_ASSIGN(ImageCache);
+};
+
+}  // namespace caffe
+
+#endif   // CAFFE_UTIL_IMAGE_CACHE_H_
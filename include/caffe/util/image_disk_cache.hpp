@@ -0,0 +1,42 @@
+#ifndef CAFFE_UTIL_IMAGE_DISK_CACHE_H_
+#define CAFFE_UTIL_IMAGE_DISK_CACHE_H_
+
+#include <string>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief A persistent cache of decoded 8-bit images stored as raw pixel
+ *        files in a directory, so that an image is decoded (and resized) once
+ *        and then read back without decoding on later epochs and runs.
+ *
+ * Every image lives in its own file, named after a hash of its key. The file
+ * starts with a small header (magic number, rows, cols, channels and the key
+ * itself, to detect hash collisions) followed by the pixels in OpenCV's
+ * row-major interleaved order, so it can be mapped into memory as is.
+ * Files are written under a temporary name and renamed into place, which
+ * makes concurrent writers, whether threads or processes, safe.
+ */
+class ImageDiskCache {
+ public:
+  explicit ImageDiskCache(const string& directory);
+
+  /// @brief Reads the image cached under key, if any.
+  bool Read(const string& key, cv::Mat* image) const;
+  /// @brief Stores image under key; returns false if it could not be written.
+  bool Write(const string& key, const cv::Mat& image) const;
+
+  /// @brief The path of the file holding the image cached under key.
+  string KeyPath(const string& key) const;
+
+  inline const string& directory() const { return directory_; }
+
+ private:
+  string directory_;
+};
+
+}  // namespace caffe
+
+#endif   // CAFFE_UTIL_IMAGE_DISK_CACHE_H_
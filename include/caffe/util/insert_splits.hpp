@@ -8,7 +8,9 @@
 namespace caffe {
 
 // Copy NetParameters with SplitLayers added to replace any shared bottom
-// blobs with unique bottom blobs provided by the SplitLayer.
+// blobs with unique bottom blobs provided by the SplitLayer. With
+// param.accumulate_diffs(), blobs whose users all accumulate their gradients
+// stay shared.
 void InsertSplits(const NetParameter& param, NetParameter* param_split);
 
 void ConfigureSplitLayer(const string& layer_name, const string& blob_name,
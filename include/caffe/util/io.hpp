@@ -135,11 +135,28 @@ cv::Mat ReadImageToCVMat(const string& filename,
 
 cv::Mat ReadImageToCVMat(const string& filename);
 
+// Reads a color image, keeping its alpha channel (BGRA) if it has one.
+cv::Mat ReadImageToCVMatWithAlpha(const string& filename,
+    const int height, const int width);
+
 cv::Mat DecodeDatumToCVMatNative(const Datum& datum);
 cv::Mat DecodeDatumToCVMat(const Datum& datum, bool is_color);
 
 void CVMatToDatum(const cv::Mat& cv_img, Datum* datum);
 
+// Holds the process-wide HDF5 lock while in scope. libhdf5 is usually built
+// without thread safety, so every call into it, from any thread, is made
+// under this lock. The hdf5_* functions below take it themselves; the lock is
+// recursive, so callers making their own H5 calls may hold it around them.
+class HDF5Lock {
+ public:
+  HDF5Lock();
+  ~HDF5Lock();
+
+ private:
+  DISABLE_COPY_AND_ASSIGN(HDF5Lock);
+};
+
 template <typename Dtype>
 void hdf5_load_nd_dataset_helper(
     hid_t file_id, const char* dataset_name_, int min_dim, int max_dim,
@@ -154,6 +171,13 @@ template <typename Dtype>
 void hdf5_save_nd_dataset(
     const hid_t file_id, const string& dataset_name, const Blob<Dtype>& blob);
 
+// Appends the rows (num) of blob to a chunked dataset that can grow along its
+// first axis, creating the dataset on the first call.
+template <typename Dtype>
+void hdf5_append_nd_dataset(
+    const hid_t file_id, const string& dataset_name, const Blob<Dtype>& blob,
+    const int chunk_rows);
+
 }  // namespace caffe
 
 #endif   // CAFFE_UTIL_IO_H_
@@ -0,0 +1,60 @@
+#ifndef CAFFE_UTIL_THREAD_POOL_H_
+#define CAFFE_UTIL_THREAD_POOL_H_
+
+#include <boost/function.hpp>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief A fixed set of worker threads used to spread independent per-item
+ *        work (e.g. the items of a prefetch batch) over several cores.
+ *
+ * Run() behaves like a parallel for loop: it calls task(i) for every i in
+ * [0, n) and does not return before all calls have finished. The calling
+ * thread takes part in the work, so a pool of one thread runs everything
+ * inline without spawning any thread. The order in which indices are
+ * processed is unspecified; tasks must only touch state owned by their index.
+ */
+class ThreadPool {
+ public:
+  /**
+   * @param num_threads
+   *    Number of threads working on Run(), the caller included. 0 uses one
+   *    thread per hardware core.
+   */
+  explicit ThreadPool(int num_threads);
+  ~ThreadPool();
+
+  void Run(int n, const boost::function<void(int)>& task);
+  /**
+   * @brief Like Run(), but returns false without calling task when another
+   *        thread is running work on the pool, instead of waiting for it.
+   */
+  bool TryRun(int n, const boost::function<void(int)>& task);
+
+  inline int num_threads() const { return num_threads_; }
+
+  /// @brief The number of hardware threads, or 1 if it can't be determined.
+  static int HardwareConcurrency();
+  /**
+   * @brief The pool of one thread per hardware core shared by the whole
+   *        process, created on first use.
+   *
+   * Other code may be running work on it, so callers use TryRun() and do the
+   * work themselves when it returns false.
+   */
+  static ThreadPool& Global();
+
+ private:
+  class Impl;
+  int num_threads_;
+  shared_ptr<Impl> impl_;
+
+  DISABLE_COPY_AND_ASSIGN(ThreadPool);
+};
+
+}  // namespace caffe
+
+#endif   // CAFFE_UTIL_THREAD_POOL_H_
@@ -0,0 +1,77 @@
+#ifndef CAFFE_UTIL_VECTOR_MATH_H_
+#define CAFFE_UTIL_VECTOR_MATH_H_
+
+namespace caffe {
+
+// Elementwise CPU kernels of the neuron layers and fast approximations of
+// exp, log and tanh. The loops are branch-free so that the compiler can
+// vectorize them, and arrays of more than a few tens of thousands of
+// elements are split over a process-wide pool of threads. On x86 the loops
+// are also built for AVX2 and AVX-512, and the variant for the running CPU
+// is picked on the first call (see cpu_dispatch.hpp). All the functions
+// allow in-place computation (y == x).
+//
+// For float, exp, log and tanh are polynomial approximations with a
+// relative error of at most 2 ulp (2.4e-7) over the whole float range,
+// denormal results of exp being flushed to 0. For double, they call libm.
+
+// y[i] = exp(x[i])
+template <typename Dtype>
+void caffe_cpu_fast_exp(const int n, const Dtype* x, Dtype* y);
+
+// y[i] = log(x[i])
+template <typename Dtype>
+void caffe_cpu_fast_log(const int n, const Dtype* x, Dtype* y);
+
+// y[i] = pow(x[i], b). For float, finite positive x[i] and b not in
+// {0.5, 1, 2}, this is exp(b * log(x[i])), which adds a relative error of
+// about |b * log(x[i])| * 6e-8.
+template <typename Dtype>
+void caffe_cpu_fast_powx(const int n, const Dtype* x, const Dtype b,
+    Dtype* y);
+
+// y[i] = max(x[i], 0) + negative_slope * min(x[i], 0)
+template <typename Dtype>
+void caffe_cpu_relu(const int n, const Dtype* x, const Dtype negative_slope,
+    Dtype* y);
+
+// dx[i] = dy[i] * (x[i] > 0 ? 1 : negative_slope)
+template <typename Dtype>
+void caffe_cpu_relu_backward(const int n, const Dtype* x, const Dtype* dy,
+    const Dtype negative_slope, Dtype* dx);
+
+// y[i] = 1 / (1 + exp(-x[i]))
+template <typename Dtype>
+void caffe_cpu_sigmoid(const int n, const Dtype* x, Dtype* y);
+
+// dx[i] = dy[i] * y[i] * (1 - y[i]), from the output y of the sigmoid.
+template <typename Dtype>
+void caffe_cpu_sigmoid_backward(const int n, const Dtype* y, const Dtype* dy,
+    Dtype* dx);
+
+// y[i] = tanh(x[i])
+template <typename Dtype>
+void caffe_cpu_tanh(const int n, const Dtype* x, Dtype* y);
+
+// dx[i] = dy[i] * (1 - y[i]^2), from the output y of the tanh.
+template <typename Dtype>
+void caffe_cpu_tanh_backward(const int n, const Dtype* y, const Dtype* dy,
+    Dtype* dx);
+
+// y[i] = log(1 + exp(x[i])), computed without overflow.
+template <typename Dtype>
+void caffe_cpu_bnll(const int n, const Dtype* x, Dtype* y);
+
+// dx[i] = dy[i] * exp(x[i]) / (1 + exp(x[i])), from the input x.
+template <typename Dtype>
+void caffe_cpu_bnll_backward(const int n, const Dtype* x, const Dtype* dy,
+    Dtype* dx);
+
+// y[i] = x[i] > threshold ? 1 : 0
+template <typename Dtype>
+void caffe_cpu_threshold(const int n, const Dtype* x, const Dtype threshold,
+    Dtype* y);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_VECTOR_MATH_H_
@@ -0,0 +1,55 @@
+#ifndef CAFFE_UTIL_VECTOR_MATH_KERNELS_H_
+#define CAFFE_UTIL_VECTOR_MATH_KERNELS_H_
+
+#include "caffe/util/cpu_dispatch.hpp"
+
+namespace caffe {
+
+/**
+ * @brief The loops behind the functions of vector_math.hpp, as built for one
+ *        CPUInstructionSet. Each one processes the elements [begin, end) of
+ *        its arrays; see vector_math.hpp for what they compute.
+ */
+template <typename Dtype>
+struct VectorMathKernels {
+  void (*fast_exp)(const Dtype* x, Dtype* y, int begin, int end);
+  void (*fast_log)(const Dtype* x, Dtype* y, int begin, int end);
+  void (*fast_powx)(const Dtype* x, Dtype b, Dtype* y, int begin, int end);
+  void (*relu)(const Dtype* x, Dtype negative_slope, Dtype* y, int begin,
+      int end);
+  void (*relu_backward)(const Dtype* x, const Dtype* dy,
+      Dtype negative_slope, Dtype* dx, int begin, int end);
+  void (*sigmoid)(const Dtype* x, Dtype* y, int begin, int end);
+  void (*sigmoid_backward)(const Dtype* y, const Dtype* dy, Dtype* dx,
+      int begin, int end);
+  void (*tanh)(const Dtype* x, Dtype* y, int begin, int end);
+  void (*tanh_backward)(const Dtype* y, const Dtype* dy, Dtype* dx,
+      int begin, int end);
+  void (*bnll)(const Dtype* x, Dtype* y, int begin, int end);
+  void (*bnll_backward)(const Dtype* x, const Dtype* dy, Dtype* dx,
+      int begin, int end);
+  void (*threshold)(const Dtype* x, Dtype threshold, Dtype* y, int begin,
+      int end);
+};
+
+/**
+ * @brief Sets the kernels built for instruction_set, or returns false if
+ *        this build of Caffe does not have them (e.g. AVX-512 with an older
+ *        compiler, or any x86 extension on other CPUs).
+ *
+ * The caller must make sure that the CPU supports instruction_set.
+ */
+bool GetVectorMathKernels(CPUInstructionSet instruction_set,
+    VectorMathKernels<float>* float_kernels,
+    VectorMathKernels<double>* double_kernels);
+
+// The variants of GetVectorMathKernels, each in a file of its own built with
+// the compiler flags of its instruction set.
+bool GetAVX2VectorMathKernels(VectorMathKernels<float>* float_kernels,
+    VectorMathKernels<double>* double_kernels);
+bool GetAVX512VectorMathKernels(VectorMathKernels<float>* float_kernels,
+    VectorMathKernels<double>* double_kernels);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_VECTOR_MATH_KERNELS_H_
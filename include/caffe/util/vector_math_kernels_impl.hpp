@@ -0,0 +1,277 @@
+#ifndef CAFFE_UTIL_VECTOR_MATH_KERNELS_IMPL_H_
+#define CAFFE_UTIL_VECTOR_MATH_KERNELS_IMPL_H_
+
+// The definition of the VectorMathKernels, included by the vector_math*.cpp
+// files that build them for each CPUInstructionSet.
+//
+// Everything here has internal linkage and calls no inline function of other
+// headers (not even std::max): at -O0 those are emitted as weak symbols, and
+// the linker could pick the copy built for a newer instruction set for every
+// caller.
+
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "caffe/util/vector_math_kernels.hpp"
+
+namespace caffe {
+
+namespace {
+
+inline float FloatFromBits(int32_t bits) {
+  float value;
+  memcpy(&value, &bits, sizeof(value));  // NOLINT(caffe/alt_fn)
+  return value;
+}
+
+inline int32_t BitsFromFloat(float value) {
+  int32_t bits;
+  memcpy(&bits, &value, sizeof(bits));  // NOLINT(caffe/alt_fn)
+  return bits;
+}
+
+template <typename Dtype>
+inline Dtype Max(Dtype a, Dtype b) { return a < b ? b : a; }
+template <typename Dtype>
+inline Dtype Min(Dtype a, Dtype b) { return b < a ? b : a; }
+template <typename Dtype>
+inline Dtype Abs(Dtype a) { return a < 0 ? -a : a; }
+
+inline float MaxFinite(float /* unused */) { return FLT_MAX; }
+inline double MaxFinite(double /* unused */) { return DBL_MAX; }
+
+// The float approximations follow the Cephes library: a reduction of the
+// argument to a small interval, where a minimax polynomial is evaluated.
+// Special values are patched in at the end with selects rather than
+// branches, so that loops over them vectorize.
+
+inline float Exp(float x) {
+  const float kMax = 88.7228394f;   // log(FLT_MAX)
+  const float kMin = -87.3365479f;  // log(FLT_MIN)
+  const float t = Min(Max(x, kMin), kMax);
+  // t = k * log(2) + r with |r| <= log(2) / 2. Adding and subtracting
+  // 1.5 * 2^23 rounds to the nearest integer.
+  const float kRound = 12582912.f;
+  const float k = (t * 1.44269504088896341f + kRound) - kRound;
+  const float r = t - k * 0.693359375f + k * 2.12194440e-4f;
+  float p = 1.9875691500e-4f;
+  p = p * r + 1.3981999507e-3f;
+  p = p * r + 8.3334519073e-3f;
+  p = p * r + 4.1665795894e-2f;
+  p = p * r + 1.6666665459e-1f;
+  p = p * r + 5.0000001201e-1f;
+  p = p * r * r + r + 1.f;
+  // Scale by 2^k in two steps, as 2^128 has no normal float.
+  const int32_t k1 = static_cast<int32_t>(k) / 2;
+  const int32_t k2 = static_cast<int32_t>(k) - k1;
+  float y = p * FloatFromBits((k1 + 127) << 23) *
+      FloatFromBits((k2 + 127) << 23);
+  y = x > kMax ? INFINITY : y;
+  y = x < kMin ? 0.f : y;
+  return x != x ? x : y;
+}
+
+inline float Log(float x) {
+  // Scale denormals up by 2^25 to read their exponent.
+  const bool denormal = x < FLT_MIN;
+  int32_t bits = BitsFromFloat(denormal ? x * 33554432.f : x);
+  // x = m * 2^e with m in [sqrt(1/2), sqrt(2)).
+  int32_t e = ((bits >> 23) & 0xff) - 126 - (denormal ? 25 : 0);
+  float m = FloatFromBits((bits & 0x007fffff) | 0x3f000000);
+  const bool below_sqrt_half = m < 0.707106781186547524f;
+  e -= below_sqrt_half ? 1 : 0;
+  m = below_sqrt_half ? m + m - 1.f : m - 1.f;
+  const float fe = static_cast<float>(e);
+  const float z = m * m;
+  float p = 7.0376836292e-2f;
+  p = p * m - 1.1514610310e-1f;
+  p = p * m + 1.1676998740e-1f;
+  p = p * m - 1.2420140846e-1f;
+  p = p * m + 1.4249322787e-1f;
+  p = p * m - 1.6668057665e-1f;
+  p = p * m + 2.0000714765e-1f;
+  p = p * m - 2.4999993993e-1f;
+  p = p * m + 3.3333331174e-1f;
+  float y = m * z * p - 2.12194440e-4f * fe - 0.5f * z;
+  y = m + y + 0.693359375f * fe;
+  y = x == 0.f ? -INFINITY : y;
+  y = x < 0.f ? NAN : y;
+  y = x == INFINITY ? x : y;
+  return x != x ? x : y;
+}
+
+inline float Tanh(float x) {
+  // A polynomial near 0, where 1 - 2 / (exp(2x) + 1) loses precision.
+  const float z = x * x;
+  float p = -5.70498872745e-3f;
+  p = p * z + 2.06390887954e-2f;
+  p = p * z - 5.37397155531e-2f;
+  p = p * z + 1.33314422036e-1f;
+  p = p * z - 3.33332819422e-1f;
+  const float near_zero = p * z * x + x;
+  const float a = Abs(x);
+  float y = 1.f - 2.f / (Exp(a + a) + 1.f);
+  y = x < 0.f ? -y : y;
+  return a < 0.625f ? near_zero : y;
+}
+
+inline float Sqrt(float x) { return sqrtf(x); }
+
+inline double Exp(double x) { return exp(x); }
+inline double Log(double x) { return log(x); }
+inline double Tanh(double x) { return tanh(x); }
+inline double Sqrt(double x) { return sqrt(x); }
+
+template <typename Dtype>
+inline Dtype Sigmoid(Dtype x) {
+  return Dtype(1) / (Dtype(1) + Exp(-x));
+}
+
+template <typename Dtype>
+void ExpKernel(const Dtype* x, Dtype* y, int begin, int end) {
+  for (int i = begin; i < end; ++i) {
+    y[i] = Exp(x[i]);
+  }
+}
+
+template <typename Dtype>
+void LogKernel(const Dtype* x, Dtype* y, int begin, int end) {
+  for (int i = begin; i < end; ++i) {
+    y[i] = Log(x[i]);
+  }
+}
+
+template <typename Dtype>
+void PowxKernel(const Dtype* x, Dtype b, Dtype* y, int begin, int end) {
+  if (b == Dtype(2)) {
+    for (int i = begin; i < end; ++i) {
+      y[i] = x[i] * x[i];
+    }
+    return;
+  }
+  // The approximation of exp(b * log(x)) is only used for float, and only
+  // right for finite positive x.
+  int all_positive = (sizeof(Dtype) == sizeof(float));
+  if (all_positive) {
+    const Dtype max = MaxFinite(Dtype(0));
+    for (int i = begin; i < end; ++i) {
+      all_positive &= (x[i] > 0) & (x[i] <= max);
+    }
+  }
+  if (!all_positive) {
+    for (int i = begin; i < end; ++i) {
+      y[i] = pow(static_cast<double>(x[i]), static_cast<double>(b));
+    }
+  } else if (b == Dtype(0.5)) {
+    for (int i = begin; i < end; ++i) {
+      y[i] = Sqrt(x[i]);
+    }
+  } else {
+    // In two loops, which vectorize where a single one doesn't.
+    for (int i = begin; i < end; ++i) {
+      y[i] = b * Log(x[i]);
+    }
+    for (int i = begin; i < end; ++i) {
+      y[i] = Exp(y[i]);
+    }
+  }
+}
+
+template <typename Dtype>
+void ReLUKernel(const Dtype* x, Dtype negative_slope, Dtype* y, int begin,
+    int end) {
+  for (int i = begin; i < end; ++i) {
+    y[i] = Max(x[i], Dtype(0)) + negative_slope * Min(x[i], Dtype(0));
+  }
+}
+
+template <typename Dtype>
+void ReLUBackwardKernel(const Dtype* x, const Dtype* dy, Dtype negative_slope,
+    Dtype* dx, int begin, int end) {
+  for (int i = begin; i < end; ++i) {
+    dx[i] = dy[i] * (x[i] > 0 ? Dtype(1) : negative_slope);
+  }
+}
+
+template <typename Dtype>
+void SigmoidKernel(const Dtype* x, Dtype* y, int begin, int end) {
+  for (int i = begin; i < end; ++i) {
+    y[i] = Sigmoid(x[i]);
+  }
+}
+
+template <typename Dtype>
+void SigmoidBackwardKernel(const Dtype* y, const Dtype* dy, Dtype* dx,
+    int begin, int end) {
+  for (int i = begin; i < end; ++i) {
+    dx[i] = dy[i] * y[i] * (Dtype(1) - y[i]);
+  }
+}
+
+template <typename Dtype>
+void TanHKernel(const Dtype* x, Dtype* y, int begin, int end) {
+  for (int i = begin; i < end; ++i) {
+    y[i] = Tanh(x[i]);
+  }
+}
+
+template <typename Dtype>
+void TanHBackwardKernel(const Dtype* y, const Dtype* dy, Dtype* dx,
+    int begin, int end) {
+  for (int i = begin; i < end; ++i) {
+    dx[i] = dy[i] * (Dtype(1) - y[i] * y[i]);
+  }
+}
+
+template <typename Dtype>
+void BNLLKernel(const Dtype* x, Dtype* y, int begin, int end) {
+  for (int i = begin; i < end; ++i) {
+    y[i] = Max(x[i], Dtype(0)) + Log(Dtype(1) + Exp(-Abs(x[i])));
+  }
+}
+
+template <typename Dtype>
+void BNLLBackwardKernel(const Dtype* x, const Dtype* dy, Dtype* dx,
+    int begin, int end) {
+  for (int i = begin; i < end; ++i) {
+    dx[i] = dy[i] * Sigmoid(x[i]);
+  }
+}
+
+template <typename Dtype>
+void ThresholdKernel(const Dtype* x, Dtype threshold, Dtype* y, int begin,
+    int end) {
+  for (int i = begin; i < end; ++i) {
+    y[i] = x[i] > threshold ? Dtype(1) : Dtype(0);
+  }
+}
+
+template <typename Dtype>
+void FillKernels(VectorMathKernels<Dtype>* kernels) {
+  kernels->fast_exp = &ExpKernel<Dtype>;
+  kernels->fast_log = &LogKernel<Dtype>;
+  kernels->fast_powx = &PowxKernel<Dtype>;
+  kernels->relu = &ReLUKernel<Dtype>;
+  kernels->relu_backward = &ReLUBackwardKernel<Dtype>;
+  kernels->sigmoid = &SigmoidKernel<Dtype>;
+  kernels->sigmoid_backward = &SigmoidBackwardKernel<Dtype>;
+  kernels->tanh = &TanHKernel<Dtype>;
+  kernels->tanh_backward = &TanHBackwardKernel<Dtype>;
+  kernels->bnll = &BNLLKernel<Dtype>;
+  kernels->bnll_backward = &BNLLBackwardKernel<Dtype>;
+  kernels->threshold = &ThresholdKernel<Dtype>;
+}
+
+void FillVectorMathKernels(VectorMathKernels<float>* float_kernels,
+    VectorMathKernels<double>* double_kernels) {
+  FillKernels(float_kernels);
+  FillKernels(double_kernels);
+}
+
+}  // namespace
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_VECTOR_MATH_KERNELS_IMPL_H_
@@ -16,6 +16,8 @@
 
 namespace caffe {
 
+class ThreadPool;
+
 /**
  * @brief Abstract base class that factors out the BLAS code common to
  *        ConvolutionLayer and DeconvolutionLayer.
@@ -46,6 +48,10 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   void weight_cpu_gemm(const Dtype* input, const Dtype* output, Dtype*
       weights);
   void backward_cpu_bias(Dtype* bias, const Dtype* input);
+  // Convolves the num_ images of input into output, without the biases, with
+  // the CPU algorithm of the convolution_param (or the one tuned for AUTO).
+  void forward_cpu_conv(const Dtype* input, const Dtype* weights,
+      Dtype* output);
 
 #ifndef CPU_ONLY
   void forward_gpu_gemm(const Dtype* col_input, const Dtype* weights,
@@ -96,6 +102,20 @@ class BaseConvolutionLayer : public Layer<Dtype> {
         kernel_h_, kernel_w_, pad_h_, pad_w_, stride_h_, stride_w_, data);
   }
 #endif
+  // The CPU forward algorithms, on all the images, see forward_cpu_conv.
+  void forward_cpu_gemm_images(const Dtype* input, const Dtype* weights,
+      Dtype* output, int begin, int end, Dtype* col_buff);
+  void forward_cpu_gemm_range(const Dtype* input, const Dtype* weights,
+      Dtype* output, int num_ranges, int range);
+  void forward_cpu_batched_gemm(const Dtype* input, const Dtype* weights,
+      Dtype* output);
+  void forward_cpu_direct(const Dtype* input, const Dtype* weights,
+      Dtype* output);
+  void forward_cpu_threaded_gemm(const Dtype* input, const Dtype* weights,
+      Dtype* output);
+  // Times every CPU algorithm on the current shape, unless the
+  // ConvolutionTuner knows the fastest, and keeps the fastest one.
+  void TuneCPUAlgorithm(const Blob<Dtype>& bottom, Blob<Dtype>* top);
 
   int conv_out_channels_;
   int conv_in_channels_;
@@ -109,6 +129,14 @@ class BaseConvolutionLayer : public Layer<Dtype> {
 
   Blob<Dtype> col_buffer_;
   Blob<Dtype> bias_multiplier_;
+
+  ConvolutionParameter_CPUAlgorithm cpu_algorithm_;
+  // The input shape (num, height, width) cpu_algorithm_ was tuned for.
+  vector<int> tuned_shape_;
+  // Buffers of the BATCHED_GEMM and THREADED_IM2COL_GEMM algorithms.
+  shared_ptr<Blob<Dtype> > batch_col_buffer_;
+  shared_ptr<Blob<Dtype> > batch_output_buffer_;
+  vector<shared_ptr<Blob<Dtype> > > thread_col_buffers_;
 };
 
 /**
@@ -420,6 +448,67 @@ class PoolingLayer : public Layer<Dtype> {
   Blob<int> max_idx_;
 };
 
+/**
+ * @brief Max pools regions of interest (ROIs) of a feature map into a fixed
+ *        size grid each, as in Fast R-CNN (R. Girshick, 2015).
+ *
+ * Running the convolutional layers once per image, and pooling the features
+ * of every proposal from their output, replaces the per-window forward
+ * passes of R-CNN. The ROIs are pooled in parallel.
+ */
+template <typename Dtype>
+class ROIPoolingLayer : public Layer<Dtype> {
+ public:
+  explicit ROIPoolingLayer(const LayerParameter& param)
+      : Layer<Dtype>(param) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  virtual inline const char* type() const { return "ROIPooling"; }
+  virtual inline int ExactNumBottomBlobs() const { return 2; }
+  virtual inline int ExactNumTopBlobs() const { return 1; }
+  /// We cannot backpropagate to the ROIs; ignore force_backward for them.
+  virtual inline bool AllowForceBackward(const int bottom_index) const {
+    return bottom_index != 1;
+  }
+
+ protected:
+  /**
+   * @param bottom input Blob vector (length 2)
+   *   -# @f$ (N \times C \times H \times W) @f$
+   *      the feature maps
+   *   -# @f$ (R \times 5) @f$
+   *      the ROIs, each (n, x1, y1, x2, y2): the index of the feature map
+   *      and the corners of the region, inclusive, in input image pixels
+   * @param top output Blob vector (length 1)
+   *   -# @f$ (R \times C \times pooled_h \times pooled_w) @f$
+   *      the maximum of each bin of each ROI, or 0 for empty bins
+   */
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  /// @brief Computes the error gradient w.r.t. the feature maps only.
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+
+  // Pools ROI r over all channels.
+  void ForwardROI(const Dtype* bottom_data, int num, const Dtype* rois,
+      Dtype* top_data, int* argmax_data, int r);
+  // Backpropagates channel c of all ROIs, so that no two tasks accumulate
+  // into the same bottom values.
+  void BackwardChannel(const Dtype* top_diff, const int* argmax_data,
+      const Dtype* rois, int num_rois, Dtype* bottom_diff, int c);
+
+  int channels_;
+  int height_, width_;
+  int pooled_height_, pooled_width_;
+  Dtype spatial_scale_;
+  // The offset in its feature map channel of the maximum of each bin, or -1.
+  Blob<int> max_idx_;
+  shared_ptr<ThreadPool> thread_pool_;
+};
+
 #ifdef USE_CUDNN
 /*
  * @brief cuDNN implementation of PoolingLayer.
@@ -3,13 +3,22 @@
 // caffe::Caffe functions so that one could easily call it from matlab.
 // Note that for matlab, we will simply use float as the data type.
 
+#include <boost/bind.hpp>
+#include <opencv2/core/core.hpp>
+#include <stdint.h>
+
+#include <algorithm>
 #include <sstream>
 #include <string>
 #include <vector>
 
 #include "mex.h"
 
+#include "caffe/batch_preprocessor.hpp"
 #include "caffe/caffe.hpp"
+#include "caffe/forward_pipeline.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 #define MEX_ARGS int nlhs, mxArray **plhs, int nrhs, const mxArray **prhs
 
@@ -24,6 +33,19 @@ using namespace caffe;  // NOLINT(build/namespaces)
 // The pointer to the internal caffe::Net instance
 static shared_ptr<Net<float> > net_;
 static int init_key = -2;
+// The shape of the net input when it was initialized.
+static vector<int> input_shape_;
+
+// Native preprocessing, configured by set_preprocess: of images passed as
+// MATLAB arrays, and of image files, which OpenCV reads as BGR.
+static shared_ptr<BatchPreprocessor<float> > array_preprocessor_;
+static shared_ptr<BatchPreprocessor<float> > file_preprocessor_;
+static shared_ptr<ThreadPool> reader_pool_;
+// Runs net_ on the batches of forward_images in a background thread. Its
+// batch blobs are the input and output buffers, reused across calls. They
+// live in ordinary host memory from CaffeMallocHost, which is not pinned.
+static shared_ptr<ForwardPipeline<float> > pipeline_;
+static const int kPipelineDepth = 2;
 
 // Five things to be aware of:
 //   caffe uses row-major order
@@ -48,6 +70,20 @@ static int init_key = -2;
 //
 // If you have multiple images, cat them with cat(4, ...)
 //
+// Or let caffe prepare the data natively, in threads, once configured with
+//   caffe('set_preprocess', struct('mean', mean, 'image_dims', [256 256], ...
+//       'raw_scale', 255, 'channel_swap', [3 2 1]));
+// where mean is per channel, or of the crop size in [width, height,
+// channels] order, BGR. Then
+//   input_data = caffe('prepare_batch', {im1, im2, ...});
+// turns images (H x W x C, uint8 or single in [0, 1]) into input data,
+//   output_data = caffe('forward_images', {'a.jpg', 'b.jpg', ...});
+// reads, preprocesses and runs a whole list of image files, a net batch at
+// a time, and returns the outputs of all of the images. Files are read as
+// BGR, so channel_swap only applies to images passed as arrays. With the
+// 'oversample' option set, each image gives its 4 corner and center crops
+// and their mirrors, as consecutive items.
+//
 // The actual forward function. It takes in a cell array of 4-D arrays as
 // input and outputs a cell array.
 
@@ -242,6 +278,282 @@ static mxArray* do_get_weights() {
   return mx_layers;
 }
 
+// Returns the field name of options, or NULL if it is missing or empty.
+static const mxArray* get_option(const mxArray* options, const char* name) {
+  const mxArray* field = mxGetField(options, 0, name);
+  return field && !mxIsEmpty(field) ? field : NULL;
+}
+
+static vector<float> get_values(const mxArray* values) {
+  const int count = mxGetNumberOfElements(values);
+  vector<float> result(count);
+  if (mxIsSingle(values)) {
+    const float* data = reinterpret_cast<const float*>(mxGetData(values));
+    std::copy(data, data + count, result.begin());
+  } else if (mxIsDouble(values)) {
+    const double* data = mxGetPr(values);
+    std::copy(data, data + count, result.begin());
+  } else {
+    mex_error("Preprocessing options must be single or double");
+  }
+  return result;
+}
+
+static void set_preprocess(MEX_ARGS) {
+  if (nrhs != 1 || !mxIsStruct(prhs[0])) {
+    mex_error("Usage: caffe('set_preprocess', options_struct)");
+  }
+  if (!net_) {
+    mex_error("Call init before set_preprocess");
+  }
+  const mxArray* const options = prhs[0];
+  const Blob<float>& input = *net_->input_blobs()[0];
+  const int channels = input.channels();
+
+  const mxArray* option = get_option(options, "num_threads");
+  const int num_threads = option ? static_cast<int>(mxGetScalar(option)) : 0;
+  shared_ptr<BatchPreprocessor<float> > array_preprocessor(
+      new BatchPreprocessor<float>(num_threads));
+  shared_ptr<BatchPreprocessor<float> > file_preprocessor(
+      new BatchPreprocessor<float>(num_threads));
+  BatchPreprocessor<float>* const preprocessors[] = {
+    array_preprocessor.get(), file_preprocessor.get()
+  };
+  array_preprocessor->set_column_major(true);
+  if ((option = get_option(options, "channel_swap"))) {
+    const vector<float> order = get_values(option);
+    if (order.size() != channels) {
+      mex_error("channel_swap must have one index per channel");
+    }
+    vector<int> channel_swap(channels);
+    for (int c = 0; c < channels; ++c) {
+      channel_swap[c] = static_cast<int>(order[c]) - 1;
+      if (channel_swap[c] < 0 || channel_swap[c] >= channels) {
+        mex_error("channel_swap indices must be in 1..channels");
+      }
+    }
+    array_preprocessor->set_channel_swap(channel_swap);
+  }
+  for (int i = 0; i < 2; ++i) {
+    if ((option = get_option(options, "image_dims"))) {
+      const vector<float> dims = get_values(option);
+      if (dims.size() != 2 || dims[0] < input.height() ||
+          dims[1] < input.width()) {
+        mex_error("image_dims must be [height width], at least the input "
+            "size");
+      }
+      preprocessors[i]->set_image_dims(dims[0], dims[1]);
+    }
+    if ((option = get_option(options, "oversample"))) {
+      preprocessors[i]->set_oversample(mxGetScalar(option) != 0);
+    }
+    if ((option = get_option(options, "raw_scale"))) {
+      preprocessors[i]->set_raw_scale(mxGetScalar(option));
+    }
+    if ((option = get_option(options, "mean"))) {
+      const vector<float> mean = get_values(option);
+      if (mean.size() != channels && mean.size() != input.count(1)) {
+        mex_error("mean must have one value per channel or per input value");
+      }
+      preprocessors[i]->set_mean(mean);
+    }
+    if ((option = get_option(options, "input_scale"))) {
+      preprocessors[i]->set_input_scale(mxGetScalar(option));
+    }
+  }
+  array_preprocessor_ = array_preprocessor;
+  file_preprocessor_ = file_preprocessor;
+  reader_pool_.reset(new ThreadPool(num_threads));
+}
+
+static void check_preprocess() {
+  if (!net_) {
+    mex_error("Call init first");
+  }
+  if (!file_preprocessor_) {
+    mex_error("Call set_preprocess first");
+  }
+  if (net_->num_inputs() != 1) {
+    mex_error("Native preprocessing needs a net with one input");
+  }
+}
+
+// Prepares a cell array of images as the input data of forward.
+static void prepare_batch(MEX_ARGS) {
+  if (nrhs != 1 || !mxIsCell(prhs[0])) {
+    mex_error("Usage: caffe('prepare_batch', {image1, image2, ...})");
+  }
+  check_preprocess();
+  const Blob<float>& input = *net_->input_blobs()[0];
+  const int num = mxGetNumberOfElements(prhs[0]);
+  if (num == 0) {
+    mex_error("No images given");
+  }
+  const bool is_uint8 = mxIsUint8(mxGetCell(prhs[0], 0));
+  vector<const uint8_t*> uint8_images(num);
+  vector<const float*> float_images(num);
+  vector<int> heights(num), widths(num);
+  for (int i = 0; i < num; ++i) {
+    const mxArray* const image = mxGetCell(prhs[0], i);
+    if (!image || (is_uint8 ? !mxIsUint8(image) : !mxIsSingle(image))) {
+      mex_error("Images must all be uint8, or all single");
+    }
+    const mwSize* const dims = mxGetDimensions(image);
+    const int num_dims = mxGetNumberOfDimensions(image);
+    if (num_dims > 3 || (num_dims == 3 ? dims[2] : 1) != input.channels()) {
+      mex_error("Images must be height x width x channels of the input");
+    }
+    heights[i] = dims[0];
+    widths[i] = dims[1];
+    uint8_images[i] = reinterpret_cast<const uint8_t*>(mxGetData(image));
+    float_images[i] = reinterpret_cast<const float*>(mxGetData(image));
+  }
+  // The data is written in place in the output array.
+  const int crops = array_preprocessor_->crops_per_image();
+  mwSize dims[4] = {input.width(), input.height(), input.channels(),
+    num * crops};
+  mxArray* mx_batch = mxCreateNumericArray(4, dims, mxSINGLE_CLASS, mxREAL);
+  Blob<float> batch(num * crops, input.channels(), input.height(),
+      input.width());
+  batch.set_cpu_data(reinterpret_cast<float*>(mxGetData(mx_batch)));
+  if (is_uint8) {
+    array_preprocessor_->Preprocess(uint8_images, heights, widths, &batch);
+  } else {
+    array_preprocessor_->Preprocess(float_images, heights, widths, &batch);
+  }
+  plhs[0] = mx_batch;
+}
+
+static void read_image(const vector<string>* files, int first, bool is_color,
+    vector<cv::Mat>* images, int i) {
+  (*images)[i] = ReadImageToCVMat((*files)[first + i], is_color);
+}
+
+// Copies the outputs of the oldest batch of pipeline_ into outputs, from
+// item *offset on, creating them for num_items items the first time.
+static void pop_outputs(int num_items, vector<mxArray*>* outputs,
+    int* offset) {
+  const vector<shared_ptr<Blob<float> > >& blobs = pipeline_->Pop();
+  for (int i = 0; i < blobs.size(); ++i) {
+    if (!(*outputs)[i]) {
+      mwSize dims[4] = {blobs[i]->width(), blobs[i]->height(),
+        blobs[i]->channels(), num_items};
+      (*outputs)[i] = mxCreateNumericArray(4, dims, mxSINGLE_CLASS, mxREAL);
+    }
+    float* data = reinterpret_cast<float*>(mxGetData((*outputs)[i]));
+    caffe_copy(blobs[i]->count(), blobs[i]->cpu_data(),
+        data + *offset * blobs[i]->count(1));
+  }
+  *offset += blobs[0]->num();
+  pipeline_->Release();
+}
+
+// Gives the net input its shape from init back, for forward.
+static void restore_input_shape() {
+  net_->input_blobs()[0]->Reshape(input_shape_);
+  net_->Reshape();
+}
+
+// Waits for the queued batches of pipeline_, dropping their outputs.
+static void drain_pipeline(int queued) {
+  for (; queued > 0; --queued) {
+    try {
+      pipeline_->Pop();
+    } catch (const std::exception& /* e */) {
+    }
+    pipeline_->Release();
+  }
+  restore_input_shape();
+}
+
+// Runs the net on a cell array of image files, reading and preprocessing a
+// batch while the net runs on the previous one. The outputs hold the items
+// of all of the images, in order.
+static void forward_images(MEX_ARGS) {
+  if (nrhs != 1 || !mxIsCell(prhs[0])) {
+    mex_error("Usage: caffe('forward_images', {'file1', 'file2', ...})");
+  }
+  check_preprocess();
+  const int num = mxGetNumberOfElements(prhs[0]);
+  vector<string> files(num);
+  for (int i = 0; i < num; ++i) {
+    const mxArray* const file = mxGetCell(prhs[0], i);
+    if (!file || !mxIsChar(file)) {
+      mex_error("Image files must be strings");
+    }
+    char* file_name = mxArrayToString(file);
+    files[i] = file_name;
+    mxFree(file_name);
+  }
+  const int channels = input_shape_[1];
+  if (channels != 1 && channels != 3) {
+    mex_error("forward_images reads 1 or 3 channel images");
+  }
+  if (!pipeline_) {
+    vector<string> output_names;
+    for (int i = 0; i < net_->num_outputs(); ++i) {
+      output_names.push_back(
+          net_->blob_names()[net_->output_blob_indices()[i]]);
+    }
+    pipeline_.reset(
+        new ForwardPipeline<float>(net_, output_names, kPipelineDepth));
+  }
+  const int crops = file_preprocessor_->crops_per_image();
+  const int batch_images = std::max(input_shape_[0] / crops, 1);
+  vector<mxArray*> outputs(net_->num_outputs(), NULL);
+  vector<cv::Mat> images;
+  int queued = 0;
+  int offset = 0;
+  for (int first = 0; first < num; first += batch_images) {
+    const int batch_num = std::min(batch_images, num - first);
+    if (queued == kPipelineDepth) {
+      try {
+        pop_outputs(num * crops, &outputs, &offset);
+      } catch (const std::exception& e) {
+        drain_pipeline(queued - 1);
+        mex_error(e.what());
+      }
+      --queued;
+    }
+    images.resize(batch_num);
+    reader_pool_->Run(batch_num, boost::bind(&read_image, &files, first,
+        channels == 3, &images, _1));
+    vector<const uint8_t*> data(batch_num);
+    vector<int> heights(batch_num), widths(batch_num);
+    for (int i = 0; i < batch_num; ++i) {
+      if (!images[i].data) {
+        drain_pipeline(queued);
+        mex_error("Could not read image " + files[first + i]);
+      }
+      CHECK(images[i].isContinuous());
+      data[i] = images[i].data;
+      heights[i] = images[i].rows;
+      widths[i] = images[i].cols;
+    }
+    Blob<float>* batch = pipeline_->NextInputs()[0].get();
+    batch->Reshape(batch_num * crops, channels, input_shape_[2],
+        input_shape_[3]);
+    file_preprocessor_->Preprocess(data, heights, widths, batch);
+    pipeline_->Push();
+    ++queued;
+  }
+  for (; queued > 0; --queued) {
+    try {
+      pop_outputs(num * crops, &outputs, &offset);
+    } catch (const std::exception& e) {
+      drain_pipeline(queued - 1);
+      mex_error(e.what());
+    }
+  }
+  restore_input_shape();
+
+  mxArray* mx_out = mxCreateCellMatrix(outputs.size(), 1);
+  for (int i = 0; i < outputs.size(); ++i) {
+    mxSetCell(mx_out, i, outputs[i]);
+  }
+  plhs[0] = mx_out;
+}
+
 static void get_weights(MEX_ARGS) {
   plhs[0] = do_get_weights();
 }
@@ -289,8 +601,14 @@ static void init(MEX_ARGS) {
     mex_error("Unknown phase.");
   }
 
+  pipeline_.reset();
+  array_preprocessor_.reset();
+  file_preprocessor_.reset();
   net_.reset(new Net<float>(string(param_file), phase));
   net_->CopyTrainedLayersFrom(string(model_file));
+  if (net_->num_inputs()) {
+    input_shape_ = net_->input_blobs()[0]->shape();
+  }
 
   mxFree(param_file);
   mxFree(model_file);
@@ -305,6 +623,9 @@ static void init(MEX_ARGS) {
 
 static void reset(MEX_ARGS) {
   if (net_) {
+    pipeline_.reset();
+    array_preprocessor_.reset();
+    file_preprocessor_.reset();
     net_.reset();
     init_key = -2;
     LOG(INFO) << "Network reset, call init before use it again";
@@ -385,6 +706,9 @@ static handler_registry handlers[] = {
   { "get_init_key",       get_init_key    },
   { "reset",              reset           },
   { "read_mean",          read_mean       },
+  { "set_preprocess",     set_preprocess  },
+  { "prepare_batch",      prepare_batch   },
+  { "forward_images",     forward_images  },
   // The end.
   { "END",                NULL            },
 };
@@ -27,13 +27,10 @@ if ischar(list_im)
     filename = list_im;
     list_im = read_cell(filename);
 end
-% Adjust the batch size and dim to match with models/bvlc_reference_caffenet/deploy.prototxt
-batch_size = 10;
-dim = 1000;
+% Adjust the dims to match with models/bvlc_reference_caffenet/deploy.prototxt
+IMAGE_DIM = 256;
+CROPPED_DIM = 227;
 disp(list_im)
-if mod(length(list_im),batch_size)
-    warning(['Assuming batches of ' num2str(batch_size) ' images rest will be filled with zeros'])
-end
 
 % init caffe network (spews logging info)
 if exist('use_gpu', 'var')
@@ -42,30 +39,20 @@ else
   matcaffe_init();
 end
 
+% The mean of the center crop, in [width, height, channels] order.
 d = load('ilsvrc_2012_mean');
-IMAGE_MEAN = d.image_mean;
-
-% prepare input
-
-num_images = length(list_im);
-scores = zeros(dim,num_images,'single');
-num_batches = ceil(length(list_im)/batch_size)
+center = floor((IMAGE_DIM - CROPPED_DIM) / 2) + 1;
+crop = center:center+CROPPED_DIM-1;
+IMAGE_MEAN = permute(d.image_mean(crop,crop,:),[2 1 3]);
+
+% Read, resize, crop and preprocess the images natively in threads, a batch
+% at a time while the previous batch runs through the net.
+caffe('set_preprocess', struct('mean', IMAGE_MEAN, ...
+    'image_dims', [IMAGE_DIM IMAGE_DIM], 'raw_scale', 255));
 initic=tic;
-for bb = 1 : num_batches
-    batchtic = tic;
-    range = 1+batch_size*(bb-1):min(num_images,batch_size * bb);
-    tic
-    input_data = prepare_batch(list_im(range),IMAGE_MEAN,batch_size);
-    toc, tic
-    fprintf('Batch %d out of %d %.2f%% Complete ETA %.2f seconds\n',...
-        bb,num_batches,bb/num_batches*100,toc(initic)/bb*(num_batches-bb));
-    output_data = caffe('forward', {input_data});
-    toc
-    output_data = squeeze(output_data{1});
-    scores(:,range) = output_data(:,mod(range-1,batch_size)+1);
-    toc(batchtic)
-end
+output_data = caffe('forward_images', list_im);
 toc(initic);
+scores = squeeze(output_data{1});
 
 if exist('filename', 'var')
     save([filename '.probs.mat'],'list_im','scores','-v7.3');
@@ -1,6 +1,8 @@
 % ------------------------------------------------------------------------
 function images = prepare_batch(image_files,IMAGE_MEAN,batch_size)
 % ------------------------------------------------------------------------
+% caffe('prepare_batch', images) does the same natively and in threads,
+% once configured by caffe('set_preprocess', ...): see matcaffe.cpp.
 if nargin < 2
     d = load('ilsvrc_2012_mean');
     IMAGE_MEAN = d.image_mean; 
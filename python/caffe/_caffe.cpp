@@ -14,13 +14,17 @@
 #include <vector>  // NOLINT(build/include_order)
 #include <fstream>  // NOLINT
 
+#include "caffe/batch_preprocessor.hpp"
 #include "caffe/caffe.hpp"
+#include "caffe/forward_pipeline.hpp"
 #include "caffe/python_layer.hpp"
 
 // Temporary solution for numpy < 1.7 versions: old macro, no promises.
 // You're strongly advised to upgrade to >= 1.7.
 #ifndef NPY_ARRAY_C_CONTIGUOUS
 #define NPY_ARRAY_C_CONTIGUOUS NPY_C_CONTIGUOUS
+#define NPY_ARRAY_ALIGNED NPY_ALIGNED
+#define NPY_ARRAY_WRITEABLE NPY_WRITEABLE
 #define PyArray_SetBaseObject(arr, x) (PyArray_BASE(arr) = (x))
 #endif
 
@@ -32,6 +36,28 @@ namespace caffe {
 typedef float Dtype;
 const int NPY_DTYPE = NPY_FLOAT32;
 
+// Thread safety: the GIL is released while Caffe computes or reads files
+// (net execution and construction, weight loading and solving), so other
+// Python threads run meanwhile. Each Net or Solver must still only be used
+// by one thread at a time, including the numpy arrays viewing its blobs.
+// Threads may use different Nets at once, even when they share weights
+// through share_with, as long as none of them trains. The mode and device
+// set by set_mode_* and set_device are process-wide, so set them before
+// starting threads that use Caffe.
+
+// Releases the GIL for its lifetime. Python objects must not be touched in
+// its scope; Python layers take the GIL back themselves.
+class ScopedGILRelease {
+ public:
+  ScopedGILRelease() : state_(PyEval_SaveThread()) {}
+  ~ScopedGILRelease() { PyEval_RestoreThread(state_); }
+
+ private:
+  PyThreadState* state_;
+
+  DISABLE_COPY_AND_ASSIGN(ScopedGILRelease);
+};
+
 // Selecting mode.
 void set_mode_cpu() { Caffe::set_mode(Caffe::CPU); }
 void set_mode_gpu() { Caffe::set_mode(Caffe::GPU); }
@@ -76,6 +102,7 @@ shared_ptr<Net<Dtype> > Net_Init(
     string param_file, int phase) {
   CheckFile(param_file);
 
+  ScopedGILRelease release;
   shared_ptr<Net<Dtype> > net(new Net<Dtype>(param_file,
       static_cast<Phase>(phase)));
   return net;
@@ -87,18 +114,142 @@ shared_ptr<Net<Dtype> > Net_Init_Load(
   CheckFile(param_file);
   CheckFile(pretrained_param_file);
 
+  ScopedGILRelease release;
   shared_ptr<Net<Dtype> > net(new Net<Dtype>(param_file,
       static_cast<Phase>(phase)));
   net->CopyTrainedLayersFrom(pretrained_param_file);
   return net;
 }
 
+Dtype Net_ForwardFromTo(Net<Dtype>* net, int start, int end) {
+  ScopedGILRelease release;
+  return net->ForwardFromTo(start, end);
+}
+
+void Net_BackwardFromTo(Net<Dtype>* net, int start, int end) {
+  ScopedGILRelease release;
+  net->BackwardFromTo(start, end);
+}
+
+void Net_Reshape(Net<Dtype>* net) {
+  ScopedGILRelease release;
+  net->Reshape();
+}
+
+void Net_CopyFrom(Net<Dtype>* net, string filename) {
+  ScopedGILRelease release;
+  net->CopyTrainedLayersFrom(filename);
+}
+
 void Net_Save(const Net<Dtype>& net, string filename) {
+  ScopedGILRelease release;
   NetParameter net_param;
   net.ToProto(&net_param, false);
   WriteProtoToBinaryFile(net_param, filename.c_str());
 }
 
+// Makes arrays the storage of input blobs of net until it goes out of scope,
+// then gives the blobs their own storage back, even when an exception is
+// thrown. Blobs that took on the storage of an input meanwhile, such as Split
+// and Flatten tops, share the input again, which then gets a copy of the
+// array, so that no blob of the net is left viewing an array.
+class ScopedBlobBinding {
+ public:
+  explicit ScopedBlobBinding(Net<Dtype>* net) : net_(net) {}
+  ~ScopedBlobBinding() {
+    const vector<shared_ptr<Blob<Dtype> > >& net_blobs = net_->blobs();
+    for (int i = 0; i < blobs_.size(); ++i) {
+      const shared_ptr<SyncedMemory> bound = blobs_[i]->data();
+      blobs_[i]->ShareData(*saved_[i]);
+      bool copied = false;
+      for (int j = 0; j < net_blobs.size(); ++j) {
+        if (net_blobs[j]->data() != bound) {
+          continue;
+        }
+        if (!copied) {
+          caffe_copy(blobs_[i]->count(),
+              static_cast<const Dtype*>(bound->cpu_data()),
+              blobs_[i]->mutable_cpu_data());
+          copied = true;
+        }
+        net_blobs[j]->ShareData(*blobs_[i]);
+      }
+    }
+  }
+
+  void Bind(Blob<Dtype>* blob, Dtype* data) {
+    shared_ptr<Blob<Dtype> > saved(new Blob<Dtype>(blob->shape()));
+    saved->ShareData(*blob);
+    Blob<Dtype> bound(blob->shape());
+    bound.set_cpu_data(data);
+    blob->ShareData(bound);
+    blobs_.push_back(blob);
+    saved_.push_back(saved);
+  }
+
+ private:
+  Net<Dtype>* net_;
+  vector<Blob<Dtype>*> blobs_;
+  vector<shared_ptr<Blob<Dtype> > > saved_;
+
+  DISABLE_COPY_AND_ASSIGN(ScopedBlobBinding);
+};
+
+// Runs the net forward with the arrays of inputs, a dict from input blob
+// names to C contiguous float32 arrays, as the storage of those blobs instead
+// of copying them in. The blobs, and the net, are reshaped to the arrays
+// first if need be.
+Dtype Net_ForwardBound(Net<Dtype>* net, bp::dict inputs, int start, int end) {
+  const bp::list items = inputs.items();
+  vector<Blob<Dtype>*> blobs(bp::len(items));
+  vector<Dtype*> data(blobs.size());
+  bool reshape = false;
+  for (int i = 0; i < blobs.size(); ++i) {
+    const string name = bp::extract<string>(items[i][0]);
+    const vector<int>& input_indices = net->input_blob_indices();
+    int j = 0;
+    while (j < input_indices.size() &&
+        net->blob_names()[input_indices[j]] != name) {
+      ++j;
+    }
+    if (j == input_indices.size()) {
+      throw std::runtime_error(name + " is not an input blob");
+    }
+    blobs[i] = net->blobs()[input_indices[j]].get();
+    bp::object arr_obj = items[i][1];
+    PyArrayObject* arr = reinterpret_cast<PyArrayObject*>(arr_obj.ptr());
+    if (!PyArray_Check(arr_obj.ptr()) || PyArray_TYPE(arr) != NPY_FLOAT32) {
+      throw std::runtime_error(name + " array must be a float32 ndarray");
+    }
+    const int flags =
+        NPY_ARRAY_C_CONTIGUOUS | NPY_ARRAY_ALIGNED | NPY_ARRAY_WRITEABLE;
+    if ((PyArray_FLAGS(arr) & flags) != flags) {
+      throw std::runtime_error(name
+          + " array must be C contiguous, aligned and writeable");
+    }
+    const vector<int> shape(PyArray_DIMS(arr),
+        PyArray_DIMS(arr) + PyArray_NDIM(arr));
+    if (shape != blobs[i]->shape()) {
+      blobs[i]->Reshape(shape);
+      reshape = true;
+    }
+    data[i] = static_cast<Dtype*>(PyArray_DATA(arr));
+  }
+  // inputs holds references to the arrays while the GIL is released.
+  ScopedGILRelease release;
+  // Bind before reshaping the net, so that the layers sharing an input's
+  // storage (Split, Flatten, views) pick up the array and not the storage it
+  // replaces.
+  ScopedBlobBinding binding(net);
+  for (int i = 0; i < blobs.size(); ++i) {
+    binding.Bind(blobs[i], data[i]);
+  }
+  if (reshape) {
+    net->Reshape();
+  }
+  return net->ForwardFromTo(start, end);
+}
+
 void Net_SetInputArrays(Net<Dtype>* net, bp::object data_obj,
     bp::object labels_obj) {
   // check that this network has an input MemoryDataLayer
@@ -134,9 +285,31 @@ void Net_SetInputArrays(Net<Dtype>* net, bp::object data_obj,
 Solver<Dtype>* GetSolverFromFile(const string& filename) {
   SolverParameter param;
   ReadProtoFromTextFileOrDie(filename, &param);
+  ScopedGILRelease release;
   return GetSolver<Dtype>(param);
 }
 
+template <typename SolverType>
+shared_ptr<SolverType> Solver_Init(string param_file) {
+  ScopedGILRelease release;
+  return shared_ptr<SolverType>(new SolverType(param_file));
+}
+
+void Solver_Solve(Solver<Dtype>* solver, const char* resume_file = NULL) {
+  ScopedGILRelease release;
+  solver->Solve(resume_file);
+}
+
+void Solver_Step(Solver<Dtype>* solver, int iters) {
+  ScopedGILRelease release;
+  solver->Step(iters);
+}
+
+void Solver_Restore(Solver<Dtype>* solver, const char* resume_file) {
+  ScopedGILRelease release;
+  solver->Restore(resume_file);
+}
+
 struct NdarrayConverterGenerator {
   template <typename T> struct apply;
 };
@@ -190,7 +363,158 @@ bp::object Blob_Reshape(bp::tuple args, bp::dict kwargs) {
   return bp::object();
 }
 
-BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(SolveOverloads, Solve, 0, 1);
+void BatchPreprocessor_SetChannelSwap(BatchPreprocessor<Dtype>* self,
+    bp::object order) {
+  vector<int> channel_swap(bp::len(order));
+  for (int c = 0; c < channel_swap.size(); ++c) {
+    channel_swap[c] = bp::extract<int>(order[c]);
+  }
+  self->set_channel_swap(channel_swap);
+}
+
+// Takes the mean as a flat sequence: one value per channel or per item value.
+void BatchPreprocessor_SetMean(BatchPreprocessor<Dtype>* self,
+    bp::object mean_obj) {
+  vector<Dtype> mean(bp::len(mean_obj));
+  for (int i = 0; i < mean.size(); ++i) {
+    mean[i] = bp::extract<Dtype>(mean_obj[i]);
+  }
+  self->set_mean(mean);
+}
+
+// Preprocesses arrays, or the windows of them if windows is not NULL.
+template <typename Pixel>
+void BatchPreprocessor_PreprocessArrays(BatchPreprocessor<Dtype>* self,
+    const vector<bp::object>& arrays, const vector<vector<int> >* windows,
+    Blob<Dtype>* blob) {
+  vector<const Pixel*> images(arrays.size());
+  vector<int> heights(arrays.size()), widths(arrays.size());
+  for (int i = 0; i < arrays.size(); ++i) {
+    PyArrayObject* arr = reinterpret_cast<PyArrayObject*>(arrays[i].ptr());
+    images[i] = static_cast<const Pixel*>(PyArray_DATA(arr));
+    heights[i] = PyArray_DIMS(arr)[0];
+    widths[i] = PyArray_DIMS(arr)[1];
+  }
+  // arrays holds references to the images while the GIL is released.
+  ScopedGILRelease release;
+  if (windows) {
+    self->PreprocessWindows(images, heights, widths, *windows, blob);
+  } else {
+    self->Preprocess(images, heights, widths, blob);
+  }
+}
+
+// Converts a list of H x W x K (or H x W) images to arrays read in place by
+// the preprocessor: C contiguous uint8 or float32 arrays, as the dtype of the
+// first image. Returns that type.
+int BatchPreprocessor_ImageArrays(bp::object images, const Blob<Dtype>& blob,
+    vector<bp::object>* arrays) {
+  if (blob.num_axes() != 4) {
+    throw std::runtime_error("input blob must be 4-d");
+  }
+  const int num = bp::len(images);
+  arrays->resize(num);
+  int type = NPY_FLOAT32;
+  for (int i = 0; i < num; ++i) {
+    bp::object image = images[i];
+    if (i == 0 && PyArray_Check(image.ptr()) && PyArray_TYPE(
+        reinterpret_cast<PyArrayObject*>(image.ptr())) == NPY_UINT8) {
+      type = NPY_UINT8;
+    }
+    PyObject* arr_obj = PyArray_FROM_OTF(image.ptr(), type,
+        NPY_ARRAY_C_CONTIGUOUS | NPY_ARRAY_ALIGNED);
+    if (!arr_obj) {
+      bp::throw_error_already_set();
+    }
+    (*arrays)[i] = bp::object(bp::handle<>(arr_obj));
+    PyArrayObject* arr = reinterpret_cast<PyArrayObject*>(arr_obj);
+    if (PyArray_NDIM(arr) < 2 || PyArray_NDIM(arr) > 3) {
+      throw std::runtime_error("images must be 2-d or 3-d");
+    }
+    const int channels = PyArray_NDIM(arr) == 3 ? PyArray_DIMS(arr)[2] : 1;
+    if (channels != blob.channels()) {
+      throw std::runtime_error("image has wrong number of channels");
+    }
+  }
+  return type;
+}
+
+// Preprocesses a list of images into blob, reshaping it to hold their crops.
+void BatchPreprocessor_Preprocess(BatchPreprocessor<Dtype>* self,
+    bp::object images, Blob<Dtype>* blob) {
+  vector<bp::object> arrays;
+  const int type = BatchPreprocessor_ImageArrays(images, *blob, &arrays);
+  blob->Reshape(arrays.size() * self->crops_per_image(), blob->channels(),
+      blob->height(), blob->width());
+  if (type == NPY_UINT8) {
+    BatchPreprocessor_PreprocessArrays<uint8_t>(self, arrays, NULL, blob);
+  } else {
+    BatchPreprocessor_PreprocessArrays<float>(self, arrays, NULL, blob);
+  }
+}
+
+// Warps windows of a list of images into blob, reshaping it to hold one item
+// per window. Each window is (image index, ymin, xmin, ymax, xmax).
+void BatchPreprocessor_PreprocessWindows(BatchPreprocessor<Dtype>* self,
+    bp::object images, bp::object windows_obj, Blob<Dtype>* blob) {
+  vector<bp::object> arrays;
+  const int type = BatchPreprocessor_ImageArrays(images, *blob, &arrays);
+  vector<vector<int> > windows(bp::len(windows_obj));
+  for (int k = 0; k < windows.size(); ++k) {
+    bp::object window = windows_obj[k];
+    if (bp::len(window) != 5) {
+      throw std::runtime_error(
+          "window must be (image index, ymin, xmin, ymax, xmax)");
+    }
+    for (int j = 0; j < 5; ++j) {
+      windows[k].push_back(bp::extract<int>(window[j]));
+    }
+    if (windows[k][0] < 0 || windows[k][0] >= arrays.size()) {
+      throw std::runtime_error("window image index out of range");
+    }
+  }
+  blob->Reshape(windows.size(), blob->channels(), blob->height(),
+      blob->width());
+  if (type == NPY_UINT8) {
+    BatchPreprocessor_PreprocessArrays<uint8_t>(self, arrays, &windows, blob);
+  } else {
+    BatchPreprocessor_PreprocessArrays<float>(self, arrays, &windows, blob);
+  }
+}
+
+shared_ptr<ForwardPipeline<Dtype> > ForwardPipeline_Init(
+    shared_ptr<Net<Dtype> > net, bp::object output_names, int depth) {
+  vector<string> names(bp::len(output_names));
+  for (int i = 0; i < names.size(); ++i) {
+    names[i] = bp::extract<string>(output_names[i]);
+    if (!net->has_blob(names[i])) {
+      throw std::runtime_error("unknown blob " + names[i]);
+    }
+  }
+  return shared_ptr<ForwardPipeline<Dtype> >(
+      new ForwardPipeline<Dtype>(net, names, depth));
+}
+
+// The pipeline calls that wait for its thread release the GIL, which Python
+// layers run by the thread need.
+const vector<shared_ptr<Blob<Dtype> > >& ForwardPipeline_NextInputs(
+    ForwardPipeline<Dtype>* pipeline) {
+  ScopedGILRelease release;
+  return pipeline->NextInputs();
+}
+
+const vector<shared_ptr<Blob<Dtype> > >& ForwardPipeline_Pop(
+    ForwardPipeline<Dtype>* pipeline) {
+  ScopedGILRelease release;
+  return pipeline->Pop();
+}
+
+void ForwardPipeline_Stop(ForwardPipeline<Dtype>* pipeline) {
+  ScopedGILRelease release;
+  pipeline->Stop();
+}
+
+BOOST_PYTHON_FUNCTION_OVERLOADS(SolveOverloads, Solver_Solve, 1, 2);
 
 BOOST_PYTHON_MODULE(_caffe) {
   // below, we prepend an underscore to methods that will be replaced
@@ -204,12 +528,11 @@ BOOST_PYTHON_MODULE(_caffe) {
     bp::no_init)
     .def("__init__", bp::make_constructor(&Net_Init))
     .def("__init__", bp::make_constructor(&Net_Init_Load))
-    .def("_forward", &Net<Dtype>::ForwardFromTo)
-    .def("_backward", &Net<Dtype>::BackwardFromTo)
-    .def("reshape", &Net<Dtype>::Reshape)
-    // The cast is to select a particular overload.
-    .def("copy_from", static_cast<void (Net<Dtype>::*)(const string)>(
-        &Net<Dtype>::CopyTrainedLayersFrom))
+    .def("_forward", &Net_ForwardFromTo)
+    .def("_forward_bound", &Net_ForwardBound)
+    .def("_backward", &Net_BackwardFromTo)
+    .def("reshape", &Net_Reshape)
+    .def("copy_from", &Net_CopyFrom)
     .def("share_with", &Net<Dtype>::ShareTrainedLayersWith)
     .add_property("_blobs", bp::make_function(&Net<Dtype>::blobs,
         bp::return_internal_reference<>()))
@@ -259,24 +582,53 @@ BOOST_PYTHON_MODULE(_caffe) {
     .add_property("test_nets", bp::make_function(&Solver<Dtype>::test_nets,
           bp::return_internal_reference<>()))
     .add_property("iter", &Solver<Dtype>::iter)
-    .def("solve", static_cast<void (Solver<Dtype>::*)(const char*)>(
-          &Solver<Dtype>::Solve), SolveOverloads())
-    .def("step", &Solver<Dtype>::Step)
-    .def("restore", &Solver<Dtype>::Restore);
+    .def("solve", &Solver_Solve, SolveOverloads())
+    .def("step", &Solver_Step)
+    .def("restore", &Solver_Restore);
 
   bp::class_<SGDSolver<Dtype>, bp::bases<Solver<Dtype> >,
     shared_ptr<SGDSolver<Dtype> >, boost::noncopyable>(
-        "SGDSolver", bp::init<string>());
+        "SGDSolver", bp::no_init)
+    .def("__init__", bp::make_constructor(&Solver_Init<SGDSolver<Dtype> >));
   bp::class_<NesterovSolver<Dtype>, bp::bases<Solver<Dtype> >,
     shared_ptr<NesterovSolver<Dtype> >, boost::noncopyable>(
-        "NesterovSolver", bp::init<string>());
+        "NesterovSolver", bp::no_init)
+    .def("__init__",
+        bp::make_constructor(&Solver_Init<NesterovSolver<Dtype> >));
   bp::class_<AdaGradSolver<Dtype>, bp::bases<Solver<Dtype> >,
     shared_ptr<AdaGradSolver<Dtype> >, boost::noncopyable>(
-        "AdaGradSolver", bp::init<string>());
+        "AdaGradSolver", bp::no_init)
+    .def("__init__",
+        bp::make_constructor(&Solver_Init<AdaGradSolver<Dtype> >));
 
   bp::def("get_solver", &GetSolverFromFile,
       bp::return_value_policy<bp::manage_new_object>());
 
+  bp::class_<ForwardPipeline<Dtype>, shared_ptr<ForwardPipeline<Dtype> >,
+    boost::noncopyable>("ForwardPipeline", bp::no_init)
+    .def("__init__", bp::make_constructor(&ForwardPipeline_Init))
+    .def("next_inputs", &ForwardPipeline_NextInputs,
+        bp::return_internal_reference<>())
+    .def("push", &ForwardPipeline<Dtype>::Push)
+    .def("pop", &ForwardPipeline_Pop, bp::return_internal_reference<>())
+    .def("release", &ForwardPipeline<Dtype>::Release)
+    .def("stop", &ForwardPipeline_Stop);
+
+  bp::class_<BatchPreprocessor<Dtype>, shared_ptr<BatchPreprocessor<Dtype> >,
+    boost::noncopyable>("BatchPreprocessor",
+        bp::init<int>((bp::arg("num_threads") = 0)))
+    .def("set_image_dims", &BatchPreprocessor<Dtype>::set_image_dims)
+    .def("set_oversample", &BatchPreprocessor<Dtype>::set_oversample)
+    .def("set_channel_swap", &BatchPreprocessor_SetChannelSwap)
+    .def("set_raw_scale", &BatchPreprocessor<Dtype>::set_raw_scale)
+    .def("set_mean", &BatchPreprocessor_SetMean)
+    .def("set_input_scale", &BatchPreprocessor<Dtype>::set_input_scale)
+    .def("set_context_pad", &BatchPreprocessor<Dtype>::set_context_pad)
+    .add_property("crops_per_image",
+        &BatchPreprocessor<Dtype>::crops_per_image)
+    .def("preprocess", &BatchPreprocessor_Preprocess)
+    .def("preprocess_windows", &BatchPreprocessor_PreprocessWindows);
+
   // vector wrappers for all the vector types we use
   bp::class_<vector<shared_ptr<Blob<Dtype> > > >("BlobVec")
     .def(bp::vector_indexing_suite<vector<shared_ptr<Blob<Dtype> > >, true>());
@@ -293,6 +645,12 @@ BOOST_PYTHON_MODULE(_caffe) {
   bp::class_<vector<bool> >("BoolVec")
     .def(bp::vector_indexing_suite<vector<bool> >());
 
+  // Create the GIL, which Python < 3.7 only does once a thread is started,
+  // so that ScopedGILRelease and Python layers can hand it over.
+#if PY_VERSION_HEX < 0x03070000
+  PyEval_InitThreads();
+#endif
+
   // boost python expects a void (missing) return value, while import_array
   // returns NULL for python3. import_array1() forces a void return value.
   import_array1();
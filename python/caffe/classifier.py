@@ -43,6 +43,20 @@ class Classifier(caffe.Net):
         if not image_dims:
             image_dims = self.crop_dims
         self.image_dims = image_dims
+        self.batch_size = self.blobs[in_].num
+
+        # the same pre-processing, done natively for a batch at a time
+        self.preprocessor = caffe.BatchPreprocessor()
+        self.preprocessor.set_image_dims(int(image_dims[0]),
+                                         int(image_dims[1]))
+        if mean is not None:
+            self.preprocessor.set_mean(np.asarray(mean).ravel())
+        if input_scale is not None:
+            self.preprocessor.set_input_scale(input_scale)
+        if raw_scale is not None:
+            self.preprocessor.set_raw_scale(raw_scale)
+        if channel_swap is not None:
+            self.preprocessor.set_channel_swap(channel_swap)
 
 
     def predict(self, inputs, oversample=True):
@@ -50,7 +64,8 @@ class Classifier(caffe.Net):
         Predict classification probabilities of inputs.
 
         Take
-        inputs: iterable of (H x W x K) input ndarrays.
+        inputs: iterable of (H x W x K) input ndarrays, uint8 in [0, 255]
+                or float in [0, 1] as from caffe.io.load_image.
         oversample: average predictions across center, corners, and mirrors
                     when True (default). Center-only prediction when False.
 
@@ -58,32 +73,20 @@ class Classifier(caffe.Net):
         predictions: (N x C) ndarray of class probabilities
                      for N images and C classes.
         """
-        # Scale to standardize input dimensions.
-        input_ = np.zeros((len(inputs),
-            self.image_dims[0], self.image_dims[1], inputs[0].shape[2]),
-            dtype=np.float32)
-        for ix, in_ in enumerate(inputs):
-            input_[ix] = caffe.io.resize_image(in_, self.image_dims)
-
-        if oversample:
-            # Generate center, corner, and mirrored crops.
-            input_ = caffe.io.oversample(input_, self.crop_dims)
-        else:
-            # Take center crop.
-            center = np.array(self.image_dims) / 2.0
-            crop = np.tile(center, (1, 2))[0] + np.concatenate([
-                -self.crop_dims / 2.0,
-                self.crop_dims / 2.0
-            ])
-            input_ = input_[:, crop[0]:crop[2], crop[1]:crop[3], :]
-
-        # Classify
-        caffe_in = np.zeros(np.array(input_.shape)[[0,3,1,2]],
-                            dtype=np.float32)
-        for ix, in_ in enumerate(input_):
-            caffe_in[ix] = self.transformer.preprocess(self.inputs[0], in_)
-        out = self.forward_all(**{self.inputs[0]: caffe_in})
-        predictions = out[self.outputs[0]]
+        # Resize, crop and preprocess each batch of inputs straight into the
+        # input blob, then classify it.
+        self.preprocessor.set_oversample(oversample)
+        crops = self.preprocessor.crops_per_image
+        images_per_batch = max(self.batch_size // crops, 1)
+        inputs = list(inputs)
+        predictions = []
+        for i in range(0, len(inputs), images_per_batch):
+            self.preprocessor.preprocess(inputs[i:i + images_per_batch],
+                                         self.blobs[self.inputs[0]])
+            self.reshape()
+            out = self.forward()
+            predictions.append(out[self.outputs[0]].copy())
+        predictions = np.concatenate(predictions)
 
         # For oversampling, average predictions across crops.
         if oversample:
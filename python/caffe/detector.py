@@ -53,6 +53,21 @@ class Detector(caffe.Net):
 
         self.configure_crop(context_pad)
 
+        # the same cropping and pre-processing, done natively for a batch of
+        # windows at a time
+        self.batch_size = self.blobs[in_].num
+        self.preprocessor = caffe.BatchPreprocessor()
+        if mean is not None:
+            self.preprocessor.set_mean(np.asarray(mean).ravel())
+        if input_scale is not None:
+            self.preprocessor.set_input_scale(input_scale)
+        if raw_scale is not None:
+            self.preprocessor.set_raw_scale(raw_scale)
+        if channel_swap is not None:
+            self.preprocessor.set_channel_swap(channel_swap)
+        if context_pad:
+            self.preprocessor.set_context_pad(context_pad)
+
 
     def detect_windows(self, images_windows):
         """
@@ -67,37 +82,42 @@ class Detector(caffe.Net):
         detections: list of {filename: image filename, window: crop coordinates,
             predictions: prediction vector} dicts.
         """
-        # Extract windows.
-        window_inputs = []
-        for image_fname, windows in images_windows:
-            image = caffe.io.load_image(image_fname).astype(np.float32)
-            for window in windows:
-                window_inputs.append(self.crop(image, window))
-
-        # Run through the net (warping windows to input dimensions).
-        in_ = self.inputs[0]
-        caffe_in = np.zeros((len(window_inputs), window_inputs[0].shape[2])
-                            + self.blobs[in_].data.shape[2:],
-                            dtype=np.float32)
-        for ix, window_in in enumerate(window_inputs):
-            caffe_in[ix] = self.transformer.preprocess(in_, window_in)
-        out = self.forward_all(**{in_: caffe_in})
-        predictions = out[self.outputs[0]].squeeze(axis=(2,3))
-
-        # Package predictions with images and windows.
+        # Fill each batch with the windows of as many images as needed, and
+        # crop and warp them straight into the input blob.
         detections = []
-        ix = 0
-        for image_fname, windows in images_windows:
-            for window in windows:
-                detections.append({
-                    'window': window,
-                    'prediction': predictions[ix],
-                    'filename': image_fname
-                })
-                ix += 1
+        images, windows, batch = [], [], []
+        for image_fname, image_windows in images_windows:
+            images.append(caffe.io.load_image(image_fname).astype(np.float32))
+            for window in image_windows:
+                windows.append([len(images) - 1] + [int(w) for w in window])
+                batch.append((image_fname, window))
+                if len(windows) == self.batch_size:
+                    self._detect_batch(images, windows, batch, detections)
+                    # Only the current image has windows left.
+                    images, windows, batch = images[-1:], [], []
+        if windows:
+            self._detect_batch(images, windows, batch, detections)
         return detections
 
 
+    def _detect_batch(self, images, windows, batch, detections):
+        """
+        Run a batch of windows through the net and package their predictions
+        with their images and windows into detections.
+        """
+        self.preprocessor.preprocess_windows(images, windows,
+                                             self.blobs[self.inputs[0]])
+        self.reshape()
+        out = self.forward()
+        predictions = out[self.outputs[0]].reshape(len(windows), -1)
+        for (image_fname, window), prediction in zip(batch, predictions):
+            detections.append({
+                'window': window,
+                'prediction': prediction.copy(),
+                'filename': image_fname
+            })
+
+
     def detect_selective_search(self, image_fnames):
         """
         Do windowed detection over Selective Search proposals by extracting
@@ -8,9 +8,10 @@ try:
 	from itertools import izip_longest
 except:
 	from itertools import zip_longest as izip_longest
+from itertools import islice
 import numpy as np
 
-from ._caffe import Net, SGDSolver
+from ._caffe import Net, SGDSolver, ForwardPipeline
 import caffe.io
 
 # We directly update methods from Net here (rather than using composition or
@@ -49,20 +50,10 @@ def _Net_outputs(self):
     return [list(self.blobs.keys())[i] for i in self._outputs]
 
 
-def _Net_forward(self, blobs=None, start=None, end=None, **kwargs):
+def _Net_forward_range(self, blobs=None, start=None, end=None):
     """
-    Forward pass: prepare inputs and run the net forward.
-
-    Take
-    blobs: list of blobs to return in addition to output blobs.
-    kwargs: Keys are input blob names and values are blob ndarrays.
-            For formatting inputs for Caffe, see Net.preprocess().
-            If None, input is taken from data layers.
-    start: optional name of layer at which to begin the forward pass
-    end: optional name of layer at which to finish the forward pass (inclusive)
-
-    Give
-    outs: {blob name: blob ndarray} dict.
+    Give the first and last layer indices and the set of blobs to return for
+    a forward pass with the blobs, start and end arguments of forward().
     """
     if blobs is None:
         blobs = []
@@ -78,6 +69,25 @@ def _Net_forward(self, blobs=None, start=None, end=None, **kwargs):
     else:
         end_ind = len(self.layers) - 1
         outputs = set(self.outputs + blobs)
+    return start_ind, end_ind, outputs
+
+
+def _Net_forward(self, blobs=None, start=None, end=None, **kwargs):
+    """
+    Forward pass: prepare inputs and run the net forward.
+
+    Take
+    blobs: list of blobs to return in addition to output blobs.
+    kwargs: Keys are input blob names and values are blob ndarrays.
+            For formatting inputs for Caffe, see Net.preprocess().
+            If None, input is taken from data layers.
+    start: optional name of layer at which to begin the forward pass
+    end: optional name of layer at which to finish the forward pass (inclusive)
+
+    Give
+    outs: {blob name: blob ndarray} dict.
+    """
+    start_ind, end_ind, outputs = self._forward_range(blobs, start, end)
 
     if kwargs:
         if set(kwargs.keys()) != set(self.inputs):
@@ -95,6 +105,33 @@ def _Net_forward(self, blobs=None, start=None, end=None, **kwargs):
     return {out: self.blobs[out].data for out in outputs}
 
 
+def _Net_forward_bound(self, blobs=None, start=None, end=None, **kwargs):
+    """
+    Forward pass reading the inputs in place from the given arrays, instead
+    of copying them into the input blobs as forward() does.
+
+    Take
+    blobs, start, end: as in forward().
+    kwargs: Keys are input blob names and values are C-contiguous, writeable
+            float32 ndarrays. An input blob, and the net, are reshaped to its
+            array's shape if they differ.
+
+    The arrays are the storage of the input blobs for the duration of the
+    call only. Afterwards no blob of the net refers to them: the input blobs
+    get their own storage back, holding a copy of the input only when other
+    blobs (Split or Flatten tops) shared it. Layers computing in place on an
+    input write into its array.
+
+    Give
+    outs: {blob name: blob ndarray} dict.
+    """
+    start_ind, end_ind, outputs = self._forward_range(blobs, start, end)
+    if set(kwargs.keys()) != set(self.inputs):
+        raise Exception('Input blob arguments do not match net inputs.')
+    self._forward_bound(kwargs, start_ind, end_ind)
+    return {out: self.blobs[out].data for out in outputs}
+
+
 def _Net_backward(self, diffs=None, start=None, end=None, **kwargs):
     """
     Backward pass: prepare diffs and run the net backward.
@@ -171,6 +208,59 @@ def _Net_forward_all(self, blobs=None, **kwargs):
     return all_outs
 
 
+def _Net_forward_iter(self, inputs, blobs=None, depth=3):
+    """
+    Run net forward over a stream of inputs in batches. A background thread
+    runs the net on each batch while the next batches are assembled and the
+    outputs of the previous ones are read. The last batch is not padded:
+    the net is reshaped to its size instead.
+
+    Take
+    inputs: iterable of {input blob name: ndarray} dicts of single inputs,
+            or of ndarrays for nets with one input.
+    blobs: list of blobs to return in addition to output blobs.
+    depth: number of batches in flight at a time.
+
+    Give (yield)
+    outs: {blob name: ndarray} dict of single outputs, in input order.
+    """
+    outputs = list(set(self.outputs + (blobs or [])))
+    batch_size = self.blobs[self.inputs[0]].num
+    pipeline = ForwardPipeline(self, outputs, depth)
+
+    def pop():
+        outs = [out.data.copy() for out in pipeline.pop()]
+        pipeline.release()
+        return [dict(zip(outputs, item)) for item in zip(*outs)]
+
+    queued = 0
+    inputs = iter(inputs)
+    try:
+        while True:
+            batch = list(islice(inputs, batch_size))
+            if not batch:
+                break
+            if queued == depth:
+                for out in pop():
+                    yield out
+                queued -= 1
+            for in_, blob in zip(self.inputs, pipeline.next_inputs()):
+                items = [item[in_] if isinstance(item, dict) else item
+                         for item in batch]
+                blob.reshape(len(items), *items[0].shape)
+                data = blob.data
+                for i, item in enumerate(items):
+                    data[i] = item
+            pipeline.push()
+            queued += 1
+        while queued:
+            for out in pop():
+                yield out
+            queued -= 1
+    finally:
+        pipeline.stop()
+
+
 def _Net_forward_backward_all(self, blobs=None, diffs=None, **kwargs):
     """
     Run net forward + backward in batches.
@@ -260,8 +350,11 @@ def _Net_batch(self, blobs):
 Net.blobs = _Net_blobs
 Net.params = _Net_params
 Net.forward = _Net_forward
+Net.forward_bound = _Net_forward_bound
+Net._forward_range = _Net_forward_range
 Net.backward = _Net_backward
 Net.forward_all = _Net_forward_all
+Net.forward_iter = _Net_forward_iter
 Net.forward_backward_all = _Net_forward_backward_all
 Net.set_input_arrays = _Net_set_input_arrays
 Net._batch = _Net_batch
@@ -31,6 +31,36 @@ def simple_net_file(num_output):
     f.close()
     return f.name
 
+def input_net_file():
+    """Make a net prototxt with an input blob, returning the name of the
+    (temporary) file."""
+
+    f = tempfile.NamedTemporaryFile(delete=False)
+    f.write("""name: 'inputnet' input: 'data'
+    input_shape { dim: 2 dim: 3 dim: 4 dim: 5 }
+    layer { type: 'InnerProduct' name: 'ip' bottom: 'data' top: 'ip'
+      inner_product_param { num_output: 7
+        weight_filler { type: 'gaussian' std: 1 } } }""")
+    f.close()
+    return f.name
+
+def split_input_net_file():
+    """Make a net prototxt whose input blob feeds several layers, one of them
+    a Flatten, returning the name of the (temporary) file."""
+
+    f = tempfile.NamedTemporaryFile(delete=False)
+    f.write("""name: 'splitinputnet' input: 'data'
+    input_shape { dim: 2 dim: 3 dim: 4 dim: 5 }
+    layer { type: 'InnerProduct' name: 'ip' bottom: 'data' top: 'ip'
+      inner_product_param { num_output: 7
+        weight_filler { type: 'gaussian' std: 1 } } }
+    layer { type: 'InnerProduct' name: 'ip2' bottom: 'data' top: 'ip2'
+      inner_product_param { num_output: 3
+        weight_filler { type: 'gaussian' std: 1 } } }
+    layer { type: 'Flatten' name: 'flat' bottom: 'data' top: 'flat' }""")
+    f.close()
+    return f.name
+
 class TestNet(unittest.TestCase):
     def setUp(self):
         self.num_output = 13
@@ -76,3 +106,66 @@ class TestNet(unittest.TestCase):
             for i in range(len(self.net.params[name])):
                 self.assertEqual(abs(self.net.params[name][i].data
                     - net2.params[name][i].data).sum(), 0)
+
+
+class TestNetForwardBound(unittest.TestCase):
+    def setUp(self):
+        net_file = input_net_file()
+        self.net = caffe.Net(net_file, caffe.TEST)
+        os.remove(net_file)
+
+    def test_forward_bound(self):
+        data = np.random.randn(2, 3, 4, 5).astype(np.float32)
+        expected = self.net.forward(data=data)['ip'].copy()
+        self.net.blobs['data'].data[...] = 0
+        out = self.net.forward_bound(data=data)['ip']
+        self.assertTrue(np.allclose(out, expected))
+        # the input blob gets its own storage back
+        self.assertEqual(abs(self.net.blobs['data'].data).sum(), 0)
+
+    def test_reshape(self):
+        data = np.random.randn(6, 3, 4, 5).astype(np.float32)
+        out = self.net.forward_bound(data=data)['ip']
+        self.assertEqual(out.shape, (6, 7))
+        self.assertEqual(self.net.blobs['data'].data.shape, data.shape)
+
+    def test_not_contiguous(self):
+        data = np.zeros((2, 3, 4, 10), dtype=np.float32)[..., ::2]
+        self.assertRaises(RuntimeError, self.net.forward_bound, data=data)
+
+    def test_split_input(self):
+        net_file = split_input_net_file()
+        net = caffe.Net(net_file, caffe.TEST)
+        os.remove(net_file)
+        # the split and flattened copies of the input read the bound array,
+        # also when it reshapes the net, and do not keep referring to it
+        for num in (2, 4, 4, 2):
+            data = np.random.randn(num, 3, 4, 5).astype(np.float32)
+            expected = dict((name, out.copy()) for name, out in
+                            net.forward(data=data).iteritems())
+            net.blobs['data'].data[...] = 0
+            begin = data.__array_interface__['data'][0]
+            end = begin + data.nbytes
+            outs = net.forward_bound(data=data)
+            del data
+            for name, blob in net.blobs.iteritems():
+                address = blob.data.__array_interface__['data'][0]
+                self.assertFalse(begin <= address < end, name)
+            for name in ('ip', 'ip2', 'flat'):
+                self.assertEqual(outs[name].shape, expected[name].shape)
+                self.assertTrue(np.allclose(outs[name], expected[name]))
+
+
+class TestNetForwardIter(unittest.TestCase):
+    def setUp(self):
+        net_file = input_net_file()
+        self.net = caffe.Net(net_file, caffe.TEST)
+        os.remove(net_file)
+
+    def test_forward_iter(self):
+        data = np.random.randn(7, 3, 4, 5).astype(np.float32)
+        outs = list(self.net.forward_iter(iter(data), depth=2))
+        self.assertEqual(len(outs), len(data))
+        for item, out in zip(data, outs):
+            expected = self.net.forward_bound(data=item[np.newaxis])['ip']
+            self.assertTrue(np.allclose(out['ip'], expected[0]))
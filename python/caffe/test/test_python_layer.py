@@ -1,6 +1,7 @@
 import unittest
 import tempfile
 import os
+import threading
 
 import caffe
 
@@ -58,3 +59,22 @@ class TestPythonLayer(unittest.TestCase):
         for blob in self.net.blobs.itervalues():
             for d in blob.data.shape:
                 self.assertEqual(s, d)
+
+    def test_forward_in_threads(self):
+        # The GIL is released during forward, and taken back by each layer.
+        net_file = python_net_file()
+        nets = [caffe.Net(net_file, caffe.TRAIN) for i in range(4)]
+        os.remove(net_file)
+        def run(net, x):
+            for i in range(10):
+                net.blobs['data'].data[...] = x
+                net.forward()
+        threads = [threading.Thread(target=run, args=(net, x))
+                   for x, net in enumerate(nets)]
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+        for x, net in enumerate(nets):
+            for y in net.blobs['three'].data.flat:
+                self.assertEqual(y, 10**3 * x)
@@ -0,0 +1,360 @@
+#include <boost/bind.hpp>
+#include <stdint.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "caffe/batch_preprocessor.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+namespace {
+
+// The bilinear taps along an axis resized from in to out pixels, with the
+// pixel centers aligned as by cv::resize: output i samples the input at
+// (i + 0.5) * in / out - 0.5, clamped to the edge pixels.
+void ComputeTaps(int in, int out, vector<int>* first, vector<int>* second,
+    vector<float>* weight) {
+  first->resize(out);
+  second->resize(out);
+  weight->resize(out);
+  const double scale = static_cast<double>(in) / out;
+  for (int i = 0; i < out; ++i) {
+    const double x = std::max((i + 0.5) * scale - 0.5, 0.);
+    const int x0 = std::min(static_cast<int>(x), in - 1);
+    (*first)[i] = x0;
+    (*second)[i] = std::min(x0 + 1, in - 1);
+    (*weight)[i] = x - x0;
+  }
+}
+
+// Resizes image, whose pixel (y, x, c) is at y * row_step + x * column_step
+// + c * channel_step, to out_height x out_width x channels values in row-major
+// order, multiplying it by scale.
+template <typename Pixel, typename Dtype>
+void Resize(const Pixel* image, int height, int width, int channels,
+    int row_step, int column_step, int channel_step, int out_height,
+    int out_width, Dtype scale, Dtype* out) {
+  if (height == out_height && width == out_width) {
+    for (int y = 0; y < height; ++y) {
+      for (int x = 0; x < width; ++x) {
+        const Pixel* pixel = image + y * row_step + x * column_step;
+        for (int c = 0; c < channels; ++c) {
+          *out++ = pixel[c * channel_step] * scale;
+        }
+      }
+    }
+    return;
+  }
+  vector<int> y0, y1, x0, x1;
+  vector<float> wy, wx;
+  ComputeTaps(height, out_height, &y0, &y1, &wy);
+  ComputeTaps(width, out_width, &x0, &x1, &wx);
+  for (int y = 0; y < out_height; ++y) {
+    const Pixel* top = image + y0[y] * row_step;
+    const Pixel* bottom = image + y1[y] * row_step;
+    const Dtype bottom_weight = wy[y] * scale;
+    const Dtype top_weight = scale - bottom_weight;
+    for (int x = 0; x < out_width; ++x) {
+      const int left = x0[x] * column_step;
+      const int right = x1[x] * column_step;
+      const Dtype right_weight = wx[x];
+      const Dtype left_weight = 1 - right_weight;
+      for (int c = 0; c < channels; ++c) {
+        const int offset = c * channel_step;
+        *out++ =
+            top_weight * (left_weight * top[left + offset] +
+                right_weight * top[right + offset]) +
+            bottom_weight * (left_weight * bottom[left + offset] +
+                right_weight * bottom[right + offset]);
+      }
+    }
+  }
+}
+
+// The value of a pixel as an image in [0, 1].
+inline float PixelScale(const uint8_t* /* image */) { return 1.f / 255; }
+inline float PixelScale(const float* /* image */) { return 1.f; }
+
+// Rounds as numpy.round, halves to even.
+inline double RoundHalfToEven(double x) {
+  const double rounded = std::floor(x + 0.5);
+  return rounded - x == 0.5 && std::fmod(rounded, 2) != 0 ?
+      rounded - 1 : rounded;
+}
+
+// Rounds as the round of Python 2, halves away from zero.
+inline int RoundHalfAway(double x) {
+  return static_cast<int>(x < 0 ? std::ceil(x - 0.5) : std::floor(x + 0.5));
+}
+
+}  // namespace
+
+template <typename Dtype>
+BatchPreprocessor<Dtype>::BatchPreprocessor(int num_threads)
+    : thread_pool_(new ThreadPool(num_threads)), image_height_(0),
+      image_width_(0), oversample_(false), column_major_(false),
+      context_pad_(0), raw_scale_(1), input_scale_(1) {}
+
+template <typename Dtype>
+void BatchPreprocessor<Dtype>::set_image_dims(int height, int width) {
+  CHECK_GE(height, 0);
+  CHECK_GE(width, 0);
+  CHECK_EQ(height == 0, width == 0)
+      << "Set both image dims, or neither to resize to the crop size.";
+  image_height_ = height;
+  image_width_ = width;
+}
+
+template <typename Dtype>
+void BatchPreprocessor<Dtype>::set_context_pad(int pad) {
+  CHECK_GE(pad, 0);
+  context_pad_ = pad;
+}
+
+template <typename Dtype>
+void BatchPreprocessor<Dtype>::CheckBlob(const Blob<Dtype>& blob) const {
+  CHECK_EQ(blob.num_axes(), 4) << "The input blob must be 4-D.";
+  const int channels = blob.channels();
+  if (channel_swap_.size()) {
+    CHECK_EQ(channel_swap_.size(), channels)
+        << "The channel swap must have one index per channel.";
+    for (int c = 0; c < channels; ++c) {
+      CHECK_GE(channel_swap_[c], 0);
+      CHECK_LT(channel_swap_[c], channels);
+    }
+  }
+  CHECK(mean_.empty() || mean_.size() == channels ||
+      mean_.size() == blob.count(1))
+      << "The mean must have one value per channel or per item value.";
+}
+
+template <typename Dtype>
+template <typename Pixel>
+void BatchPreprocessor<Dtype>::Preprocess(const vector<const Pixel*>& images,
+    const vector<int>& heights, const vector<int>& widths,
+    Blob<Dtype>* blob) {
+  CHECK_EQ(images.size(), heights.size());
+  CHECK_EQ(images.size(), widths.size());
+  CheckBlob(*blob);
+  CHECK_EQ(blob->num(), images.size() * crops_per_image())
+      << "The input blob must have " << crops_per_image()
+      << " items per image.";
+  CHECK(!image_height_ || (image_height_ >= blob->height() &&
+      image_width_ >= blob->width()))
+      << "The image dims must be at least the crop size.";
+  thread_pool_->Run(images.size(), boost::bind(
+      &BatchPreprocessor<Dtype>::template PreprocessImage<Pixel>, this,
+      &images, &heights, &widths, blob, blob->mutable_cpu_data(), _1));
+}
+
+template <typename Dtype>
+template <typename Pixel>
+void BatchPreprocessor<Dtype>::PreprocessWindows(
+    const vector<const Pixel*>& images, const vector<int>& heights,
+    const vector<int>& widths, const vector<vector<int> >& windows,
+    Blob<Dtype>* blob) {
+  CHECK_EQ(images.size(), heights.size());
+  CHECK_EQ(images.size(), widths.size());
+  CheckBlob(*blob);
+  CHECK_EQ(blob->num(), windows.size())
+      << "The input blob must have one item per window.";
+  CHECK(2 * context_pad_ < blob->height() && 2 * context_pad_ < blob->width())
+      << "The context pad must leave room for the window.";
+  for (int k = 0; k < windows.size(); ++k) {
+    CHECK_EQ(windows[k].size(), 5)
+        << "A window is (image index, ymin, xmin, ymax, xmax).";
+    CHECK_GE(windows[k][0], 0);
+    CHECK_LT(windows[k][0], images.size());
+  }
+  thread_pool_->Run(windows.size(), boost::bind(
+      &BatchPreprocessor<Dtype>::template PreprocessWindow<Pixel>, this,
+      &images, &heights, &widths, &windows, blob, blob->mutable_cpu_data(),
+      _1));
+}
+
+template <typename Dtype>
+template <typename Pixel>
+void BatchPreprocessor<Dtype>::ResizeImage(const Pixel* image, int height,
+    int width, int channels, int top, int left, int bottom, int right,
+    int out_height, int out_width, Dtype* out) const {
+  // The steps between pixels (y, x, c) of the image along each axis.
+  const int row_step = column_major_ ? 1 : width * channels;
+  const int column_step = column_major_ ? height : channels;
+  const int channel_step = column_major_ ? height * width : 1;
+  Resize(image + top * row_step + left * column_step, bottom - top,
+      right - left, channels, row_step, column_step, channel_step,
+      out_height, out_width, static_cast<Dtype>(raw_scale_ * PixelScale(image)),
+      out);
+}
+
+template <typename Dtype>
+template <typename Pixel>
+void BatchPreprocessor<Dtype>::PreprocessImage(
+    const vector<const Pixel*>* images, const vector<int>* heights,
+    const vector<int>* widths, const Blob<Dtype>* blob, Dtype* data, int i) {
+  const int channels = blob->channels();
+  const int crop_height = blob->height();
+  const int crop_width = blob->width();
+  const int height = image_height_ ? image_height_ : crop_height;
+  const int width = image_width_ ? image_width_ : crop_width;
+  vector<Dtype> resized(height * width * channels);
+  ResizeImage((*images)[i], (*heights)[i], (*widths)[i], channels, 0, 0,
+      (*heights)[i], (*widths)[i], height, width, &resized[0]);
+
+  // The crops as (top, left, mirror), in the order of caffe.io.oversample.
+  const int bottom = height - crop_height;
+  const int right = width - crop_width;
+  const int crops[][3] = {
+    {0, 0, 0}, {0, right, 0}, {bottom, 0, 0}, {bottom, right, 0},
+    {bottom / 2, right / 2, 0},
+    {0, 0, 1}, {0, right, 1}, {bottom, 0, 1}, {bottom, right, 1},
+    {bottom / 2, right / 2, 1}
+  };
+  const int first_crop = oversample_ ? 0 : 4;
+  Dtype* item = data + blob->offset(i * crops_per_image());
+  for (int k = first_crop; k < first_crop + crops_per_image(); ++k) {
+    WriteItem(&resized[0], height, width, crops[k][0], crops[k][1],
+        crops[k][2], *blob, item);
+    item += blob->count(1);
+  }
+}
+
+template <typename Dtype>
+template <typename Pixel>
+void BatchPreprocessor<Dtype>::PreprocessWindow(
+    const vector<const Pixel*>* images, const vector<int>* heights,
+    const vector<int>* widths, const vector<vector<int> >* windows,
+    const Blob<Dtype>* blob, Dtype* data, int k) {
+  const vector<int>& window = (*windows)[k];
+  const int i = window[0];
+  const int image_height = (*heights)[i];
+  const int image_width = (*widths)[i];
+  const int crop_height = blob->height();
+  const int crop_width = blob->width();
+  // The image region [top, bottom) x [left, right) is warped to warped_height
+  // x warped_width pixels at (pad_y, pad_x) of the item, as caffe.Detector.
+  double box[4];
+  std::copy(window.begin() + 1, window.end(), box);
+  int warped_height = crop_height;
+  int warped_width = crop_width;
+  int pad_y = 0;
+  int pad_x = 0;
+  if (context_pad_) {
+    // Enlarge the window about its center so that, warped, it has
+    // context_pad_ pixels of context at each side.
+    const double scale_y = crop_height / (crop_height - 2. * context_pad_);
+    const double scale_x = crop_width / (crop_width - 2. * context_pad_);
+    const double half_height = (box[2] - box[0] + 1) / 2;
+    const double half_width = (box[3] - box[1] + 1) / 2;
+    const double center_y = box[0] + half_height;
+    const double center_x = box[1] + half_width;
+    box[0] = RoundHalfToEven(center_y - scale_y * half_height);
+    box[1] = RoundHalfToEven(center_x - scale_x * half_width);
+    box[2] = RoundHalfToEven(center_y + scale_y * half_height);
+    box[3] = RoundHalfToEven(center_x + scale_x * half_width);
+    // Clip it to the image, and pad the item for the part outside.
+    const double warp_y = crop_height / (box[2] - box[0] + 1);
+    const double warp_x = crop_width / (box[3] - box[1] + 1);
+    pad_y = RoundHalfAway(std::max(0., -box[0]) * warp_y);
+    pad_x = RoundHalfAway(std::max(0., -box[1]) * warp_x);
+    box[0] = std::min(std::max(box[0], 0.), static_cast<double>(image_height));
+    box[1] = std::min(std::max(box[1], 0.), static_cast<double>(image_width));
+    box[2] = std::min(std::max(box[2], 0.), static_cast<double>(image_height));
+    box[3] = std::min(std::max(box[3], 0.), static_cast<double>(image_width));
+    warped_height = std::min(
+        RoundHalfAway((box[2] - box[0] + 1) * warp_y), crop_height - pad_y);
+    warped_width = std::min(
+        RoundHalfAway((box[3] - box[1] + 1) * warp_x), crop_width - pad_x);
+  }
+  const int top = std::min(std::max(static_cast<int>(box[0]), 0),
+      image_height);
+  const int left = std::min(std::max(static_cast<int>(box[1]), 0),
+      image_width);
+  const int bottom = std::min(static_cast<int>(box[2]), image_height);
+  const int right = std::min(static_cast<int>(box[3]), image_width);
+  vector<Dtype> warped;
+  if (bottom > top && right > left && warped_height > 0 && warped_width > 0) {
+    warped.resize(warped_height * warped_width * blob->channels());
+    ResizeImage((*images)[i], image_height, image_width, blob->channels(),
+        top, left, bottom, right, warped_height, warped_width, &warped[0]);
+  } else {
+    // Nothing of the image is in the window: the item is all mean.
+    warped_height = warped_width = 0;
+  }
+  WriteItem(warped.empty() ? NULL : &warped[0], warped_height, warped_width,
+      -pad_y, -pad_x, false, *blob, data + blob->offset(k));
+}
+
+template <typename Dtype>
+void BatchPreprocessor<Dtype>::WriteItem(const Dtype* image, int height,
+    int width, int top, int left, bool mirror, const Blob<Dtype>& blob,
+    Dtype* item) const {
+  const int channels = blob.channels();
+  const int crop_height = blob.height();
+  const int crop_width = blob.width();
+  const bool full_mean = mean_.size() && mean_.size() != channels;
+  for (int c = 0; c < channels; ++c) {
+    const int source_channel = channel_swap_.size() ? channel_swap_[c] : c;
+    const Dtype channel_mean =
+        mean_.empty() || full_mean ? Dtype(0) : mean_[c];
+    for (int y = 0; y < crop_height; ++y) {
+      const int source_y = top + y;
+      if (source_y < 0 || source_y >= height) {
+        // Outside the image the values are those of the mean.
+        caffe_set(crop_width, Dtype(0), item);
+        item += crop_width;
+        continue;
+      }
+      const Dtype* row = image + source_y * width * channels + source_channel;
+      const Dtype* mean_row = full_mean ?
+          &mean_[(c * crop_height + y) * crop_width] : NULL;
+      for (int x = 0; x < crop_width; ++x) {
+        const int source_x = left + (mirror ? crop_width - 1 - x : x);
+        if (source_x < 0 || source_x >= width) {
+          item[x] = 0;
+          continue;
+        }
+        const Dtype mean = mean_row ? mean_row[x] : channel_mean;
+        item[x] = (row[source_x * channels] - mean) * input_scale_;
+      }
+      item += crop_width;
+    }
+  }
+}
+
+INSTANTIATE_CLASS(BatchPreprocessor);
+
+template void BatchPreprocessor<float>::Preprocess(
+    const vector<const uint8_t*>& images, const vector<int>& heights,
+    const vector<int>& widths, Blob<float>* blob);
+template void BatchPreprocessor<float>::Preprocess(
+    const vector<const float*>& images, const vector<int>& heights,
+    const vector<int>& widths, Blob<float>* blob);
+template void BatchPreprocessor<double>::Preprocess(
+    const vector<const uint8_t*>& images, const vector<int>& heights,
+    const vector<int>& widths, Blob<double>* blob);
+template void BatchPreprocessor<double>::Preprocess(
+    const vector<const float*>& images, const vector<int>& heights,
+    const vector<int>& widths, Blob<double>* blob);
+
+template void BatchPreprocessor<float>::PreprocessWindows(
+    const vector<const uint8_t*>& images, const vector<int>& heights,
+    const vector<int>& widths, const vector<vector<int> >& windows,
+    Blob<float>* blob);
+template void BatchPreprocessor<float>::PreprocessWindows(
+    const vector<const float*>& images, const vector<int>& heights,
+    const vector<int>& widths, const vector<vector<int> >& windows,
+    Blob<float>* blob);
+template void BatchPreprocessor<double>::PreprocessWindows(
+    const vector<const uint8_t*>& images, const vector<int>& heights,
+    const vector<int>& widths, const vector<vector<int> >& windows,
+    Blob<double>* blob);
+template void BatchPreprocessor<double>::PreprocessWindows(
+    const vector<const float*>& images, const vector<int>& heights,
+    const vector<int>& widths, const vector<vector<int> >& windows,
+    Blob<double>* blob);
+
+}  // namespace caffe
@@ -1,15 +1,186 @@
 #include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
 
+#include <boost/random.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>  // NOLINT(readability/streams)
 #include <string>
 #include <vector>
 
 #include "caffe/data_transformer.hpp"
+#include "caffe/util/image_cache.hpp"
 #include "caffe/util/io.hpp"
 #include "caffe/util/math_functions.hpp"
 #include "caffe/util/rng.hpp"
 
 namespace caffe {
 
+namespace {
+
+// Row kernels: each one converts a row of a single channel, reading every
+// src_step-th element of src, so the branches on the kind of input, mean and
+// mirroring are taken once per row instead of once per element and the inner
+// loops are simple enough for the compiler to vectorize.
+
+// 8-bit pixels through a precomputed table of (pixel - mean) * scale.
+template <typename Dtype>
+void TableRow(const uint8_t* src, const int src_step, const Dtype* table,
+    const int width, const bool mirror, Dtype* dst) {
+  if (mirror) {
+    Dtype* dst_end = dst + width - 1;
+    for (int w = 0; w < width; ++w) {
+      dst_end[-w] = table[src[w * src_step]];
+    }
+  } else {
+    for (int w = 0; w < width; ++w) {
+      dst[w] = table[src[w * src_step]];
+    }
+  }
+}
+
+// (pixel - mean) * scale with a single mean for the whole row.
+template <typename Dtype, typename SrcType>
+void ScaleRow(const SrcType* src, const int src_step, const Dtype mean,
+    const Dtype scale, const int width, const bool mirror, Dtype* dst) {
+  if (mirror) {
+    Dtype* dst_end = dst + width - 1;
+    for (int w = 0; w < width; ++w) {
+      dst_end[-w] = (static_cast<Dtype>(src[w * src_step]) - mean) * scale;
+    }
+  } else {
+    for (int w = 0; w < width; ++w) {
+      dst[w] = (static_cast<Dtype>(src[w * src_step]) - mean) * scale;
+    }
+  }
+}
+
+// (pixel - mean) * scale with the mean taken from the matching mean file row.
+template <typename Dtype, typename SrcType>
+void MeanFileRow(const SrcType* src, const int src_step, const Dtype* mean,
+    const Dtype scale, const int width, const bool mirror, Dtype* dst) {
+  if (mirror) {
+    Dtype* dst_end = dst + width - 1;
+    for (int w = 0; w < width; ++w) {
+      dst_end[-w] = (static_cast<Dtype>(src[w * src_step]) - mean[w]) * scale;
+    }
+  } else {
+    for (int w = 0; w < width; ++w) {
+      dst[w] = (static_cast<Dtype>(src[w * src_step]) - mean[w]) * scale;
+    }
+  }
+}
+
+// Uniform random number in [a, b).
+float RandUniform(caffe::rng_t* rng, const float a, const float b) {
+  if (a >= b) {
+    return a;
+  }
+  boost::uniform_real<float> distribution(a, b);
+  boost::variate_generator<caffe::rng_t*, boost::uniform_real<float> >
+      variate_generator(rng, distribution);
+  return variate_generator();
+}
+
+// Blends a BGRA image over a BGR background of the same size, or over black
+// if the background is empty.
+cv::Mat CompositeOver(const cv::Mat& image, const cv::Mat& background) {
+  cv::Mat composite(image.rows, image.cols, CV_8UC3);
+  for (int h = 0; h < image.rows; ++h) {
+    const uchar* src = image.ptr<uchar>(h);
+    const uchar* back = background.empty() ? NULL : background.ptr<uchar>(h);
+    uchar* dst = composite.ptr<uchar>(h);
+    for (int w = 0; w < image.cols; ++w) {
+      const int alpha = src[w * 4 + 3];
+      for (int c = 0; c < 3; ++c) {
+        const int back_value = back ? back[w * 3 + c] : 0;
+        dst[w * 3 + c] = (src[w * 4 + c] * alpha
+            + back_value * (255 - alpha) + 127) / 255;
+      }
+    }
+  }
+  return composite;
+}
+
+// Picks a region of a rows x cols image covering a random fraction in
+// [min_area, 1] of it with a random aspect ratio in
+// [1 / max_aspect_ratio, max_aspect_ratio], drawn log-uniformly.
+cv::Rect RandomCropRect(const int rows, const int cols, const float min_area,
+    const float max_aspect_ratio, caffe::rng_t* rng) {
+  const float log_ratio = std::log(max_aspect_ratio);
+  for (int attempt = 0; attempt < 10; ++attempt) {
+    const float area = RandUniform(rng, min_area, 1) * rows * cols;
+    const float ratio = std::exp(RandUniform(rng, -log_ratio, log_ratio));
+    const int width = static_cast<int>(std::sqrt(area * ratio) + 0.5f);
+    const int height = static_cast<int>(std::sqrt(area / ratio) + 0.5f);
+    if (width > 0 && height > 0 && width <= cols && height <= rows) {
+      const int x = (*rng)() % (cols - width + 1);
+      const int y = (*rng)() % (rows - height + 1);
+      return cv::Rect(x, y, width, height);
+    }
+  }
+  // Fall back to the largest central square.
+  const int side = std::min(rows, cols);
+  return cv::Rect((cols - side) / 2, (rows - side) / 2, side, side);
+}
+
+// Scales the brightness, the contrast (around the mean luminance) and the
+// saturation (around the luminance of every pixel) of an 8-bit image in a
+// single pass, as all three are linear in the pixel values.
+cv::Mat JitterColor(const cv::Mat& image, const float brightness,
+    const float contrast, const float saturation) {
+  const int channels = image.channels();
+  const int width = image.cols;
+  // Luminance weights of the B, G and R channels.
+  const float weights[3] = { 0.114f, 0.587f, 0.299f };
+  vector<float> luma(image.rows * width);
+  double luma_sum = 0;
+  for (int h = 0; h < image.rows; ++h) {
+    const uchar* src = image.ptr<uchar>(h);
+    float* luma_row = &luma[h * width];
+    if (channels == 3) {
+      for (int w = 0; w < width; ++w) {
+        luma_row[w] = weights[0] * src[w * 3] + weights[1] * src[w * 3 + 1]
+            + weights[2] * src[w * 3 + 2];
+      }
+    } else {
+      for (int w = 0; w < width; ++w) {
+        luma_row[w] = src[w * channels];
+      }
+    }
+    for (int w = 0; w < width; ++w) {
+      luma_sum += luma_row[w];
+    }
+  }
+  const float mean = brightness * luma_sum / std::max<size_t>(luma.size(), 1);
+  // Every value v becomes (v * brightness - mean) * contrast + mean, and then
+  // each channel is moved away from the pixel's luminance by saturation.
+  const float gain = brightness * contrast;
+  const float offset = mean * (1 - contrast);
+  cv::Mat jittered(image.rows, width, image.type());
+  for (int h = 0; h < image.rows; ++h) {
+    const uchar* src = image.ptr<uchar>(h);
+    const float* luma_row = &luma[h * width];
+    uchar* dst = jittered.ptr<uchar>(h);
+    for (int w = 0; w < width; ++w) {
+      const float gray = luma_row[w] * gain + offset;
+      for (int c = 0; c < channels; ++c) {
+        const int index = w * channels + c;
+        const float value = src[index] * gain + offset;
+        const float saturated = channels == 3 ?
+            gray + (value - gray) * saturation : value;
+        dst[index] = static_cast<uchar>(
+            std::min(std::max(saturated, 0.f), 255.f) + 0.5f);
+      }
+    }
+  }
+  return jittered;
+}
+
+}  // namespace
+
 template<typename Dtype>
 DataTransformer<Dtype>::DataTransformer(const TransformationParameter& param,
     Phase phase)
@@ -32,6 +203,28 @@ DataTransformer<Dtype>::DataTransformer(const TransformationParameter& param,
       mean_values_.push_back(param_.mean_value(c));
     }
   }
+  CHECK(param_.min_crop_area() > 0 && param_.min_crop_area() <= 1) <<
+    "min_crop_area must be in (0, 1]";
+  CHECK_GE(param_.max_aspect_ratio(), 1);
+  CHECK(param_.brightness_jitter() >= 0 && param_.brightness_jitter() < 1);
+  CHECK(param_.contrast_jitter() >= 0 && param_.contrast_jitter() < 1);
+  CHECK(param_.saturation_jitter() >= 0 && param_.saturation_jitter() < 1);
+  // check if we want to composite images over backgrounds
+  if (param_.has_background_source()) {
+    const string& background_source = param_.background_source();
+    LOG(INFO) << "Loading background list from: " << background_source;
+    std::ifstream infile(background_source.c_str());
+    CHECK(infile.good()) << "Failed to open background list "
+        << background_source;
+    string background;
+    while (infile >> background) {
+      background_images_.push_back(background);
+    }
+    CHECK(!background_images_.empty()) << "No backgrounds in "
+        << background_source;
+    background_cache_.reset(new ImageCache(
+        static_cast<size_t>(param_.background_cache_mb()) << 20));
+  }
 }
 
 template<typename Dtype>
@@ -53,12 +246,12 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
   CHECK_GE(datum_height, crop_size);
   CHECK_GE(datum_width, crop_size);
 
-  Dtype* mean = NULL;
+  const Dtype* mean = NULL;
   if (has_mean_file) {
     CHECK_EQ(datum_channels, data_mean_.channels());
     CHECK_LE(datum_height, data_mean_.height());
     CHECK_LE(datum_width, data_mean_.width());
-    mean = data_mean_.mutable_cpu_data();
+    mean = data_mean_.cpu_data();
   }
   if (has_mean_values) {
     CHECK(mean_values_.size() == 1 || mean_values_.size() == datum_channels) <<
@@ -89,34 +282,37 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
     }
   }
 
-  Dtype datum_element;
-  int top_index, data_index;
+  const uint8_t* uint8_data = NULL;
+  const float* float_data = NULL;
+  const Dtype* tables = NULL;
+  if (has_uint8) {
+    uint8_data = reinterpret_cast<const uint8_t*>(data.data());
+    if (!has_mean_file) {
+      tables = PixelTables(datum_channels);
+    }
+  } else {
+    float_data = datum.float_data().data();
+  }
   for (int c = 0; c < datum_channels; ++c) {
     for (int h = 0; h < height; ++h) {
-      for (int w = 0; w < width; ++w) {
-        data_index = (c * datum_height + h_off + h) * datum_width + w_off + w;
-        if (do_mirror) {
-          top_index = (c * height + h) * width + (width - 1 - w);
-        } else {
-          top_index = (c * height + h) * width + w;
-        }
+      const int data_index = (c * datum_height + h_off + h) * datum_width
+          + w_off;
+      Dtype* top_row = transformed_data + (c * height + h) * width;
+      if (has_mean_file) {
         if (has_uint8) {
-          datum_element =
-            static_cast<Dtype>(static_cast<uint8_t>(data[data_index]));
+          MeanFileRow(uint8_data + data_index, 1, mean + data_index, scale,
+              width, do_mirror, top_row);
         } else {
-          datum_element = datum.float_data(data_index);
-        }
-        if (has_mean_file) {
-          transformed_data[top_index] =
-            (datum_element - mean[data_index]) * scale;
-        } else {
-          if (has_mean_values) {
-            transformed_data[top_index] =
-              (datum_element - mean_values_[c]) * scale;
-          } else {
-            transformed_data[top_index] = datum_element * scale;
-          }
+          MeanFileRow(float_data + data_index, 1, mean + data_index, scale,
+              width, do_mirror, top_row);
         }
+      } else if (has_uint8) {
+        TableRow(uint8_data + data_index, 1, tables + c * 256, width,
+            do_mirror, top_row);
+      } else {
+        const Dtype mean_value = has_mean_values ? mean_values_[c] : Dtype(0);
+        ScaleRow(float_data + data_index, 1, mean_value, scale, width,
+            do_mirror, top_row);
       }
     }
   }
@@ -125,32 +321,9 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
 template<typename Dtype>
 void DataTransformer<Dtype>::Transform(const Datum& datum,
                                        Blob<Dtype>* transformed_blob) {
-  const int datum_channels = datum.channels();
-  const int datum_height = datum.height();
-  const int datum_width = datum.width();
-
-  const int channels = transformed_blob->channels();
-  const int height = transformed_blob->height();
-  const int width = transformed_blob->width();
-  const int num = transformed_blob->num();
-
-  CHECK_EQ(channels, datum_channels);
-  CHECK_LE(height, datum_height);
-  CHECK_LE(width, datum_width);
-  CHECK_GE(num, 1);
-
-  const int crop_size = param_.crop_size();
-
-  if (crop_size) {
-    CHECK_EQ(crop_size, height);
-    CHECK_EQ(crop_size, width);
-  } else {
-    CHECK_EQ(datum_height, height);
-    CHECK_EQ(datum_width, width);
-  }
-
-  Dtype* transformed_data = transformed_blob->mutable_cpu_data();
-  Transform(datum, transformed_data);
+  CheckShape(datum.channels(), datum.height(), datum.width(),
+      transformed_blob);
+  Transform(datum, transformed_blob->mutable_cpu_data());
 }
 
 template<typename Dtype>
@@ -158,18 +331,18 @@ void DataTransformer<Dtype>::Transform(const vector<Datum> & datum_vector,
                                        Blob<Dtype>* transformed_blob) {
   const int datum_num = datum_vector.size();
   const int num = transformed_blob->num();
-  const int channels = transformed_blob->channels();
-  const int height = transformed_blob->height();
-  const int width = transformed_blob->width();
 
   CHECK_GT(datum_num, 0) << "There is no datum to add";
   CHECK_LE(datum_num, num) <<
     "The size of datum_vector must be no greater than transformed_blob->num()";
-  Blob<Dtype> uni_blob(1, channels, height, width);
+  // Transform the whole batch straight into the blob, rather than through a
+  // temporary single item blob.
+  Dtype* transformed_data = transformed_blob->mutable_cpu_data();
   for (int item_id = 0; item_id < datum_num; ++item_id) {
-    int offset = transformed_blob->offset(item_id);
-    uni_blob.set_cpu_data(transformed_blob->mutable_cpu_data() + offset);
-    Transform(datum_vector[item_id], &uni_blob);
+    const Datum& datum = datum_vector[item_id];
+    CheckShape(datum.channels(), datum.height(), datum.width(),
+        transformed_blob);
+    Transform(datum, transformed_data + transformed_blob->offset(item_id));
   }
 }
 
@@ -178,38 +351,32 @@ void DataTransformer<Dtype>::Transform(const vector<cv::Mat> & mat_vector,
                                        Blob<Dtype>* transformed_blob) {
   const int mat_num = mat_vector.size();
   const int num = transformed_blob->num();
-  const int channels = transformed_blob->channels();
-  const int height = transformed_blob->height();
-  const int width = transformed_blob->width();
 
   CHECK_GT(mat_num, 0) << "There is no MAT to add";
   CHECK_EQ(mat_num, num) <<
     "The size of mat_vector must be equals to transformed_blob->num()";
-  Blob<Dtype> uni_blob(1, channels, height, width);
+  Dtype* transformed_data = transformed_blob->mutable_cpu_data();
   for (int item_id = 0; item_id < mat_num; ++item_id) {
-    int offset = transformed_blob->offset(item_id);
-    uni_blob.set_cpu_data(transformed_blob->mutable_cpu_data() + offset);
-    Transform(mat_vector[item_id], &uni_blob);
+    const cv::Mat& cv_img = mat_vector[item_id];
+    CheckShape(cv_img.channels(), cv_img.rows, cv_img.cols, transformed_blob);
+    Transform(cv_img, transformed_data + transformed_blob->offset(item_id));
   }
 }
 
 template<typename Dtype>
 void DataTransformer<Dtype>::Transform(const cv::Mat& cv_img,
                                        Blob<Dtype>* transformed_blob) {
+  CheckShape(cv_img.channels(), cv_img.rows, cv_img.cols, transformed_blob);
+  Transform(cv_img, transformed_blob->mutable_cpu_data());
+}
+
+template<typename Dtype>
+void DataTransformer<Dtype>::Transform(const cv::Mat& cv_img,
+                                       Dtype* transformed_data) {
   const int img_channels = cv_img.channels();
   const int img_height = cv_img.rows;
   const int img_width = cv_img.cols;
 
-  const int channels = transformed_blob->channels();
-  const int height = transformed_blob->height();
-  const int width = transformed_blob->width();
-  const int num = transformed_blob->num();
-
-  CHECK_EQ(channels, img_channels);
-  CHECK_LE(height, img_height);
-  CHECK_LE(width, img_width);
-  CHECK_GE(num, 1);
-
   CHECK(cv_img.depth() == CV_8U) << "Image data type must be unsigned byte";
 
   const int crop_size = param_.crop_size();
@@ -222,12 +389,12 @@ void DataTransformer<Dtype>::Transform(const cv::Mat& cv_img,
   CHECK_GE(img_height, crop_size);
   CHECK_GE(img_width, crop_size);
 
-  Dtype* mean = NULL;
+  const Dtype* mean = NULL;
   if (has_mean_file) {
     CHECK_EQ(img_channels, data_mean_.channels());
     CHECK_LE(img_height, data_mean_.height());
     CHECK_LE(img_width, data_mean_.width());
-    mean = data_mean_.mutable_cpu_data();
+    mean = data_mean_.cpu_data();
   }
   if (has_mean_values) {
     CHECK(mean_values_.size() == 1 || mean_values_.size() == img_channels) <<
@@ -240,12 +407,14 @@ void DataTransformer<Dtype>::Transform(const cv::Mat& cv_img,
     }
   }
 
+  int height = img_height;
+  int width = img_width;
+
   int h_off = 0;
   int w_off = 0;
-  cv::Mat cv_cropped_img = cv_img;
   if (crop_size) {
-    CHECK_EQ(crop_size, height);
-    CHECK_EQ(crop_size, width);
+    height = crop_size;
+    width = crop_size;
     // We only do random crop when we do training.
     if (phase_ == TRAIN) {
       h_off = Rand(img_height - crop_size + 1);
@@ -254,41 +423,24 @@ void DataTransformer<Dtype>::Transform(const cv::Mat& cv_img,
       h_off = (img_height - crop_size) / 2;
       w_off = (img_width - crop_size) / 2;
     }
-    cv::Rect roi(w_off, h_off, crop_size, crop_size);
-    cv_cropped_img = cv_img(roi);
-  } else {
-    CHECK_EQ(img_height, height);
-    CHECK_EQ(img_width, width);
   }
 
-  CHECK(cv_cropped_img.data);
+  CHECK(cv_img.data);
 
-  Dtype* transformed_data = transformed_blob->mutable_cpu_data();
-  int top_index;
+  // The image is interleaved (HWC) while the blob is planar (CHW), so every
+  // channel of a row is gathered with a stride of img_channels.
+  const Dtype* tables = has_mean_file ? NULL : PixelTables(img_channels);
   for (int h = 0; h < height; ++h) {
-    const uchar* ptr = cv_cropped_img.ptr<uchar>(h);
-    int img_index = 0;
-    for (int w = 0; w < width; ++w) {
-      for (int c = 0; c < img_channels; ++c) {
-        if (do_mirror) {
-          top_index = (c * height + h) * width + (width - 1 - w);
-        } else {
-          top_index = (c * height + h) * width + w;
-        }
-        // int top_index = (c * height + h) * width + w;
-        Dtype pixel = static_cast<Dtype>(ptr[img_index++]);
-        if (has_mean_file) {
-          int mean_index = (c * img_height + h_off + h) * img_width + w_off + w;
-          transformed_data[top_index] =
-            (pixel - mean[mean_index]) * scale;
-        } else {
-          if (has_mean_values) {
-            transformed_data[top_index] =
-              (pixel - mean_values_[c]) * scale;
-          } else {
-            transformed_data[top_index] = pixel * scale;
-          }
-        }
+    const uchar* ptr = cv_img.ptr<uchar>(h_off + h) + w_off * img_channels;
+    for (int c = 0; c < img_channels; ++c) {
+      Dtype* top_row = transformed_data + (c * height + h) * width;
+      if (has_mean_file) {
+        const int mean_index = (c * img_height + h_off + h) * img_width + w_off;
+        MeanFileRow(ptr + c, img_channels, mean + mean_index, scale, width,
+            do_mirror, top_row);
+      } else {
+        TableRow(ptr + c, img_channels, tables + c * 256, width, do_mirror,
+            top_row);
       }
     }
   }
@@ -395,10 +547,135 @@ void DataTransformer<Dtype>::Transform(Blob<Dtype>* input_blob,
   }
 }
 
+template <typename Dtype>
+void DataTransformer<Dtype>::Augment(const cv::Mat& cv_img, Caffe::RNG* rng,
+    cv::Mat* augmented) const {
+  CHECK(cv_img.depth() == CV_8U) << "Image data type must be unsigned byte";
+  cv::Mat image = cv_img;
+  caffe::rng_t* generator = NULL;
+  if (phase_ == TRAIN && needs_augmentation()) {
+    CHECK(rng);
+    generator = static_cast<caffe::rng_t*>(rng->generator());
+  }
+
+  if (image.channels() == 4 && param_.has_background_source()) {
+    cv::Mat background;
+    if (phase_ == TRAIN) {
+      const string& path =
+          background_images_[(*generator)() % background_images_.size()];
+      if (!background_cache_->Get(path, &background)) {
+        background = cv::imread(path, CV_LOAD_IMAGE_COLOR);
+        if (background.data) {
+          background_cache_->Put(path, background);
+        } else {
+          LOG(ERROR) << "Could not open or find background " << path;
+        }
+      }
+      if (background.rows >= image.rows && background.cols >= image.cols) {
+        const int h_off = (*generator)() % (background.rows - image.rows + 1);
+        const int w_off = (*generator)() % (background.cols - image.cols + 1);
+        background = background(
+            cv::Rect(w_off, h_off, image.cols, image.rows));
+      } else if (background.data) {
+        cv::resize(background, background, cv::Size(image.cols, image.rows));
+      }
+    }
+    image = CompositeOver(image, background);
+  }
+  if (phase_ != TRAIN) {
+    *augmented = image;
+    return;
+  }
+
+  const int crop_size = param_.crop_size();
+  if (crop_size &&
+      (param_.min_crop_area() < 1 || param_.max_aspect_ratio() > 1)) {
+    const cv::Rect roi = RandomCropRect(image.rows, image.cols,
+        param_.min_crop_area(), param_.max_aspect_ratio(), generator);
+    cv::Mat resized;
+    cv::resize(image(roi), resized, cv::Size(crop_size, crop_size));
+    image = resized;
+  }
+
+  const float brightness_jitter = param_.brightness_jitter();
+  const float contrast_jitter = param_.contrast_jitter();
+  const float saturation_jitter = param_.saturation_jitter();
+  if ((image.channels() == 1 || image.channels() == 3) &&
+      (brightness_jitter > 0 || contrast_jitter > 0 || saturation_jitter > 0)) {
+    const float brightness = RandUniform(generator,
+        1 - brightness_jitter, 1 + brightness_jitter);
+    const float contrast = RandUniform(generator,
+        1 - contrast_jitter, 1 + contrast_jitter);
+    const float saturation = RandUniform(generator,
+        1 - saturation_jitter, 1 + saturation_jitter);
+    image = JitterColor(image, brightness, contrast, saturation);
+  }
+  *augmented = image;
+}
+
+template <typename Dtype>
+bool DataTransformer<Dtype>::needs_augmentation() const {
+  if (param_.has_background_source()) {
+    return true;
+  }
+  return phase_ == TRAIN && ((param_.crop_size() &&
+      (param_.min_crop_area() < 1 || param_.max_aspect_ratio() > 1)) ||
+      param_.brightness_jitter() > 0 || param_.contrast_jitter() > 0 ||
+      param_.saturation_jitter() > 0);
+}
+
+template <typename Dtype>
+unsigned int DataTransformer<Dtype>::RandSeed() {
+  CHECK(rng_);
+  caffe::rng_t* rng =
+      static_cast<caffe::rng_t*>(rng_->generator());
+  return (*rng)();
+}
+
+template <typename Dtype>
+void DataTransformer<Dtype>::CheckShape(const int input_channels,
+    const int input_height, const int input_width,
+    const Blob<Dtype>* transformed_blob) const {
+  const int channels = transformed_blob->channels();
+  const int height = transformed_blob->height();
+  const int width = transformed_blob->width();
+
+  CHECK_EQ(channels, input_channels);
+  CHECK_LE(height, input_height);
+  CHECK_LE(width, input_width);
+  CHECK_GE(transformed_blob->num(), 1);
+
+  const int crop_size = param_.crop_size();
+  if (crop_size) {
+    CHECK_EQ(crop_size, height);
+    CHECK_EQ(crop_size, width);
+  } else {
+    CHECK_EQ(input_height, height);
+    CHECK_EQ(input_width, width);
+  }
+}
+
+template <typename Dtype>
+const Dtype* DataTransformer<Dtype>::PixelTables(const int channels) {
+  // (pixel - mean) * scale for every 8-bit pixel value of every channel,
+  // computed once instead of for every pixel of every image.
+  if (pixel_tables_.size() != channels * 256) {
+    const Dtype scale = param_.scale();
+    pixel_tables_.resize(channels * 256);
+    for (int c = 0; c < channels; ++c) {
+      const Dtype mean = mean_values_.empty() ? Dtype(0) : mean_values_[c];
+      for (int v = 0; v < 256; ++v) {
+        pixel_tables_[c * 256 + v] = (static_cast<Dtype>(v) - mean) * scale;
+      }
+    }
+  }
+  return &pixel_tables_[0];
+}
+
 template <typename Dtype>
 void DataTransformer<Dtype>::InitRand() {
   const bool needs_rand = param_.mirror() ||
-      (phase_ == TRAIN && param_.crop_size());
+      (phase_ == TRAIN && param_.crop_size()) || needs_augmentation();
   if (needs_rand) {
     const unsigned int rng_seed = caffe_rng_rand();
     rng_.reset(new Caffe::RNG(rng_seed));
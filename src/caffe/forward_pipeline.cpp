@@ -0,0 +1,157 @@
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "caffe/forward_pipeline.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+ForwardPipeline<Dtype>::ForwardPipeline(const shared_ptr<Net<Dtype> >& net,
+    const vector<string>& output_names, int depth)
+    : net_(net), device_(-1), filling_(NULL), reading_(NULL) {
+  CHECK_GT(depth, 0);
+#ifndef CPU_ONLY
+  if (Caffe::mode() == Caffe::GPU) {
+    CUDA_CHECK(cudaGetDevice(&device_));
+  }
+#endif
+  for (int i = 0; i < output_names.size(); ++i) {
+    CHECK(net_->has_blob(output_names[i]))
+        << "Unknown blob " << output_names[i];
+    output_blobs_.push_back(net_->blob_by_name(output_names[i]));
+  }
+  for (int i = 0; i < net_->num_inputs(); ++i) {
+    input_storage_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+  }
+  for (int i = 0; i < depth; ++i) {
+    shared_ptr<PipelineBatch<Dtype> > batch(new PipelineBatch<Dtype>());
+    for (int j = 0; j < net_->num_inputs(); ++j) {
+      batch->inputs_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+      batch->inputs_[j]->ReshapeLike(*net_->input_blobs()[j]);
+    }
+    for (int j = 0; j < output_blobs_.size(); ++j) {
+      batch->outputs_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+    }
+    batch->failed_ = false;
+    batches_.push_back(batch);
+    free_.push(batch.get());
+  }
+  CHECK(StartInternalThread()) << "Thread execution failed";
+}
+
+template <typename Dtype>
+ForwardPipeline<Dtype>::~ForwardPipeline() {
+  Stop();
+}
+
+template <typename Dtype>
+const vector<shared_ptr<Blob<Dtype> > >& ForwardPipeline<Dtype>::NextInputs() {
+  if (!filling_) {
+    filling_ = free_.pop();
+  }
+  return filling_->inputs_;
+}
+
+template <typename Dtype>
+void ForwardPipeline<Dtype>::Push() {
+  CHECK(filling_) << "Call NextInputs() to get a batch to push.";
+  CHECK(is_started()) << "The pipeline is stopped.";
+  full_.push(filling_);
+  filling_ = NULL;
+}
+
+template <typename Dtype>
+const vector<shared_ptr<Blob<Dtype> > >& ForwardPipeline<Dtype>::Pop() {
+  Release();
+  reading_ = done_.pop();
+  if (reading_->failed_) {
+    Release();
+    throw std::runtime_error("The forward pass of a batch failed.");
+  }
+  return reading_->outputs_;
+}
+
+template <typename Dtype>
+void ForwardPipeline<Dtype>::Release() {
+  if (reading_) {
+    free_.push(reading_);
+    reading_ = NULL;
+  }
+}
+
+template <typename Dtype>
+void ForwardPipeline<Dtype>::Stop() {
+  if (is_started()) {
+    full_.push(NULL);
+    WaitForInternalThreadToExit();
+  }
+}
+
+template <typename Dtype>
+void ForwardPipeline<Dtype>::InternalThreadEntry() {
+#ifndef CPU_ONLY
+  if (device_ >= 0) {
+    CUDA_CHECK(cudaSetDevice(device_));
+  }
+#endif
+  while (true) {
+    PipelineBatch<Dtype>* batch = full_.pop();
+    if (!batch) {
+      break;
+    }
+    try {
+      Forward(batch);
+      batch->failed_ = false;
+    } catch (...) {
+      // E.g. a Python layer raised; Pop() reports it to the caller.
+      batch->failed_ = true;
+    }
+    done_.push(batch);
+  }
+}
+
+template <typename Dtype>
+void ForwardPipeline<Dtype>::Forward(PipelineBatch<Dtype>* batch) {
+  const vector<Blob<Dtype>*>& inputs = net_->input_blobs();
+  bool reshape = false;
+  for (int i = 0; i < inputs.size(); ++i) {
+    if (inputs[i]->shape() != batch->inputs_[i]->shape()) {
+      inputs[i]->ReshapeLike(*batch->inputs_[i]);
+      reshape = true;
+    }
+  }
+  // Run on the batch inputs in place, then give the net inputs their own
+  // storage back, so that no net input outlives the batch with its storage.
+  // The inputs are swapped before reshaping the net, so that the layers
+  // sharing an input's storage (Split, Flatten, views) pick up the batch.
+  for (int i = 0; i < inputs.size(); ++i) {
+    input_storage_[i]->ReshapeLike(*inputs[i]);
+    input_storage_[i]->ShareData(*inputs[i]);
+    inputs[i]->ShareData(*batch->inputs_[i]);
+  }
+  try {
+    if (reshape) {
+      net_->Reshape();
+    }
+    net_->ForwardPrefilled();
+  } catch (...) {
+    for (int i = 0; i < inputs.size(); ++i) {
+      inputs[i]->ShareData(*input_storage_[i]);
+    }
+    throw;
+  }
+  for (int i = 0; i < inputs.size(); ++i) {
+    inputs[i]->ShareData(*input_storage_[i]);
+  }
+  for (int i = 0; i < output_blobs_.size(); ++i) {
+    batch->outputs_[i]->ReshapeLike(*output_blobs_[i]);
+    caffe_copy(output_blobs_[i]->count(), output_blobs_[i]->cpu_data(),
+        batch->outputs_[i]->mutable_cpu_data());
+  }
+}
+
+INSTANTIATE_CLASS(ForwardPipeline);
+
+}  // namespace caffe
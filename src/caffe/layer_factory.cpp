@@ -11,6 +11,13 @@
 
 namespace caffe {
 
+bool LayerTypeAllowsAccumulateBottomDiff(const string& type,
+    const int bottom_index) {
+  // Only the gradient w.r.t. the feature maps of ROIPooling is computed.
+  return (type == "InnerProduct" || type == "ROIPooling") &&
+      bottom_index == 0;
+}
+
 // Get convolution layer according to engine.
 template <typename Dtype>
 shared_ptr<Layer<Dtype> > GetConvolutionLayer(
@@ -161,6 +168,7 @@ REGISTER_LAYER_CREATOR(TanH, GetTanHLayer);
 template <typename Dtype>
 shared_ptr<Layer<Dtype> > GetPythonLayer(const LayerParameter& param) {
   Py_Initialize();
+  ScopedGILAcquire gil;
   try {
     bp::object module = bp::import(param.python_param().module().c_str());
     bp::object layer = module.attr(param.python_param().layer().c_str())(param);
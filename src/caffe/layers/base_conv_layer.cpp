@@ -1,13 +1,27 @@
+#include <algorithm>
+#include <limits>
+#include <sstream>
+#include <string>
 #include <vector>
 
+#include "boost/bind.hpp"
+
 #include "caffe/filler.hpp"
 #include "caffe/layer.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/conv_tuner.hpp"
 #include "caffe/util/im2col.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
 #include "caffe/vision_layers.hpp"
 
 namespace caffe {
 
+// The column buffer of BATCHED_GEMM holds as many images as fit in this.
+const size_t kMaxBatchedColumnBytes = 64 << 20;
+// Number of timed runs of every algorithm when tuning, after a warm-up run.
+const int kTuningRuns = 3;
+
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
@@ -98,6 +112,8 @@ void BaseConvolutionLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   }
   // Propagate gradients to the parameters (as directed by backward pass).
   this->param_propagate_down_.resize(this->blobs_.size(), true);
+  cpu_algorithm_ = conv_param.cpu_algorithm();
+  tuned_shape_.clear();
 }
 
 template <typename Dtype>
@@ -153,6 +169,79 @@ void BaseConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
     caffe_set(bias_multiplier_.count(), Dtype(1),
         bias_multiplier_.mutable_cpu_data());
   }
+  if (this->layer_param_.convolution_param().cpu_algorithm() ==
+      ConvolutionParameter_CPUAlgorithm_AUTO && !reverse_dimensions() &&
+      Caffe::mode() == Caffe::CPU) {
+    TuneCPUAlgorithm(*bottom[0], top[0]);
+  }
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::TuneCPUAlgorithm(const Blob<Dtype>& bottom,
+    Blob<Dtype>* top) {
+  vector<int> shape(3);
+  shape[0] = num_;
+  shape[1] = height_;
+  shape[2] = width_;
+  if (shape == tuned_shape_) {
+    return;
+  }
+  tuned_shape_ = shape;
+  std::ostringstream key;
+  key << ConvolutionTuner::MachineKey() << " "
+      << (sizeof(Dtype) == sizeof(float) ? "float" : "double") << " "
+      << num_ << "x" << channels_ << "x" << height_ << "x" << width_
+      << " output " << num_output_ << " group " << group_
+      << " kernel " << kernel_h_ << "x" << kernel_w_
+      << " pad " << pad_h_ << "x" << pad_w_
+      << " stride " << stride_h_ << "x" << stride_w_;
+  string name;
+  if (ConvolutionTuner::Get().Lookup(key.str(), &name) &&
+      ConvolutionParameter_CPUAlgorithm_Parse(name, &cpu_algorithm_) &&
+      cpu_algorithm_ != ConvolutionParameter_CPUAlgorithm_AUTO) {
+    return;
+  }
+  // Time every algorithm on the current input. The output is overwritten by
+  // the next forward pass anyway.
+  const Dtype* input = bottom.cpu_data();
+  const Dtype* weights = this->blobs_[0]->cpu_data();
+  Dtype* output = top->mutable_cpu_data();
+  ConvolutionParameter_CPUAlgorithm best_algorithm =
+      ConvolutionParameter_CPUAlgorithm_IM2COL_GEMM;
+  double best_us = std::numeric_limits<double>::max();
+  CPUTimer timer;
+  for (int i = ConvolutionParameter_CPUAlgorithm_CPUAlgorithm_MIN;
+       i <= ConvolutionParameter_CPUAlgorithm_CPUAlgorithm_MAX; ++i) {
+    if (i == ConvolutionParameter_CPUAlgorithm_AUTO) {
+      continue;
+    }
+    cpu_algorithm_ = static_cast<ConvolutionParameter_CPUAlgorithm>(i);
+    forward_cpu_conv(input, weights, output);
+    for (int run = 0; run < kTuningRuns; ++run) {
+      timer.Start();
+      forward_cpu_conv(input, weights, output);
+      const double us = timer.MicroSeconds();
+      if (us < best_us) {
+        best_us = us;
+        best_algorithm = cpu_algorithm_;
+      }
+    }
+  }
+  cpu_algorithm_ = best_algorithm;
+  // Release the buffers of the algorithms that lost.
+  if (cpu_algorithm_ != ConvolutionParameter_CPUAlgorithm_BATCHED_GEMM) {
+    batch_col_buffer_.reset();
+    batch_output_buffer_.reset();
+  }
+  if (cpu_algorithm_ !=
+      ConvolutionParameter_CPUAlgorithm_THREADED_IM2COL_GEMM) {
+    thread_col_buffers_.clear();
+  }
+  name = ConvolutionParameter_CPUAlgorithm_Name(cpu_algorithm_);
+  ConvolutionTuner::Get().Record(key.str(), name, best_us);
+  LOG(INFO) << "Convolution " << this->layer_param_.name() << " on "
+      << num_ << "x" << channels_ << "x" << height_ << "x" << width_
+      << " uses " << name << " (" << best_us << " us)";
 }
 
 template <typename Dtype>
@@ -173,6 +262,176 @@ void BaseConvolutionLayer<Dtype>::forward_cpu_gemm(const Dtype* input,
   }
 }
 
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_conv(const Dtype* input,
+    const Dtype* weights, Dtype* output) {
+  switch (cpu_algorithm_) {
+  case ConvolutionParameter_CPUAlgorithm_BATCHED_GEMM:
+    forward_cpu_batched_gemm(input, weights, output);
+    break;
+  case ConvolutionParameter_CPUAlgorithm_DIRECT:
+    forward_cpu_direct(input, weights, output);
+    break;
+  case ConvolutionParameter_CPUAlgorithm_THREADED_IM2COL_GEMM:
+    forward_cpu_threaded_gemm(input, weights, output);
+    break;
+  default:
+    forward_cpu_gemm_images(input, weights, output, 0, num_,
+        col_buffer_.mutable_cpu_data());
+    break;
+  }
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_gemm_images(const Dtype* input,
+    const Dtype* weights, Dtype* output, int begin, int end, Dtype* col_buff) {
+  const int input_dim = conv_in_channels_ * conv_in_height_ * conv_in_width_;
+  const int output_dim = conv_out_channels_ * conv_out_spatial_dim_;
+  for (int n = begin; n < end; ++n) {
+    const Dtype* image_col = input + n * input_dim;
+    if (!is_1x1_) {
+      conv_im2col_cpu(input + n * input_dim, col_buff);
+      image_col = col_buff;
+    }
+    for (int g = 0; g < group_; ++g) {
+      caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, conv_out_channels_ /
+          group_, conv_out_spatial_dim_, kernel_dim_ / group_,
+          (Dtype)1., weights + weight_offset_ * g, image_col + col_offset_ * g,
+          (Dtype)0., output + n * output_dim + output_offset_ * g);
+    }
+  }
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_gemm_range(const Dtype* input,
+    const Dtype* weights, Dtype* output, int num_ranges, int range) {
+  forward_cpu_gemm_images(input, weights, output,
+      num_ * range / num_ranges, num_ * (range + 1) / num_ranges,
+      thread_col_buffers_[range]->mutable_cpu_data());
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_threaded_gemm(
+    const Dtype* input, const Dtype* weights, Dtype* output) {
+  // Every thread convolves a range of images with a column buffer of its own.
+  // The pool is shared with the other layers; when it is busy, e.g. with the
+  // layers of another net, the images are convolved on this thread instead.
+  ThreadPool& pool = ThreadPool::Global();
+  const int num_ranges = std::min(pool.num_threads(), num_);
+  thread_col_buffers_.resize(num_ranges);
+  for (int i = 0; i < num_ranges; ++i) {
+    if (!thread_col_buffers_[i]) {
+      thread_col_buffers_[i].reset(new Blob<Dtype>());
+    }
+    thread_col_buffers_[i]->ReshapeLike(col_buffer_);
+    // Allocate here rather than concurrently on the pool.
+    thread_col_buffers_[i]->mutable_cpu_data();
+  }
+  if (!pool.TryRun(num_ranges, boost::bind(
+      &BaseConvolutionLayer<Dtype>::forward_cpu_gemm_range, this, input,
+      weights, output, num_ranges, _1))) {
+    forward_cpu_gemm_images(input, weights, output, 0, num_,
+        thread_col_buffers_[0]->mutable_cpu_data());
+  }
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_batched_gemm(
+    const Dtype* input, const Dtype* weights, Dtype* output) {
+  const int input_dim = conv_in_channels_ * conv_in_height_ * conv_in_width_;
+  const int output_dim = conv_out_channels_ * conv_out_spatial_dim_;
+  const size_t image_col_bytes =
+      sizeof(Dtype) * kernel_dim_ * conv_out_spatial_dim_;
+  const int batch = std::max(1, std::min(num_,
+      static_cast<int>(kMaxBatchedColumnBytes / image_col_bytes)));
+  if (!batch_col_buffer_) {
+    batch_col_buffer_.reset(new Blob<Dtype>());
+    batch_output_buffer_.reset(new Blob<Dtype>());
+  }
+  batch_col_buffer_->Reshape(1, 1, kernel_dim_, batch * conv_out_spatial_dim_);
+  batch_output_buffer_->Reshape(1, 1, conv_out_channels_,
+      batch * conv_out_spatial_dim_);
+  for (int first = 0; first < num_; first += batch) {
+    // Lay the columns of the images side by side, so that one GEMM per group
+    // convolves them all, then scatter its output back to the images.
+    const int images = std::min(batch, num_ - first);
+    const int columns = images * conv_out_spatial_dim_;
+    Dtype* col_buff = batch_col_buffer_->mutable_cpu_data();
+    for (int b = 0; b < images; ++b) {
+      const Dtype* image_col = input + (first + b) * input_dim;
+      if (!is_1x1_) {
+        conv_im2col_cpu(image_col, col_buffer_.mutable_cpu_data());
+        image_col = col_buffer_.cpu_data();
+      }
+      for (int k = 0; k < kernel_dim_; ++k) {
+        caffe_copy(conv_out_spatial_dim_, image_col + k * conv_out_spatial_dim_,
+            col_buff + k * columns + b * conv_out_spatial_dim_);
+      }
+    }
+    Dtype* batch_output = batch_output_buffer_->mutable_cpu_data();
+    for (int g = 0; g < group_; ++g) {
+      caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, conv_out_channels_ /
+          group_, columns, kernel_dim_ / group_,
+          (Dtype)1., weights + weight_offset_ * g,
+          col_buff + kernel_dim_ / group_ * columns * g,
+          (Dtype)0., batch_output + conv_out_channels_ / group_ * columns * g);
+    }
+    for (int b = 0; b < images; ++b) {
+      for (int m = 0; m < conv_out_channels_; ++m) {
+        caffe_copy(conv_out_spatial_dim_,
+            batch_output + m * columns + b * conv_out_spatial_dim_,
+            output + (first + b) * output_dim + m * conv_out_spatial_dim_);
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_direct(const Dtype* input,
+    const Dtype* weights, Dtype* output) {
+  const int in_channels = conv_in_channels_ / group_;
+  const int out_channels = conv_out_channels_ / group_;
+  const int input_spatial_dim = conv_in_height_ * conv_in_width_;
+  const int input_dim = conv_in_channels_ * input_spatial_dim;
+  const int output_dim = conv_out_channels_ * conv_out_spatial_dim_;
+  caffe_set(num_ * output_dim, Dtype(0), output);
+  for (int n = 0; n < num_; ++n) {
+    for (int o = 0; o < conv_out_channels_; ++o) {
+      Dtype* out = output + n * output_dim + o * conv_out_spatial_dim_;
+      const int g = o / out_channels;
+      for (int c = 0; c < in_channels; ++c) {
+        const Dtype* in = input + n * input_dim +
+            (g * in_channels + c) * input_spatial_dim;
+        const Dtype* kernel = weights +
+            (o * in_channels + c) * kernel_h_ * kernel_w_;
+        for (int kh = 0; kh < kernel_h_; ++kh) {
+          for (int kw = 0; kw < kernel_w_; ++kw) {
+            const Dtype weight = kernel[kh * kernel_w_ + kw];
+            // The output columns x whose input column x * stride_w_ - pad_w_
+            // + kw lies inside the image.
+            const int x_begin = pad_w_ > kw ?
+                (pad_w_ - kw + stride_w_ - 1) / stride_w_ : 0;
+            const int last_x = conv_in_width_ - 1 + pad_w_ - kw;
+            const int x_end = last_x < 0 ? 0 :
+                std::min(width_out_, last_x / stride_w_ + 1);
+            for (int y = 0; y < height_out_; ++y) {
+              const int in_y = y * stride_h_ - pad_h_ + kh;
+              if (in_y < 0 || in_y >= conv_in_height_) {
+                continue;
+              }
+              const Dtype* in_row = in + in_y * conv_in_width_ + kw - pad_w_;
+              Dtype* out_row = out + y * width_out_;
+              for (int x = x_begin; x < x_end; ++x) {
+                out_row[x] += weight * in_row[x * stride_w_];
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::forward_cpu_bias(Dtype* output,
     const Dtype* bias) {
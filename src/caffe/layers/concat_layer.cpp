@@ -48,6 +48,13 @@ void ConcatLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   }
   top[0]->Reshape(top_shape);
   CHECK_EQ(bottom_count_sum, top[0]->count());
+  if (concat_param.share_memory()) {
+    if (num_concats_ == 1) {
+      bottom_views_.Share(bottom, top[0], true);
+    } else {
+      bottom_views_.Unshare(true);
+    }
+  }
 }
 
 template <typename Dtype>
@@ -56,6 +63,7 @@ void ConcatLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   Dtype* top_data = top[0]->mutable_cpu_data();
   int offset_concat_axis = 0;
   const int top_concat_axis = top[0]->shape(concat_axis_);
+  // caffe_copy skips the bottoms that are views of the top already.
   for (int i = 0; i < bottom.size(); ++i) {
     const Dtype* bottom_data = bottom[i]->cpu_data();
     const int bottom_concat_axis = bottom[i]->shape(concat_axis_);
@@ -47,21 +47,26 @@ void DataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
       DecodeDatumNative(&datum)) {
     LOG(INFO) << "Decoding Datum";
   }
+  int channels = datum.channels();
+  if (channels == 4 && this->transform_param_.has_background_source()) {
+    // Images with an alpha channel are composited over a background.
+    channels = 3;
+  }
   // image
   int crop_size = this->layer_param_.transform_param().crop_size();
   if (crop_size > 0) {
     top[0]->Reshape(this->layer_param_.data_param().batch_size(),
-        datum.channels(), crop_size, crop_size);
+        channels, crop_size, crop_size);
     this->prefetch_data_.Reshape(this->layer_param_.data_param().batch_size(),
-        datum.channels(), crop_size, crop_size);
-    this->transformed_data_.Reshape(1, datum.channels(), crop_size, crop_size);
+        channels, crop_size, crop_size);
+    this->transformed_data_.Reshape(1, channels, crop_size, crop_size);
   } else {
     top[0]->Reshape(
-        this->layer_param_.data_param().batch_size(), datum.channels(),
+        this->layer_param_.data_param().batch_size(), channels,
         datum.height(), datum.width());
     this->prefetch_data_.Reshape(this->layer_param_.data_param().batch_size(),
-        datum.channels(), datum.height(), datum.width());
-    this->transformed_data_.Reshape(1, datum.channels(),
+        channels, datum.height(), datum.width());
+    this->transformed_data_.Reshape(1, channels,
       datum.height(), datum.width());
   }
   LOG(INFO) << "output data size: " << top[0]->num() << ","
@@ -90,6 +95,7 @@ void DataLayer<Dtype>::InternalThreadEntry() {
   const int batch_size = this->layer_param_.data_param().batch_size();
   const int crop_size = this->layer_param_.transform_param().crop_size();
   bool force_color = this->layer_param_.data_param().force_encoded_color();
+  const bool augment = this->data_transformer_->needs_augmentation();
   if (batch_size == 1 && crop_size == 0) {
     Datum datum;
     datum.ParseFromString(cursor_->value());
@@ -100,9 +106,12 @@ void DataLayer<Dtype>::InternalThreadEntry() {
         DecodeDatumNative(&datum);
       }
     }
-    this->prefetch_data_.Reshape(1, datum.channels(),
-        datum.height(), datum.width());
-    this->transformed_data_.Reshape(1, datum.channels(),
+    int channels = datum.channels();
+    if (channels == 4 && this->transform_param_.has_background_source()) {
+      channels = 3;
+    }
+    this->prefetch_data_.Reshape(1, channels, datum.height(), datum.width());
+    this->transformed_data_.Reshape(1, channels,
         datum.height(), datum.width());
   }
 
@@ -125,6 +134,11 @@ void DataLayer<Dtype>::InternalThreadEntry() {
       } else {
         cv_img = DecodeDatumToCVMatNative(datum);
       }
+      if (augment) {
+        // Augment (crop, color jitter...) the decoded image.
+        Caffe::RNG rng(this->data_transformer_->RandSeed());
+        this->data_transformer_->Augment(cv_img, &rng, &cv_img);
+      }
       if (cv_img.channels() != this->transformed_data_.channels()) {
         LOG(WARNING) << "Your dataset contains encoded images with mixed "
         << "channel sizes. Consider adding a 'force_color' flag to the "
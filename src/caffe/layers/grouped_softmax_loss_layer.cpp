@@ -0,0 +1,174 @@
+#include <boost/bind.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <vector>
+
+#include "caffe/layer.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
+#include "caffe/vision_layers.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void GroupedSoftmaxWithLossLayer<Dtype>::LayerSetUp(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  LossLayer<Dtype>::LayerSetUp(bottom, top);
+  const GroupedSoftmaxLossParameter& grouped_param =
+      this->layer_param_.grouped_softmax_loss_param();
+  CHECK_GT(grouped_param.group_size(), 0) << "group_size must be > 0";
+  group_size_ = grouped_param.group_size();
+  has_ignore_label_ =
+    this->layer_param_.loss_param().has_ignore_label();
+  if (has_ignore_label_) {
+    ignore_label_ = this->layer_param_.loss_param().ignore_label();
+  }
+  normalize_ = this->layer_param_.loss_param().normalize();
+  thread_pool_.reset(new ThreadPool(grouped_param.num_threads()));
+}
+
+template <typename Dtype>
+void GroupedSoftmaxWithLossLayer<Dtype>::Reshape(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  LossLayer<Dtype>::Reshape(bottom, top);
+  softmax_axis_ =
+      bottom[0]->CanonicalAxisIndex(this->layer_param_.softmax_param().axis());
+  outer_num_ = bottom[0]->count(0, softmax_axis_);
+  inner_num_ = bottom[0]->count(softmax_axis_ + 1);
+  CHECK_EQ(0, bottom[0]->shape(softmax_axis_) % group_size_)
+      << "The number of classes must be a multiple of group_size.";
+  num_groups_ = bottom[0]->shape(softmax_axis_) / group_size_;
+  CHECK_EQ(outer_num_ * inner_num_, bottom[1]->count())
+      << "Number of labels must match number of predictions; "
+      << "e.g., if softmax axis == 1 and prediction shape is (N, C, H, W), "
+      << "label count (number of labels) must be N*H*W, "
+      << "with integer values in {0, 1, ..., group_size-1}.";
+  CHECK_EQ(bottom[1]->count(), bottom[2]->count())
+      << "There must be one group index per label.";
+  vector<int> prob_shape = bottom[0]->shape();
+  prob_shape[softmax_axis_] = group_size_;
+  prob_.Reshape(prob_shape);
+  vector<int> outer_shape(1, outer_num_);
+  outer_loss_.Reshape(outer_shape);
+  outer_count_.Reshape(outer_shape);
+}
+
+template <typename Dtype>
+void GroupedSoftmaxWithLossLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  // The tasks take the data synced to the CPU here, not concurrently.
+  thread_pool_->Run(outer_num_, boost::bind(
+      &GroupedSoftmaxWithLossLayer<Dtype>::ForwardInstances, this,
+      bottom[0]->cpu_data(), bottom[1]->cpu_data(), bottom[2]->cpu_data(),
+      prob_.mutable_cpu_data(), outer_loss_.mutable_cpu_data(),
+      outer_count_.mutable_cpu_data(), _1));
+  // Sum in order, for results not depending on the threads.
+  const Dtype* loss_data = outer_loss_.cpu_data();
+  const int* count_data = outer_count_.cpu_data();
+  Dtype loss = 0;
+  int count = 0;
+  for (int i = 0; i < outer_num_; ++i) {
+    loss += loss_data[i];
+    count += count_data[i];
+  }
+  if (normalize_) {
+    top[0]->mutable_cpu_data()[0] = loss / count;
+  } else {
+    top[0]->mutable_cpu_data()[0] = loss / outer_num_;
+  }
+}
+
+template <typename Dtype>
+void GroupedSoftmaxWithLossLayer<Dtype>::ForwardInstances(
+    const Dtype* bottom_data, const Dtype* label, const Dtype* group,
+    Dtype* prob_data, Dtype* loss_data, int* count_data, int i) {
+  const int dim = num_groups_ * group_size_ * inner_num_;
+  loss_data[i] = 0;
+  count_data[i] = 0;
+  for (int j = 0; j < inner_num_; ++j) {
+    const int label_value = static_cast<int>(label[i * inner_num_ + j]);
+    if (has_ignore_label_ && label_value == ignore_label_) {
+      continue;
+    }
+    const int group_value = static_cast<int>(group[i * inner_num_ + j]);
+    DCHECK_GE(label_value, 0);
+    DCHECK_LT(label_value, group_size_);
+    CHECK_GE(group_value, 0);
+    CHECK_LT(group_value, num_groups_);
+    const Dtype* scores =
+        bottom_data + i * dim + group_value * group_size_ * inner_num_ + j;
+    Dtype* prob = prob_data + (i * group_size_ * inner_num_) + j;
+    // Subtract the maximum for numerical stability, as SoftmaxLayer.
+    Dtype max_score = scores[0];
+    for (int c = 1; c < group_size_; ++c) {
+      max_score = std::max(max_score, scores[c * inner_num_]);
+    }
+    Dtype sum = 0;
+    for (int c = 0; c < group_size_; ++c) {
+      prob[c * inner_num_] = exp(scores[c * inner_num_] - max_score);
+      sum += prob[c * inner_num_];
+    }
+    for (int c = 0; c < group_size_; ++c) {
+      prob[c * inner_num_] /= sum;
+    }
+    loss_data[i] -= log(std::max(prob[label_value * inner_num_],
+                                 Dtype(FLT_MIN)));
+    ++count_data[i];
+  }
+}
+
+template <typename Dtype>
+void GroupedSoftmaxWithLossLayer<Dtype>::Backward_cpu(
+    const vector<Blob<Dtype>*>& top, const vector<bool>& propagate_down,
+    const vector<Blob<Dtype>*>& bottom) {
+  if (propagate_down[1] || propagate_down[2]) {
+    LOG(FATAL) << this->type()
+               << " Layer cannot backpropagate to label or group inputs.";
+  }
+  if (!propagate_down[0]) {
+    return;
+  }
+  const Dtype loss_weight = top[0]->cpu_diff()[0];
+  Dtype scale = loss_weight / outer_num_;
+  if (normalize_) {
+    const int* count_data = outer_count_.cpu_data();
+    int count = 0;
+    for (int i = 0; i < outer_num_; ++i) {
+      count += count_data[i];
+    }
+    scale = loss_weight / count;
+  }
+  thread_pool_->Run(outer_num_, boost::bind(
+      &GroupedSoftmaxWithLossLayer<Dtype>::BackwardInstances, this,
+      prob_.cpu_data(), bottom[1]->cpu_data(), bottom[2]->cpu_data(), scale,
+      bottom[0]->mutable_cpu_diff(), _1));
+}
+
+template <typename Dtype>
+void GroupedSoftmaxWithLossLayer<Dtype>::BackwardInstances(
+    const Dtype* prob_data, const Dtype* label, const Dtype* group,
+    Dtype scale, Dtype* bottom_diff, int i) {
+  const int dim = num_groups_ * group_size_ * inner_num_;
+  bottom_diff += i * dim;
+  caffe_set(dim, Dtype(0), bottom_diff);
+  for (int j = 0; j < inner_num_; ++j) {
+    const int label_value = static_cast<int>(label[i * inner_num_ + j]);
+    if (has_ignore_label_ && label_value == ignore_label_) {
+      continue;
+    }
+    const int group_value = static_cast<int>(group[i * inner_num_ + j]);
+    Dtype* diff = bottom_diff + group_value * group_size_ * inner_num_ + j;
+    const Dtype* prob = prob_data + (i * group_size_ * inner_num_) + j;
+    for (int c = 0; c < group_size_; ++c) {
+      diff[c * inner_num_] = prob[c * inner_num_] * scale;
+    }
+    diff[label_value * inner_num_] -= scale;
+  }
+}
+
+INSTANTIATE_CLASS(GroupedSoftmaxWithLossLayer);
+REGISTER_LAYER_CLASS(GroupedSoftmaxWithLoss);
+
+}  // namespace caffe
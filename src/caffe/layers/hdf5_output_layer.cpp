@@ -15,15 +15,35 @@ template <typename Dtype>
 void HDF5OutputLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
   file_name_ = this->layer_param_.hdf5_output_param().file_name();
-  file_id_ = H5Fcreate(file_name_.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT,
-                       H5P_DEFAULT);
+  {
+    HDF5Lock lock;
+    file_id_ = H5Fcreate(file_name_.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT,
+                         H5P_DEFAULT);
+  }
   CHECK_GE(file_id_, 0) << "Failed to open HDF5 file" << file_name_;
   file_opened_ = true;
+  if (this->layer_param_.hdf5_output_param().append()) {
+    const int queue_size = this->layer_param_.hdf5_output_param().queue_size();
+    CHECK_GT(queue_size, 0);
+    batches_.resize(queue_size);
+    for (int i = 0; i < queue_size; ++i) {
+      batches_[i].reset(new Batch<Dtype>());
+      free_.push(batches_[i].get());
+    }
+    CHECK(StartInternalThread()) << "Thread execution failed";
+  }
 }
 
 template <typename Dtype>
 HDF5OutputLayer<Dtype>::~HDF5OutputLayer<Dtype>() {
+  if (is_started()) {
+    // Let the writer drain the queue, then stop.
+    full_.push(NULL);
+    CHECK(WaitForInternalThreadToExit()) << "Thread joining failed";
+    LOG(INFO) << "Successfully saved " << file_name_;
+  }
   if (file_opened_) {
+    HDF5Lock lock;
     herr_t status = H5Fclose(file_id_);
     CHECK_GE(status, 0) << "Failed to close HDF5 file " << file_name_;
   }
@@ -40,11 +60,39 @@ void HDF5OutputLayer<Dtype>::SaveBlobs() {
   LOG(INFO) << "Successfully saved " << data_blob_.num() << " rows";
 }
 
+template <typename Dtype>
+void HDF5OutputLayer<Dtype>::InternalThreadEntry() {
+  const int chunk_rows = this->layer_param_.hdf5_output_param().chunk_rows();
+  while (true) {
+    Batch<Dtype>* batch = full_.pop();
+    if (!batch) {
+      break;
+    }
+    hdf5_append_nd_dataset(file_id_, HDF5_DATA_DATASET_NAME, batch->data_,
+        chunk_rows);
+    hdf5_append_nd_dataset(file_id_, HDF5_DATA_LABEL_NAME, batch->label_,
+        chunk_rows);
+    free_.push(batch);
+  }
+}
+
 template <typename Dtype>
 void HDF5OutputLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   CHECK_GE(bottom.size(), 2);
   CHECK_EQ(bottom[0]->num(), bottom[1]->num());
+  if (this->layer_param_.hdf5_output_param().append()) {
+    // Waits for a free batch if the writer is queue_size batches behind.
+    Batch<Dtype>* batch = free_.pop();
+    batch->data_.ReshapeLike(*bottom[0]);
+    batch->label_.ReshapeLike(*bottom[1]);
+    caffe_copy(bottom[0]->count(), bottom[0]->cpu_data(),
+        batch->data_.mutable_cpu_data());
+    caffe_copy(bottom[1]->count(), bottom[1]->cpu_data(),
+        batch->label_.mutable_cpu_data());
+    full_.push(batch);
+    return;
+  }
   data_blob_.Reshape(bottom[0]->num(), bottom[0]->channels(),
                      bottom[0]->height(), bottom[0]->width());
   label_blob_.Reshape(bottom[1]->num(), bottom[1]->channels(),
@@ -0,0 +1,302 @@
+#include <algorithm>
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
+#include <vector>
+
+#include "hdf5.h"
+
+#include "caffe/data_layers.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/rng.hpp"
+
+namespace caffe {
+
+namespace {
+
+// The HDF5 memory type of Dtype; HDF5 converts the stored type to it.
+template <typename Dtype> hid_t HDF5NativeType();
+template <> hid_t HDF5NativeType<float>() { return H5T_NATIVE_FLOAT; }
+template <> hid_t HDF5NativeType<double>() { return H5T_NATIVE_DOUBLE; }
+
+}  // namespace
+
+template <typename Dtype>
+HDF5StreamDataLayer<Dtype>::~HDF5StreamDataLayer<Dtype>() {
+  CHECK(WaitForInternalThreadToExit()) << "Thread joining failed";
+  CloseFile();
+}
+
+template <typename Dtype>
+void HDF5StreamDataLayer<Dtype>::LayerSetUp(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  // Refuse transformation parameters since HDF5 is totally generic.
+  CHECK(!this->layer_param_.has_transform_param()) <<
+      this->type() << " does not transform data.";
+  const HDF5DataParameter& hdf5_data_param =
+      this->layer_param_.hdf5_data_param();
+  CHECK_GT(hdf5_data_param.chunk_rows(), 0);
+  if (hdf5_data_param.shuffle()) {
+    CHECK_GT(hdf5_data_param.shuffle_buffer_rows(), 0);
+  }
+  // Read the source to parse the filenames.
+  const string& source = hdf5_data_param.source();
+  LOG(INFO) << "Loading list of HDF5 filenames from: " << source;
+  hdf_filenames_.clear();
+  std::ifstream source_file(source.c_str());
+  if (source_file.is_open()) {
+    std::string line;
+    while (source_file >> line) {
+      hdf_filenames_.push_back(line);
+    }
+  } else {
+    LOG(FATAL) << "Failed to open source file: " << source;
+  }
+  source_file.close();
+  const int num_files = hdf_filenames_.size();
+  LOG(INFO) << "Number of HDF5 files: " << num_files;
+  CHECK_GE(num_files, 1) << "Must have at least 1 HDF5 filename listed in "
+    << source;
+
+  // Default to identity permutation.
+  file_permutation_.resize(num_files);
+  for (int i = 0; i < num_files; ++i) {
+    file_permutation_[i] = i;
+  }
+  const unsigned int prefetch_rng_seed = caffe_rng_rand();
+  prefetch_rng_.reset(new Caffe::RNG(prefetch_rng_seed));
+  if (hdf5_data_param.shuffle()) {
+    caffe::rng_t* prefetch_rng =
+        static_cast<caffe::rng_t*>(prefetch_rng_->generator());
+    shuffle(file_permutation_.begin(), file_permutation_.end(), prefetch_rng);
+  }
+
+  // Open the first file to learn the shape of the rows.
+  const int top_size = this->layer_param_.top_size();
+  row_shapes_.clear();
+  current_file_ = 0;
+  OpenFile();
+  chunk_size_ = 0;
+  chunk_row_ = 0;
+  shuffle_size_ = 0;
+
+  // Reshape blobs.
+  const int batch_size = hdf5_data_param.batch_size();
+  chunk_blobs_.resize(top_size);
+  shuffle_blobs_.resize(hdf5_data_param.shuffle() ? top_size : 0);
+  prefetch_blobs_.resize(top_size);
+  for (int i = 0; i < top_size; ++i) {
+    vector<int> top_shape(1, batch_size);
+    top_shape.insert(top_shape.end(), row_shapes_[i].begin(),
+        row_shapes_[i].end());
+    top[i]->Reshape(top_shape);
+    prefetch_blobs_[i].reset(new Blob<Dtype>(top_shape));
+    top_shape[0] = hdf5_data_param.chunk_rows();
+    chunk_blobs_[i].reset(new Blob<Dtype>(top_shape));
+    if (hdf5_data_param.shuffle()) {
+      top_shape[0] = hdf5_data_param.shuffle_buffer_rows();
+      shuffle_blobs_[i].reset(new Blob<Dtype>(top_shape));
+    }
+  }
+  LOG(INFO) << "Streaming " << hdf5_data_param.chunk_rows()
+      << " rows at a time";
+  CHECK(StartInternalThread()) << "Thread execution failed";
+}
+
+template <typename Dtype>
+void HDF5StreamDataLayer<Dtype>::OpenFile() {
+  const char* filename =
+      hdf_filenames_[file_permutation_[current_file_]].c_str();
+  DLOG(INFO) << "Opening HDF5 file: " << filename;
+  HDF5Lock lock;
+  file_id_ = H5Fopen(filename, H5F_ACC_RDONLY, H5P_DEFAULT);
+  if (file_id_ < 0) {
+    LOG(FATAL) << "Failed opening HDF5 file: " << filename;
+  }
+  const int top_size = this->layer_param_.top_size();
+  const bool first_file = row_shapes_.empty();
+  row_shapes_.resize(top_size);
+  row_dims_.resize(top_size);
+  datasets_.resize(top_size);
+  for (int i = 0; i < top_size; ++i) {
+    const char* dataset_name = this->layer_param_.top(i).c_str();
+    datasets_[i] = H5Dopen2(file_id_, dataset_name, H5P_DEFAULT);
+    CHECK_GE(datasets_[i], 0) << "Failed to find HDF5 dataset "
+        << dataset_name << " in " << filename;
+    hid_t type = H5Dget_type(datasets_[i]);
+    CHECK_EQ(H5Tget_class(type), H5T_FLOAT) << "Expected float or double data";
+    H5Tclose(type);
+    hid_t space = H5Dget_space(datasets_[i]);
+    const int ndims = H5Sget_simple_extent_ndims(space);
+    CHECK_GE(ndims, 1) << "Input must have at least 1 axis.";
+    vector<hsize_t> dims(ndims);
+    H5Sget_simple_extent_dims(space, dims.data(), NULL);
+    H5Sclose(space);
+    if (i == 0) {
+      file_rows_ = dims[0];
+      CHECK_GT(file_rows_, 0) << "No rows in " << filename;
+    } else {
+      CHECK_EQ(dims[0], file_rows_);
+    }
+    const vector<int> row_shape(dims.begin() + 1, dims.end());
+    if (first_file) {
+      row_shapes_[i] = row_shape;
+      row_dims_[i] = 1;
+      for (int j = 0; j < row_shape.size(); ++j) {
+        row_dims_[i] *= row_shape[j];
+      }
+    } else {
+      CHECK(row_shape == row_shapes_[i]) << "Rows of " << dataset_name
+          << " in " << filename << " differ in shape from the first file's";
+    }
+  }
+
+  // Plan the order in which the chunks of the file are read.
+  const hsize_t chunk_rows = this->layer_param_.hdf5_data_param().chunk_rows();
+  chunk_order_.resize((file_rows_ + chunk_rows - 1) / chunk_rows);
+  for (int i = 0; i < chunk_order_.size(); ++i) {
+    chunk_order_[i] = i;
+  }
+  if (this->layer_param_.hdf5_data_param().shuffle()) {
+    caffe::rng_t* prefetch_rng =
+        static_cast<caffe::rng_t*>(prefetch_rng_->generator());
+    shuffle(chunk_order_.begin(), chunk_order_.end(), prefetch_rng);
+  }
+  current_chunk_ = 0;
+}
+
+template <typename Dtype>
+void HDF5StreamDataLayer<Dtype>::CloseFile() {
+  HDF5Lock lock;
+  for (int i = 0; i < datasets_.size(); ++i) {
+    if (datasets_[i] >= 0) {
+      H5Dclose(datasets_[i]);
+    }
+  }
+  datasets_.clear();
+  if (file_id_ >= 0) {
+    herr_t status = H5Fclose(file_id_);
+    CHECK_GE(status, 0) << "Failed to close HDF5 file";
+    file_id_ = -1;
+  }
+}
+
+template <typename Dtype>
+void HDF5StreamDataLayer<Dtype>::ReadChunk() {
+  if (current_chunk_ == chunk_order_.size()) {
+    const int num_files = hdf_filenames_.size();
+    ++current_file_;
+    if (current_file_ == num_files) {
+      current_file_ = 0;
+      if (this->layer_param_.hdf5_data_param().shuffle()) {
+        caffe::rng_t* prefetch_rng =
+            static_cast<caffe::rng_t*>(prefetch_rng_->generator());
+        shuffle(file_permutation_.begin(), file_permutation_.end(),
+            prefetch_rng);
+      }
+      DLOG(INFO) << "Looping around to first file.";
+    }
+    CloseFile();
+    OpenFile();
+  }
+  const hsize_t chunk_rows = this->layer_param_.hdf5_data_param().chunk_rows();
+  const hsize_t start_row = chunk_order_[current_chunk_++] * chunk_rows;
+  chunk_size_ = std::min(chunk_rows, file_rows_ - start_row);
+  chunk_row_ = 0;
+  HDF5Lock lock;
+  for (int i = 0; i < datasets_.size(); ++i) {
+    // Select rows [start_row, start_row + chunk_size_) of the dataset.
+    hid_t file_space = H5Dget_space(datasets_[i]);
+    const int ndims = H5Sget_simple_extent_ndims(file_space);
+    vector<hsize_t> start(ndims, 0);
+    vector<hsize_t> count(ndims);
+    H5Sget_simple_extent_dims(file_space, count.data(), NULL);
+    start[0] = start_row;
+    count[0] = chunk_size_;
+    herr_t status = H5Sselect_hyperslab(file_space, H5S_SELECT_SET,
+        start.data(), NULL, count.data(), NULL);
+    CHECK_GE(status, 0) << "Failed to select rows of "
+        << this->layer_param_.top(i);
+    hid_t memory_space = H5Screate_simple(ndims, count.data(), NULL);
+    status = H5Dread(datasets_[i], HDF5NativeType<Dtype>(), memory_space,
+        file_space, H5P_DEFAULT, chunk_blobs_[i]->mutable_cpu_data());
+    CHECK_GE(status, 0) << "Failed to read rows of "
+        << this->layer_param_.top(i);
+    H5Sclose(memory_space);
+    H5Sclose(file_space);
+  }
+}
+
+template <typename Dtype>
+int HDF5StreamDataLayer<Dtype>::PrefetchRand(int n) {
+  caffe::rng_t* prefetch_rng =
+      static_cast<caffe::rng_t*>(prefetch_rng_->generator());
+  return (*prefetch_rng)() % n;
+}
+
+// This function is used to create a thread that prefetches the data.
+template <typename Dtype>
+void HDF5StreamDataLayer<Dtype>::InternalThreadEntry() {
+  const HDF5DataParameter& hdf5_data_param =
+      this->layer_param_.hdf5_data_param();
+  const int batch_size = hdf5_data_param.batch_size();
+  const int shuffle_buffer_rows = hdf5_data_param.shuffle_buffer_rows();
+  const int top_size = row_dims_.size();
+  for (int item_id = 0; item_id < batch_size; ++item_id) {
+    if (!hdf5_data_param.shuffle()) {
+      if (chunk_row_ == chunk_size_) {
+        ReadChunk();
+      }
+      for (int i = 0; i < top_size; ++i) {
+        caffe_copy(row_dims_[i],
+            chunk_blobs_[i]->cpu_data() + chunk_row_ * row_dims_[i],
+            prefetch_blobs_[i]->mutable_cpu_data() + item_id * row_dims_[i]);
+      }
+      ++chunk_row_;
+      continue;
+    }
+    // Top up the shuffle buffer, then output one of its rows at random and
+    // fill the hole with its last row.
+    while (shuffle_size_ < shuffle_buffer_rows) {
+      if (chunk_row_ == chunk_size_) {
+        ReadChunk();
+      }
+      for (int i = 0; i < top_size; ++i) {
+        caffe_copy(row_dims_[i],
+            chunk_blobs_[i]->cpu_data() + chunk_row_ * row_dims_[i],
+            shuffle_blobs_[i]->mutable_cpu_data()
+                + shuffle_size_ * row_dims_[i]);
+      }
+      ++chunk_row_;
+      ++shuffle_size_;
+    }
+    const int row = PrefetchRand(shuffle_size_);
+    --shuffle_size_;
+    for (int i = 0; i < top_size; ++i) {
+      Dtype* buffer = shuffle_blobs_[i]->mutable_cpu_data();
+      caffe_copy(row_dims_[i], buffer + row * row_dims_[i],
+          prefetch_blobs_[i]->mutable_cpu_data() + item_id * row_dims_[i]);
+      if (row != shuffle_size_) {
+        caffe_copy(row_dims_[i], buffer + shuffle_size_ * row_dims_[i],
+            buffer + row * row_dims_[i]);
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void HDF5StreamDataLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  CHECK(WaitForInternalThreadToExit()) << "Thread joining failed";
+  for (int i = 0; i < top.size(); ++i) {
+    caffe_copy(prefetch_blobs_[i]->count(), prefetch_blobs_[i]->cpu_data(),
+        top[i]->mutable_cpu_data());
+  }
+  CHECK(StartInternalThread()) << "Thread execution failed";
+}
+
+INSTANTIATE_CLASS(HDF5StreamDataLayer);
+REGISTER_LAYER_CLASS(HDF5StreamData);
+
+}  // namespace caffe
@@ -2,6 +2,7 @@
 
 #include <fstream>  // NOLINT(readability/streams)
 #include <iostream>  // NOLINT(readability/streams)
+#include <sstream>
 #include <string>
 #include <utility>
 #include <vector>
@@ -9,12 +10,48 @@
 #include "caffe/data_layers.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/util/benchmark.hpp"
+#include "caffe/util/image_disk_cache.hpp"
 #include "caffe/util/io.hpp"
 #include "caffe/util/math_functions.hpp"
 #include "caffe/util/rng.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
+namespace {
+
+// ThreadPool task loading the i-th image of a batch, and augmenting it with
+// its own random stream if the transformer asks for it.
+template <typename Dtype>
+class BatchImageLoader {
+ public:
+  typedef void (ImageDataLayer<Dtype>::*LoadFn)(const string&, cv::Mat*);
+  BatchImageLoader(ImageDataLayer<Dtype>* layer, LoadFn load,
+      const DataTransformer<Dtype>* transformer,
+      const vector<string>& filenames, const vector<unsigned int>& seeds,
+      vector<cv::Mat>* images)
+      : layer_(layer), load_(load), transformer_(transformer),
+        filenames_(filenames), seeds_(seeds), images_(images) {}
+  void operator()(int i) const {
+    cv::Mat* image = &(*images_)[i];
+    (layer_->*load_)(filenames_[i], image);
+    if (transformer_ && image->data) {
+      Caffe::RNG rng(seeds_[i]);
+      transformer_->Augment(*image, &rng, image);
+    }
+  }
+
+ private:
+  ImageDataLayer<Dtype>* layer_;
+  LoadFn load_;
+  const DataTransformer<Dtype>* transformer_;
+  const vector<string>& filenames_;
+  const vector<unsigned int>& seeds_;
+  vector<cv::Mat>* images_;
+};
+
+}  // namespace
+
 template <typename Dtype>
 ImageDataLayer<Dtype>::~ImageDataLayer<Dtype>() {
   this->JoinPrefetchThread();
@@ -25,12 +62,20 @@ void ImageDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   const int new_height = this->layer_param_.image_data_param().new_height();
   const int new_width  = this->layer_param_.image_data_param().new_width();
-  const bool is_color  = this->layer_param_.image_data_param().is_color();
-  string root_folder = this->layer_param_.image_data_param().root_folder();
-
   CHECK((new_height == 0 && new_width == 0) ||
       (new_height > 0 && new_width > 0)) << "Current implementation requires "
       "new_height and new_width to be set at the same time.";
+  const string& cache_dir = this->layer_param_.image_data_param().cache_dir();
+  if (!cache_dir.empty()) {
+    LOG(INFO) << "Caching decoded images in " << cache_dir;
+    disk_cache_.reset(new ImageDiskCache(cache_dir));
+  } else {
+    disk_cache_.reset();
+  }
+  thread_pool_.reset(
+      new ThreadPool(this->layer_param_.image_data_param().num_threads()));
+  LOG(INFO) << "Loading images with " << thread_pool_->num_threads()
+      << " threads";
   // Read the file with filenames and labels
   const string& source = this->layer_param_.image_data_param().source();
   LOG(INFO) << "Opening file " << source;
@@ -60,9 +105,14 @@ void ImageDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
     lines_id_ = skip;
   }
   // Read an image, and use it to initialize the top blob.
-  cv::Mat cv_img = ReadImageToCVMat(root_folder + lines_[lines_id_].first,
-                                    new_height, new_width, is_color);
-  const int channels = cv_img.channels();
+  cv::Mat cv_img;
+  LoadImage(lines_[lines_id_].first, &cv_img);
+  CHECK(cv_img.data) << "Could not load " << lines_[lines_id_].first;
+  int channels = cv_img.channels();
+  if (channels == 4 && this->transform_param_.has_background_source()) {
+    // Images with an alpha channel are composited over a background.
+    channels = 3;
+  }
   const int height = cv_img.rows;
   const int width = cv_img.cols;
   // image
@@ -93,6 +143,38 @@ void ImageDataLayer<Dtype>::ShuffleImages() {
   shuffle(lines_.begin(), lines_.end(), prefetch_rng);
 }
 
+template <typename Dtype>
+void ImageDataLayer<Dtype>::LoadImage(const string& filename,
+    cv::Mat* cv_img) {
+  const ImageDataParameter& image_data_param =
+      this->layer_param_.image_data_param();
+  const int new_height = image_data_param.new_height();
+  const int new_width = image_data_param.new_width();
+  const bool is_color = image_data_param.is_color();
+  // Keep the alpha channel of images that get composited over a background.
+  const bool with_alpha =
+      is_color && this->transform_param_.has_background_source();
+  const string path = image_data_param.root_folder() + filename;
+  string key;
+  if (disk_cache_) {
+    std::ostringstream key_stream;
+    key_stream << path << ":" << new_height << "x" << new_width
+        << (with_alpha ? ":alpha" : (is_color ? ":color" : ":gray"));
+    key = key_stream.str();
+    if (disk_cache_->Read(key, cv_img)) {
+      return;
+    }
+  }
+  if (with_alpha) {
+    *cv_img = ReadImageToCVMatWithAlpha(path, new_height, new_width);
+  } else {
+    *cv_img = ReadImageToCVMat(path, new_height, new_width, is_color);
+  }
+  if (disk_cache_ && cv_img->data) {
+    disk_cache_->Write(key, *cv_img);
+  }
+}
+
 // This function is used to create a thread that prefetches the data.
 template <typename Dtype>
 void ImageDataLayer<Dtype>::InternalThreadEntry() {
@@ -108,40 +190,21 @@ void ImageDataLayer<Dtype>::InternalThreadEntry() {
   const int new_height = image_data_param.new_height();
   const int new_width = image_data_param.new_width();
   const int crop_size = this->layer_param_.transform_param().crop_size();
-  const bool is_color = image_data_param.is_color();
-  string root_folder = image_data_param.root_folder();
 
-  // Reshape on single input batches for inputs of varying dimension.
-  if (batch_size == 1 && crop_size == 0 && new_height == 0 && new_width == 0) {
-    cv::Mat cv_img = ReadImageToCVMat(root_folder + lines_[lines_id_].first,
-        0, 0, is_color);
-    this->prefetch_data_.Reshape(1, cv_img.channels(),
-        cv_img.rows, cv_img.cols);
-    this->transformed_data_.Reshape(1, cv_img.channels(),
-        cv_img.rows, cv_img.cols);
-  }
-
-  Dtype* prefetch_data = this->prefetch_data_.mutable_cpu_data();
-  Dtype* prefetch_label = this->prefetch_label_.mutable_cpu_data();
-
-  // datum scales
+  // Pick the files of the batch and the seeds of their augmentation, then
+  // load and augment them in parallel.
+  const bool augment = this->data_transformer_->needs_augmentation();
+  vector<string> filenames(batch_size);
+  vector<int> labels(batch_size);
+  vector<unsigned int> seeds(augment ? batch_size : 0);
   const int lines_size = lines_.size();
   for (int item_id = 0; item_id < batch_size; ++item_id) {
-    // get a blob
-    timer.Start();
     CHECK_GT(lines_size, lines_id_);
-    cv::Mat cv_img = ReadImageToCVMat(root_folder + lines_[lines_id_].first,
-        new_height, new_width, is_color);
-    CHECK(cv_img.data) << "Could not load " << lines_[lines_id_].first;
-    read_time += timer.MicroSeconds();
-    timer.Start();
-    // Apply transformations (mirror, crop...) to the image
-    int offset = this->prefetch_data_.offset(item_id);
-    this->transformed_data_.set_cpu_data(prefetch_data + offset);
-    this->data_transformer_->Transform(cv_img, &(this->transformed_data_));
-    trans_time += timer.MicroSeconds();
-
-    prefetch_label[item_id] = lines_[lines_id_].second;
+    filenames[item_id] = lines_[lines_id_].first;
+    labels[item_id] = lines_[lines_id_].second;
+    if (augment) {
+      seeds[item_id] = this->data_transformer_->RandSeed();
+    }
     // go to the next iter
     lines_id_++;
     if (lines_id_ >= lines_size) {
@@ -153,6 +216,38 @@ void ImageDataLayer<Dtype>::InternalThreadEntry() {
       }
     }
   }
+  timer.Start();
+  vector<cv::Mat> cv_imgs(batch_size);
+  thread_pool_->Run(batch_size, BatchImageLoader<Dtype>(this,
+      &ImageDataLayer<Dtype>::LoadImage,
+      augment ? this->data_transformer_.get() : NULL, filenames, seeds,
+      &cv_imgs));
+  read_time += timer.MicroSeconds();
+  for (int item_id = 0; item_id < batch_size; ++item_id) {
+    CHECK(cv_imgs[item_id].data) << "Could not load " << filenames[item_id];
+  }
+
+  // Reshape on single input batches for inputs of varying dimension.
+  if (batch_size == 1 && crop_size == 0 && new_height == 0 && new_width == 0) {
+    this->prefetch_data_.Reshape(1, cv_imgs[0].channels(),
+        cv_imgs[0].rows, cv_imgs[0].cols);
+    this->transformed_data_.Reshape(1, cv_imgs[0].channels(),
+        cv_imgs[0].rows, cv_imgs[0].cols);
+  }
+
+  Dtype* prefetch_data = this->prefetch_data_.mutable_cpu_data();
+  Dtype* prefetch_label = this->prefetch_label_.mutable_cpu_data();
+  for (int item_id = 0; item_id < batch_size; ++item_id) {
+    timer.Start();
+    // Apply transformations (mirror, crop...) to the image
+    int offset = this->prefetch_data_.offset(item_id);
+    this->transformed_data_.set_cpu_data(prefetch_data + offset);
+    this->data_transformer_->Transform(cv_imgs[item_id],
+        &(this->transformed_data_));
+    trans_time += timer.MicroSeconds();
+
+    prefetch_label[item_id] = labels[item_id];
+  }
   batch_timer.Stop();
   DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
   DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
@@ -3,6 +3,7 @@
 
 #include "caffe/filler.hpp"
 #include "caffe/layer.hpp"
+#include "caffe/util/vector_math.hpp"
 #include "caffe/vision_layers.hpp"
 
 namespace caffe {
@@ -79,10 +80,10 @@ void PReLULayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   // if channel_shared, channel index in the following computation becomes
   // always zero.
   const int div_factor = channel_shared_ ? channels : 1;
-  for (int i = 0; i < count; ++i) {
-    int c = (i / dim) % channels / div_factor;
-    top_data[i] = std::max(bottom_data[i], Dtype(0))
-        + slope_data[c] * std::min(bottom_data[i], Dtype(0));
+  for (int offset = 0, c = 0; offset < count; offset += dim) {
+    caffe_cpu_relu(dim, bottom_data + offset, slope_data[c / div_factor],
+        top_data + offset);
+    c = (c + 1) % channels;
   }
 }
 
@@ -113,18 +114,22 @@ void PReLULayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   if (this->param_propagate_down_[0]) {
     Dtype* slope_diff = this->blobs_[0]->mutable_cpu_diff();
     caffe_set(this->blobs_[0]->count(), Dtype(0), slope_diff);
-    for (int i = 0; i < count; ++i) {
-      int c = (i / dim) % channels / div_factor;
-      slope_diff[c] += top_diff[i] * bottom_data[i] * (bottom_data[i] <= 0);
+    for (int offset = 0, c = 0; offset < count; offset += dim) {
+      Dtype channel_diff = 0;
+      for (int i = offset; i < offset + dim; ++i) {
+        channel_diff += top_diff[i] * bottom_data[i] * (bottom_data[i] <= 0);
+      }
+      slope_diff[c / div_factor] += channel_diff;
+      c = (c + 1) % channels;
     }
   }
   // Propagate to bottom
   if (propagate_down[0]) {
     Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-    for (int i = 0; i < count; ++i) {
-      int c = (i / dim) % channels / div_factor;
-      bottom_diff[i] = top_diff[i] * ((bottom_data[i] > 0)
-          + slope_data[c] * (bottom_data[i] <= 0));
+    for (int offset = 0, c = 0; offset < count; offset += dim) {
+      caffe_cpu_relu_backward(dim, bottom_data + offset, top_diff + offset,
+          slope_data[c / div_factor], bottom_diff + offset);
+      c = (c + 1) % channels;
     }
   }
 }
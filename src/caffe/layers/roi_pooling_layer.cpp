@@ -0,0 +1,156 @@
+#include <boost/bind.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <vector>
+
+#include "caffe/layer.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
+#include "caffe/vision_layers.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void ROIPoolingLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  const ROIPoolingParameter& roi_pool_param =
+      this->layer_param_.roi_pooling_param();
+  CHECK_GT(roi_pool_param.pooled_h(), 0) << "pooled_h must be > 0";
+  CHECK_GT(roi_pool_param.pooled_w(), 0) << "pooled_w must be > 0";
+  CHECK_GT(roi_pool_param.spatial_scale(), 0) << "spatial_scale must be > 0";
+  pooled_height_ = roi_pool_param.pooled_h();
+  pooled_width_ = roi_pool_param.pooled_w();
+  spatial_scale_ = roi_pool_param.spatial_scale();
+  thread_pool_.reset(new ThreadPool(roi_pool_param.num_threads()));
+}
+
+template <typename Dtype>
+void ROIPoolingLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  CHECK_EQ(4, bottom[0]->num_axes()) << "Input must have 4 axes, "
+      << "corresponding to (num, channels, height, width)";
+  CHECK_EQ(2, bottom[1]->num_axes()) << "ROIs must have 2 axes, "
+      << "corresponding to (num_rois, 5)";
+  CHECK_EQ(5, bottom[1]->shape(1))
+      << "Each ROI must be (batch index, x1, y1, x2, y2)";
+  channels_ = bottom[0]->channels();
+  height_ = bottom[0]->height();
+  width_ = bottom[0]->width();
+  top[0]->Reshape(bottom[1]->num(), channels_, pooled_height_,
+      pooled_width_);
+  max_idx_.Reshape(bottom[1]->num(), channels_, pooled_height_,
+      pooled_width_);
+}
+
+template <typename Dtype>
+void ROIPoolingLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  // The tasks take the data synced to the CPU here, not concurrently.
+  thread_pool_->Run(bottom[1]->num(), boost::bind(
+      &ROIPoolingLayer<Dtype>::ForwardROI, this, bottom[0]->cpu_data(),
+      bottom[0]->num(), bottom[1]->cpu_data(), top[0]->mutable_cpu_data(),
+      max_idx_.mutable_cpu_data(), _1));
+}
+
+template <typename Dtype>
+void ROIPoolingLayer<Dtype>::ForwardROI(const Dtype* bottom_data, int num,
+      const Dtype* rois, Dtype* top_data, int* argmax_data, int r) {
+  const Dtype* roi = rois + r * 5;
+  const int n = static_cast<int>(roi[0]);
+  CHECK_GE(n, 0);
+  CHECK_LT(n, num);
+  const int roi_start_w = round(roi[1] * spatial_scale_);
+  const int roi_start_h = round(roi[2] * spatial_scale_);
+  const int roi_end_w = round(roi[3] * spatial_scale_);
+  const int roi_end_h = round(roi[4] * spatial_scale_);
+  // Malformed ROIs are forced to be 1 x 1.
+  const int roi_height = std::max(roi_end_h - roi_start_h + 1, 1);
+  const int roi_width = std::max(roi_end_w - roi_start_w + 1, 1);
+  const Dtype bin_size_h = static_cast<Dtype>(roi_height) / pooled_height_;
+  const Dtype bin_size_w = static_cast<Dtype>(roi_width) / pooled_width_;
+
+  bottom_data += n * channels_ * height_ * width_;
+  top_data += r * channels_ * pooled_height_ * pooled_width_;
+  argmax_data += r * channels_ * pooled_height_ * pooled_width_;
+  for (int c = 0; c < channels_; ++c) {
+    for (int ph = 0; ph < pooled_height_; ++ph) {
+      // The bins tile the ROI, rounded outwards, and clipped to the map.
+      int hstart = static_cast<int>(floor(ph * bin_size_h));
+      int hend = static_cast<int>(ceil((ph + 1) * bin_size_h));
+      hstart = std::min(std::max(hstart + roi_start_h, 0), height_);
+      hend = std::min(std::max(hend + roi_start_h, 0), height_);
+      for (int pw = 0; pw < pooled_width_; ++pw) {
+        int wstart = static_cast<int>(floor(pw * bin_size_w));
+        int wend = static_cast<int>(ceil((pw + 1) * bin_size_w));
+        wstart = std::min(std::max(wstart + roi_start_w, 0), width_);
+        wend = std::min(std::max(wend + roi_start_w, 0), width_);
+        const int pool_index = ph * pooled_width_ + pw;
+        if (hend <= hstart || wend <= wstart) {
+          top_data[pool_index] = 0;
+          argmax_data[pool_index] = -1;
+          continue;
+        }
+        Dtype maxval = -FLT_MAX;
+        int maxidx = -1;
+        for (int h = hstart; h < hend; ++h) {
+          for (int w = wstart; w < wend; ++w) {
+            const int index = h * width_ + w;
+            if (bottom_data[index] > maxval) {
+              maxval = bottom_data[index];
+              maxidx = index;
+            }
+          }
+        }
+        top_data[pool_index] = maxval;
+        argmax_data[pool_index] = maxidx;
+      }
+    }
+    bottom_data += height_ * width_;
+    top_data += pooled_height_ * pooled_width_;
+    argmax_data += pooled_height_ * pooled_width_;
+  }
+}
+
+template <typename Dtype>
+void ROIPoolingLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  if (propagate_down[1]) {
+    LOG(FATAL) << this->type()
+               << " Layer cannot backpropagate to ROI inputs.";
+  }
+  if (!propagate_down[0]) {
+    return;
+  }
+  Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
+  if (!this->accumulate_bottom_diff(0)) {
+    caffe_set(bottom[0]->count(), Dtype(0), bottom_diff);
+  }
+  thread_pool_->Run(channels_, boost::bind(
+      &ROIPoolingLayer<Dtype>::BackwardChannel, this, top[0]->cpu_diff(),
+      max_idx_.cpu_data(), bottom[1]->cpu_data(), bottom[1]->num(),
+      bottom_diff, _1));
+}
+
+template <typename Dtype>
+void ROIPoolingLayer<Dtype>::BackwardChannel(const Dtype* top_diff,
+      const int* argmax_data, const Dtype* rois, int num_rois,
+      Dtype* bottom_diff, int c) {
+  const int pooled_dim = pooled_height_ * pooled_width_;
+  for (int r = 0; r < num_rois; ++r) {
+    const int n = static_cast<int>(rois[r * 5]);
+    const int top_offset = (r * channels_ + c) * pooled_dim;
+    Dtype* channel_diff = bottom_diff + (n * channels_ + c) * height_ * width_;
+    for (int i = top_offset; i < top_offset + pooled_dim; ++i) {
+      if (argmax_data[i] >= 0) {
+        channel_diff[argmax_data[i]] += top_diff[i];
+      }
+    }
+  }
+}
+
+INSTANTIATE_CLASS(ROIPoolingLayer);
+REGISTER_LAYER_CLASS(ROIPooling);
+
+}  // namespace caffe
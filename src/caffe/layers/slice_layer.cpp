@@ -67,6 +67,13 @@ void SliceLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
     }
   }
   CHECK_EQ(count, bottom[0]->count());
+  if (slice_param.share_memory()) {
+    if (num_slices_ == 1) {
+      top_views_.Share(top, bottom[0], false);
+    } else {
+      top_views_.Unshare(false);
+    }
+  }
 }
 
 template <typename Dtype>
@@ -75,6 +82,7 @@ void SliceLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   int offset_slice_axis = 0;
   const Dtype* bottom_data = bottom[0]->cpu_data();
   const int bottom_slice_axis = bottom[0]->shape(slice_axis_);
+  // caffe_copy skips the tops that are views of the bottom already.
   for (int i = 0; i < top.size(); ++i) {
     Dtype* top_data = top[i]->mutable_cpu_data();
     const int top_slice_axis = top[i]->shape(slice_axis_);
@@ -15,9 +15,11 @@
 #include "caffe/data_layers.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/util/benchmark.hpp"
+#include "caffe/util/image_cache.hpp"
 #include "caffe/util/io.hpp"
 #include "caffe/util/math_functions.hpp"
 #include "caffe/util/rng.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 // caffe.proto > LayerParameter > WindowDataParameter
 //   'source' field specifies the window_file
@@ -25,6 +27,70 @@
 
 namespace caffe {
 
+namespace {
+
+// ThreadPool task decoding the i-th distinct image of a batch.
+template <typename Dtype>
+class BatchImageLoader {
+ public:
+  typedef void (WindowDataLayer<Dtype>::*LoadFn)(int, cv::Mat*);
+  BatchImageLoader(WindowDataLayer<Dtype>* layer, LoadFn load,
+      const vector<int>& image_indices, vector<cv::Mat>* images)
+      : layer_(layer), load_(load), image_indices_(image_indices),
+        images_(images) {}
+  void operator()(int i) const {
+    (layer_->*load_)(image_indices_[i], &(*images_)[i]);
+  }
+
+ private:
+  WindowDataLayer<Dtype>* layer_;
+  LoadFn load_;
+  const vector<int>& image_indices_;
+  vector<cv::Mat>* images_;
+};
+
+// ThreadPool task cropping and warping the i-th window of a batch into its
+// slot of the prefetch blob. When mirroring, every window draws its random
+// numbers from its own stream, seeded serially by the prefetch thread, so a
+// batch depends on the layer seed only and not on how its windows are spread
+// over threads. Without mirroring there are no seeds, and no stream.
+template <typename Dtype>
+class BatchWindowWarper {
+ public:
+  typedef void (WindowDataLayer<Dtype>::*WarpFn)(const cv::Mat&,
+      const vector<float>&, Caffe::RNG*, Dtype*);
+  BatchWindowWarper(WindowDataLayer<Dtype>* layer, WarpFn warp,
+      const vector<cv::Mat>& images,
+      const vector<const vector<float>*>& windows,
+      const vector<int>& window_slots, const vector<unsigned int>& seeds,
+      Dtype* top_data, int item_size)
+      : layer_(layer), warp_(warp), images_(images), windows_(windows),
+        window_slots_(window_slots), seeds_(seeds), top_data_(top_data),
+        item_size_(item_size) {}
+  void operator()(int i) const {
+    if (seeds_.empty()) {
+      (layer_->*warp_)(images_[window_slots_[i]], *windows_[i], NULL,
+          top_data_ + i * item_size_);
+      return;
+    }
+    Caffe::RNG rng(seeds_[i]);
+    (layer_->*warp_)(images_[window_slots_[i]], *windows_[i], &rng,
+        top_data_ + i * item_size_);
+  }
+
+ private:
+  WindowDataLayer<Dtype>* layer_;
+  WarpFn warp_;
+  const vector<cv::Mat>& images_;
+  const vector<const vector<float>*>& windows_;
+  const vector<int>& window_slots_;
+  const vector<unsigned int>& seeds_;
+  Dtype* top_data_;
+  int item_size_;
+};
+
+}  // namespace
+
 template <typename Dtype>
 WindowDataLayer<Dtype>::~WindowDataLayer<Dtype>() {
   this->JoinPrefetchThread();
@@ -57,11 +123,24 @@ void WindowDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
       << this->layer_param_.window_data_param().fg_fraction() << std::endl
       << "  cache_images: "
       << this->layer_param_.window_data_param().cache_images() << std::endl
+      << "  decoded_cache_mb: "
+      << this->layer_param_.window_data_param().decoded_cache_mb() << std::endl
       << "  root_folder: "
       << this->layer_param_.window_data_param().root_folder();
 
   cache_images_ = this->layer_param_.window_data_param().cache_images();
   string root_folder = this->layer_param_.window_data_param().root_folder();
+  const size_t decoded_cache_mb =
+      this->layer_param_.window_data_param().decoded_cache_mb();
+  if (decoded_cache_mb > 0) {
+    image_cache_.reset(new ImageCache(decoded_cache_mb << 20));
+  } else {
+    image_cache_.reset();
+  }
+  thread_pool_.reset(
+      new ThreadPool(this->layer_param_.window_data_param().num_threads()));
+  LOG(INFO) << "Preparing batches with " << thread_pool_->num_threads()
+      << " threads";
 
   const bool prefetch_needs_rand =
       this->transform_param_.mirror() ||
@@ -217,31 +296,38 @@ unsigned int WindowDataLayer<Dtype>::PrefetchRand() {
   return (*prefetch_rng)();
 }
 
-// Thread fetching the data
 template <typename Dtype>
-void WindowDataLayer<Dtype>::InternalThreadEntry() {
-  // At each iteration, sample N windows where N*p are foreground (object)
-  // windows and N*(1-p) are background (non-object) windows
-  CPUTimer batch_timer;
-  batch_timer.Start();
-  double read_time = 0;
-  double trans_time = 0;
-  CPUTimer timer;
-  Dtype* top_data = this->prefetch_data_.mutable_cpu_data();
-  Dtype* top_label = this->prefetch_label_.mutable_cpu_data();
+void WindowDataLayer<Dtype>::LoadImage(int image_index, cv::Mat* cv_img) {
+  const string& image_path = image_database_[image_index].first;
+  if (image_cache_ && image_cache_->Get(image_path, cv_img)) {
+    return;
+  }
+  if (this->cache_images_) {
+    *cv_img = DecodeDatumToCVMat(image_database_cache_[image_index].second,
+        true);
+  } else {
+    *cv_img = cv::imread(image_path, CV_LOAD_IMAGE_COLOR);
+  }
+  if (image_cache_ && cv_img->data) {
+    image_cache_->Put(image_path, *cv_img);
+  }
+}
+
+template <typename Dtype>
+void WindowDataLayer<Dtype>::WarpWindow(const cv::Mat& cv_img,
+    const vector<float>& window, Caffe::RNG* rng, Dtype* top_data) {
   const Dtype scale = this->layer_param_.window_data_param().scale();
-  const int batch_size = this->layer_param_.window_data_param().batch_size();
   const int context_pad = this->layer_param_.window_data_param().context_pad();
   const int crop_size = this->transform_param_.crop_size();
   const bool mirror = this->transform_param_.mirror();
-  const float fg_fraction =
-      this->layer_param_.window_data_param().fg_fraction();
-  Dtype* mean = NULL;
+  // data_mean_ was filled on the CPU at setup, so reading it from several
+  // workers does not touch its synced memory state.
+  const Dtype* mean = NULL;
   int mean_off = 0;
   int mean_width = 0;
   int mean_height = 0;
   if (this->has_mean_file_) {
-    mean = this->data_mean_.mutable_cpu_data();
+    mean = this->data_mean_.cpu_data();
     mean_off = (this->data_mean_.width() - crop_size) / 2;
     mean_width = this->data_mean_.width();
     mean_height = this->data_mean_.height();
@@ -251,213 +337,260 @@ void WindowDataLayer<Dtype>::InternalThreadEntry() {
 
   bool use_square = (crop_mode == "square") ? true : false;
 
-  // zero out batch
-  caffe_set(this->prefetch_data_.count(), Dtype(0), top_data);
+  bool do_mirror = false;
+  if (mirror) {
+    CHECK(rng);
+    caffe::rng_t* window_rng = static_cast<caffe::rng_t*>(rng->generator());
+    do_mirror = (*window_rng)() % 2;
+  }
 
-  const int num_fg = static_cast<int>(static_cast<float>(batch_size)
-      * fg_fraction);
-  const int num_samples[2] = { batch_size - num_fg, num_fg };
+  const int channels = cv_img.channels();
+
+  // crop window out of image and warp it
+  int x1 = window[WindowDataLayer<Dtype>::X1];
+  int y1 = window[WindowDataLayer<Dtype>::Y1];
+  int x2 = window[WindowDataLayer<Dtype>::X2];
+  int y2 = window[WindowDataLayer<Dtype>::Y2];
+
+  int pad_w = 0;
+  int pad_h = 0;
+  if (context_pad > 0 || use_square) {
+    // scale factor by which to expand the original region
+    // such that after warping the expanded region to crop_size x crop_size
+    // there's exactly context_pad amount of padding on each side
+    Dtype context_scale = static_cast<Dtype>(crop_size) /
+        static_cast<Dtype>(crop_size - 2*context_pad);
+
+    // compute the expanded region
+    Dtype half_height = static_cast<Dtype>(y2-y1+1)/2.0;
+    Dtype half_width = static_cast<Dtype>(x2-x1+1)/2.0;
+    Dtype center_x = static_cast<Dtype>(x1) + half_width;
+    Dtype center_y = static_cast<Dtype>(y1) + half_height;
+    if (use_square) {
+      if (half_height > half_width) {
+        half_width = half_height;
+      } else {
+        half_height = half_width;
+      }
+    }
+    x1 = static_cast<int>(round(center_x - half_width*context_scale));
+    x2 = static_cast<int>(round(center_x + half_width*context_scale));
+    y1 = static_cast<int>(round(center_y - half_height*context_scale));
+    y2 = static_cast<int>(round(center_y + half_height*context_scale));
+
+    // the expanded region may go outside of the image
+    // so we compute the clipped (expanded) region and keep track of
+    // the extent beyond the image
+    int unclipped_height = y2-y1+1;
+    int unclipped_width = x2-x1+1;
+    int pad_x1 = std::max(0, -x1);
+    int pad_y1 = std::max(0, -y1);
+    int pad_x2 = std::max(0, x2 - cv_img.cols + 1);
+    int pad_y2 = std::max(0, y2 - cv_img.rows + 1);
+    // clip bounds
+    x1 = x1 + pad_x1;
+    x2 = x2 - pad_x2;
+    y1 = y1 + pad_y1;
+    y2 = y2 - pad_y2;
+    CHECK_GT(x1, -1);
+    CHECK_GT(y1, -1);
+    CHECK_LT(x2, cv_img.cols);
+    CHECK_LT(y2, cv_img.rows);
+
+    int clipped_height = y2-y1+1;
+    int clipped_width = x2-x1+1;
+
+    // scale factors that would be used to warp the unclipped
+    // expanded region
+    Dtype scale_x =
+        static_cast<Dtype>(crop_size)/static_cast<Dtype>(unclipped_width);
+    Dtype scale_y =
+        static_cast<Dtype>(crop_size)/static_cast<Dtype>(unclipped_height);
+
+    // size to warp the clipped expanded region to
+    cv_crop_size.width =
+        static_cast<int>(round(static_cast<Dtype>(clipped_width)*scale_x));
+    cv_crop_size.height =
+        static_cast<int>(round(static_cast<Dtype>(clipped_height)*scale_y));
+    pad_x1 = static_cast<int>(round(static_cast<Dtype>(pad_x1)*scale_x));
+    pad_x2 = static_cast<int>(round(static_cast<Dtype>(pad_x2)*scale_x));
+    pad_y1 = static_cast<int>(round(static_cast<Dtype>(pad_y1)*scale_y));
+    pad_y2 = static_cast<int>(round(static_cast<Dtype>(pad_y2)*scale_y));
+
+    pad_h = pad_y1;
+    // if we're mirroring, we mirror the padding too (to be pedantic)
+    if (do_mirror) {
+      pad_w = pad_x2;
+    } else {
+      pad_w = pad_x1;
+    }
 
-  int item_id = 0;
-  // sample from bg set then fg set
-  for (int is_fg = 0; is_fg < 2; ++is_fg) {
-    for (int dummy = 0; dummy < num_samples[is_fg]; ++dummy) {
-      // sample a window
-      timer.Start();
-      const unsigned int rand_index = PrefetchRand();
-      vector<float> window = (is_fg) ?
-          fg_windows_[rand_index % fg_windows_.size()] :
-          bg_windows_[rand_index % bg_windows_.size()];
+    // ensure that the warped, clipped region plus the padding fits in the
+    // crop_size x crop_size image (it might not due to rounding)
+    if (pad_h + cv_crop_size.height > crop_size) {
+      cv_crop_size.height = crop_size - pad_h;
+    }
+    if (pad_w + cv_crop_size.width > crop_size) {
+      cv_crop_size.width = crop_size - pad_w;
+    }
+  }
 
-      bool do_mirror = mirror && PrefetchRand() % 2;
+  cv::Rect roi(x1, y1, x2-x1+1, y2-y1+1);
+  cv::Mat cv_cropped_img = cv_img(roi);
+  cv::resize(cv_cropped_img, cv_cropped_img,
+      cv_crop_size, 0, 0, cv::INTER_LINEAR);
 
-      // load the image containing the window
-      pair<std::string, vector<int> > image =
-          image_database_[window[WindowDataLayer<Dtype>::IMAGE_INDEX]];
+  // horizontal flip at random
+  if (do_mirror) {
+    cv::flip(cv_cropped_img, cv_cropped_img, 1);
+  }
 
-      cv::Mat cv_img;
-      if (this->cache_images_) {
-        pair<std::string, Datum> image_cached =
-          image_database_cache_[window[WindowDataLayer<Dtype>::IMAGE_INDEX]];
-        cv_img = DecodeDatumToCVMat(image_cached.second, true);
-      } else {
-        cv_img = cv::imread(image.first, CV_LOAD_IMAGE_COLOR);
-        if (!cv_img.data) {
-          LOG(ERROR) << "Could not open or find file " << image.first;
-          return;
-        }
-      }
-      read_time += timer.MicroSeconds();
-      timer.Start();
-      const int channels = cv_img.channels();
-
-      // crop window out of image and warp it
-      int x1 = window[WindowDataLayer<Dtype>::X1];
-      int y1 = window[WindowDataLayer<Dtype>::Y1];
-      int x2 = window[WindowDataLayer<Dtype>::X2];
-      int y2 = window[WindowDataLayer<Dtype>::Y2];
-
-      int pad_w = 0;
-      int pad_h = 0;
-      if (context_pad > 0 || use_square) {
-        // scale factor by which to expand the original region
-        // such that after warping the expanded region to crop_size x crop_size
-        // there's exactly context_pad amount of padding on each side
-        Dtype context_scale = static_cast<Dtype>(crop_size) /
-            static_cast<Dtype>(crop_size - 2*context_pad);
-
-        // compute the expanded region
-        Dtype half_height = static_cast<Dtype>(y2-y1+1)/2.0;
-        Dtype half_width = static_cast<Dtype>(x2-x1+1)/2.0;
-        Dtype center_x = static_cast<Dtype>(x1) + half_width;
-        Dtype center_y = static_cast<Dtype>(y1) + half_height;
-        if (use_square) {
-          if (half_height > half_width) {
-            half_width = half_height;
+  // copy the warped window into top_data
+  for (int h = 0; h < cv_cropped_img.rows; ++h) {
+    const uchar* ptr = cv_cropped_img.ptr<uchar>(h);
+    int img_index = 0;
+    for (int w = 0; w < cv_cropped_img.cols; ++w) {
+      for (int c = 0; c < channels; ++c) {
+        int top_index = (c * crop_size + h + pad_h) * crop_size + w + pad_w;
+        // int top_index = (c * height + h) * width + w;
+        Dtype pixel = static_cast<Dtype>(ptr[img_index++]);
+        if (this->has_mean_file_) {
+          int mean_index = (c * mean_height + h + mean_off + pad_h)
+                       * mean_width + w + mean_off + pad_w;
+          top_data[top_index] = (pixel - mean[mean_index]) * scale;
+        } else {
+          if (this->has_mean_values_) {
+            top_data[top_index] = (pixel - this->mean_values_[c]) * scale;
           } else {
-            half_height = half_width;
+            top_data[top_index] = pixel * scale;
           }
         }
-        x1 = static_cast<int>(round(center_x - half_width*context_scale));
-        x2 = static_cast<int>(round(center_x + half_width*context_scale));
-        y1 = static_cast<int>(round(center_y - half_height*context_scale));
-        y2 = static_cast<int>(round(center_y + half_height*context_scale));
-
-        // the expanded region may go outside of the image
-        // so we compute the clipped (expanded) region and keep track of
-        // the extent beyond the image
-        int unclipped_height = y2-y1+1;
-        int unclipped_width = x2-x1+1;
-        int pad_x1 = std::max(0, -x1);
-        int pad_y1 = std::max(0, -y1);
-        int pad_x2 = std::max(0, x2 - cv_img.cols + 1);
-        int pad_y2 = std::max(0, y2 - cv_img.rows + 1);
-        // clip bounds
-        x1 = x1 + pad_x1;
-        x2 = x2 - pad_x2;
-        y1 = y1 + pad_y1;
-        y2 = y2 - pad_y2;
-        CHECK_GT(x1, -1);
-        CHECK_GT(y1, -1);
-        CHECK_LT(x2, cv_img.cols);
-        CHECK_LT(y2, cv_img.rows);
-
-        int clipped_height = y2-y1+1;
-        int clipped_width = x2-x1+1;
-
-        // scale factors that would be used to warp the unclipped
-        // expanded region
-        Dtype scale_x =
-            static_cast<Dtype>(crop_size)/static_cast<Dtype>(unclipped_width);
-        Dtype scale_y =
-            static_cast<Dtype>(crop_size)/static_cast<Dtype>(unclipped_height);
-
-        // size to warp the clipped expanded region to
-        cv_crop_size.width =
-            static_cast<int>(round(static_cast<Dtype>(clipped_width)*scale_x));
-        cv_crop_size.height =
-            static_cast<int>(round(static_cast<Dtype>(clipped_height)*scale_y));
-        pad_x1 = static_cast<int>(round(static_cast<Dtype>(pad_x1)*scale_x));
-        pad_x2 = static_cast<int>(round(static_cast<Dtype>(pad_x2)*scale_x));
-        pad_y1 = static_cast<int>(round(static_cast<Dtype>(pad_y1)*scale_y));
-        pad_y2 = static_cast<int>(round(static_cast<Dtype>(pad_y2)*scale_y));
-
-        pad_h = pad_y1;
-        // if we're mirroring, we mirror the padding too (to be pedantic)
-        if (do_mirror) {
-          pad_w = pad_x2;
-        } else {
-          pad_w = pad_x1;
-        }
+      }
+    }
+  }
 
-        // ensure that the warped, clipped region plus the padding fits in the
-        // crop_size x crop_size image (it might not due to rounding)
-        if (pad_h + cv_crop_size.height > crop_size) {
-          cv_crop_size.height = crop_size - pad_h;
-        }
-        if (pad_w + cv_crop_size.width > crop_size) {
-          cv_crop_size.width = crop_size - pad_w;
-        }
+  #if 0
+  // useful debugging code for dumping transformed windows to disk
+  string file_id;
+  std::stringstream ss;
+  ss << caffe_rng_rand();
+  ss >> file_id;
+  std::ofstream inf((string("dump/") + file_id +
+      string("_info.txt")).c_str(), std::ofstream::out);
+  inf << image_database_[window[WindowDataLayer<Dtype>::IMAGE_INDEX]].first
+      << std::endl
+      << window[WindowDataLayer<Dtype>::X1]+1 << std::endl
+      << window[WindowDataLayer<Dtype>::Y1]+1 << std::endl
+      << window[WindowDataLayer<Dtype>::X2]+1 << std::endl
+      << window[WindowDataLayer<Dtype>::Y2]+1 << std::endl
+      << do_mirror << std::endl
+      << window[WindowDataLayer<Dtype>::LABEL] << std::endl
+      << (window[WindowDataLayer<Dtype>::OVERLAP] > 0) << std::endl;
+  inf.close();
+  std::ofstream top_data_file((string("dump/") + file_id +
+      string("_data.txt")).c_str(),
+      std::ofstream::out | std::ofstream::binary);
+  for (int c = 0; c < channels; ++c) {
+    for (int h = 0; h < crop_size; ++h) {
+      for (int w = 0; w < crop_size; ++w) {
+        top_data_file.write(reinterpret_cast<char*>(
+            &top_data[(c * crop_size + h) * crop_size + w]),
+            sizeof(Dtype));
       }
+    }
+  }
+  top_data_file.close();
+  #endif
+}
+
+// Thread fetching the data
+template <typename Dtype>
+void WindowDataLayer<Dtype>::InternalThreadEntry() {
+  // At each iteration, sample N windows where N*p are foreground (object)
+  // windows and N*(1-p) are background (non-object) windows
+  CPUTimer batch_timer;
+  batch_timer.Start();
+  double read_time = 0;
+  double trans_time = 0;
+  CPUTimer timer;
+  Dtype* top_data = this->prefetch_data_.mutable_cpu_data();
+  Dtype* top_label = this->prefetch_label_.mutable_cpu_data();
+  const int batch_size = this->layer_param_.window_data_param().batch_size();
+  const float fg_fraction =
+      this->layer_param_.window_data_param().fg_fraction();
 
-      cv::Rect roi(x1, y1, x2-x1+1, y2-y1+1);
-      cv::Mat cv_cropped_img = cv_img(roi);
-      cv::resize(cv_cropped_img, cv_cropped_img,
-          cv_crop_size, 0, 0, cv::INTER_LINEAR);
+  // zero out batch
+  caffe_set(this->prefetch_data_.count(), Dtype(0), top_data);
 
-      // horizontal flip at random
-      if (do_mirror) {
-        cv::flip(cv_cropped_img, cv_cropped_img, 1);
-      }
+  const int num_fg = static_cast<int>(static_cast<float>(batch_size)
+      * fg_fraction);
+  const int num_samples[2] = { batch_size - num_fg, num_fg };
 
-      // copy the warped window into top_data
-      for (int h = 0; h < cv_cropped_img.rows; ++h) {
-        const uchar* ptr = cv_cropped_img.ptr<uchar>(h);
-        int img_index = 0;
-        for (int w = 0; w < cv_cropped_img.cols; ++w) {
-          for (int c = 0; c < channels; ++c) {
-            int top_index = ((item_id * channels + c) * crop_size + h + pad_h)
-                     * crop_size + w + pad_w;
-            // int top_index = (c * height + h) * width + w;
-            Dtype pixel = static_cast<Dtype>(ptr[img_index++]);
-            if (this->has_mean_file_) {
-              int mean_index = (c * mean_height + h + mean_off + pad_h)
-                           * mean_width + w + mean_off + pad_w;
-              top_data[top_index] = (pixel - mean[mean_index]) * scale;
-            } else {
-              if (this->has_mean_values_) {
-                top_data[top_index] = (pixel - this->mean_values_[c]) * scale;
-              } else {
-                top_data[top_index] = pixel * scale;
-              }
-            }
-          }
-        }
+  // sample the windows of the batch from bg set then fg set, and collect
+  // the distinct images they come from
+  // Draw the seed of a window only when mirroring uses it, so the windows
+  // sampled for a given seed are those of the serial layer.
+  const bool mirror = this->transform_param_.mirror();
+  timer.Start();
+  vector<const vector<float>*> windows;
+  vector<unsigned int> window_seeds;
+  map<int, int> image_slots;
+  vector<int> image_indices;
+  vector<int> window_slots;
+  for (int is_fg = 0; is_fg < 2; ++is_fg) {
+    for (int dummy = 0; dummy < num_samples[is_fg]; ++dummy) {
+      const unsigned int rand_index = PrefetchRand();
+      const vector<float>& window = (is_fg) ?
+          fg_windows_[rand_index % fg_windows_.size()] :
+          bg_windows_[rand_index % bg_windows_.size()];
+      windows.push_back(&window);
+      if (mirror) {
+        window_seeds.push_back(PrefetchRand());
       }
-      trans_time += timer.MicroSeconds();
-      // get window label
-      top_label[item_id] = window[WindowDataLayer<Dtype>::LABEL];
-
-      #if 0
-      // useful debugging code for dumping transformed windows to disk
-      string file_id;
-      std::stringstream ss;
-      ss << PrefetchRand();
-      ss >> file_id;
-      std::ofstream inf((string("dump/") + file_id +
-          string("_info.txt")).c_str(), std::ofstream::out);
-      inf << image.first << std::endl
-          << window[WindowDataLayer<Dtype>::X1]+1 << std::endl
-          << window[WindowDataLayer<Dtype>::Y1]+1 << std::endl
-          << window[WindowDataLayer<Dtype>::X2]+1 << std::endl
-          << window[WindowDataLayer<Dtype>::Y2]+1 << std::endl
-          << do_mirror << std::endl
-          << top_label[item_id] << std::endl
-          << is_fg << std::endl;
-      inf.close();
-      std::ofstream top_data_file((string("dump/") + file_id +
-          string("_data.txt")).c_str(),
-          std::ofstream::out | std::ofstream::binary);
-      for (int c = 0; c < channels; ++c) {
-        for (int h = 0; h < crop_size; ++h) {
-          for (int w = 0; w < crop_size; ++w) {
-            top_data_file.write(reinterpret_cast<char*>(
-                &top_data[((item_id * channels + c) * crop_size + h)
-                          * crop_size + w]),
-                sizeof(Dtype));
-          }
-        }
+      const int image_index = window[WindowDataLayer<Dtype>::IMAGE_INDEX];
+      map<int, int>::iterator slot = image_slots.find(image_index);
+      if (slot == image_slots.end()) {
+        slot = image_slots.insert(
+            std::make_pair(image_index, image_indices.size())).first;
+        image_indices.push_back(image_index);
       }
-      top_data_file.close();
-      #endif
+      window_slots.push_back(slot->second);
+    }
+  }
 
-      item_id++;
+  // decode each image once, in parallel
+  vector<cv::Mat> images(image_indices.size());
+  thread_pool_->Run(image_indices.size(), BatchImageLoader<Dtype>(this,
+      &WindowDataLayer<Dtype>::LoadImage, image_indices, &images));
+  for (int i = 0; i < images.size(); ++i) {
+    if (!images[i].data) {
+      LOG(ERROR) << "Could not open or find file "
+          << image_database_[image_indices[i]].first;
+      return;
     }
   }
+  read_time += timer.MicroSeconds();
+
+  // crop and warp the windows into top_data, in parallel
+  timer.Start();
+  thread_pool_->Run(windows.size(), BatchWindowWarper<Dtype>(this,
+      &WindowDataLayer<Dtype>::WarpWindow, images, windows, window_slots,
+      window_seeds, top_data, this->prefetch_data_.offset(1)));
+  trans_time += timer.MicroSeconds();
+  for (int item_id = 0; item_id < windows.size(); ++item_id) {
+    // get window label
+    top_label[item_id] = (*windows[item_id])[WindowDataLayer<Dtype>::LABEL];
+  }
   batch_timer.Stop();
   DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
   DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
   DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
+  if (image_cache_) {
+    DLOG(INFO) << "   Image cache: " << image_cache_->num_images()
+        << " images, " << image_cache_->size_bytes() / (1 << 20) << " MB, "
+        << image_cache_->hits() << " hits, "
+        << image_cache_->misses() << " misses.";
+  }
 }
 
 INSTANTIATE_CLASS(WindowDataLayer);
@@ -199,6 +199,24 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
       }
     }
   }
+  // Blobs left shared by InsertSplits get the sum of the gradients of their
+  // users: the first to run Backward writes the diff, the others add to it.
+  vector<bool> blob_diff_written(blobs_.size(), false);
+  for (int layer_id = layers_.size() - 1; layer_id >= 0; --layer_id) {
+    if (!layer_need_backward_[layer_id]) { continue; }
+    // The diffs of the tops are those the layer reads.
+    for (int top_id = 0; top_id < top_id_vecs_[layer_id].size(); ++top_id) {
+      blob_diff_written[top_id_vecs_[layer_id][top_id]] = false;
+    }
+    for (int bottom_id = 0; bottom_id < bottom_id_vecs_[layer_id].size();
+         ++bottom_id) {
+      if (!bottom_need_backward_[layer_id][bottom_id]) { continue; }
+      const int blob_id = bottom_id_vecs_[layer_id][bottom_id];
+      layers_[layer_id]->set_accumulate_bottom_diff(bottom_id,
+          blob_diff_written[blob_id]);
+      blob_diff_written[blob_id] = true;
+    }
+  }
   // In the end, all remaining blobs are considered output blobs.
   for (set<string>::iterator it = available_blobs.begin();
       it != available_blobs.end(); ++it) {
@@ -372,7 +390,14 @@ int Net<Dtype>::AppendBottom(const NetParameter& param,
     set<string>* available_blobs, map<string, int>* blob_name_to_idx) {
   const LayerParameter& layer_param = param.layer(layer_id);
   const string& blob_name = layer_param.bottom(bottom_id);
-  if (available_blobs->find(blob_name) == available_blobs->end()) {
+  // Blobs left shared by InsertSplits are used again once taken, by layers
+  // accumulating their gradient: InsertSplits only leaves a blob shared when
+  // all of its users do.
+  const bool shared_blob = param.accumulate_diffs() &&
+      LayerTypeAllowsAccumulateBottomDiff(layer_param.type(), bottom_id) &&
+      blob_name_to_idx->find(blob_name) != blob_name_to_idx->end();
+  if (available_blobs->find(blob_name) == available_blobs->end() &&
+      !shared_blob) {
     LOG(FATAL) << "Unknown blob input " << blob_name
                << " (at index " << bottom_id << ") to layer " << layer_id;
   }
@@ -470,8 +495,13 @@ Dtype Net<Dtype>::ForwardFromTo(int start, int end) {
   }
   for (int i = start; i <= end; ++i) {
     // LOG(ERROR) << "Forwarding " << layer_names_[i];
+    if (profiler_) { profiler_->Start(); }
     layers_[i]->Reshape(bottom_vecs_[i], top_vecs_[i]);
     Dtype layer_loss = layers_[i]->Forward(bottom_vecs_[i], top_vecs_[i]);
+    if (profiler_) {
+      profiler_->Stop(NetProfiler<Dtype>::FORWARD, i, layers_[i].get(),
+          bottom_vecs_[i], top_vecs_[i]);
+    }
     loss += layer_loss;
     if (debug_info_) { ForwardDebugInfo(i); }
   }
@@ -535,8 +565,13 @@ void Net<Dtype>::BackwardFromTo(int start, int end) {
   CHECK_LT(start, layers_.size());
   for (int i = start; i >= end; --i) {
     if (layer_need_backward_[i]) {
+      if (profiler_) { profiler_->Start(); }
       layers_[i]->Backward(
           top_vecs_[i], bottom_need_backward_[i], bottom_vecs_[i]);
+      if (profiler_) {
+        profiler_->Stop(NetProfiler<Dtype>::BACKWARD, i, layers_[i].get(),
+            bottom_vecs_[i], top_vecs_[i]);
+      }
       if (debug_info_) { BackwardDebugInfo(i); }
     }
   }
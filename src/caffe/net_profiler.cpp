@@ -0,0 +1,212 @@
+#include <algorithm>
+#include <fstream>  // NOLINT(readability/streams)
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "caffe/net_profiler.hpp"
+#include "caffe/syncedmem.hpp"
+
+namespace caffe {
+
+namespace {
+
+// Returns the element of sorted at the given percentile (nearest rank).
+float Percentile(const vector<float>& sorted, int percent) {
+  const int rank = (percent * sorted.size() + 99) / 100;
+  return sorted[std::max(rank, 1) - 1];
+}
+
+string JSONEscape(const string& s) {
+  string escaped;
+  for (int i = 0; i < s.size(); ++i) {
+    if (s[i] == '"' || s[i] == '\\') {
+      escaped += '\\';
+    }
+    escaped += s[i];
+  }
+  return escaped;
+}
+
+}  // namespace
+
+template <typename Dtype>
+NetProfiler<Dtype>::NetProfiler(int max_events)
+    : max_events_(max_events), start_us_(0), start_allocated_bytes_(0) {
+  Clear();
+}
+
+template <typename Dtype>
+void NetProfiler<Dtype>::Clear() {
+  events_.clear();
+  epoch_ = boost::posix_time::microsec_clock::local_time();
+}
+
+template <typename Dtype>
+void NetProfiler<Dtype>::Start() {
+  start_us_ = (boost::posix_time::microsec_clock::local_time() - epoch_)
+      .total_microseconds();
+  start_allocated_bytes_ = SyncedMemory::allocated_bytes();
+  timer_.Start();
+}
+
+template <typename Dtype>
+void NetProfiler<Dtype>::Stop(Pass pass, int layer_id, Layer<Dtype>* layer,
+    const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) {
+  if (events_.size() >= max_events_) {
+    return;
+  }
+  Event event;
+  event.duration_us = timer_.MicroSeconds();
+  event.allocated_bytes =
+      SyncedMemory::allocated_bytes() - start_allocated_bytes_;
+  event.layer_id = layer_id;
+  event.pass = pass;
+  event.start_us = start_us_;
+  event.flops = EstimateFlops(pass, *layer, bottom, top);
+  int64_t count = 0;
+  for (int i = 0; i < bottom.size(); ++i) {
+    count += bottom[i]->count();
+  }
+  for (int i = 0; i < top.size(); ++i) {
+    count += top[i]->count();
+  }
+  for (int i = 0; i < layer->blobs().size(); ++i) {
+    count += layer->blobs()[i]->count();
+  }
+  // The backward pass reads the data and writes the diff of each blob.
+  event.bytes = count * sizeof(Dtype) * (pass == BACKWARD ? 2 : 1);
+  if (layer_id >= layer_names_.size()) {
+    layer_names_.resize(layer_id + 1);
+    layer_types_.resize(layer_id + 1);
+  }
+  layer_names_[layer_id] = layer->layer_param().name();
+  layer_types_[layer_id] = layer->type();
+  events_.push_back(event);
+  LOG_IF(WARNING, events_.size() == max_events_) << "NetProfiler recorded "
+      << max_events_ << " events and stops recording.";
+}
+
+template <typename Dtype>
+int64_t NetProfiler<Dtype>::EstimateFlops(Pass pass,
+    const Layer<Dtype>& layer, const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) {
+  const string type = layer.type();
+  const LayerParameter& param = layer.layer_param();
+  int64_t flops = 0;
+  if (type == "Convolution" || type == "Deconvolution") {
+    const ConvolutionParameter& conv_param = param.convolution_param();
+    const int64_t kernel_h = conv_param.has_kernel_size() ?
+        conv_param.kernel_size() : conv_param.kernel_h();
+    const int64_t kernel_w = conv_param.has_kernel_size() ?
+        conv_param.kernel_size() : conv_param.kernel_w();
+    // Every output of a convolution is a dot product over the kernel and
+    // the input channels of its group; a deconvolution swaps the roles.
+    const bool is_conv = (type == "Convolution");
+    for (int i = 0; i < top.size(); ++i) {
+      const Blob<Dtype>& output = is_conv ? *top[i] : *bottom[i];
+      const Blob<Dtype>& input = is_conv ? *bottom[i] : *top[i];
+      flops += 2 * output.count() * kernel_h * kernel_w *
+          (input.channels() / conv_param.group());
+    }
+  } else if (type == "InnerProduct") {
+    flops = 2 * static_cast<int64_t>(bottom[0]->count()) *
+        param.inner_product_param().num_output();
+  } else if (type == "Pooling") {
+    const PoolingParameter& pool_param = param.pooling_param();
+    int64_t window = bottom[0]->height() * bottom[0]->width();
+    if (!pool_param.global_pooling()) {
+      window = pool_param.has_kernel_size() ?
+          pool_param.kernel_size() * pool_param.kernel_size() :
+          pool_param.kernel_h() * pool_param.kernel_w();
+    }
+    flops = window * top[0]->count();
+  } else {
+    for (int i = 0; i < top.size(); ++i) {
+      flops += top[i]->count();
+    }
+  }
+  if (pass == BACKWARD && (type == "Convolution" ||
+      type == "Deconvolution" || type == "InnerProduct")) {
+    flops *= 2;
+  }
+  return flops;
+}
+
+template <typename Dtype>
+string NetProfiler<Dtype>::Summary() const {
+  // Durations, flops, bytes and allocations per layer and pass.
+  const int num_passes = 2;
+  const int num_slots = layer_names_.size() * num_passes;
+  vector<vector<float> > durations(num_slots);
+  vector<double> flops(num_slots, 0);
+  vector<double> bytes(num_slots, 0);
+  vector<double> allocated_bytes(num_slots, 0);
+  for (int i = 0; i < events_.size(); ++i) {
+    const Event& event = events_[i];
+    const int slot = event.layer_id * num_passes + event.pass;
+    durations[slot].push_back(event.duration_us);
+    flops[slot] += event.flops;
+    bytes[slot] += event.bytes;
+    allocated_bytes[slot] += event.allocated_bytes;
+  }
+  std::ostringstream summary;
+  summary << std::fixed << std::setprecision(3);
+  for (int slot = 0; slot < num_slots; ++slot) {
+    vector<float>& slot_durations = durations[slot];
+    if (slot_durations.empty()) {
+      continue;
+    }
+    std::sort(slot_durations.begin(), slot_durations.end());
+    double total_us = 0;
+    for (int i = 0; i < slot_durations.size(); ++i) {
+      total_us += slot_durations[i];
+    }
+    const int calls = slot_durations.size();
+    const int layer_id = slot / num_passes;
+    // GFLOP/s and GB/s are flops and bytes per nanosecond.
+    const double total_ns = std::max(total_us, 1e-3) * 1000;
+    summary << std::setw(12) << layer_names_[layer_id] << " "
+        << std::setw(14) << layer_types_[layer_id]
+        << (slot % num_passes == FORWARD ? "  forward:" : " backward:")
+        << " calls " << calls
+        << " mean " << total_us / calls / 1000 << " ms"
+        << " p50 " << Percentile(slot_durations, 50) / 1000 << " ms"
+        << " p90 " << Percentile(slot_durations, 90) / 1000 << " ms"
+        << " p99 " << Percentile(slot_durations, 99) / 1000 << " ms"
+        << " max " << slot_durations.back() / 1000 << " ms"
+        << " " << flops[slot] / total_ns << " GFLOP/s"
+        << " " << bytes[slot] / total_ns << " GB/s"
+        << " alloc " << static_cast<int64_t>(allocated_bytes[slot] / calls)
+        << " B\n";
+  }
+  return summary.str();
+}
+
+template <typename Dtype>
+void NetProfiler<Dtype>::WriteChromeTrace(const string& filename) const {
+  std::ofstream trace(filename.c_str());
+  CHECK(trace) << "Failed to open " << filename;
+  trace << std::fixed << std::setprecision(3);
+  trace << "{\"traceEvents\":[";
+  for (int i = 0; i < events_.size(); ++i) {
+    const Event& event = events_[i];
+    trace << (i ? ",\n" : "\n")
+        << "{\"name\":\"" << JSONEscape(layer_names_[event.layer_id])
+        << "\",\"cat\":\"" << (event.pass == FORWARD ? "forward" : "backward")
+        << "\",\"ph\":\"X\",\"pid\":0,\"tid\":0"
+        << ",\"ts\":" << event.start_us << ",\"dur\":" << event.duration_us
+        << ",\"args\":{\"type\":\""
+        << JSONEscape(layer_types_[event.layer_id])
+        << "\",\"flops\":" << event.flops << ",\"bytes\":" << event.bytes
+        << ",\"allocated_bytes\":" << event.allocated_bytes << "}}";
+  }
+  trace << "\n]}\n";
+  CHECK(trace) << "Failed to write " << filename;
+}
+
+INSTANTIATE_CLASS(NetProfiler);
+
+}  // namespace caffe
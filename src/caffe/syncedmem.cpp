@@ -6,14 +6,33 @@
 
 namespace caffe {
 
+namespace {
+
+// Bytes allocated by all SyncedMemory objects, which may live on different
+// threads (e.g. the prefetch threads of data layers). Allocations are on the
+// Reshape path, so the total is updated atomically rather than under a lock.
+int64_t allocated_bytes_total = 0;
+
+void AddAllocatedBytes(int64_t bytes) {
+  __sync_fetch_and_add(&allocated_bytes_total, bytes);
+}
+
+}  // namespace
+
+int64_t SyncedMemory::allocated_bytes() {
+  return __sync_fetch_and_add(&allocated_bytes_total, 0);
+}
+
 SyncedMemory::~SyncedMemory() {
   if (cpu_ptr_ && own_cpu_data_) {
     CaffeFreeHost(cpu_ptr_);
+    AddAllocatedBytes(-static_cast<int64_t>(size_));
   }
 
 #ifndef CPU_ONLY
   if (gpu_ptr_) {
     CUDA_CHECK(cudaFree(gpu_ptr_));
+    AddAllocatedBytes(-static_cast<int64_t>(size_));
   }
 #endif  // CPU_ONLY
 }
@@ -22,6 +41,7 @@ inline void SyncedMemory::to_cpu() {
   switch (head_) {
   case UNINITIALIZED:
     CaffeMallocHost(&cpu_ptr_, size_);
+    AddAllocatedBytes(size_);
     caffe_memset(size_, 0, cpu_ptr_);
     head_ = HEAD_AT_CPU;
     own_cpu_data_ = true;
@@ -30,6 +50,7 @@ inline void SyncedMemory::to_cpu() {
 #ifndef CPU_ONLY
     if (cpu_ptr_ == NULL) {
       CaffeMallocHost(&cpu_ptr_, size_);
+      AddAllocatedBytes(size_);
       own_cpu_data_ = true;
     }
     caffe_gpu_memcpy(size_, gpu_ptr_, cpu_ptr_);
@@ -49,12 +70,14 @@ inline void SyncedMemory::to_gpu() {
   switch (head_) {
   case UNINITIALIZED:
     CUDA_CHECK(cudaMalloc(&gpu_ptr_, size_));
+    AddAllocatedBytes(size_);
     caffe_gpu_memset(size_, 0, gpu_ptr_);
     head_ = HEAD_AT_GPU;
     break;
   case HEAD_AT_CPU:
     if (gpu_ptr_ == NULL) {
       CUDA_CHECK(cudaMalloc(&gpu_ptr_, size_));
+      AddAllocatedBytes(size_);
     }
     caffe_gpu_memcpy(size_, cpu_ptr_, gpu_ptr_);
     head_ = SYNCED;
@@ -77,6 +100,7 @@ void SyncedMemory::set_cpu_data(void* data) {
   CHECK(data);
   if (own_cpu_data_) {
     CaffeFreeHost(cpu_ptr_);
+    AddAllocatedBytes(-static_cast<int64_t>(size_));
   }
   cpu_ptr_ = data;
   head_ = HEAD_AT_CPU;
@@ -0,0 +1,248 @@
+#include <stdint.h>
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/batch_preprocessor.hpp"
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class BatchPreprocessorTest : public ::testing::Test {
+ protected:
+  BatchPreprocessorTest() : blob_(new Blob<Dtype>()) {}
+
+  // An image of height x width x channels distinct values.
+  vector<float> MakeImage(int height, int width, int channels, float offset) {
+    vector<float> image(height * width * channels);
+    for (int i = 0; i < image.size(); ++i) {
+      image[i] = offset + 0.01 * i;
+    }
+    return image;
+  }
+
+  shared_ptr<Blob<Dtype> > blob_;
+};
+
+TYPED_TEST_CASE(BatchPreprocessorTest, TestDtypes);
+
+TYPED_TEST(BatchPreprocessorTest, TestCenterCrop) {
+  const int height = 5, width = 6, channels = 3;
+  const vector<float> image = this->MakeImage(height, width, channels, 0);
+  BatchPreprocessor<TypeParam> preprocessor(1);
+  preprocessor.set_image_dims(height, width);
+  vector<int> channel_swap(3);
+  channel_swap[0] = 2;
+  channel_swap[1] = 0;
+  channel_swap[2] = 1;
+  preprocessor.set_channel_swap(channel_swap);
+  preprocessor.set_raw_scale(255);
+  vector<TypeParam> mean(3);
+  mean[0] = 10;
+  mean[1] = 20;
+  mean[2] = 30;
+  preprocessor.set_mean(mean);
+  preprocessor.set_input_scale(0.5);
+  this->blob_->Reshape(1, channels, 3, 4);
+  preprocessor.Preprocess(vector<const float*>(1, &image[0]),
+      vector<int>(1, height), vector<int>(1, width), this->blob_.get());
+  for (int c = 0; c < channels; ++c) {
+    for (int y = 0; y < 3; ++y) {
+      for (int x = 0; x < 4; ++x) {
+        // The crop starts at (1, 1).
+        const float pixel =
+            image[((1 + y) * width + 1 + x) * channels + channel_swap[c]];
+        EXPECT_NEAR(this->blob_->data_at(0, c, y, x),
+            (pixel * 255 - mean[c]) * 0.5, 1e-3);
+      }
+    }
+  }
+}
+
+TYPED_TEST(BatchPreprocessorTest, TestOversample) {
+  const int height = 4, width = 5, channels = 2;
+  const int crop_height = 2, crop_width = 3;
+  vector<float> images[2] = {this->MakeImage(height, width, channels, 0),
+      this->MakeImage(height, width, channels, 1)};
+  vector<const float*> image_data;
+  image_data.push_back(&images[0][0]);
+  image_data.push_back(&images[1][0]);
+  BatchPreprocessor<TypeParam> preprocessor(2);
+  preprocessor.set_image_dims(height, width);
+  preprocessor.set_oversample(true);
+  // One mean value per value of a crop.
+  vector<TypeParam> mean(channels * crop_height * crop_width);
+  for (int i = 0; i < mean.size(); ++i) {
+    mean[i] = i;
+  }
+  preprocessor.set_mean(mean);
+  this->blob_->Reshape(20, channels, crop_height, crop_width);
+  preprocessor.Preprocess(image_data, vector<int>(2, height),
+      vector<int>(2, width), this->blob_.get());
+  // The crops of caffe.io.oversample: corners, center, and their mirrors.
+  const int tops[] = {0, 0, 2, 2, 1};
+  const int lefts[] = {0, 2, 0, 2, 1};
+  for (int n = 0; n < 20; ++n) {
+    const vector<float>& image = images[n / 10];
+    const int crop = n % 5;
+    const bool mirror = (n % 10) >= 5;
+    for (int c = 0; c < channels; ++c) {
+      for (int y = 0; y < crop_height; ++y) {
+        for (int x = 0; x < crop_width; ++x) {
+          const int image_x = lefts[crop] + (mirror ? crop_width - 1 - x : x);
+          const float pixel =
+              image[((tops[crop] + y) * width + image_x) * channels + c];
+          EXPECT_NEAR(this->blob_->data_at(n, c, y, x),
+              pixel - mean[(c * crop_height + y) * crop_width + x], 1e-5);
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(BatchPreprocessorTest, TestResize) {
+  // A horizontal ramp upsampled twice, with the pixel centers aligned.
+  const float ramp[] = {0, 1, 2, 3};
+  BatchPreprocessor<TypeParam> preprocessor(1);
+  this->blob_->Reshape(1, 1, 2, 8);
+  preprocessor.Preprocess(vector<const float*>(1, ramp), vector<int>(1, 1),
+      vector<int>(1, 4), this->blob_.get());
+  const float expected[] = {0, 0.25, 0.75, 1.25, 1.75, 2.25, 2.75, 3};
+  for (int y = 0; y < 2; ++y) {
+    for (int x = 0; x < 8; ++x) {
+      EXPECT_NEAR(this->blob_->data_at(0, 0, y, x), expected[x], 1e-5);
+    }
+  }
+  // uint8 pixels are scaled to [0, 1], and a constant image stays constant.
+  const vector<uint8_t> constant(7 * 9 * 3, 51);
+  this->blob_->Reshape(1, 3, 4, 4);
+  preprocessor.Preprocess(vector<const uint8_t*>(1, &constant[0]),
+      vector<int>(1, 7), vector<int>(1, 9), this->blob_.get());
+  for (int i = 0; i < this->blob_->count(); ++i) {
+    EXPECT_NEAR(this->blob_->cpu_data()[i], 0.2, 1e-6);
+  }
+}
+
+TYPED_TEST(BatchPreprocessorTest, TestColumnMajor) {
+  const int height = 5, width = 7, channels = 3;
+  const vector<float> image = this->MakeImage(height, width, channels, 0);
+  vector<float> column_major(image.size());
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      for (int c = 0; c < channels; ++c) {
+        column_major[y + height * (x + width * c)] =
+            image[(y * width + x) * channels + c];
+      }
+    }
+  }
+  Blob<TypeParam> expected(10, channels, 3, 4);
+  BatchPreprocessor<TypeParam> preprocessor(1);
+  preprocessor.set_oversample(true);
+  preprocessor.set_image_dims(4, 6);
+  preprocessor.Preprocess(vector<const float*>(1, &image[0]),
+      vector<int>(1, height), vector<int>(1, width), &expected);
+  this->blob_->ReshapeLike(expected);
+  preprocessor.set_column_major(true);
+  preprocessor.Preprocess(vector<const float*>(1, &column_major[0]),
+      vector<int>(1, height), vector<int>(1, width), this->blob_.get());
+  for (int i = 0; i < expected.count(); ++i) {
+    EXPECT_EQ(this->blob_->cpu_data()[i], expected.cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(BatchPreprocessorTest, TestWindows) {
+  const int height = 8, width = 9, channels = 2;
+  vector<float> images[2] = {this->MakeImage(height, width, channels, 0),
+      this->MakeImage(height, width, channels, 1)};
+  vector<const float*> image_data;
+  image_data.push_back(&images[0][0]);
+  image_data.push_back(&images[1][0]);
+  // Windows of the crop size, of either image, are copied as they are.
+  const int windows[][5] = {{1, 2, 1, 5, 5}, {0, 0, 5, 3, 9}, {1, 5, 0, 8, 4}};
+  vector<vector<int> > window_list;
+  for (int k = 0; k < 3; ++k) {
+    window_list.push_back(vector<int>(windows[k], windows[k] + 5));
+  }
+  BatchPreprocessor<TypeParam> preprocessor(2);
+  vector<TypeParam> mean(channels);
+  mean[0] = 0.5;
+  mean[1] = 0.25;
+  preprocessor.set_mean(mean);
+  this->blob_->Reshape(3, channels, 3, 4);
+  preprocessor.PreprocessWindows(image_data, vector<int>(2, height),
+      vector<int>(2, width), window_list, this->blob_.get());
+  for (int k = 0; k < 3; ++k) {
+    const vector<float>& image = images[windows[k][0]];
+    for (int c = 0; c < channels; ++c) {
+      for (int y = 0; y < 3; ++y) {
+        for (int x = 0; x < 4; ++x) {
+          const float pixel = image[((windows[k][1] + y) * width +
+              windows[k][2] + x) * channels + c];
+          EXPECT_NEAR(this->blob_->data_at(k, c, y, x), pixel - mean[c],
+              1e-5);
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(BatchPreprocessorTest, TestWindowContextPad) {
+  // A window over a whole 4 x 4 image, with 2 pixels of context in an 8 x 8
+  // item: as caffe.Detector.crop, the image is centered in the item, and the
+  // context outside of it is the mean.
+  const int size = 4, channels = 3;
+  const vector<float> image = this->MakeImage(size, size, channels, 0);
+  const int window[] = {0, 0, 0, size - 1, size - 1};
+  BatchPreprocessor<TypeParam> preprocessor(1);
+  preprocessor.set_context_pad(2);
+  preprocessor.set_raw_scale(255);
+  vector<TypeParam> mean(channels, 100);
+  preprocessor.set_mean(mean);
+  preprocessor.set_input_scale(2);
+  this->blob_->Reshape(1, channels, 8, 8);
+  preprocessor.PreprocessWindows(vector<const float*>(1, &image[0]),
+      vector<int>(1, size), vector<int>(1, size),
+      vector<vector<int> >(1, vector<int>(window, window + 5)),
+      this->blob_.get());
+  for (int c = 0; c < channels; ++c) {
+    for (int y = 0; y < 8; ++y) {
+      for (int x = 0; x < 8; ++x) {
+        const bool inside = y >= 2 && y < 6 && x >= 2 && x < 6;
+        const float expected = inside ?
+            (image[((y - 2) * size + x - 2) * channels + c] * 255 - 100) * 2 :
+            0;
+        EXPECT_NEAR(this->blob_->data_at(0, c, y, x), expected, 1e-3);
+      }
+    }
+  }
+}
+
+TYPED_TEST(BatchPreprocessorTest, TestThreads) {
+  // Images of different sizes, preprocessed by one and by four threads.
+  const int num = 37;
+  vector<vector<float> > images(num);
+  vector<const float*> image_data(num);
+  vector<int> heights(num), widths(num);
+  for (int i = 0; i < num; ++i) {
+    heights[i] = 10 + i % 7;
+    widths[i] = 12 + i % 5;
+    images[i] = this->MakeImage(heights[i], widths[i], 3, i);
+    image_data[i] = &images[i][0];
+  }
+  Blob<TypeParam> expected(num, 3, 8, 9);
+  BatchPreprocessor<TypeParam> serial(1);
+  serial.Preprocess(image_data, heights, widths, &expected);
+  this->blob_->ReshapeLike(expected);
+  BatchPreprocessor<TypeParam> parallel(4);
+  parallel.Preprocess(image_data, heights, widths, this->blob_.get());
+  for (int i = 0; i < expected.count(); ++i) {
+    EXPECT_EQ(this->blob_->cpu_data()[i], expected.cpu_data()[i]);
+  }
+}
+
+}  // namespace caffe
@@ -6,6 +6,7 @@
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
+#include "caffe/util/math_functions.hpp"
 #include "caffe/vision_layers.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -154,6 +155,104 @@ TYPED_TEST(ConcatLayerTest, TestForwardChannels) {
   }
 }
 
+TYPED_TEST(ConcatLayerTest, TestForwardNumShareMemory) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_concat_param()->set_axis(0);
+  layer_param.mutable_concat_param()->set_share_memory(true);
+  ConcatLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_1_, this->blob_top_vec_);
+  if (Caffe::mode() == Caffe::CPU) {
+    EXPECT_EQ(this->blob_bottom_0_->cpu_data(), this->blob_top_->cpu_data());
+    EXPECT_EQ(this->blob_bottom_2_->cpu_data(),
+        this->blob_top_->cpu_data() + this->blob_bottom_0_->count());
+    EXPECT_EQ(this->blob_bottom_2_->cpu_diff(),
+        this->blob_top_->cpu_diff() + this->blob_bottom_0_->count());
+  }
+  // The bottoms keep their values, and the top follows them.
+  this->blob_bottom_2_->mutable_cpu_data()[0] = 4;
+  layer.Forward(this->blob_bottom_vec_1_, this->blob_top_vec_);
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    const int bottom_count = this->blob_bottom_0_->count();
+    const Dtype expected = i < bottom_count ? 1 : i == bottom_count ? 4 : 3;
+    EXPECT_EQ(this->blob_top_->cpu_data()[i], expected);
+  }
+}
+
+TYPED_TEST(ConcatLayerTest, TestReshapeShareMemory) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Concatenating channels, the bottoms are views of the top for one item,
+  // and copied again for two.
+  Blob<Dtype> bottom_0(1, 2, 3, 4), bottom_1(1, 1, 3, 4);
+  vector<Blob<Dtype>*> bottom_vec;
+  bottom_vec.push_back(&bottom_0);
+  bottom_vec.push_back(&bottom_1);
+  LayerParameter layer_param;
+  layer_param.mutable_concat_param()->set_share_memory(true);
+  ConcatLayer<Dtype> layer(layer_param);
+  for (int num = 1; num <= 2; ++num) {
+    bottom_0.Reshape(num, 2, 3, 4);
+    bottom_1.Reshape(num, 1, 3, 4);
+    if (num == 1) {
+      layer.SetUp(bottom_vec, this->blob_top_vec_);
+    } else {
+      layer.Reshape(bottom_vec, this->blob_top_vec_);
+    }
+    EXPECT_EQ(bottom_0.cpu_data() == this->blob_top_->cpu_data(),
+        num == 1 && Caffe::mode() == Caffe::CPU);
+    caffe_set(bottom_0.count(), Dtype(1), bottom_0.mutable_cpu_data());
+    caffe_set(bottom_1.count(), Dtype(2), bottom_1.mutable_cpu_data());
+    layer.Forward(bottom_vec, this->blob_top_vec_);
+    for (int n = 0; n < num; ++n) {
+      for (int c = 0; c < 3; ++c) {
+        for (int h = 0; h < 3; ++h) {
+          for (int w = 0; w < 4; ++w) {
+            EXPECT_EQ(this->blob_top_->data_at(n, c, h, w), c < 2 ? 1 : 2);
+          }
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(ConcatLayerTest, TestForwardNestedShareMemory) {
+  typedef typename TypeParam::Dtype Dtype;
+  // The top of an inner concatenation is a bottom of an outer one, so both
+  // make it a view of theirs in turn, as Net reshapes each layer before its
+  // Forward.
+  Blob<Dtype> bottom_0(1, 2, 3, 4), bottom_1(1, 1, 3, 4);
+  Blob<Dtype> inner_top, outer_top;
+  vector<Blob<Dtype>*> inner_bottom_vec, inner_top_vec(1, &inner_top);
+  inner_bottom_vec.push_back(&bottom_0);
+  inner_bottom_vec.push_back(&bottom_1);
+  vector<Blob<Dtype>*> outer_bottom_vec, outer_top_vec(1, &outer_top);
+  outer_bottom_vec.push_back(&bottom_1);
+  outer_bottom_vec.push_back(&inner_top);
+  LayerParameter layer_param;
+  layer_param.mutable_concat_param()->set_share_memory(true);
+  ConcatLayer<Dtype> inner_layer(layer_param);
+  ConcatLayer<Dtype> outer_layer(layer_param);
+  inner_layer.SetUp(inner_bottom_vec, inner_top_vec);
+  outer_layer.SetUp(outer_bottom_vec, outer_top_vec);
+  for (int pass = 0; pass < 2; ++pass) {
+    caffe_set(bottom_0.count(), Dtype(pass + 1), bottom_0.mutable_cpu_data());
+    caffe_set(bottom_1.count(), Dtype(pass + 2), bottom_1.mutable_cpu_data());
+    inner_layer.Reshape(inner_bottom_vec, inner_top_vec);
+    inner_layer.Forward(inner_bottom_vec, inner_top_vec);
+    outer_layer.Reshape(outer_bottom_vec, outer_top_vec);
+    outer_layer.Forward(outer_bottom_vec, outer_top_vec);
+    // The channels of outer_top are those of bottom_1, bottom_0, bottom_1.
+    for (int c = 0; c < 4; ++c) {
+      for (int h = 0; h < 3; ++h) {
+        for (int w = 0; w < 4; ++w) {
+          EXPECT_EQ(outer_top.data_at(0, c, h, w),
+              c == 1 || c == 2 ? pass + 1 : pass + 2);
+        }
+      }
+    }
+  }
+}
+
 TYPED_TEST(ConcatLayerTest, TestGradientNum) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
@@ -164,6 +263,17 @@ TYPED_TEST(ConcatLayerTest, TestGradientNum) {
     this->blob_top_vec_);
 }
 
+TYPED_TEST(ConcatLayerTest, TestGradientNumShareMemory) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_concat_param()->set_axis(0);
+  layer_param.mutable_concat_param()->set_share_memory(true);
+  ConcatLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-2);
+  checker.CheckGradient(&layer, this->blob_bottom_vec_1_,
+    this->blob_top_vec_);
+}
+
 TYPED_TEST(ConcatLayerTest, TestGradientChannels) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
@@ -1,4 +1,6 @@
 #include <cstring>
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -6,6 +8,8 @@
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
+#include "caffe/util/conv_tuner.hpp"
+#include "caffe/util/io.hpp"
 #include "caffe/vision_layers.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -134,6 +138,16 @@ class ConvolutionLayerTest : public MultiDeviceTest<TypeParam> {
     return this->ref_blob_top_.get();
   }
 
+  vector<string> ReadLines(const string& filename) {
+    std::ifstream file(filename.c_str());
+    vector<string> lines;
+    string line;
+    while (std::getline(file, line)) {
+      lines.push_back(line);
+    }
+    return lines;
+  }
+
   Blob<Dtype>* const blob_bottom_;
   Blob<Dtype>* const blob_bottom_2_;
   Blob<Dtype>* const blob_top_;
@@ -421,6 +435,79 @@ TYPED_TEST(ConvolutionLayerTest, TestGradientGroup) {
       this->blob_top_vec_);
 }
 
+TYPED_TEST(ConvolutionLayerTest, TestCPUAlgorithms) {
+  typedef typename TypeParam::Dtype Dtype;
+  if (Caffe::mode() != Caffe::CPU) {
+    return;
+  }
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->set_num_output(6);
+  convolution_param->set_group(3);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  for (int kernel_size = 1; kernel_size <= 3; kernel_size += 2) {
+    convolution_param->set_kernel_size(kernel_size);
+    convolution_param->set_stride(kernel_size == 1 ? 1 : 2);
+    convolution_param->set_pad(kernel_size / 2);
+    for (int i = ConvolutionParameter_CPUAlgorithm_CPUAlgorithm_MIN;
+         i < ConvolutionParameter_CPUAlgorithm_AUTO; ++i) {
+      convolution_param->set_cpu_algorithm(
+          static_cast<ConvolutionParameter_CPUAlgorithm>(i));
+      ConvolutionLayer<Dtype> layer(layer_param);
+      layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+      layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      caffe_conv(this->blob_bottom_, convolution_param, layer.blobs(),
+          this->MakeReferenceTop(this->blob_top_));
+      const Dtype* top_data = this->blob_top_->cpu_data();
+      const Dtype* ref_top_data = this->ref_blob_top_->cpu_data();
+      for (int j = 0; j < this->blob_top_->count(); ++j) {
+        EXPECT_NEAR(top_data[j], ref_top_data[j], 1e-4)
+            << ConvolutionParameter_CPUAlgorithm_Name(
+                convolution_param->cpu_algorithm());
+      }
+    }
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestCPUAlgorithmTuningCache) {
+  typedef typename TypeParam::Dtype Dtype;
+  if (Caffe::mode() != Caffe::CPU) {
+    return;
+  }
+  string cache_file;
+  MakeTempFilename(&cache_file);
+  ConvolutionTuner::Get().Load(cache_file);
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->set_kernel_size(3);
+  convolution_param->set_num_output(4);
+  convolution_param->set_cpu_algorithm(ConvolutionParameter_CPUAlgorithm_AUTO);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  ConvolutionLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  caffe_conv(this->blob_bottom_, convolution_param, layer.blobs(),
+      this->MakeReferenceTop(this->blob_top_));
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_NEAR(this->blob_top_->cpu_data()[i],
+        this->ref_blob_top_->cpu_data()[i], 1e-4);
+  }
+  // The result of the tuning is written to the cache file.
+  vector<string> lines = this->ReadLines(cache_file);
+  ASSERT_EQ(lines.size(), 1);
+  EXPECT_EQ(lines[0].find(ConvolutionTuner::MachineKey()), 0);
+  EXPECT_NE(lines[0].find("2x3x6x4"), string::npos);
+  // Another layer of the same shape reuses it, after reloading the file.
+  ConvolutionTuner::Get().Load(cache_file);
+  ConvolutionLayer<Dtype> other_layer(layer_param);
+  other_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(this->ReadLines(cache_file).size(), 1);
+  ConvolutionTuner::Get().Load("");
+}
+
 #ifdef USE_CUDNN
 
 template <typename Dtype>
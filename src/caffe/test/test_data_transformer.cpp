@@ -1,3 +1,6 @@
+#include <opencv2/core/core.hpp>
+
+#include <fstream>  // NOLINT(readability/streams)
 #include <string>
 #include <vector>
 
@@ -352,4 +355,181 @@ TYPED_TEST(DataTransformTest, TestMeanFile) {
   }
 }
 
+TYPED_TEST(DataTransformTest, TestFloatDataMeanValuesMirror) {
+  TransformationParameter transform_param;
+  const int channels = 3;
+  const int height = 4;
+  const int width = 5;
+
+  transform_param.set_mirror(true);
+  transform_param.set_scale(0.5);
+  transform_param.add_mean_value(0);
+  transform_param.add_mean_value(1);
+  transform_param.add_mean_value(2);
+  Datum datum;
+  datum.set_channels(channels);
+  datum.set_height(height);
+  datum.set_width(width);
+  for (int j = 0; j < channels * height * width; ++j) {
+    datum.add_float_data(j);
+  }
+  Blob<TypeParam>* blob = new Blob<TypeParam>(1, channels, height, width);
+  DataTransformer<TypeParam>* transformer =
+      new DataTransformer<TypeParam>(transform_param, TEST);
+  transformer->InitRand();
+  transformer->Transform(datum, blob);
+  // Each row is either kept or mirrored as a whole.
+  const bool mirrored = blob->cpu_data()[0] != TypeParam(0);
+  for (int c = 0; c < channels; ++c) {
+    for (int h = 0; h < height; ++h) {
+      for (int w = 0; w < width; ++w) {
+        const int src_w = mirrored ? width - 1 - w : w;
+        const int data_index = (c * height + h) * width + src_w;
+        EXPECT_EQ(blob->data_at(0, c, h, w),
+            TypeParam(data_index - c) * TypeParam(0.5));
+      }
+    }
+  }
+}
+
+TYPED_TEST(DataTransformTest, TestBatchMatchesSingle) {
+  TransformationParameter transform_param;
+  const bool unique_pixels = true;  // pixels are consecutive ints [0,size]
+  const int num = 4;
+  const int channels = 3;
+  const int height = 6;
+  const int width = 7;
+  const int crop_size = 3;
+
+  transform_param.set_crop_size(crop_size);
+  transform_param.set_scale(0.25);
+  transform_param.add_mean_value(5);
+  vector<Datum> datum_vector(num);
+  for (int n = 0; n < num; ++n) {
+    FillDatum(n, channels, height, width, unique_pixels, &datum_vector[n]);
+  }
+  DataTransformer<TypeParam>* transformer =
+      new DataTransformer<TypeParam>(transform_param, TEST);
+  transformer->InitRand();
+  Blob<TypeParam>* batch_blob =
+      new Blob<TypeParam>(num, channels, crop_size, crop_size);
+  transformer->Transform(datum_vector, batch_blob);
+  Blob<TypeParam>* blob = new Blob<TypeParam>(1, channels, crop_size,
+      crop_size);
+  for (int n = 0; n < num; ++n) {
+    transformer->Transform(datum_vector[n], blob);
+    for (int j = 0; j < blob->count(); ++j) {
+      EXPECT_EQ(blob->cpu_data()[j],
+          batch_blob->cpu_data()[batch_blob->offset(n) + j]);
+    }
+  }
+  // The central crop of the first channel starts at (1, 2).
+  EXPECT_EQ(batch_blob->data_at(0, 0, 0, 0),
+      (TypeParam(1 * width + 2) - 5) * TypeParam(0.25));
+}
+
+TYPED_TEST(DataTransformTest, TestAugmentRandomResizedCrop) {
+  TransformationParameter transform_param;
+  const int crop_size = 4;
+
+  transform_param.set_crop_size(crop_size);
+  transform_param.set_min_crop_area(0.3);
+  transform_param.set_max_aspect_ratio(2);
+  cv::Mat cv_img(10, 12, CV_8UC3);
+  for (int h = 0; h < cv_img.rows; ++h) {
+    for (int w = 0; w < cv_img.cols * 3; ++w) {
+      cv_img.ptr<uchar>(h)[w] = static_cast<uchar>(h * 16 + w);
+    }
+  }
+  DataTransformer<TypeParam>* transformer =
+      new DataTransformer<TypeParam>(transform_param, TRAIN);
+  EXPECT_TRUE(transformer->needs_augmentation());
+  // The same seed gives the same crop.
+  cv::Mat augmented, augmented_again;
+  Caffe::RNG rng(this->seed_);
+  transformer->Augment(cv_img, &rng, &augmented);
+  Caffe::RNG rng_again(this->seed_);
+  transformer->Augment(cv_img, &rng_again, &augmented_again);
+  EXPECT_EQ(augmented.rows, crop_size);
+  EXPECT_EQ(augmented.cols, crop_size);
+  EXPECT_EQ(augmented.channels(), 3);
+  for (int h = 0; h < crop_size; ++h) {
+    for (int w = 0; w < crop_size * 3; ++w) {
+      EXPECT_EQ(augmented.ptr<uchar>(h)[w], augmented_again.ptr<uchar>(h)[w]);
+    }
+  }
+  // Nothing is augmented in the TEST phase.
+  DataTransformer<TypeParam>* test_transformer =
+      new DataTransformer<TypeParam>(transform_param, TEST);
+  EXPECT_FALSE(test_transformer->needs_augmentation());
+}
+
+TYPED_TEST(DataTransformTest, TestAugmentColorJitterGray) {
+  TransformationParameter transform_param;
+  transform_param.set_brightness_jitter(0.5);
+  transform_param.set_contrast_jitter(0.5);
+  transform_param.set_saturation_jitter(0.5);
+  // A uniform gray image stays uniform and gray, only its brightness changes.
+  cv::Mat cv_img(5, 6, CV_8UC3);
+  for (int h = 0; h < cv_img.rows; ++h) {
+    for (int w = 0; w < cv_img.cols * 3; ++w) {
+      cv_img.ptr<uchar>(h)[w] = 100;
+    }
+  }
+  DataTransformer<TypeParam>* transformer =
+      new DataTransformer<TypeParam>(transform_param, TRAIN);
+  for (int iter = 0; iter < this->num_iter_; ++iter) {
+    cv::Mat augmented;
+    Caffe::RNG rng(this->seed_ + iter);
+    transformer->Augment(cv_img, &rng, &augmented);
+    ASSERT_EQ(augmented.rows, cv_img.rows);
+    ASSERT_EQ(augmented.cols, cv_img.cols);
+    const uchar value = augmented.ptr<uchar>(0)[0];
+    EXPECT_GE(value, 50 - 1);
+    EXPECT_LE(value, 150 + 1);
+    for (int h = 0; h < augmented.rows; ++h) {
+      for (int w = 0; w < augmented.cols * 3; ++w) {
+        EXPECT_NEAR(augmented.ptr<uchar>(h)[w], value, 1);
+      }
+    }
+  }
+}
+
+TYPED_TEST(DataTransformTest, TestAugmentCompositeTest) {
+  TransformationParameter transform_param;
+  string background_source;
+  MakeTempFilename(&background_source);
+  std::ofstream outfile(background_source.c_str());
+  outfile << "background.jpg" << std::endl;
+  outfile.close();
+  transform_param.set_background_source(background_source);
+  // Opaque on the left half, transparent on the right half.
+  cv::Mat cv_img(3, 4, CV_8UC4);
+  for (int h = 0; h < cv_img.rows; ++h) {
+    for (int w = 0; w < cv_img.cols; ++w) {
+      uchar* pixel = cv_img.ptr<uchar>(h) + w * 4;
+      pixel[0] = 10;
+      pixel[1] = 20;
+      pixel[2] = 30;
+      pixel[3] = w < 2 ? 255 : 0;
+    }
+  }
+  DataTransformer<TypeParam>* transformer =
+      new DataTransformer<TypeParam>(transform_param, TEST);
+  EXPECT_TRUE(transformer->needs_augmentation());
+  // The TEST phase composites over black.
+  cv::Mat augmented;
+  transformer->Augment(cv_img, NULL, &augmented);
+  ASSERT_EQ(augmented.channels(), 3);
+  ASSERT_EQ(augmented.rows, cv_img.rows);
+  ASSERT_EQ(augmented.cols, cv_img.cols);
+  for (int h = 0; h < augmented.rows; ++h) {
+    for (int w = 0; w < augmented.cols; ++w) {
+      for (int c = 0; c < 3; ++c) {
+        EXPECT_EQ(augmented.ptr<uchar>(h)[w * 3 + c], w < 2 ? 10 * (c + 1) : 0);
+      }
+    }
+  }
+}
+
 }  // namespace caffe
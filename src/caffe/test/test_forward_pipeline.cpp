@@ -0,0 +1,180 @@
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/forward_pipeline.hpp"
+#include "caffe/net.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class ForwardPipelineTest : public ::testing::Test {
+ protected:
+  ForwardPipelineTest() {
+    const string proto =
+        "name: 'PipelinedNet' "
+        "input: 'data' "
+        "input_shape { dim: 2 dim: 3 dim: 4 dim: 4 } "
+        "layer { "
+        "  name: 'conv' "
+        "  type: 'Convolution' "
+        "  convolution_param { "
+        "    num_output: 2 "
+        "    kernel_size: 3 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "  bottom: 'data' "
+        "  top: 'conv' "
+        "} "
+        "layer { "
+        "  name: 'ip' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 5 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "  bottom: 'conv' "
+        "  top: 'ip' "
+        "} ";
+    InitNet(proto);
+    output_names_.push_back("ip");
+    output_names_.push_back("conv");
+  }
+
+  // Makes the net, whose single input takes batches of 3 x 4 x 4 items.
+  void InitNet(const string& proto) {
+    NetParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+    param.mutable_state()->set_phase(TEST);
+    net_.reset(new Net<Dtype>(param));
+  }
+
+  // Runs batches of nums[i] random inputs through a pipeline of the given
+  // depth, and checks the outputs against forward passes of the net.
+  void RunAndCheck(const vector<int>& nums, int depth) {
+    const int num_batches = nums.size();
+    vector<shared_ptr<Blob<Dtype> > > inputs(num_batches);
+    vector<vector<shared_ptr<Blob<Dtype> > > > outputs(num_batches);
+    {
+      ForwardPipeline<Dtype> pipeline(net_, output_names_, depth);
+      int popped = 0;
+      for (int i = 0; i < num_batches; ++i) {
+        if (i - popped == depth) {
+          CopyOutputs(pipeline.Pop(), &outputs[popped]);
+          pipeline.Release();
+          ++popped;
+        }
+        Blob<Dtype>* batch = pipeline.NextInputs()[0].get();
+        FillInputs(nums[i], batch);
+        inputs[i].reset(new Blob<Dtype>());
+        inputs[i]->CopyFrom(*batch, false, true);
+        pipeline.Push();
+      }
+      for (; popped < num_batches; ++popped) {
+        CopyOutputs(pipeline.Pop(), &outputs[popped]);
+      }
+    }
+    for (int i = 0; i < num_batches; ++i) {
+      CheckOutputs(*inputs[i], outputs[i]);
+    }
+  }
+
+  void CopyOutputs(const vector<shared_ptr<Blob<Dtype> > >& out,
+      vector<shared_ptr<Blob<Dtype> > >* copies) {
+    for (int j = 0; j < out.size(); ++j) {
+      copies->push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+      copies->back()->CopyFrom(*out[j], false, true);
+    }
+  }
+
+  // Fills blob with a batch of num random inputs.
+  void FillInputs(int num, Blob<Dtype>* blob) {
+    blob->Reshape(num, 3, 4, 4);
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(blob);
+  }
+
+  // Checks outputs against a forward pass of the net on inputs.
+  void CheckOutputs(const Blob<Dtype>& inputs,
+      const vector<shared_ptr<Blob<Dtype> > >& outputs) {
+    Blob<Dtype>* input = net_->input_blobs()[0];
+    input->ReshapeLike(inputs);
+    input->CopyFrom(inputs);
+    net_->Reshape();
+    net_->ForwardPrefilled();
+    ASSERT_EQ(outputs.size(), output_names_.size());
+    for (int i = 0; i < outputs.size(); ++i) {
+      const Blob<Dtype>& expected = *net_->blob_by_name(output_names_[i]);
+      ASSERT_EQ(outputs[i]->shape(), expected.shape());
+      for (int j = 0; j < expected.count(); ++j) {
+        EXPECT_EQ(outputs[i]->cpu_data()[j], expected.cpu_data()[j]);
+      }
+    }
+  }
+
+  shared_ptr<Net<Dtype> > net_;
+  vector<string> output_names_;
+};
+
+TYPED_TEST_CASE(ForwardPipelineTest, TestDtypes);
+
+TYPED_TEST(ForwardPipelineTest, TestForward) {
+  // Batches of varying sizes, with up to depth of them in flight.
+  const int nums[] = {2, 2, 3, 1, 2, 4};
+  this->RunAndCheck(vector<int>(nums, nums + sizeof(nums) / sizeof(nums[0])),
+      2);
+}
+
+TYPED_TEST(ForwardPipelineTest, TestForwardSplitInput) {
+  // The input feeds several layers through a Split, and a Flatten, which
+  // share its storage.
+  const string proto =
+      "name: 'SplitInputNet' "
+      "input: 'data' "
+      "input_shape { dim: 2 dim: 3 dim: 4 dim: 4 } "
+      "layer { "
+      "  name: 'ip' "
+      "  type: 'InnerProduct' "
+      "  inner_product_param { "
+      "    num_output: 5 "
+      "    weight_filler { type: 'gaussian' std: 0.1 } "
+      "  } "
+      "  bottom: 'data' "
+      "  top: 'ip' "
+      "} "
+      "layer { "
+      "  name: 'flat' "
+      "  type: 'Flatten' "
+      "  bottom: 'data' "
+      "  top: 'flat' "
+      "} ";
+  this->InitNet(proto);
+  this->output_names_.clear();
+  this->output_names_.push_back("ip");
+  this->output_names_.push_back("flat");
+  const int nums[] = {2, 2, 3, 3, 1, 2};
+  this->RunAndCheck(vector<int>(nums, nums + sizeof(nums) / sizeof(nums[0])),
+      2);
+}
+
+TYPED_TEST(ForwardPipelineTest, TestInputStorageRestored) {
+  Blob<TypeParam>* input = this->net_->input_blobs()[0];
+  const TypeParam* storage = input->cpu_data();
+  ForwardPipeline<TypeParam> pipeline(this->net_, this->output_names_, 1);
+  this->FillInputs(2, pipeline.NextInputs()[0].get());
+  pipeline.Push();
+  pipeline.Pop();
+  pipeline.Stop();
+  EXPECT_EQ(input->cpu_data(), storage);
+}
+
+}  // namespace caffe
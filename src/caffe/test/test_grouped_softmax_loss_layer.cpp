@@ -0,0 +1,119 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/vision_layers.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class GroupedSoftmaxWithLossLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  // 3 groups of 4 classes.
+  GroupedSoftmaxWithLossLayerTest()
+      : blob_bottom_data_(new Blob<Dtype>(10, 12, 2, 3)),
+        blob_bottom_label_(new Blob<Dtype>(10, 1, 2, 3)),
+        blob_bottom_group_(new Blob<Dtype>(10, 1, 2, 3)),
+        blob_top_loss_(new Blob<Dtype>()) {
+    // fill the values
+    FillerParameter filler_param;
+    filler_param.set_std(10);
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_data_);
+    blob_bottom_vec_.push_back(blob_bottom_data_);
+    for (int i = 0; i < blob_bottom_label_->count(); ++i) {
+      blob_bottom_label_->mutable_cpu_data()[i] = caffe_rng_rand() % 4;
+      blob_bottom_group_->mutable_cpu_data()[i] = caffe_rng_rand() % 3;
+    }
+    blob_bottom_vec_.push_back(blob_bottom_label_);
+    blob_bottom_vec_.push_back(blob_bottom_group_);
+    blob_top_vec_.push_back(blob_top_loss_);
+  }
+  virtual ~GroupedSoftmaxWithLossLayerTest() {
+    delete blob_bottom_data_;
+    delete blob_bottom_label_;
+    delete blob_bottom_group_;
+    delete blob_top_loss_;
+  }
+  Blob<Dtype>* const blob_bottom_data_;
+  Blob<Dtype>* const blob_bottom_label_;
+  Blob<Dtype>* const blob_bottom_group_;
+  Blob<Dtype>* const blob_top_loss_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(GroupedSoftmaxWithLossLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(GroupedSoftmaxWithLossLayerTest, TestForward) {
+  typedef typename TypeParam::Dtype Dtype;
+  // The loss is that of SoftmaxWithLoss over the predictions of the group of
+  // each instance.
+  Blob<Dtype> group_data(10, 4, 2, 3);
+  for (int n = 0; n < 10; ++n) {
+    for (int h = 0; h < 2; ++h) {
+      for (int w = 0; w < 3; ++w) {
+        const int group = this->blob_bottom_group_->data_at(n, 0, h, w);
+        for (int c = 0; c < 4; ++c) {
+          group_data.mutable_cpu_data()[group_data.offset(n, c, h, w)] =
+              this->blob_bottom_data_->data_at(n, group * 4 + c, h, w);
+        }
+      }
+    }
+  }
+  vector<Blob<Dtype>*> group_bottom_vec;
+  group_bottom_vec.push_back(&group_data);
+  group_bottom_vec.push_back(this->blob_bottom_label_);
+  Blob<Dtype> expected_loss;
+  vector<Blob<Dtype>*> expected_top_vec(1, &expected_loss);
+  for (int normalize = 0; normalize < 2; ++normalize) {
+    LayerParameter layer_param;
+    layer_param.mutable_loss_param()->set_normalize(normalize);
+    layer_param.mutable_loss_param()->set_ignore_label(0);
+    SoftmaxWithLossLayer<Dtype> softmax_loss_layer(layer_param);
+    softmax_loss_layer.SetUp(group_bottom_vec, expected_top_vec);
+    softmax_loss_layer.Forward(group_bottom_vec, expected_top_vec);
+    layer_param.mutable_grouped_softmax_loss_param()->set_group_size(4);
+    layer_param.mutable_grouped_softmax_loss_param()->set_num_threads(3);
+    GroupedSoftmaxWithLossLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    EXPECT_NEAR(expected_loss.cpu_data()[0],
+        this->blob_top_loss_->cpu_data()[0], 1e-4);
+  }
+}
+
+TYPED_TEST(GroupedSoftmaxWithLossLayerTest, TestGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.add_loss_weight(3);
+  layer_param.mutable_grouped_softmax_loss_param()->set_group_size(4);
+  layer_param.mutable_grouped_softmax_loss_param()->set_num_threads(2);
+  GroupedSoftmaxWithLossLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-2, 1701);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 0);
+}
+
+TYPED_TEST(GroupedSoftmaxWithLossLayerTest, TestGradientIgnoreLabel) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  // labels are in {0, ..., 3}, so we'll ignore about a fourth of them
+  layer_param.mutable_loss_param()->set_ignore_label(0);
+  layer_param.mutable_loss_param()->set_normalize(false);
+  layer_param.mutable_grouped_softmax_loss_param()->set_group_size(4);
+  GroupedSoftmaxWithLossLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-2, 1701);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 0);
+}
+
+}  // namespace caffe
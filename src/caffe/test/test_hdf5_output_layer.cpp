@@ -117,4 +117,68 @@ TYPED_TEST(HDF5OutputLayerTest, TestForward) {
       this->output_file_name_;
 }
 
+TYPED_TEST(HDF5OutputLayerTest, TestForwardAppend) {
+  typedef typename TypeParam::Dtype Dtype;
+  hid_t file_id = H5Fopen(this->input_file_name_.c_str(), H5F_ACC_RDONLY,
+                          H5P_DEFAULT);
+  ASSERT_GE(file_id, 0)<< "Failed to open HDF5 file" <<
+      this->input_file_name_;
+  hdf5_load_nd_dataset(file_id, HDF5_DATA_DATASET_NAME, 0, 4,
+                       this->blob_data_);
+  hdf5_load_nd_dataset(file_id, HDF5_DATA_LABEL_NAME, 0, 4,
+                       this->blob_label_);
+  herr_t status = H5Fclose(file_id);
+  EXPECT_GE(status, 0)<< "Failed to close HDF5 file " <<
+      this->input_file_name_;
+  this->blob_bottom_vec_.push_back(this->blob_data_);
+  this->blob_bottom_vec_.push_back(this->blob_label_);
+
+  LayerParameter param;
+  HDF5OutputParameter* hdf5_output_param = param.mutable_hdf5_output_param();
+  hdf5_output_param->set_file_name(this->output_file_name_);
+  hdf5_output_param->set_append(true);
+  hdf5_output_param->set_queue_size(2);
+  hdf5_output_param->set_chunk_rows(3);
+  // More forward passes than queued batches; the layer's destruction writes
+  // the batches still queued.
+  const int num_forward = 5;
+  {
+    HDF5OutputLayer<Dtype> layer(param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    for (int i = 0; i < num_forward; ++i) {
+      layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    }
+  }
+  file_id = H5Fopen(this->output_file_name_.c_str(), H5F_ACC_RDONLY,
+                          H5P_DEFAULT);
+  ASSERT_GE(file_id, 0)<< "Failed to open HDF5 file" <<
+      this->output_file_name_;
+  Blob<Dtype> blob_data;
+  hdf5_load_nd_dataset(file_id, HDF5_DATA_DATASET_NAME, 0, 4, &blob_data);
+  Blob<Dtype> blob_label;
+  hdf5_load_nd_dataset(file_id, HDF5_DATA_LABEL_NAME, 0, 4, &blob_label);
+  status = H5Fclose(file_id);
+  EXPECT_GE(status, 0) << "Failed to close HDF5 file " <<
+      this->output_file_name_;
+
+  // The batches were appended one after the other.
+  const int num = this->blob_data_->num();
+  ASSERT_EQ(blob_data.num(), num_forward * num);
+  ASSERT_EQ(blob_label.num(), num_forward * num);
+  Blob<Dtype> batch_data(num, blob_data.channels(), blob_data.height(),
+      blob_data.width());
+  Blob<Dtype> batch_label(num, blob_label.channels(), blob_label.height(),
+      blob_label.width());
+  for (int i = 0; i < num_forward; ++i) {
+    caffe_copy(batch_data.count(),
+        blob_data.cpu_data() + blob_data.offset(i * num),
+        batch_data.mutable_cpu_data());
+    this->CheckBlobEqual(*(this->blob_data_), batch_data);
+    caffe_copy(batch_label.count(),
+        blob_label.cpu_data() + blob_label.offset(i * num),
+        batch_label.mutable_cpu_data());
+    this->CheckBlobEqual(*(this->blob_label_), batch_label);
+  }
+}
+
 }  // namespace caffe
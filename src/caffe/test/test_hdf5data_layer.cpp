@@ -132,4 +132,93 @@ TYPED_TEST(HDF5DataLayerTest, TestRead) {
   }
 }
 
+TYPED_TEST(HDF5DataLayerTest, TestStreamRead) {
+  typedef typename TypeParam::Dtype Dtype;
+  // The same data as in TestRead, streamed 3 rows at a time so that batches
+  // straddle chunks and files.
+  LayerParameter param;
+  param.add_top("data");
+  param.add_top("label");
+  param.add_top("label2");
+
+  HDF5DataParameter* hdf5_data_param = param.mutable_hdf5_data_param();
+  int batch_size = 5;
+  hdf5_data_param->set_batch_size(batch_size);
+  hdf5_data_param->set_source(*(this->filename));
+  hdf5_data_param->set_chunk_rows(3);
+  int num_cols = 8;
+  int height = 6;
+  int width = 5;
+
+  HDF5StreamDataLayer<Dtype> layer(param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(this->blob_top_data_->num(), batch_size);
+  EXPECT_EQ(this->blob_top_data_->channels(), num_cols);
+  EXPECT_EQ(this->blob_top_data_->height(), height);
+  EXPECT_EQ(this->blob_top_data_->width(), width);
+
+  EXPECT_EQ(this->blob_top_label_->num_axes(), 2);
+  EXPECT_EQ(this->blob_top_label_->shape(0), batch_size);
+  EXPECT_EQ(this->blob_top_label_->shape(1), 1);
+
+  const int data_size = num_cols * height * width;
+  for (int iter = 0; iter < 10; ++iter) {
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    int label_offset = 1 + ((iter % 2 == 0) ? 0 : batch_size);
+    int label2_offset = 1 + label_offset;
+    int data_offset = (iter % 2 == 0) ? 0 : batch_size * data_size;
+    int file_offset = (iter % 4 < 2) ? 0 : 2400;
+    for (int i = 0; i < batch_size; ++i) {
+      EXPECT_EQ(label_offset + i, this->blob_top_label_->cpu_data()[i]);
+      EXPECT_EQ(label2_offset + i, this->blob_top_label2_->cpu_data()[i]);
+    }
+    for (int idx = 0; idx < batch_size * data_size; ++idx) {
+      EXPECT_EQ(file_offset + data_offset + idx,
+          this->blob_top_data_->cpu_data()[idx])
+          << "debug: idx " << idx << " iter " << iter;
+    }
+  }
+}
+
+TYPED_TEST(HDF5DataLayerTest, TestStreamShuffle) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter param;
+  param.add_top("data");
+  param.add_top("label");
+  param.add_top("label2");
+
+  HDF5DataParameter* hdf5_data_param = param.mutable_hdf5_data_param();
+  int batch_size = 5;
+  hdf5_data_param->set_batch_size(batch_size);
+  hdf5_data_param->set_source(*(this->filename));
+  hdf5_data_param->set_chunk_rows(4);
+  hdf5_data_param->set_shuffle(true);
+  hdf5_data_param->set_shuffle_buffer_rows(7);
+  const int data_size = 8 * 6 * 5;
+
+  Caffe::set_random_seed(1701);
+  HDF5StreamDataLayer<Dtype> layer(param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  int num_in_order = 0;
+  for (int iter = 0; iter < 8; ++iter) {
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    for (int i = 0; i < batch_size; ++i) {
+      // Rows are shuffled as a whole: the labels and the data of each row
+      // still belong together.
+      const int label = this->blob_top_label_->cpu_data()[i];
+      EXPECT_GE(label, 1);
+      EXPECT_LE(label, 10);
+      EXPECT_EQ(label + 1, this->blob_top_label2_->cpu_data()[i]);
+      const Dtype* data = this->blob_top_data_->cpu_data() + i * data_size;
+      const int file_offset = data[0] - (label - 1) * data_size;
+      EXPECT_TRUE(file_offset == 0 || file_offset == 2400);
+      for (int j = 0; j < data_size; ++j) {
+        EXPECT_EQ(data[0] + j, data[j]);
+      }
+      num_in_order += (label == (iter * batch_size + i) % 10 + 1);
+    }
+  }
+  EXPECT_LT(num_in_order, 8 * batch_size);
+}
+
 }  // namespace caffe
@@ -0,0 +1,113 @@
+#include <opencv2/core/core.hpp>
+
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "caffe/util/image_cache.hpp"
+#include "caffe/util/image_disk_cache.hpp"
+#include "caffe/util/io.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class ImageCacheTest : public ::testing::Test {};
+
+TEST_F(ImageCacheTest, TestGetPut) {
+  ImageCache cache(1000);
+  cv::Mat image(10, 10, CV_8UC3);
+  cv::Mat cached;
+  EXPECT_FALSE(cache.Get("a", &cached));
+  cache.Put("a", image);
+  EXPECT_TRUE(cache.Get("a", &cached));
+  EXPECT_EQ(cached.data, image.data);
+  EXPECT_EQ(cache.num_images(), 1);
+  EXPECT_EQ(cache.size_bytes(), 300);
+  EXPECT_EQ(cache.hits(), 1);
+  EXPECT_EQ(cache.misses(), 1);
+  // Replacing an image does not count it twice.
+  cache.Put("a", cv::Mat(5, 5, CV_8UC3));
+  EXPECT_EQ(cache.num_images(), 1);
+  EXPECT_EQ(cache.size_bytes(), 75);
+}
+
+TEST_F(ImageCacheTest, TestEvictLeastRecentlyUsed) {
+  ImageCache cache(900);
+  cache.Put("a", cv::Mat(10, 10, CV_8UC3));
+  cache.Put("b", cv::Mat(10, 10, CV_8UC3));
+  cache.Put("c", cv::Mat(10, 10, CV_8UC3));
+  EXPECT_EQ(cache.size_bytes(), 900);
+  cv::Mat cached;
+  // Touch "a" so that "b" becomes the least recently used image.
+  EXPECT_TRUE(cache.Get("a", &cached));
+  cache.Put("d", cv::Mat(10, 10, CV_8UC3));
+  EXPECT_EQ(cache.num_images(), 3);
+  EXPECT_TRUE(cache.Get("a", &cached));
+  EXPECT_FALSE(cache.Get("b", &cached));
+  EXPECT_TRUE(cache.Get("c", &cached));
+  EXPECT_TRUE(cache.Get("d", &cached));
+}
+
+TEST_F(ImageCacheTest, TestSkipOversized) {
+  ImageCache cache(100);
+  cache.Put("a", cv::Mat(10, 10, CV_8UC3));
+  cv::Mat cached;
+  EXPECT_FALSE(cache.Get("a", &cached));
+  EXPECT_EQ(cache.size_bytes(), 0);
+}
+
+class ImageDiskCacheTest : public ::testing::Test {};
+
+TEST_F(ImageDiskCacheTest, TestWriteRead) {
+  string cache_dir;
+  MakeTempDir(&cache_dir);
+  ImageDiskCache cache(cache_dir + "/images");
+  cv::Mat image(7, 5, CV_8UC3);
+  for (int h = 0; h < image.rows; ++h) {
+    for (int w = 0; w < image.cols * 3; ++w) {
+      image.ptr<uchar>(h)[w] = h * 31 + w;
+    }
+  }
+  cv::Mat cached;
+  EXPECT_FALSE(cache.Read("a.png:0x0:color", &cached));
+  EXPECT_TRUE(cache.Write("a.png:0x0:color", image));
+  // A cache opened on the same directory sees the image.
+  ImageDiskCache reopened(cache_dir + "/images");
+  ASSERT_TRUE(reopened.Read("a.png:0x0:color", &cached));
+  EXPECT_EQ(cached.rows, 7);
+  EXPECT_EQ(cached.cols, 5);
+  EXPECT_EQ(cached.channels(), 3);
+  for (int h = 0; h < image.rows; ++h) {
+    for (int w = 0; w < image.cols * 3; ++w) {
+      EXPECT_EQ(cached.ptr<uchar>(h)[w], image.ptr<uchar>(h)[w]);
+    }
+  }
+  EXPECT_FALSE(reopened.Read("a.png:0x0:gray", &cached));
+}
+
+TEST_F(ImageDiskCacheTest, TestWriteCropped) {
+  string cache_dir;
+  MakeTempDir(&cache_dir);
+  ImageDiskCache cache(cache_dir);
+  cv::Mat image(6, 6, CV_8UC1);
+  for (int h = 0; h < image.rows; ++h) {
+    for (int w = 0; w < image.cols; ++w) {
+      image.ptr<uchar>(h)[w] = h * 6 + w;
+    }
+  }
+  // Non-continuous images are stored row by row.
+  cv::Mat cropped = image(cv::Rect(1, 2, 3, 4));
+  EXPECT_TRUE(cache.Write("cropped", cropped));
+  cv::Mat cached;
+  ASSERT_TRUE(cache.Read("cropped", &cached));
+  EXPECT_EQ(cached.rows, 4);
+  EXPECT_EQ(cached.cols, 3);
+  for (int h = 0; h < cached.rows; ++h) {
+    for (int w = 0; w < cached.cols; ++w) {
+      EXPECT_EQ(cached.ptr<uchar>(h)[w], (h + 2) * 6 + w + 1);
+    }
+  }
+}
+
+}  // namespace caffe
@@ -115,6 +115,81 @@ TYPED_TEST(ImageDataLayerTest, TestResize) {
   }
 }
 
+TYPED_TEST(ImageDataLayerTest, TestCacheDir) {
+  typedef typename TypeParam::Dtype Dtype;
+  string cache_dir;
+  MakeTempDir(&cache_dir);
+  LayerParameter param;
+  ImageDataParameter* image_data_param = param.mutable_image_data_param();
+  image_data_param->set_batch_size(5);
+  image_data_param->set_source(this->filename_.c_str());
+  image_data_param->set_new_height(256);
+  image_data_param->set_new_width(256);
+  image_data_param->set_shuffle(false);
+  image_data_param->set_num_threads(2);
+  ImageDataLayer<Dtype> uncached_layer(param);
+  uncached_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  uncached_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<Dtype> expected_data;
+  expected_data.CopyFrom(*this->blob_top_data_, false, true);
+  // The first layer fills the cache, the second one only reads from it.
+  image_data_param->set_cache_dir(cache_dir);
+  for (int run = 0; run < 2; ++run) {
+    ImageDataLayer<Dtype> layer(param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    EXPECT_EQ(this->blob_top_data_->height(), 256);
+    EXPECT_EQ(this->blob_top_data_->width(), 256);
+    for (int iter = 0; iter < 2; ++iter) {
+      layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      for (int i = 0; i < 5; ++i) {
+        EXPECT_EQ(i, this->blob_top_label_->cpu_data()[i]);
+      }
+      for (int i = 0; i < expected_data.count(); ++i) {
+        EXPECT_EQ(expected_data.cpu_data()[i],
+            this->blob_top_data_->cpu_data()[i]);
+      }
+    }
+  }
+}
+
+TYPED_TEST(ImageDataLayerTest, TestAugment) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter param;
+  param.set_phase(TRAIN);
+  ImageDataParameter* image_data_param = param.mutable_image_data_param();
+  image_data_param->set_batch_size(5);
+  image_data_param->set_source(this->filename_.c_str());
+  image_data_param->set_shuffle(false);
+  TransformationParameter* transform_param = param.mutable_transform_param();
+  transform_param->set_crop_size(64);
+  transform_param->set_min_crop_area(0.2);
+  transform_param->set_max_aspect_ratio(1.5);
+  transform_param->set_brightness_jitter(0.2);
+  transform_param->set_saturation_jitter(0.2);
+  // The augmentation of every image depends on the seed, not on the number
+  // of threads loading the images.
+  Blob<Dtype> expected_data;
+  for (int num_threads = 1; num_threads <= 3; num_threads += 2) {
+    image_data_param->set_num_threads(num_threads);
+    Caffe::set_random_seed(1701);
+    ImageDataLayer<Dtype> layer(param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    EXPECT_EQ(this->blob_top_data_->num(), 5);
+    EXPECT_EQ(this->blob_top_data_->channels(), 3);
+    EXPECT_EQ(this->blob_top_data_->height(), 64);
+    EXPECT_EQ(this->blob_top_data_->width(), 64);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    if (num_threads == 1) {
+      expected_data.CopyFrom(*this->blob_top_data_, false, true);
+      continue;
+    }
+    for (int i = 0; i < expected_data.count(); ++i) {
+      EXPECT_EQ(expected_data.cpu_data()[i],
+          this->blob_top_data_->cpu_data()[i]);
+    }
+  }
+}
+
 TYPED_TEST(ImageDataLayerTest, TestReshape) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter param;
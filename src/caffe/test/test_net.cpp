@@ -613,6 +613,83 @@ class NetTest : public MultiDeviceTest<TypeParam> {
     InitNetFromProtoString(proto);
   }
 
+  // A trunk with two heads, and a third head on the data also used by the
+  // trunk, with or without Split layers summing the gradients of the heads.
+  virtual void InitSharedHeadsNet(const bool accumulate_diffs) {
+    string proto =
+        "name: 'SharedHeadsNetwork' "
+        "force_backward: true "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'DummyData' "
+        "  dummy_data_param { "
+        "    num: 5 "
+        "    channels: 2 "
+        "    height: 3 "
+        "    width: 4 "
+        "    num: 5 "
+        "    channels: 3 "
+        "    height: 1 "
+        "    width: 1 "
+        "    data_filler { "
+        "      type: 'gaussian' "
+        "      std: 1 "
+        "    } "
+        "  } "
+        "  top: 'data' "
+        "  top: 'target' "
+        "} "
+        "layer { "
+        "  name: 'trunk' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 4 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 1 "
+        "    } "
+        "  } "
+        "  bottom: 'data' "
+        "  top: 'trunk' "
+        "} ";
+    const char* heads[][2] = {
+      {"head1", "trunk"}, {"head2", "trunk"}, {"head3", "data"}
+    };
+    for (int i = 0; i < 3; ++i) {
+      proto +=
+          "layer { "
+          "  name: '" + string(heads[i][0]) + "' "
+          "  type: 'InnerProduct' "
+          "  inner_product_param { "
+          "    num_output: 3 "
+          "    weight_filler { "
+          "      type: 'gaussian' "
+          "      std: 1 "
+          "    } "
+          "  } "
+          "  bottom: '" + string(heads[i][1]) + "' "
+          "  top: '" + string(heads[i][0]) + "' "
+          "} ";
+    }
+    proto +=
+        "layer { "
+        "  name: 'loss1' "
+        "  type: 'EuclideanLoss' "
+        "  bottom: 'head1' "
+        "  bottom: 'head2' "
+        "} "
+        "layer { "
+        "  name: 'loss2' "
+        "  type: 'EuclideanLoss' "
+        "  bottom: 'head3' "
+        "  bottom: 'target' "
+        "} ";
+    if (accumulate_diffs) {
+      proto += "accumulate_diffs: true ";
+    }
+    InitNetFromProtoString(proto);
+  }
+
   int seed_;
   shared_ptr<Net<Dtype> > net_;
 };
@@ -1215,6 +1292,47 @@ TYPED_TEST(NetTest, TestParamPropagateDown) {
   }
 }
 
+TYPED_TEST(NetTest, TestAccumulateDiffs) {
+  typedef typename TypeParam::Dtype Dtype;
+  vector<Blob<Dtype>*> bottom;
+  Caffe::set_random_seed(this->seed_);
+  const bool kAccumulateDiffs = true;
+  this->InitSharedHeadsNet(!kAccumulateDiffs);
+  const int num_layers = this->net_->layers().size();
+  const Dtype loss = this->net_->ForwardBackward(bottom);
+  const bool kCopyDiff = true;
+  vector<shared_ptr<Blob<Dtype> > > param_grads;
+  this->CopyNetParams(kCopyDiff, &param_grads);
+  const bool kReshape = true;
+  Blob<Dtype> data_grad, trunk_grad;
+  data_grad.CopyFrom(*this->net_->blob_by_name("data"), kCopyDiff, kReshape);
+  trunk_grad.CopyFrom(*this->net_->blob_by_name("trunk"), kCopyDiff,
+      kReshape);
+  // Without the splits of 'data' and 'trunk', the gradients are the same.
+  Caffe::set_random_seed(this->seed_);
+  this->InitSharedHeadsNet(kAccumulateDiffs);
+  EXPECT_EQ(num_layers - 2, this->net_->layers().size());
+  EXPECT_FALSE(this->net_->layer_by_name("head2")->accumulate_bottom_diff(0));
+  EXPECT_TRUE(this->net_->layer_by_name("head1")->accumulate_bottom_diff(0));
+  EXPECT_NEAR(loss, this->net_->ForwardBackward(bottom), 1e-4);
+  const vector<shared_ptr<Blob<Dtype> > >& params = this->net_->params();
+  ASSERT_EQ(param_grads.size(), params.size());
+  for (int i = 0; i < params.size(); ++i) {
+    for (int j = 0; j < params[i]->count(); ++j) {
+      EXPECT_NEAR(param_grads[i]->cpu_diff()[j], params[i]->cpu_diff()[j],
+          1e-4);
+    }
+  }
+  const Blob<Dtype>* data = this->net_->blob_by_name("data").get();
+  for (int i = 0; i < data->count(); ++i) {
+    EXPECT_NEAR(data_grad.cpu_diff()[i], data->cpu_diff()[i], 1e-4);
+  }
+  const Blob<Dtype>* trunk = this->net_->blob_by_name("trunk").get();
+  for (int i = 0; i < trunk->count(); ++i) {
+    EXPECT_NEAR(trunk_grad.cpu_diff()[i], trunk->cpu_diff()[i], 1e-4);
+  }
+}
+
 TYPED_TEST(NetTest, TestFromTo) {
   typedef typename TypeParam::Dtype Dtype;
   this->InitTinyNet();
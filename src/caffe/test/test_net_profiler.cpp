@@ -0,0 +1,162 @@
+#include <fstream>  // NOLINT(readability/streams)
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/net.hpp"
+#include "caffe/net_profiler.hpp"
+#include "caffe/util/io.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class NetProfilerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  NetProfilerTest() : profiler_(new NetProfiler<Dtype>()) {
+    const string proto =
+        "name: 'ProfiledNet' "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'DummyData' "
+        "  dummy_data_param { "
+        "    shape { dim: 2 dim: 3 dim: 4 dim: 4 } "
+        "    shape { dim: 2 dim: 5 } "
+        "    data_filler { type: 'gaussian' std: 0.01 } "
+        "  } "
+        "  top: 'data' "
+        "  top: 'label' "
+        "} "
+        "layer { "
+        "  name: 'conv' "
+        "  type: 'Convolution' "
+        "  convolution_param { "
+        "    num_output: 2 "
+        "    kernel_size: 3 "
+        "    weight_filler { type: 'gaussian' std: 0.01 } "
+        "  } "
+        "  bottom: 'data' "
+        "  top: 'conv' "
+        "} "
+        "layer { "
+        "  name: 'ip' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 5 "
+        "    weight_filler { type: 'gaussian' std: 0.01 } "
+        "  } "
+        "  bottom: 'conv' "
+        "  top: 'ip' "
+        "} "
+        "layer { "
+        "  name: 'loss' "
+        "  type: 'EuclideanLoss' "
+        "  bottom: 'ip' "
+        "  bottom: 'label' "
+        "  top: 'loss' "
+        "} ";
+    NetParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+    net_.reset(new Net<Dtype>(param));
+    net_->set_profiler(profiler_);
+  }
+
+  // Returns the events of the given layer and pass.
+  vector<typename NetProfiler<Dtype>::Event> LayerEvents(
+      const string& layer_name, typename NetProfiler<Dtype>::Pass pass) {
+    vector<typename NetProfiler<Dtype>::Event> layer_events;
+    const vector<typename NetProfiler<Dtype>::Event>& events =
+        profiler_->events();
+    for (int i = 0; i < events.size(); ++i) {
+      if (profiler_->layer_name(events[i].layer_id) == layer_name &&
+          events[i].pass == pass) {
+        layer_events.push_back(events[i]);
+      }
+    }
+    return layer_events;
+  }
+
+  shared_ptr<NetProfiler<Dtype> > profiler_;
+  shared_ptr<Net<Dtype> > net_;
+};
+
+TYPED_TEST_CASE(NetProfilerTest, TestDtypesAndDevices);
+
+TYPED_TEST(NetProfilerTest, TestRecordsLayerPasses) {
+  typedef typename TypeParam::Dtype Dtype;
+  const vector<Blob<Dtype>*> bottom;
+  for (int i = 0; i < 3; ++i) {
+    this->net_->ForwardBackward(bottom);
+  }
+  // 4 forward passes and 3 backward passes (not the data layer) each time.
+  EXPECT_EQ(this->profiler_->events().size(), 3 * 7);
+  EXPECT_EQ(this->LayerEvents("data", NetProfiler<Dtype>::BACKWARD).size(),
+      0);
+  const vector<typename NetProfiler<Dtype>::Event> conv_forward =
+      this->LayerEvents("conv", NetProfiler<Dtype>::FORWARD);
+  ASSERT_EQ(conv_forward.size(), 3);
+  // 2 x 2 x 2 x 2 outputs of 3 x 3 x 3 multiply-adds.
+  EXPECT_EQ(conv_forward[0].flops, 16 * 27 * 2);
+  // Bottom, top, weights and bias.
+  EXPECT_EQ(conv_forward[0].bytes, (96 + 16 + 54 + 2) * sizeof(Dtype));
+  const vector<typename NetProfiler<Dtype>::Event> ip_backward =
+      this->LayerEvents("ip", NetProfiler<Dtype>::BACKWARD);
+  ASSERT_EQ(ip_backward.size(), 3);
+  EXPECT_EQ(ip_backward[0].flops, 2 * 16 * 5 * 2);
+  EXPECT_EQ(this->profiler_->layer_type(ip_backward[0].layer_id),
+      string("InnerProduct"));
+  for (int i = 1; i < conv_forward.size(); ++i) {
+    EXPECT_GE(conv_forward[i].start_us, conv_forward[i - 1].start_us);
+    EXPECT_GE(conv_forward[i].duration_us, 0);
+  }
+  // Every buffer is allocated by the first pass.
+  const vector<typename NetProfiler<Dtype>::Event>& events =
+      this->profiler_->events();
+  for (int i = 7; i < events.size(); ++i) {
+    EXPECT_EQ(events[i].allocated_bytes, 0);
+  }
+}
+
+TYPED_TEST(NetProfilerTest, TestSummaryAndTrace) {
+  typedef typename TypeParam::Dtype Dtype;
+  const vector<Blob<Dtype>*> bottom;
+  this->net_->ForwardBackward(bottom);
+  this->net_->ForwardBackward(bottom);
+  const string summary = this->profiler_->Summary();
+  std::istringstream lines(summary);
+  string line;
+  int num_lines = 0;
+  while (std::getline(lines, line)) {
+    EXPECT_NE(line.find(" p99 "), string::npos) << line;
+    ++num_lines;
+  }
+  EXPECT_EQ(num_lines, 7);
+  EXPECT_NE(summary.find("conv"), string::npos);
+
+  string filename;
+  MakeTempFilename(&filename);
+  this->profiler_->WriteChromeTrace(filename);
+  std::ifstream file(filename.c_str());
+  std::stringstream trace;
+  trace << file.rdbuf();
+  EXPECT_EQ(trace.str().find("{\"traceEvents\":["), 0);
+  EXPECT_NE(trace.str().find("\"name\":\"ip\",\"cat\":\"backward\""),
+      string::npos);
+  EXPECT_EQ(trace.str().substr(trace.str().size() - 3), "]}\n");
+
+  this->profiler_->Clear();
+  EXPECT_EQ(this->profiler_->events().size(), 0);
+  this->net_->set_profiler(shared_ptr<NetProfiler<Dtype> >());
+  this->net_->ForwardBackward(bottom);
+  EXPECT_EQ(this->profiler_->events().size(), 0);
+}
+
+}  // namespace caffe
@@ -0,0 +1,162 @@
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/net.hpp"
+#include "caffe/vision_layers.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class ROIPoolingLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  ROIPoolingLayerTest()
+      : blob_bottom_data_(new Blob<Dtype>(2, 3, 6, 5)),
+        blob_bottom_rois_(new Blob<Dtype>()),
+        blob_top_(new Blob<Dtype>()) {}
+  virtual void SetUp() {
+    Caffe::set_random_seed(1701);
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_data_);
+    // Overlapping ROIs of both images, one partly outside of the map.
+    const Dtype rois[][5] = {
+      {0, 0, 0, 4, 5}, {0, 1, 2, 3, 4}, {1, 0, 1, 4, 3}, {1, 2, 3, 7, 8}
+    };
+    SetROIs(rois, 4);
+    blob_bottom_vec_.push_back(blob_bottom_data_);
+    blob_bottom_vec_.push_back(blob_bottom_rois_);
+    blob_top_vec_.push_back(blob_top_);
+  }
+  virtual ~ROIPoolingLayerTest() {
+    delete blob_bottom_data_;
+    delete blob_bottom_rois_;
+    delete blob_top_;
+  }
+
+  void SetROIs(const Dtype rois[][5], int num_rois) {
+    vector<int> shape(2);
+    shape[0] = num_rois;
+    shape[1] = 5;
+    blob_bottom_rois_->Reshape(shape);
+    for (int r = 0; r < num_rois; ++r) {
+      for (int i = 0; i < 5; ++i) {
+        blob_bottom_rois_->mutable_cpu_data()[r * 5 + i] = rois[r][i];
+      }
+    }
+  }
+
+  Blob<Dtype>* const blob_bottom_data_;
+  Blob<Dtype>* const blob_bottom_rois_;
+  Blob<Dtype>* const blob_top_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(ROIPoolingLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(ROIPoolingLayerTest, TestSetup) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ROIPoolingParameter* roi_pooling_param =
+      layer_param.mutable_roi_pooling_param();
+  roi_pooling_param->set_pooled_h(3);
+  roi_pooling_param->set_pooled_w(2);
+  ROIPoolingLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(this->blob_top_->num(), 4);
+  EXPECT_EQ(this->blob_top_->channels(), 3);
+  EXPECT_EQ(this->blob_top_->height(), 3);
+  EXPECT_EQ(this->blob_top_->width(), 2);
+}
+
+TYPED_TEST(ROIPoolingLayerTest, TestForward) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Maps of 2 channels of 4 x 4 increasing values, 100 more per map.
+  this->blob_bottom_data_->Reshape(2, 2, 4, 4);
+  for (int i = 0; i < this->blob_bottom_data_->count(); ++i) {
+    this->blob_bottom_data_->mutable_cpu_data()[i] = (i / 16) * 100 + i % 16;
+  }
+  // With a spatial scale of 1/2: the whole of map 0, (1, 1) to (3, 3) of
+  // map 1, and a region out of the map.
+  const Dtype rois[][5] = {
+    {0, 0, 0, 6, 6}, {1, 2, 2, 6, 6}, {0, 20, 20, 30, 30}
+  };
+  this->SetROIs(rois, 3);
+  LayerParameter layer_param;
+  ROIPoolingParameter* roi_pooling_param =
+      layer_param.mutable_roi_pooling_param();
+  roi_pooling_param->set_pooled_h(2);
+  roi_pooling_param->set_pooled_w(2);
+  roi_pooling_param->set_spatial_scale(0.5);
+  roi_pooling_param->set_num_threads(2);
+  ROIPoolingLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  // The bins of the 4 x 4 region are its 2 x 2 quarters; those of the 3 x 3
+  // one overlap on its middle row and column.
+  const Dtype expected[][4] = {{5, 7, 13, 15}, {10, 11, 14, 15}, {0, 0, 0, 0}};
+  const Dtype offsets[][2] = {{0, 100}, {200, 300}, {0, 0}};
+  for (int r = 0; r < 3; ++r) {
+    for (int c = 0; c < 2; ++c) {
+      for (int i = 0; i < 4; ++i) {
+        EXPECT_EQ(this->blob_top_->data_at(r, c, i / 2, i % 2),
+            expected[r][i] + offsets[r][c]);
+      }
+    }
+  }
+}
+
+TYPED_TEST(ROIPoolingLayerTest, TestGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ROIPoolingParameter* roi_pooling_param =
+      layer_param.mutable_roi_pooling_param();
+  roi_pooling_param->set_pooled_h(3);
+  roi_pooling_param->set_pooled_w(2);
+  roi_pooling_param->set_num_threads(2);
+  ROIPoolingLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-4, 1e-2);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 0);
+}
+
+TYPED_TEST(ROIPoolingLayerTest, TestForceBackward) {
+  typedef typename TypeParam::Dtype Dtype;
+  // force_backward reaches the feature maps, but not the ROIs.
+  const string proto =
+      "force_backward: true "
+      "input: 'data' "
+      "input_shape { dim: 2 dim: 3 dim: 6 dim: 5 } "
+      "input: 'rois' "
+      "input_shape { dim: 4 dim: 5 } "
+      "layer { "
+      "  name: 'roi_pool' "
+      "  type: 'ROIPooling' "
+      "  roi_pooling_param { pooled_h: 3 pooled_w: 2 } "
+      "  bottom: 'data' "
+      "  bottom: 'rois' "
+      "  top: 'pool' "
+      "} ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  Net<Dtype> net(param);
+  EXPECT_TRUE(net.bottom_need_backward()[0][0]);
+  EXPECT_FALSE(net.bottom_need_backward()[0][1]);
+  net.input_blobs()[0]->CopyFrom(*this->blob_bottom_data_);
+  net.input_blobs()[1]->CopyFrom(*this->blob_bottom_rois_);
+  net.ForwardPrefilled();
+  net.Backward();
+}
+
+}  // namespace caffe
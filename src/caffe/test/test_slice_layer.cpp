@@ -161,6 +161,27 @@ TYPED_TEST(SliceLayerTest, TestSliceAcrossChannels) {
   }
 }
 
+TYPED_TEST(SliceLayerTest, TestSliceAcrossNumShareMemory) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_slice_param()->set_axis(0);
+  layer_param.mutable_slice_param()->set_share_memory(true);
+  SliceLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_1_);
+  if (Caffe::mode() == Caffe::CPU) {
+    EXPECT_EQ(this->blob_top_1_->cpu_data(),
+        this->blob_bottom_->cpu_data() + this->blob_top_0_->count());
+    EXPECT_EQ(this->blob_top_2_->cpu_diff(),
+        this->blob_bottom_->cpu_diff() + 2 * this->blob_top_0_->count());
+  }
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_1_);
+  const int top_count = this->blob_top_0_->count();
+  for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+    EXPECT_EQ(this->blob_bottom_->cpu_data()[i],
+        this->blob_top_vec_1_[i / top_count]->cpu_data()[i % top_count]);
+  }
+}
+
 TYPED_TEST(SliceLayerTest, TestGradientAcrossNum) {
   typedef typename TypeParam::Dtype Dtype;
   // Gradient checks are slow; reduce blob size.
@@ -173,6 +194,26 @@ TYPED_TEST(SliceLayerTest, TestGradientAcrossNum) {
     this->blob_top_vec_0_);
 }
 
+TYPED_TEST(SliceLayerTest, TestGradientAcrossNumShareMemory) {
+  typedef typename TypeParam::Dtype Dtype;
+  // A small bottom, holding no more memory than its count to be shared.
+  Blob<Dtype> bottom(4, 5, 2, 2);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(&bottom);
+  vector<Blob<Dtype>*> bottom_vec(1, &bottom);
+  LayerParameter layer_param;
+  layer_param.mutable_slice_param()->set_axis(0);
+  layer_param.mutable_slice_param()->set_share_memory(true);
+  SliceLayer<Dtype> layer(layer_param);
+  layer.SetUp(bottom_vec, this->blob_top_vec_0_);
+  if (Caffe::mode() == Caffe::CPU) {
+    EXPECT_EQ(this->blob_top_0_->cpu_diff(), bottom.cpu_diff());
+  }
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, bottom_vec, this->blob_top_vec_0_);
+}
+
 TYPED_TEST(SliceLayerTest, TestGradientAcrossChannels) {
   typedef typename TypeParam::Dtype Dtype;
   // Gradient checks are slow; reduce blob size.
@@ -8,6 +8,7 @@
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
+#include "caffe/layer_factory.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/insert_splits.hpp"
 #include "caffe/vision_layers.hpp"
@@ -948,6 +949,100 @@ TEST_F(SplitLayerInsertionTest, TestInputInsertion) {
   this->RunInsertionTest(input_proto, expected_output_proto);
 }
 
+TEST_F(SplitLayerInsertionTest, TestAccumulateDiffs) {
+  // The inner products share 'data', but not 'innerprod1', also used by the
+  // loss.
+  const string& input_proto =
+      "name: 'TestNetwork' "
+      "accumulate_diffs: true "
+      "input: 'data' "
+      "input_dim: 10 "
+      "input_dim: 3 "
+      "input_dim: 227 "
+      "input_dim: 227 "
+      "layer { "
+      "  name: 'innerprod1' "
+      "  type: 'InnerProduct' "
+      "  bottom: 'data' "
+      "  top: 'innerprod1' "
+      "} "
+      "layer { "
+      "  name: 'innerprod2' "
+      "  type: 'InnerProduct' "
+      "  bottom: 'data' "
+      "  top: 'innerprod2' "
+      "} "
+      "layer { "
+      "  name: 'innerprod3' "
+      "  type: 'InnerProduct' "
+      "  bottom: 'innerprod1' "
+      "  top: 'innerprod3' "
+      "} "
+      "layer { "
+      "  name: 'loss' "
+      "  type: 'EuclideanLoss' "
+      "  bottom: 'innerprod1' "
+      "  bottom: 'innerprod2' "
+      "} ";
+  const string& expected_output_proto =
+      "name: 'TestNetwork' "
+      "accumulate_diffs: true "
+      "input: 'data' "
+      "input_dim: 10 "
+      "input_dim: 3 "
+      "input_dim: 227 "
+      "input_dim: 227 "
+      "layer { "
+      "  name: 'innerprod1' "
+      "  type: 'InnerProduct' "
+      "  bottom: 'data' "
+      "  top: 'innerprod1' "
+      "} "
+      "layer { "
+      "  name: 'innerprod1_innerprod1_0_split' "
+      "  type: 'Split' "
+      "  bottom: 'innerprod1' "
+      "  top: 'innerprod1_innerprod1_0_split_0' "
+      "  top: 'innerprod1_innerprod1_0_split_1' "
+      "} "
+      "layer { "
+      "  name: 'innerprod2' "
+      "  type: 'InnerProduct' "
+      "  bottom: 'data' "
+      "  top: 'innerprod2' "
+      "} "
+      "layer { "
+      "  name: 'innerprod3' "
+      "  type: 'InnerProduct' "
+      "  bottom: 'innerprod1_innerprod1_0_split_0' "
+      "  top: 'innerprod3' "
+      "} "
+      "layer { "
+      "  name: 'loss' "
+      "  type: 'EuclideanLoss' "
+      "  bottom: 'innerprod1_innerprod1_0_split_1' "
+      "  bottom: 'innerprod2' "
+      "} ";
+  this->RunInsertionTest(input_proto, expected_output_proto);
+}
+
+TEST_F(SplitLayerInsertionTest, TestAllowAccumulateBottomDiff) {
+  // InsertSplits and the layers get the same answer for their type.
+  EXPECT_TRUE(LayerTypeAllowsAccumulateBottomDiff("InnerProduct", 0));
+  EXPECT_TRUE(LayerTypeAllowsAccumulateBottomDiff("ROIPooling", 0));
+  EXPECT_FALSE(LayerTypeAllowsAccumulateBottomDiff("ROIPooling", 1));
+  EXPECT_FALSE(LayerTypeAllowsAccumulateBottomDiff("Convolution", 0));
+  EXPECT_FALSE(LayerTypeAllowsAccumulateBottomDiff("Python", 0));
+  LayerParameter layer_param;
+  InnerProductLayer<float> inner_product_layer(layer_param);
+  EXPECT_TRUE(inner_product_layer.AllowAccumulateBottomDiff(0));
+  ROIPoolingLayer<float> roi_pooling_layer(layer_param);
+  EXPECT_TRUE(roi_pooling_layer.AllowAccumulateBottomDiff(0));
+  EXPECT_FALSE(roi_pooling_layer.AllowAccumulateBottomDiff(1));
+  ConvolutionLayer<float> convolution_layer(layer_param);
+  EXPECT_FALSE(convolution_layer.AllowAccumulateBottomDiff(0));
+}
+
 TEST_F(SplitLayerInsertionTest, TestWithInPlace) {
   const string& input_proto =
       "name: 'TestNetwork' "
@@ -0,0 +1,115 @@
+#include <boost/ref.hpp>
+#include <boost/thread.hpp>
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/util/thread_pool.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class ThreadPoolTest : public ::testing::Test {};
+
+// Increments counts[i] once for every task index i.
+class CountTask {
+ public:
+  explicit CountTask(vector<int>* counts) : counts_(counts) {}
+  void operator()(int i) const { ++(*counts_)[i]; }
+
+ private:
+  vector<int>* counts_;
+};
+
+// Task blocking until released, signalling when the first one has started.
+class BlockingTask {
+ public:
+  BlockingTask() : started_(false), released_(false) {}
+  void operator()(int i) {
+    boost::mutex::scoped_lock lock(mutex_);
+    started_ = true;
+    cond_.notify_all();
+    while (!released_) {
+      cond_.wait(lock);
+    }
+  }
+  void WaitStarted() {
+    boost::mutex::scoped_lock lock(mutex_);
+    while (!started_) {
+      cond_.wait(lock);
+    }
+  }
+  void Release() {
+    boost::mutex::scoped_lock lock(mutex_);
+    released_ = true;
+    cond_.notify_all();
+  }
+
+ private:
+  boost::mutex mutex_;
+  boost::condition_variable cond_;
+  bool started_;
+  bool released_;
+};
+
+void RunBlocking(ThreadPool* pool, BlockingTask* task) {
+  pool->Run(2, boost::ref(*task));
+}
+
+TEST_F(ThreadPoolTest, TestDefaultSize) {
+  ThreadPool pool(0);
+  EXPECT_EQ(pool.num_threads(), ThreadPool::HardwareConcurrency());
+  EXPECT_GE(pool.num_threads(), 1);
+}
+
+TEST_F(ThreadPoolTest, TestGlobal) {
+  ThreadPool& pool = ThreadPool::Global();
+  EXPECT_EQ(&pool, &ThreadPool::Global());
+  EXPECT_EQ(pool.num_threads(), ThreadPool::HardwareConcurrency());
+}
+
+TEST_F(ThreadPoolTest, TestRunInline) {
+  ThreadPool pool(1);
+  vector<int> counts(17, 0);
+  pool.Run(counts.size(), CountTask(&counts));
+  for (int i = 0; i < counts.size(); ++i) {
+    EXPECT_EQ(counts[i], 1);
+  }
+}
+
+TEST_F(ThreadPoolTest, TestRunEachIndexOnce) {
+  ThreadPool pool(4);
+  EXPECT_EQ(pool.num_threads(), 4);
+  vector<int> counts(1000, 0);
+  // Reuse the pool for several batches of work.
+  for (int iter = 0; iter < 5; ++iter) {
+    pool.Run(counts.size(), CountTask(&counts));
+    for (int i = 0; i < counts.size(); ++i) {
+      EXPECT_EQ(counts[i], iter + 1);
+    }
+  }
+  pool.Run(0, CountTask(&counts));
+}
+
+TEST_F(ThreadPoolTest, TestTryRunBusy) {
+  ThreadPool pool(2);
+  BlockingTask blocking_task;
+  boost::thread runner(&RunBlocking, &pool, &blocking_task);
+  blocking_task.WaitStarted();
+  // The pool is busy, so TryRun gives up without running anything.
+  vector<int> counts(10, 0);
+  EXPECT_FALSE(pool.TryRun(counts.size(), CountTask(&counts)));
+  for (int i = 0; i < counts.size(); ++i) {
+    EXPECT_EQ(counts[i], 0);
+  }
+  blocking_task.Release();
+  runner.join();
+  EXPECT_TRUE(pool.TryRun(counts.size(), CountTask(&counts)));
+  for (int i = 0; i < counts.size(); ++i) {
+    EXPECT_EQ(counts[i], 1);
+  }
+}
+
+}  // namespace caffe
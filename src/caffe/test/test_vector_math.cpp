@@ -0,0 +1,284 @@
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/util/cpu_dispatch.hpp"
+#include "caffe/util/vector_math.hpp"
+#include "caffe/util/vector_math_kernels.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+namespace {
+
+// The number of floats between a and b.
+int64_t UlpDistance(float a, float b) {
+  int32_t a_bits, b_bits;
+  memcpy(&a_bits, &a, sizeof(a));  // NOLINT(caffe/alt_fn)
+  memcpy(&b_bits, &b, sizeof(b));  // NOLINT(caffe/alt_fn)
+  // Map the sign-magnitude bits to a monotonic integer scale.
+  const int64_t a_ordered = a_bits < 0 ?
+      INT32_MIN - static_cast<int64_t>(a_bits) : a_bits;
+  const int64_t b_ordered = b_bits < 0 ?
+      INT32_MIN - static_cast<int64_t>(b_bits) : b_bits;
+  return a_ordered > b_ordered ? a_ordered - b_ordered : b_ordered - a_ordered;
+}
+
+// n values evenly spaced in [begin, end].
+vector<float> Linspace(double begin, double end, int n) {
+  vector<float> x(n);
+  for (int i = 0; i < n; ++i) {
+    x[i] = begin + (end - begin) * i / (n - 1);
+  }
+  return x;
+}
+
+}  // namespace
+
+class FastMathTest : public ::testing::Test {
+ protected:
+  // Returns the largest error in ulp of f over x, compared to the double
+  // reference rounded to float.
+  int64_t MaxUlpError(void (*f)(const int, const float*, float*),
+      double (*reference)(double),  // NOLINT(readability/casting)
+      const vector<float>& x) {
+    vector<float> y(x.size());
+    f(x.size(), &x[0], &y[0]);
+    int64_t max_error = 0;
+    for (int i = 0; i < x.size(); ++i) {
+      const float expected = static_cast<float>(reference(x[i]));
+      const int64_t error = UlpDistance(y[i], expected);
+      EXPECT_LE(error, 2) << "at " << x[i] << ": " << y[i] << " instead of "
+          << expected;
+      max_error = std::max(max_error, error);
+    }
+    return max_error;
+  }
+};
+
+TEST_F(FastMathTest, TestExp) {
+  const vector<float> x = Linspace(-87.3, 88.7, 1000001);
+  LOG(INFO) << "exp max error: " << MaxUlpError(caffe_cpu_fast_exp<float>,
+      std::exp, x) << " ulp";
+  const float inf = std::numeric_limits<float>::infinity();
+  const float special[] = {-inf, -1000, 0, 89, 1000, inf,
+      std::numeric_limits<float>::quiet_NaN()};
+  float y[7];
+  caffe_cpu_fast_exp(7, special, y);
+  EXPECT_EQ(y[0], 0);
+  EXPECT_EQ(y[1], 0);
+  EXPECT_EQ(y[2], 1);
+  EXPECT_EQ(y[3], inf);
+  EXPECT_EQ(y[4], inf);
+  EXPECT_EQ(y[5], inf);
+  EXPECT_NE(y[6], y[6]);  // NaN
+}
+
+TEST_F(FastMathTest, TestLog) {
+  // Every power of 2 from the smallest denormal up, and a dense range.
+  vector<float> x = Linspace(1e-3, 1e3, 1000001);
+  for (int e = -149; e < 128; ++e) {
+    x.push_back(std::ldexp(1.f, e));
+    x.push_back(std::ldexp(1.2345f, e - 1));
+  }
+  LOG(INFO) << "log max error: " << MaxUlpError(caffe_cpu_fast_log<float>,
+      std::log, x) << " ulp";
+  const float inf = std::numeric_limits<float>::infinity();
+  const float special[] = {0, -1, inf, std::numeric_limits<float>::quiet_NaN()};
+  float y[4];
+  caffe_cpu_fast_log(4, special, y);
+  EXPECT_EQ(y[0], -inf);
+  EXPECT_NE(y[1], y[1]);  // NaN
+  EXPECT_EQ(y[2], inf);
+  EXPECT_NE(y[3], y[3]);  // NaN
+}
+
+TEST_F(FastMathTest, TestTanh) {
+  const vector<float> x = Linspace(-10, 10, 1000001);
+  LOG(INFO) << "tanh max error: " << MaxUlpError(caffe_cpu_tanh<float>,
+      std::tanh, x) << " ulp";
+  const float inf = std::numeric_limits<float>::infinity();
+  const float special[] = {-inf, 0, 100, inf};
+  float y[4];
+  caffe_cpu_tanh(4, special, y);
+  EXPECT_EQ(y[0], -1);
+  EXPECT_EQ(y[1], 0);
+  EXPECT_EQ(y[2], 1);
+  EXPECT_EQ(y[3], 1);
+}
+
+TEST_F(FastMathTest, TestPowx) {
+  const float x[] = {0.25, 2, 3.5, 1000, 0, -2};
+  float y[6];
+  caffe_cpu_fast_powx(4, x, -0.75f, y);
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_NEAR(y[i], std::pow(x[i], -0.75), std::pow(x[i], -0.75) * 1e-6);
+  }
+  caffe_cpu_fast_powx(4, x, 0.5f, y);
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_EQ(y[i], std::sqrt(x[i]));
+  }
+  // Non-positive values are left to pow.
+  caffe_cpu_fast_powx(6, x, 2.f, y);
+  for (int i = 0; i < 6; ++i) {
+    EXPECT_EQ(y[i], x[i] * x[i]);
+  }
+  caffe_cpu_fast_powx(6, x, 3.f, y);
+  EXPECT_EQ(y[4], 0);
+  EXPECT_EQ(y[5], -8);
+}
+
+TEST(CPUDispatchTest, TestInstructionSetNames) {
+  for (int i = CPU_GENERIC; i <= CPU_AVX512; ++i) {
+    const CPUInstructionSet instruction_set =
+        static_cast<CPUInstructionSet>(i);
+    CPUInstructionSet parsed;
+    EXPECT_TRUE(ParseCPUInstructionSet(CPUInstructionSetName(instruction_set),
+        &parsed));
+    EXPECT_EQ(instruction_set, parsed);
+  }
+  CPUInstructionSet parsed;
+  EXPECT_FALSE(ParseCPUInstructionSet("sse9", &parsed));
+  EXPECT_LE(SelectedCPUInstructionSet(), SupportedCPUInstructionSet());
+}
+
+TEST(CPUDispatchTest, TestKernelsOfEachInstructionSet) {
+  const vector<float> x = Linspace(-80, 80, 100003);
+  vector<float> y(x.size());
+  const int n = x.size();
+  // Every variant this build has and this CPU runs.
+  for (int i = CPU_GENERIC; i <= SupportedCPUInstructionSet(); ++i) {
+    const CPUInstructionSet instruction_set =
+        static_cast<CPUInstructionSet>(i);
+    VectorMathKernels<float> float_kernels;
+    VectorMathKernels<double> double_kernels;
+    if (!GetVectorMathKernels(instruction_set, &float_kernels,
+        &double_kernels)) {
+      LOG(INFO) << "No " << CPUInstructionSetName(instruction_set)
+          << " kernels in this build";
+      continue;
+    }
+    float_kernels.fast_exp(&x[0], &y[0], 0, n);
+    for (int j = 0; j < n; ++j) {
+      EXPECT_LE(UlpDistance(y[j],
+          static_cast<float>(std::exp(static_cast<double>(x[j])))), 2)
+          << CPUInstructionSetName(instruction_set) << " exp at " << x[j];
+    }
+    float_kernels.fast_log(&x[n / 2 + 1], &y[0], 0, n / 2);
+    for (int j = 0; j < n / 2; ++j) {
+      const float z = x[n / 2 + 1 + j];
+      EXPECT_LE(UlpDistance(y[j],
+          static_cast<float>(std::log(static_cast<double>(z)))), 2)
+          << CPUInstructionSetName(instruction_set) << " log at " << z;
+    }
+    float_kernels.tanh(&x[0], &y[0], 0, n);
+    for (int j = 0; j < n; ++j) {
+      EXPECT_LE(UlpDistance(y[j],
+          static_cast<float>(std::tanh(static_cast<double>(x[j])))), 2)
+          << CPUInstructionSetName(instruction_set) << " tanh at " << x[j];
+    }
+    float_kernels.relu(&x[0], 0.5f, &y[0], 0, n);
+    for (int j = 0; j < n; ++j) {
+      EXPECT_EQ(y[j], x[j] > 0 ? x[j] : 0.5f * x[j]);
+    }
+    // Only the given range is written.
+    vector<double> dx(4, 0), dy(4, 1);
+    double_kernels.sigmoid(&dy[0], &dx[0], 1, 3);
+    EXPECT_EQ(dx[0], 0);
+    EXPECT_NEAR(dx[1], 1 / (1 + std::exp(-1.)), 1e-15);
+    EXPECT_NEAR(dx[2], 1 / (1 + std::exp(-1.)), 1e-15);
+    EXPECT_EQ(dx[3], 0);
+  }
+}
+
+template <typename Dtype>
+class VectorMathTest : public ::testing::Test {
+ protected:
+  // Enough elements to be split over threads.
+  VectorMathTest() : x_(new Blob<Dtype>(1, 1, 1, 1 << 18)),
+      dy_(new Blob<Dtype>()), y_(new Blob<Dtype>()), dx_(new Blob<Dtype>()) {
+    FillerParameter filler_param;
+    filler_param.set_std(3);
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(x_.get());
+    dy_->ReshapeLike(*x_);
+    filler.Fill(dy_.get());
+    y_->ReshapeLike(*x_);
+    dx_->ReshapeLike(*x_);
+  }
+
+  shared_ptr<Blob<Dtype> > x_;
+  shared_ptr<Blob<Dtype> > dy_;
+  shared_ptr<Blob<Dtype> > y_;
+  shared_ptr<Blob<Dtype> > dx_;
+};
+
+TYPED_TEST_CASE(VectorMathTest, TestDtypes);
+
+TYPED_TEST(VectorMathTest, TestReLU) {
+  const int n = this->x_->count();
+  const TypeParam* x = this->x_->cpu_data();
+  const TypeParam* dy = this->dy_->cpu_data();
+  caffe_cpu_relu(n, x, TypeParam(0.1), this->y_->mutable_cpu_data());
+  caffe_cpu_relu_backward(n, x, dy, TypeParam(0.1),
+      this->dx_->mutable_cpu_data());
+  for (int i = 0; i < n; ++i) {
+    const TypeParam slope = x[i] > 0 ? 1 : 0.1;
+    EXPECT_EQ(this->y_->cpu_data()[i], x[i] * slope);
+    EXPECT_EQ(this->dx_->cpu_data()[i], dy[i] * slope);
+  }
+  // In place.
+  caffe_cpu_relu(n, x, TypeParam(0), this->x_->mutable_cpu_data());
+  for (int i = 0; i < n; ++i) {
+    EXPECT_GE(this->x_->cpu_data()[i], 0);
+  }
+}
+
+TYPED_TEST(VectorMathTest, TestSigmoid) {
+  const int n = this->x_->count();
+  const TypeParam* x = this->x_->cpu_data();
+  const TypeParam* dy = this->dy_->cpu_data();
+  caffe_cpu_sigmoid(n, x, this->y_->mutable_cpu_data());
+  const TypeParam* y = this->y_->cpu_data();
+  caffe_cpu_sigmoid_backward(n, y, dy, this->dx_->mutable_cpu_data());
+  for (int i = 0; i < n; ++i) {
+    const double expected = 1. / (1. + std::exp(-x[i]));
+    EXPECT_NEAR(y[i], expected, expected * 1e-6);
+    EXPECT_NEAR(this->dx_->cpu_data()[i], dy[i] * y[i] * (1 - y[i]), 1e-6);
+  }
+}
+
+TYPED_TEST(VectorMathTest, TestBNLL) {
+  const int n = this->x_->count();
+  const TypeParam* x = this->x_->cpu_data();
+  const TypeParam* dy = this->dy_->cpu_data();
+  caffe_cpu_bnll(n, x, this->y_->mutable_cpu_data());
+  caffe_cpu_bnll_backward(n, x, dy, this->dx_->mutable_cpu_data());
+  for (int i = 0; i < n; ++i) {
+    const double expected = std::log(1. + std::exp(x[i]));
+    EXPECT_NEAR(this->y_->cpu_data()[i], expected, 1e-6 * (1 + expected));
+    EXPECT_NEAR(this->dx_->cpu_data()[i], dy[i] / (1. + std::exp(-x[i])),
+        1e-5);
+  }
+}
+
+TYPED_TEST(VectorMathTest, TestThreshold) {
+  const int n = this->x_->count();
+  const TypeParam* x = this->x_->cpu_data();
+  caffe_cpu_threshold(n, x, TypeParam(0.5), this->y_->mutable_cpu_data());
+  for (int i = 0; i < n; ++i) {
+    EXPECT_EQ(this->y_->cpu_data()[i], x[i] > 0.5 ? 1 : 0);
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,136 @@
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/data_layers.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/io.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class WindowDataLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  WindowDataLayerTest()
+      : blob_top_data_(new Blob<Dtype>()),
+        blob_top_label_(new Blob<Dtype>()) {}
+  virtual void SetUp() {
+    blob_top_vec_.push_back(blob_top_data_);
+    blob_top_vec_.push_back(blob_top_label_);
+    // Create test window file: two images, with foreground and background
+    // windows each.
+    MakeTempFilename(&filename_);
+    std::ofstream outfile(filename_.c_str(), std::ofstream::out);
+    LOG(INFO) << "Using temporary file " << filename_;
+    outfile << "# 0\n" EXAMPLES_SOURCE_DIR "images/cat.jpg\n3\n360\n480\n3\n"
+        << "1 0.8 10 20 60 70\n"
+        << "2 0.9 30 5 75 50\n"
+        << "0 0.1 0 0 40 30\n";
+    outfile << "# 1\n" EXAMPLES_SOURCE_DIR "images/fish-bike.jpg\n3\n323\n"
+        << "481\n2\n"
+        << "3 0.7 5 5 70 60\n"
+        << "0 0.2 40 10 75 70\n";
+    outfile.close();
+  }
+
+  virtual ~WindowDataLayerTest() {
+    delete blob_top_data_;
+    delete blob_top_label_;
+  }
+
+  // Checks that the first batches of a layer with the given mirror setting
+  // are the same for any number of threads.
+  void CheckThreadsReproducible(bool mirror) {
+    LayerParameter param;
+    param.set_phase(TRAIN);
+    WindowDataParameter* window_data_param =
+        param.mutable_window_data_param();
+    window_data_param->set_source(filename_.c_str());
+    window_data_param->set_batch_size(8);
+    window_data_param->set_fg_fraction(0.5);
+    window_data_param->set_context_pad(4);
+    TransformationParameter* transform_param =
+        param.mutable_transform_param();
+    transform_param->set_crop_size(16);
+    transform_param->set_mirror(mirror);
+    const int kNumBatches = 3;
+    vector<shared_ptr<Blob<Dtype> > > expected_data;
+    vector<shared_ptr<Blob<Dtype> > > expected_label;
+    for (int num_threads = 1; num_threads <= 3; num_threads += 2) {
+      window_data_param->set_num_threads(num_threads);
+      Caffe::set_random_seed(1701);
+      WindowDataLayer<Dtype> layer(param);
+      layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+      EXPECT_EQ(blob_top_data_->num(), 8);
+      EXPECT_EQ(blob_top_data_->channels(), 3);
+      EXPECT_EQ(blob_top_data_->height(), 16);
+      EXPECT_EQ(blob_top_data_->width(), 16);
+      for (int iter = 0; iter < kNumBatches; ++iter) {
+        layer.Forward(blob_bottom_vec_, blob_top_vec_);
+        if (num_threads == 1) {
+          expected_data.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+          expected_data.back()->CopyFrom(*blob_top_data_, false, true);
+          expected_label.push_back(
+              shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+          expected_label.back()->CopyFrom(*blob_top_label_, false, true);
+          continue;
+        }
+        for (int i = 0; i < blob_top_label_->count(); ++i) {
+          EXPECT_EQ(expected_label[iter]->cpu_data()[i],
+              blob_top_label_->cpu_data()[i]);
+        }
+        for (int i = 0; i < blob_top_data_->count(); ++i) {
+          EXPECT_EQ(expected_data[iter]->cpu_data()[i],
+              blob_top_data_->cpu_data()[i]);
+        }
+      }
+    }
+  }
+
+  string filename_;
+  Blob<Dtype>* const blob_top_data_;
+  Blob<Dtype>* const blob_top_label_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(WindowDataLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(WindowDataLayerTest, TestRead) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter param;
+  WindowDataParameter* window_data_param = param.mutable_window_data_param();
+  window_data_param->set_source(this->filename_.c_str());
+  window_data_param->set_batch_size(4);
+  window_data_param->set_fg_fraction(0.5);
+  param.mutable_transform_param()->set_crop_size(16);
+  Caffe::set_random_seed(1701);
+  WindowDataLayer<Dtype> layer(param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(this->blob_top_label_->num(), 4);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  // Background windows come first, then foreground windows.
+  for (int i = 0; i < 2; ++i) {
+    EXPECT_EQ(0, this->blob_top_label_->cpu_data()[i]);
+  }
+  for (int i = 2; i < 4; ++i) {
+    EXPECT_GT(this->blob_top_label_->cpu_data()[i], 0);
+  }
+}
+
+TYPED_TEST(WindowDataLayerTest, TestThreadsReproducible) {
+  this->CheckThreadsReproducible(false);
+}
+
+TYPED_TEST(WindowDataLayerTest, TestThreadsReproducibleMirror) {
+  this->CheckThreadsReproducible(true);
+}
+
+}  // namespace caffe
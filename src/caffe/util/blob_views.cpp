@@ -0,0 +1,92 @@
+#include <vector>
+
+#include "caffe/util/blob_views.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+bool BlobViews<Dtype>::HoldsCount(const Blob<Dtype>& blob) {
+  const size_t size = blob.count() * sizeof(Dtype);
+  return blob.data()->size() == size && blob.diff()->size() == size;
+}
+
+template <typename Dtype>
+bool BlobViews<Dtype>::Share(const vector<Blob<Dtype>*>& blobs,
+    Blob<Dtype>* parent, bool keep_values) {
+  bool shareable = Caffe::mode() == Caffe::CPU && parent->count() > 0 &&
+      HoldsCount(*parent);
+  int count = 0;
+  for (int i = 0; i < blobs.size() && shareable; ++i) {
+    shareable = HoldsCount(*blobs[i]);
+    count += blobs[i]->count();
+  }
+  if (!shareable) {
+    Unshare(keep_values);
+    return false;
+  }
+  CHECK_EQ(count, parent->count()) << "The views must cover the parent.";
+  // The former storage stays alive until nothing points to it any more.
+  const shared_ptr<SyncedMemory> former_data = data_;
+  const shared_ptr<SyncedMemory> former_diff = diff_;
+  const size_t size = parent->count() * sizeof(Dtype);
+  if (!data_ || data_->size() != size) {
+    data_.reset(new SyncedMemory(size));
+    diff_.reset(new SyncedMemory(size));
+  }
+  Dtype* data = static_cast<Dtype*>(data_->mutable_cpu_data());
+  Dtype* diff = static_cast<Dtype*>(diff_->mutable_cpu_data());
+  // Stage the data to keep that is not in place: its memory may overlap the
+  // ranges it moves to. The views cover the parent, so either they keep
+  // their data, or the parent does.
+  vector<Dtype> parent_values;
+  if (!keep_values && parent->cpu_data() != data) {
+    parent_values.assign(parent->cpu_data(), parent->cpu_data() + count);
+  }
+  vector<vector<Dtype> > values(blobs.size());
+  for (int i = 0, offset = 0; i < blobs.size(); ++i) {
+    if (keep_values && blobs[i]->cpu_data() != data + offset) {
+      values[i].assign(blobs[i]->cpu_data(),
+          blobs[i]->cpu_data() + blobs[i]->count());
+    }
+    offset += blobs[i]->count();
+  }
+  parent->data()->set_cpu_data(data);
+  parent->diff()->set_cpu_data(diff);
+  if (parent_values.size()) {
+    caffe_copy(count, &parent_values[0], data);
+  }
+  for (int i = 0, offset = 0; i < blobs.size(); ++i) {
+    blobs[i]->data()->set_cpu_data(data + offset);
+    blobs[i]->diff()->set_cpu_data(diff + offset);
+    if (values[i].size()) {
+      caffe_copy(blobs[i]->count(), &values[i][0], data + offset);
+    }
+    offset += blobs[i]->count();
+  }
+  views_ = blobs;
+  memory_.clear();
+  return true;
+}
+
+template <typename Dtype>
+void BlobViews<Dtype>::Unshare(bool keep_values) {
+  for (int i = 0; i < views_.size(); ++i) {
+    Blob<Dtype>* blob = views_[i];
+    shared_ptr<SyncedMemory> data(new SyncedMemory(blob->data()->size()));
+    shared_ptr<SyncedMemory> diff(new SyncedMemory(blob->diff()->size()));
+    if (keep_values) {
+      caffe_copy(blob->count(), blob->cpu_data(),
+          static_cast<Dtype*>(data->mutable_cpu_data()));
+    }
+    blob->data()->set_cpu_data(data->mutable_cpu_data());
+    blob->diff()->set_cpu_data(diff->mutable_cpu_data());
+    memory_.push_back(data);
+    memory_.push_back(diff);
+  }
+  views_.clear();
+}
+
+INSTANTIATE_CLASS(BlobViews);
+
+}  // namespace caffe
@@ -0,0 +1,55 @@
+#include <boost/thread.hpp>
+
+#include <string>
+
+#include "caffe/util/blocking_queue.hpp"
+
+namespace caffe {
+
+class PointerBlockingQueue::sync {
+ public:
+  mutable boost::mutex mutex_;
+  boost::condition_variable condition_;
+};
+
+PointerBlockingQueue::PointerBlockingQueue()
+    : sync_(new sync()) {
+}
+
+void PointerBlockingQueue::push(void* t) {
+  {
+    boost::mutex::scoped_lock lock(sync_->mutex_);
+    queue_.push(t);
+  }
+  sync_->condition_.notify_one();
+}
+
+bool PointerBlockingQueue::try_pop(void** t) {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  if (queue_.empty()) {
+    return false;
+  }
+  *t = queue_.front();
+  queue_.pop();
+  return true;
+}
+
+void* PointerBlockingQueue::pop(const string& log_on_wait) {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  while (queue_.empty()) {
+    if (!log_on_wait.empty()) {
+      LOG(INFO) << log_on_wait;
+    }
+    sync_->condition_.wait(lock);
+  }
+  void* t = queue_.front();
+  queue_.pop();
+  return t;
+}
+
+size_t PointerBlockingQueue::size() const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return queue_.size();
+}
+
+}  // namespace caffe
@@ -0,0 +1,94 @@
+#include <boost/thread.hpp>
+#include <stdlib.h>
+
+#include <fstream>  // NOLINT(readability/streams)
+#include <map>
+#include <sstream>
+#include <string>
+
+#include "caffe/util/conv_tuner.hpp"
+#include "caffe/util/thread_pool.hpp"
+
+namespace caffe {
+
+ConvolutionTuner& ConvolutionTuner::Get() {
+  static boost::mutex creation_mutex;
+  static ConvolutionTuner* tuner = NULL;
+  boost::mutex::scoped_lock lock(creation_mutex);
+  if (!tuner) {
+    tuner = new ConvolutionTuner();
+    const char* cache_file = getenv("CAFFE_CONV_TUNING_CACHE");
+    if (cache_file) {
+      tuner->Load(cache_file);
+    }
+  }
+  return *tuner;
+}
+
+ConvolutionTuner::ConvolutionTuner()
+    : mutex_(new boost::mutex()) {
+}
+
+void ConvolutionTuner::Load(const string& cache_file) {
+  boost::mutex::scoped_lock lock(*mutex_);
+  cache_file_ = cache_file;
+  algorithms_.clear();
+  if (cache_file_.empty()) {
+    return;
+  }
+  std::ifstream file(cache_file_.c_str());
+  string line;
+  while (std::getline(file, line)) {
+    const size_t key_end = line.find('\t');
+    const size_t algorithm_end = line.find('\t', key_end + 1);
+    if (key_end == string::npos || algorithm_end == string::npos) {
+      continue;
+    }
+    // Later lines win, e.g. after the cache was shared by several runs.
+    algorithms_[line.substr(0, key_end)] =
+        line.substr(key_end + 1, algorithm_end - key_end - 1);
+  }
+  LOG(INFO) << "Loaded " << algorithms_.size()
+      << " convolution tuning results from " << cache_file_;
+}
+
+bool ConvolutionTuner::Lookup(const string& key, string* algorithm) {
+  boost::mutex::scoped_lock lock(*mutex_);
+  map<string, string>::const_iterator it = algorithms_.find(key);
+  if (it == algorithms_.end()) {
+    return false;
+  }
+  *algorithm = it->second;
+  return true;
+}
+
+void ConvolutionTuner::Record(const string& key, const string& algorithm,
+    double time_us) {
+  boost::mutex::scoped_lock lock(*mutex_);
+  algorithms_[key] = algorithm;
+  if (!cache_file_.empty()) {
+    std::ofstream file(cache_file_.c_str(), std::ios::app);
+    file << key << "\t" << algorithm << "\t" << time_us << "\n";
+    LOG_IF(ERROR, !file) << "Could not write to " << cache_file_;
+  }
+}
+
+string ConvolutionTuner::MachineKey() {
+  string cpu = "unknown CPU";
+  std::ifstream cpuinfo("/proc/cpuinfo");
+  string line;
+  while (std::getline(cpuinfo, line)) {
+    if (line.compare(0, 10, "model name") == 0) {
+      const size_t value = line.find(':');
+      if (value != string::npos && value + 2 <= line.size()) {
+        cpu = line.substr(value + 2);
+      }
+      break;
+    }
+  }
+  std::ostringstream key;
+  key << cpu << " x" << ThreadPool::HardwareConcurrency();
+  return key.str();
+}
+
+}  // namespace caffe
@@ -0,0 +1,80 @@
+#include <stdlib.h>
+
+#include <string>
+
+#include "glog/logging.h"
+
+#include "caffe/util/cpu_dispatch.hpp"
+
+namespace caffe {
+
+namespace {
+
+CPUInstructionSet SelectCPUInstructionSet() {
+  const CPUInstructionSet supported = SupportedCPUInstructionSet();
+  CPUInstructionSet selected = supported;
+  const char* requested = getenv("CAFFE_CPU_ISA");
+  if (requested && *requested) {
+    CPUInstructionSet instruction_set;
+    if (!ParseCPUInstructionSet(requested, &instruction_set)) {
+      LOG(WARNING) << "Ignoring unknown CAFFE_CPU_ISA " << requested
+          << ", expected generic, avx2 or avx512.";
+    } else if (instruction_set > supported) {
+      LOG(WARNING) << "Ignoring CAFFE_CPU_ISA " << requested
+          << ", which this CPU does not support.";
+    } else {
+      selected = instruction_set;
+    }
+  }
+  LOG(INFO) << "CPU kernels use " << CPUInstructionSetName(selected)
+      << " (this CPU supports " << CPUInstructionSetName(supported) << ")";
+  return selected;
+}
+
+}  // namespace
+
+CPUInstructionSet SupportedCPUInstructionSet() {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  // The checks include the OS support for saving the wider registers.
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("fma")) {
+    if (__builtin_cpu_supports("avx512f")) {
+      return CPU_AVX512;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+      return CPU_AVX2;
+    }
+  }
+#endif
+  return CPU_GENERIC;
+}
+
+CPUInstructionSet SelectedCPUInstructionSet() {
+  // Initialized once, by the first thread to get here.
+  static const CPUInstructionSet selected = SelectCPUInstructionSet();
+  return selected;
+}
+
+const char* CPUInstructionSetName(CPUInstructionSet instruction_set) {
+  switch (instruction_set) {
+  case CPU_AVX2:
+    return "avx2";
+  case CPU_AVX512:
+    return "avx512";
+  default:
+    return "generic";
+  }
+}
+
+bool ParseCPUInstructionSet(const string& name,
+    CPUInstructionSet* instruction_set) {
+  for (int i = CPU_GENERIC; i <= CPU_AVX512; ++i) {
+    if (name == CPUInstructionSetName(static_cast<CPUInstructionSet>(i))) {
+      *instruction_set = static_cast<CPUInstructionSet>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace caffe
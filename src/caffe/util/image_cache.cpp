@@ -0,0 +1,82 @@
+#include <boost/thread.hpp>
+#include <opencv2/core/core.hpp>
+
+#include <map>
+#include <string>
+#include <utility>
+
+#include "caffe/util/image_cache.hpp"
+
+namespace caffe {
+
+ImageCache::ImageCache(size_t capacity_bytes)
+    : capacity_bytes_(capacity_bytes), size_bytes_(0), hits_(0), misses_(0),
+      mutex_(new boost::mutex()) {
+}
+
+size_t ImageCache::ImageBytes(const cv::Mat& image) {
+  return image.total() * image.elemSize();
+}
+
+bool ImageCache::Get(const string& key, cv::Mat* image) {
+  boost::mutex::scoped_lock lock(*mutex_);
+  map<string, EntryList::iterator>::iterator it = index_.find(key);
+  if (it == index_.end()) {
+    ++misses_;
+    return false;
+  }
+  ++hits_;
+  // Move the entry to the front of the recency list.
+  entries_.splice(entries_.begin(), entries_, it->second);
+  *image = it->second->second;
+  return true;
+}
+
+void ImageCache::Put(const string& key, const cv::Mat& image) {
+  const size_t bytes = ImageBytes(image);
+  boost::mutex::scoped_lock lock(*mutex_);
+  map<string, EntryList::iterator>::iterator it = index_.find(key);
+  if (it != index_.end()) {
+    size_bytes_ -= ImageBytes(it->second->second);
+    entries_.erase(it->second);
+    index_.erase(it);
+  }
+  if (bytes > capacity_bytes_) {
+    return;
+  }
+  EvictToFit(bytes);
+  entries_.push_front(std::make_pair(key, image));
+  index_[key] = entries_.begin();
+  size_bytes_ += bytes;
+}
+
+void ImageCache::EvictToFit(size_t incoming_bytes) {
+  while (!entries_.empty() && size_bytes_ + incoming_bytes > capacity_bytes_) {
+    const std::pair<string, cv::Mat>& oldest = entries_.back();
+    size_bytes_ -= ImageBytes(oldest.second);
+    index_.erase(oldest.first);
+    entries_.pop_back();
+  }
+}
+
+size_t ImageCache::size_bytes() const {
+  boost::mutex::scoped_lock lock(*mutex_);
+  return size_bytes_;
+}
+
+size_t ImageCache::num_images() const {
+  boost::mutex::scoped_lock lock(*mutex_);
+  return entries_.size();
+}
+
+size_t ImageCache::hits() const {
+  boost::mutex::scoped_lock lock(*mutex_);
+  return hits_;
+}
+
+size_t ImageCache::misses() const {
+  boost::mutex::scoped_lock lock(*mutex_);
+  return misses_;
+}
+
+}  // namespace caffe
@@ -0,0 +1,144 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <opencv2/core/core.hpp>
+#include <stdint.h>
+#include <stdio.h>  // for snprintf
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "caffe/util/image_disk_cache.hpp"
+
+namespace caffe {
+
+namespace {
+
+// A cache file starts with this header, followed by the key and the pixels.
+struct ImageFileHeader {
+  uint32_t magic;
+  uint32_t rows;
+  uint32_t cols;
+  uint32_t channels;
+  uint32_t key_size;
+};
+
+const uint32_t kImageFileMagic = 0x474d4943;  // "CIMG"
+
+bool WriteAll(int fd, const void* data, size_t size) {
+  const char* bytes = static_cast<const char*>(data);
+  while (size > 0) {
+    const ssize_t written = write(fd, bytes, size);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    bytes += written;
+    size -= written;
+  }
+  return true;
+}
+
+}  // namespace
+
+ImageDiskCache::ImageDiskCache(const string& directory)
+    : directory_(directory) {
+  CHECK(!directory_.empty()) << "Image cache directory must not be empty";
+  if (mkdir(directory_.c_str(), 0755) != 0) {
+    CHECK_EQ(errno, EEXIST) << "Failed to create image cache directory "
+        << directory_;
+  }
+}
+
+string ImageDiskCache::KeyPath(const string& key) const {
+  // 64-bit FNV-1a hash of the key.
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < key.size(); ++i) {
+    hash ^= static_cast<unsigned char>(key[i]);
+    hash *= 1099511628211ULL;
+  }
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx.raw",
+      static_cast<unsigned long long>(hash));  // NOLINT(runtime/int)
+  return directory_ + "/" + name;
+}
+
+bool ImageDiskCache::Read(const string& key, cv::Mat* image) const {
+  const string path = KeyPath(key);
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  bool found = false;
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) == 0 &&
+      file_stat.st_size >= static_cast<off_t>(sizeof(ImageFileHeader))) {
+    const size_t file_size = file_stat.st_size;
+    void* mapped = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapped != MAP_FAILED) {
+      const char* bytes = static_cast<const char*>(mapped);
+      ImageFileHeader header;
+      memcpy(&header, bytes, sizeof(header));  // NOLINT(caffe/alt_fn)
+      const size_t pixels_offset = sizeof(header) + header.key_size;
+      const size_t pixels_size = static_cast<size_t>(header.rows)
+          * header.cols * header.channels;
+      if (header.magic == kImageFileMagic &&
+          header.channels >= 1 && header.channels <= 4 &&
+          header.key_size == key.size() &&
+          file_size == pixels_offset + pixels_size &&
+          memcmp(bytes + sizeof(header), key.data(), key.size()) == 0) {
+        cv::Mat cached(header.rows, header.cols, CV_8UC(header.channels));
+        // NOLINT_NEXT_LINE(caffe/alt_fn)
+        memcpy(cached.data, bytes + pixels_offset, pixels_size);
+        *image = cached;
+        found = true;
+      }
+      munmap(mapped, file_size);
+    }
+  }
+  close(fd);
+  return found;
+}
+
+bool ImageDiskCache::Write(const string& key, const cv::Mat& image) const {
+  CHECK_EQ(image.depth(), CV_8U) << "Only 8-bit images can be cached";
+  string temp_path = directory_ + "/.tmp.XXXXXX";
+  std::vector<char> temp_name(temp_path.begin(), temp_path.end());
+  temp_name.push_back('\0');
+  const int fd = mkstemp(&temp_name[0]);
+  if (fd < 0) {
+    LOG(ERROR) << "Could not create a file in image cache " << directory_;
+    return false;
+  }
+  temp_path = &temp_name[0];
+  ImageFileHeader header;
+  header.magic = kImageFileMagic;
+  header.rows = image.rows;
+  header.cols = image.cols;
+  header.channels = image.channels();
+  header.key_size = key.size();
+  bool written = fchmod(fd, 0644) == 0 &&
+      WriteAll(fd, &header, sizeof(header)) &&
+      WriteAll(fd, key.data(), key.size());
+  const size_t row_size = image.cols * image.elemSize();
+  for (int h = 0; written && h < image.rows; ++h) {
+    written = WriteAll(fd, image.ptr<uchar>(h), row_size);
+  }
+  written = (close(fd) == 0) && written;
+  if (written) {
+    written = rename(temp_path.c_str(), KeyPath(key).c_str()) == 0;
+  }
+  if (!written) {
+    LOG(ERROR) << "Could not write " << key << " to image cache "
+        << directory_;
+    unlink(temp_path.c_str());
+  }
+  return written;
+}
+
+}  // namespace caffe
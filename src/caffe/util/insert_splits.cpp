@@ -5,6 +5,7 @@
 #include <utility>
 
 #include "caffe/common.hpp"
+#include "caffe/layer_factory.hpp"
 #include "caffe/util/insert_splits.hpp"
 
 namespace caffe {
@@ -16,6 +17,7 @@ void InsertSplits(const NetParameter& param, NetParameter* param_split) {
   map<string, pair<int, int> > blob_name_to_last_top_idx;
   map<pair<int, int>, pair<int, int> > bottom_idx_to_source_top_idx;
   map<pair<int, int>, int> top_idx_to_bottom_count;
+  map<pair<int, int>, int> top_idx_to_accumulate_count;
   map<pair<int, int>, float> top_idx_to_loss_weight;
   map<pair<int, int>, int> top_idx_to_bottom_split_idx;
   map<int, string> layer_idx_to_layer_name;
@@ -38,6 +40,10 @@ void InsertSplits(const NetParameter& param, NetParameter* param_split) {
       const pair<int, int>& top_idx = blob_name_to_last_top_idx[blob_name];
       bottom_idx_to_source_top_idx[bottom_idx] = top_idx;
       ++top_idx_to_bottom_count[top_idx];
+      if (param.accumulate_diffs() &&
+          LayerTypeAllowsAccumulateBottomDiff(layer_param.type(), j)) {
+        ++top_idx_to_accumulate_count[top_idx];
+      }
     }
     for (int j = 0; j < layer_param.top_size(); ++j) {
       const string& blob_name = layer_param.top(j);
@@ -56,6 +62,15 @@ void InsertSplits(const NetParameter& param, NetParameter* param_split) {
       }
     }
   }
+  // Blobs whose users all accumulate their gradients need no split: count
+  // them as used once.
+  for (map<pair<int, int>, int>::iterator it =
+       top_idx_to_accumulate_count.begin();
+       it != top_idx_to_accumulate_count.end(); ++it) {
+    if (it->second == top_idx_to_bottom_count[it->first]) {
+      top_idx_to_bottom_count[it->first] = 1;
+    }
+  }
   // Create split layer for any input blobs used by other layer as bottom
   // blobs more than once.
   for (int i = 0; i < param.input_size(); ++i) {
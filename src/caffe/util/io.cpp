@@ -8,6 +8,8 @@
 #include <opencv2/imgproc/imgproc.hpp>
 #include <stdint.h>
 
+#include <boost/thread/recursive_mutex.hpp>
+
 #include <algorithm>
 #include <fstream>  // NOLINT(readability/streams)
 #include <string>
@@ -98,6 +100,26 @@ cv::Mat ReadImageToCVMat(const string& filename,
 cv::Mat ReadImageToCVMat(const string& filename) {
   return ReadImageToCVMat(filename, 0, 0, true);
 }
+
+cv::Mat ReadImageToCVMatWithAlpha(const string& filename,
+    const int height, const int width) {
+  cv::Mat cv_img_origin = cv::imread(filename, CV_LOAD_IMAGE_UNCHANGED);
+  if (!cv_img_origin.data) {
+    LOG(ERROR) << "Could not open or find file " << filename;
+    return cv_img_origin;
+  }
+  if (cv_img_origin.depth() != CV_8U || cv_img_origin.channels() != 4) {
+    // Without an 8-bit alpha channel, read it as a plain color image.
+    return ReadImageToCVMat(filename, height, width, true);
+  }
+  cv::Mat cv_img;
+  if (height > 0 && width > 0) {
+    cv::resize(cv_img_origin, cv_img, cv::Size(width, height));
+  } else {
+    cv_img = cv_img_origin;
+  }
+  return cv_img;
+}
 // Do the file extension and encoding match?
 static bool matchExt(const std::string & fn,
                      std::string en) {
@@ -228,11 +250,25 @@ void CVMatToDatum(const cv::Mat& cv_img, Datum* datum) {
   datum->set_data(buffer);
 }
 
+static boost::recursive_mutex& HDF5Mutex() {
+  static boost::recursive_mutex mutex;
+  return mutex;
+}
+
+HDF5Lock::HDF5Lock() {
+  HDF5Mutex().lock();
+}
+
+HDF5Lock::~HDF5Lock() {
+  HDF5Mutex().unlock();
+}
+
 // Verifies format of data stored in HDF5 file and reshapes blob accordingly.
 template <typename Dtype>
 void hdf5_load_nd_dataset_helper(
     hid_t file_id, const char* dataset_name_, int min_dim, int max_dim,
     Blob<Dtype>* blob) {
+  HDF5Lock lock;
   // Verify that the dataset exists.
   CHECK(H5LTfind_dataset(file_id, dataset_name_))
       << "Failed to find HDF5 dataset " << dataset_name_;
@@ -262,6 +298,7 @@ void hdf5_load_nd_dataset_helper(
 template <>
 void hdf5_load_nd_dataset<float>(hid_t file_id, const char* dataset_name_,
         int min_dim, int max_dim, Blob<float>* blob) {
+  HDF5Lock lock;
   hdf5_load_nd_dataset_helper(file_id, dataset_name_, min_dim, max_dim, blob);
   herr_t status = H5LTread_dataset_float(
     file_id, dataset_name_, blob->mutable_cpu_data());
@@ -271,6 +308,7 @@ void hdf5_load_nd_dataset<float>(hid_t file_id, const char* dataset_name_,
 template <>
 void hdf5_load_nd_dataset<double>(hid_t file_id, const char* dataset_name_,
         int min_dim, int max_dim, Blob<double>* blob) {
+  HDF5Lock lock;
   hdf5_load_nd_dataset_helper(file_id, dataset_name_, min_dim, max_dim, blob);
   herr_t status = H5LTread_dataset_double(
     file_id, dataset_name_, blob->mutable_cpu_data());
@@ -280,6 +318,7 @@ void hdf5_load_nd_dataset<double>(hid_t file_id, const char* dataset_name_,
 template <>
 void hdf5_save_nd_dataset<float>(
     const hid_t file_id, const string& dataset_name, const Blob<float>& blob) {
+  HDF5Lock lock;
   hsize_t dims[HDF5_NUM_DIMS];
   dims[0] = blob.num();
   dims[1] = blob.channels();
@@ -293,6 +332,7 @@ void hdf5_save_nd_dataset<float>(
 template <>
 void hdf5_save_nd_dataset<double>(
     const hid_t file_id, const string& dataset_name, const Blob<double>& blob) {
+  HDF5Lock lock;
   hsize_t dims[HDF5_NUM_DIMS];
   dims[0] = blob.num();
   dims[1] = blob.channels();
@@ -303,4 +343,84 @@ void hdf5_save_nd_dataset<double>(
   CHECK_GE(status, 0) << "Failed to make double dataset " << dataset_name;
 }
 
+static void hdf5_append_nd_dataset_helper(
+    const hid_t file_id, const string& dataset_name, const hid_t type,
+    const hsize_t (&dims)[HDF5_NUM_DIMS], const int chunk_rows,
+    const void* data) {
+  HDF5Lock lock;
+  hid_t dataset;
+  hsize_t old_rows = 0;
+  if (H5LTfind_dataset(file_id, dataset_name.c_str())) {
+    dataset = H5Dopen2(file_id, dataset_name.c_str(), H5P_DEFAULT);
+    CHECK_GE(dataset, 0) << "Failed to open dataset " << dataset_name;
+    hsize_t old_dims[HDF5_NUM_DIMS];
+    hid_t space = H5Dget_space(dataset);
+    CHECK_EQ(H5Sget_simple_extent_ndims(space), HDF5_NUM_DIMS);
+    H5Sget_simple_extent_dims(space, old_dims, NULL);
+    H5Sclose(space);
+    for (int i = 1; i < HDF5_NUM_DIMS; ++i) {
+      CHECK_EQ(old_dims[i], dims[i]) << "Rows appended to " << dataset_name
+          << " must have the same shape";
+    }
+    old_rows = old_dims[0];
+  } else {
+    hsize_t initial_dims[HDF5_NUM_DIMS] = { 0, dims[1], dims[2], dims[3] };
+    hsize_t max_dims[HDF5_NUM_DIMS] =
+        { H5S_UNLIMITED, dims[1], dims[2], dims[3] };
+    hsize_t chunk_dims[HDF5_NUM_DIMS] =
+        { static_cast<hsize_t>(chunk_rows), dims[1], dims[2], dims[3] };
+    hid_t space = H5Screate_simple(HDF5_NUM_DIMS, initial_dims, max_dims);
+    hid_t properties = H5Pcreate(H5P_DATASET_CREATE);
+    H5Pset_chunk(properties, HDF5_NUM_DIMS, chunk_dims);
+    dataset = H5Dcreate2(file_id, dataset_name.c_str(), type, space,
+        H5P_DEFAULT, properties, H5P_DEFAULT);
+    CHECK_GE(dataset, 0) << "Failed to make dataset " << dataset_name;
+    H5Pclose(properties);
+    H5Sclose(space);
+  }
+  hsize_t new_dims[HDF5_NUM_DIMS] =
+      { old_rows + dims[0], dims[1], dims[2], dims[3] };
+  herr_t status = H5Dset_extent(dataset, new_dims);
+  CHECK_GE(status, 0) << "Failed to extend dataset " << dataset_name;
+  // Write the new rows into the tail of the dataset.
+  hid_t file_space = H5Dget_space(dataset);
+  hsize_t start[HDF5_NUM_DIMS] = { old_rows, 0, 0, 0 };
+  status = H5Sselect_hyperslab(file_space, H5S_SELECT_SET, start, NULL, dims,
+      NULL);
+  CHECK_GE(status, 0) << "Failed to select the new rows of " << dataset_name;
+  hid_t memory_space = H5Screate_simple(HDF5_NUM_DIMS, dims, NULL);
+  status = H5Dwrite(dataset, type, memory_space, file_space, H5P_DEFAULT,
+      data);
+  CHECK_GE(status, 0) << "Failed to append to dataset " << dataset_name;
+  H5Sclose(memory_space);
+  H5Sclose(file_space);
+  H5Dclose(dataset);
+}
+
+template <>
+void hdf5_append_nd_dataset<float>(
+    const hid_t file_id, const string& dataset_name, const Blob<float>& blob,
+    const int chunk_rows) {
+  hsize_t dims[HDF5_NUM_DIMS];
+  dims[0] = blob.num();
+  dims[1] = blob.channels();
+  dims[2] = blob.height();
+  dims[3] = blob.width();
+  hdf5_append_nd_dataset_helper(file_id, dataset_name, H5T_NATIVE_FLOAT, dims,
+      chunk_rows, blob.cpu_data());
+}
+
+template <>
+void hdf5_append_nd_dataset<double>(
+    const hid_t file_id, const string& dataset_name, const Blob<double>& blob,
+    const int chunk_rows) {
+  hsize_t dims[HDF5_NUM_DIMS];
+  dims[0] = blob.num();
+  dims[1] = blob.channels();
+  dims[2] = blob.height();
+  dims[3] = blob.width();
+  hdf5_append_nd_dataset_helper(file_id, dataset_name, H5T_NATIVE_DOUBLE, dims,
+      chunk_rows, blob.cpu_data());
+}
+
 }  // namespace caffe
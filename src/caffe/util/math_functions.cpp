@@ -6,6 +6,7 @@
 #include "caffe/common.hpp"
 #include "caffe/util/math_functions.hpp"
 #include "caffe/util/rng.hpp"
+#include "caffe/util/vector_math.hpp"
 
 namespace caffe {
 
@@ -174,16 +175,27 @@ void caffe_div<double>(const int n, const double* a, const double* b,
   vdDiv(n, a, b, y);
 }
 
+// Without MKL, exp and powx use the vectorized and threaded kernels of
+// vector_math.hpp rather than libm element by element.
+
 template <>
 void caffe_powx<float>(const int n, const float* a, const float b,
     float* y) {
+#ifdef USE_MKL
   vsPowx(n, a, b, y);
+#else
+  caffe_cpu_fast_powx(n, a, b, y);
+#endif
 }
 
 template <>
 void caffe_powx<double>(const int n, const double* a, const double b,
     double* y) {
+#ifdef USE_MKL
   vdPowx(n, a, b, y);
+#else
+  caffe_cpu_fast_powx(n, a, b, y);
+#endif
 }
 
 template <>
@@ -198,12 +210,20 @@ void caffe_sqr<double>(const int n, const double* a, double* y) {
 
 template <>
 void caffe_exp<float>(const int n, const float* a, float* y) {
+#ifdef USE_MKL
   vsExp(n, a, y);
+#else
+  caffe_cpu_fast_exp(n, a, y);
+#endif
 }
 
 template <>
 void caffe_exp<double>(const int n, const double* a, double* y) {
+#ifdef USE_MKL
   vdExp(n, a, y);
+#else
+  caffe_cpu_fast_exp(n, a, y);
+#endif
 }
 
 template <>
@@ -0,0 +1,151 @@
+#include <boost/thread.hpp>
+
+#include "caffe/util/thread_pool.hpp"
+
+namespace caffe {
+
+class ThreadPool::Impl {
+ public:
+  explicit Impl(int num_workers)
+      : task_(NULL), size_(0), next_(0), pending_(0), generation_(0),
+        stop_(false) {
+    for (int i = 0; i < num_workers; ++i) {
+      workers_.add_thread(new boost::thread(&Impl::WorkerLoop, this));
+    }
+  }
+
+  ~Impl() {
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      stop_ = true;
+    }
+    work_cond_.notify_all();
+    workers_.join_all();
+  }
+
+  void Run(int n, const boost::function<void(int)>& task) {
+    // Only one batch of work is in flight at a time.
+    boost::mutex::scoped_lock run_lock(run_mutex_);
+    RunLocked(n, task);
+  }
+
+  bool TryRun(int n, const boost::function<void(int)>& task) {
+    boost::mutex::scoped_lock run_lock(run_mutex_, boost::try_to_lock);
+    if (!run_lock.owns_lock()) {
+      return false;
+    }
+    RunLocked(n, task);
+    return true;
+  }
+
+ private:
+  // Runs a batch of work, with run_mutex_ held.
+  void RunLocked(int n, const boost::function<void(int)>& task) {
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      task_ = &task;
+      size_ = n;
+      next_ = 0;
+      pending_ = n;
+      ++generation_;
+    }
+    work_cond_.notify_all();
+    Drain();
+    boost::mutex::scoped_lock lock(mutex_);
+    while (pending_ > 0) {
+      done_cond_.wait(lock);
+    }
+    task_ = NULL;
+  }
+
+  void WorkerLoop() {
+    unsigned int seen_generation = 0;
+    while (true) {
+      {
+        boost::mutex::scoped_lock lock(mutex_);
+        while (!stop_ && generation_ == seen_generation) {
+          work_cond_.wait(lock);
+        }
+        if (stop_) {
+          return;
+        }
+        seen_generation = generation_;
+      }
+      Drain();
+    }
+  }
+
+  // Claims and runs indices of the current batch until none are left.
+  void Drain() {
+    boost::mutex::scoped_lock lock(mutex_);
+    while (next_ < size_) {
+      const int index = next_++;
+      const boost::function<void(int)>* task = task_;
+      lock.unlock();
+      (*task)(index);
+      lock.lock();
+      if (--pending_ == 0) {
+        done_cond_.notify_all();
+      }
+    }
+  }
+
+  boost::thread_group workers_;
+  boost::mutex run_mutex_;
+  boost::mutex mutex_;
+  boost::condition_variable work_cond_;
+  boost::condition_variable done_cond_;
+  const boost::function<void(int)>* task_;
+  int size_;
+  int next_;
+  int pending_;
+  unsigned int generation_;
+  bool stop_;
+};
+
+ThreadPool::ThreadPool(int num_threads)
+    : num_threads_(num_threads > 0 ? num_threads : HardwareConcurrency()) {
+  if (num_threads_ > 1) {
+    impl_.reset(new Impl(num_threads_ - 1));
+  }
+}
+
+ThreadPool::~ThreadPool() {}
+
+void ThreadPool::Run(int n, const boost::function<void(int)>& task) {
+  if (n <= 0) {
+    return;
+  }
+  if (!impl_ || n == 1) {
+    for (int i = 0; i < n; ++i) {
+      task(i);
+    }
+    return;
+  }
+  impl_->Run(n, task);
+}
+
+bool ThreadPool::TryRun(int n, const boost::function<void(int)>& task) {
+  if (!impl_ || n <= 1) {
+    Run(n, task);
+    return true;
+  }
+  return impl_->TryRun(n, task);
+}
+
+int ThreadPool::HardwareConcurrency() {
+  const int cores = boost::thread::hardware_concurrency();
+  return cores > 0 ? cores : 1;
+}
+
+ThreadPool& ThreadPool::Global() {
+  static boost::mutex creation_mutex;
+  static ThreadPool* pool = NULL;
+  boost::mutex::scoped_lock lock(creation_mutex);
+  if (!pool) {
+    pool = new ThreadPool(0);
+  }
+  return *pool;
+}
+
+}  // namespace caffe
@@ -0,0 +1,245 @@
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <stdint.h>
+
+#include <algorithm>
+
+#include "caffe/common.hpp"
+#include "caffe/util/cpu_dispatch.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
+#include "caffe/util/vector_math.hpp"
+#include "caffe/util/vector_math_kernels.hpp"
+#include "caffe/util/vector_math_kernels_impl.hpp"
+
+namespace caffe {
+
+namespace {
+
+// Arrays are only split over threads in ranges of at least this many
+// elements, below which waking the threads costs more than it saves.
+const int kMinParallelCount = 1 << 16;
+
+template <typename Kernel>
+void RunRange(const Kernel& kernel, int n, int num_ranges, int range) {
+  kernel(static_cast<int64_t>(n) * range / num_ranges,
+      static_cast<int64_t>(n) * (range + 1) / num_ranges);
+}
+
+// Calls kernel(begin, end) on ranges covering [0, n), in parallel when n is
+// large enough and no other thread is using the pool. The pool is shared by
+// the whole process, so nets running on different threads don't wait for
+// each other here: whoever finds it busy runs its kernel serially.
+template <typename Kernel>
+void ParallelFor(const int n, const Kernel& kernel) {
+  const int max_ranges = n / kMinParallelCount;
+  if (max_ranges < 2) {
+    kernel(0, n);
+    return;
+  }
+  ThreadPool& pool = ThreadPool::Global();
+  const int num_ranges = std::min(max_ranges, pool.num_threads());
+  if (num_ranges < 2) {
+    kernel(0, n);
+    return;
+  }
+  if (!pool.TryRun(num_ranges, boost::bind(&RunRange<Kernel>,
+      boost::cref(kernel), n, num_ranges, _1))) {
+    kernel(0, n);
+  }
+}
+
+// The kernels of SelectedCPUInstructionSet(), or of the newest older one
+// this build has.
+struct KernelTables {
+  KernelTables() {
+    CPUInstructionSet instruction_set = SelectedCPUInstructionSet();
+    while (!GetVectorMathKernels(instruction_set, &float_kernels,
+        &double_kernels)) {
+      const CPUInstructionSet older =
+          static_cast<CPUInstructionSet>(instruction_set - 1);
+      LOG(INFO) << "This build has no "
+          << CPUInstructionSetName(instruction_set)
+          << " vector math kernels, using " << CPUInstructionSetName(older);
+      instruction_set = older;
+    }
+  }
+
+  VectorMathKernels<float> float_kernels;
+  VectorMathKernels<double> double_kernels;
+};
+
+const KernelTables& Tables() {
+  // Initialized once, by the first thread to get here.
+  static const KernelTables tables;
+  return tables;
+}
+
+template <typename Dtype>
+const VectorMathKernels<Dtype>& Kernels();
+
+template <>
+const VectorMathKernels<float>& Kernels<float>() {
+  return Tables().float_kernels;
+}
+
+template <>
+const VectorMathKernels<double>& Kernels<double>() {
+  return Tables().double_kernels;
+}
+
+}  // namespace
+
+bool GetVectorMathKernels(CPUInstructionSet instruction_set,
+    VectorMathKernels<float>* float_kernels,
+    VectorMathKernels<double>* double_kernels) {
+  switch (instruction_set) {
+  case CPU_GENERIC:
+    FillVectorMathKernels(float_kernels, double_kernels);
+    return true;
+  case CPU_AVX2:
+    return GetAVX2VectorMathKernels(float_kernels, double_kernels);
+  case CPU_AVX512:
+    return GetAVX512VectorMathKernels(float_kernels, double_kernels);
+  default:
+    LOG(FATAL) << "Unknown CPU instruction set " << instruction_set;
+    return false;
+  }
+}
+
+template <typename Dtype>
+void caffe_cpu_fast_exp(const int n, const Dtype* x, Dtype* y) {
+  ParallelFor(n, boost::bind(Kernels<Dtype>().fast_exp, x, y, _1, _2));
+}
+
+template void caffe_cpu_fast_exp<float>(const int n, const float* x,
+    float* y);
+template void caffe_cpu_fast_exp<double>(const int n, const double* x,
+    double* y);
+
+template <typename Dtype>
+void caffe_cpu_fast_log(const int n, const Dtype* x, Dtype* y) {
+  ParallelFor(n, boost::bind(Kernels<Dtype>().fast_log, x, y, _1, _2));
+}
+
+template void caffe_cpu_fast_log<float>(const int n, const float* x,
+    float* y);
+template void caffe_cpu_fast_log<double>(const int n, const double* x,
+    double* y);
+
+template <typename Dtype>
+void caffe_cpu_fast_powx(const int n, const Dtype* x, const Dtype b,
+    Dtype* y) {
+  if (b == Dtype(1)) {
+    caffe_copy(n, x, y);
+    return;
+  }
+  ParallelFor(n, boost::bind(Kernels<Dtype>().fast_powx, x, b, y, _1, _2));
+}
+
+template void caffe_cpu_fast_powx<float>(const int n, const float* x,
+    const float b, float* y);
+template void caffe_cpu_fast_powx<double>(const int n, const double* x,
+    const double b, double* y);
+
+template <typename Dtype>
+void caffe_cpu_relu(const int n, const Dtype* x, const Dtype negative_slope,
+    Dtype* y) {
+  ParallelFor(n, boost::bind(Kernels<Dtype>().relu, x, negative_slope, y, _1,
+      _2));
+}
+
+template void caffe_cpu_relu<float>(const int n, const float* x,
+    const float negative_slope, float* y);
+template void caffe_cpu_relu<double>(const int n, const double* x,
+    const double negative_slope, double* y);
+
+template <typename Dtype>
+void caffe_cpu_relu_backward(const int n, const Dtype* x, const Dtype* dy,
+    const Dtype negative_slope, Dtype* dx) {
+  ParallelFor(n, boost::bind(Kernels<Dtype>().relu_backward, x, dy,
+      negative_slope, dx, _1, _2));
+}
+
+template void caffe_cpu_relu_backward<float>(const int n, const float* x,
+    const float* dy, const float negative_slope, float* dx);
+template void caffe_cpu_relu_backward<double>(const int n, const double* x,
+    const double* dy, const double negative_slope, double* dx);
+
+template <typename Dtype>
+void caffe_cpu_sigmoid(const int n, const Dtype* x, Dtype* y) {
+  ParallelFor(n, boost::bind(Kernels<Dtype>().sigmoid, x, y, _1, _2));
+}
+
+template void caffe_cpu_sigmoid<float>(const int n, const float* x,
+    float* y);
+template void caffe_cpu_sigmoid<double>(const int n, const double* x,
+    double* y);
+
+template <typename Dtype>
+void caffe_cpu_sigmoid_backward(const int n, const Dtype* y, const Dtype* dy,
+    Dtype* dx) {
+  ParallelFor(n, boost::bind(Kernels<Dtype>().sigmoid_backward, y, dy, dx,
+      _1, _2));
+}
+
+template void caffe_cpu_sigmoid_backward<float>(const int n, const float* y,
+    const float* dy, float* dx);
+template void caffe_cpu_sigmoid_backward<double>(const int n,
+    const double* y, const double* dy, double* dx);
+
+template <typename Dtype>
+void caffe_cpu_tanh(const int n, const Dtype* x, Dtype* y) {
+  ParallelFor(n, boost::bind(Kernels<Dtype>().tanh, x, y, _1, _2));
+}
+
+template void caffe_cpu_tanh<float>(const int n, const float* x, float* y);
+template void caffe_cpu_tanh<double>(const int n, const double* x,
+    double* y);
+
+template <typename Dtype>
+void caffe_cpu_tanh_backward(const int n, const Dtype* y, const Dtype* dy,
+    Dtype* dx) {
+  ParallelFor(n, boost::bind(Kernels<Dtype>().tanh_backward, y, dy, dx, _1,
+      _2));
+}
+
+template void caffe_cpu_tanh_backward<float>(const int n, const float* y,
+    const float* dy, float* dx);
+template void caffe_cpu_tanh_backward<double>(const int n, const double* y,
+    const double* dy, double* dx);
+
+template <typename Dtype>
+void caffe_cpu_bnll(const int n, const Dtype* x, Dtype* y) {
+  ParallelFor(n, boost::bind(Kernels<Dtype>().bnll, x, y, _1, _2));
+}
+
+template void caffe_cpu_bnll<float>(const int n, const float* x, float* y);
+template void caffe_cpu_bnll<double>(const int n, const double* x,
+    double* y);
+
+template <typename Dtype>
+void caffe_cpu_bnll_backward(const int n, const Dtype* x, const Dtype* dy,
+    Dtype* dx) {
+  ParallelFor(n, boost::bind(Kernels<Dtype>().bnll_backward, x, dy, dx, _1,
+      _2));
+}
+
+template void caffe_cpu_bnll_backward<float>(const int n, const float* x,
+    const float* dy, float* dx);
+template void caffe_cpu_bnll_backward<double>(const int n, const double* x,
+    const double* dy, double* dx);
+
+template <typename Dtype>
+void caffe_cpu_threshold(const int n, const Dtype* x, const Dtype threshold,
+    Dtype* y) {
+  ParallelFor(n, boost::bind(Kernels<Dtype>().threshold, x, threshold, y,
+      _1, _2));
+}
+
+template void caffe_cpu_threshold<float>(const int n, const float* x,
+    const float threshold, float* y);
+template void caffe_cpu_threshold<double>(const int n, const double* x,
+    const double threshold, double* y);
+
+}  // namespace caffe
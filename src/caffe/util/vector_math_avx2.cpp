@@ -0,0 +1,21 @@
+// Built with -mavx2 -mfma where the compiler supports them; see the Makefile
+// and src/caffe/CMakeLists.txt.
+#ifdef __AVX2__
+#include "caffe/util/vector_math_kernels_impl.hpp"
+#endif
+
+#include "caffe/util/vector_math_kernels.hpp"
+
+namespace caffe {
+
+bool GetAVX2VectorMathKernels(VectorMathKernels<float>* float_kernels,
+    VectorMathKernels<double>* double_kernels) {
+#ifdef __AVX2__
+  FillVectorMathKernels(float_kernels, double_kernels);
+  return true;
+#else
+  return false;
+#endif
+}
+
+}  // namespace caffe
@@ -0,0 +1,381 @@
+#include <stdio.h>  // for snprintf
+#include <algorithm>
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
+#include <vector>
+
+#include "boost/scoped_ptr.hpp"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+#include "google/protobuf/text_format.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/layer_factory.hpp"
+#include "caffe/net_profiler.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/im2col.hpp"
+#include "caffe/util/math_functions.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+using boost::scoped_ptr;
+
+DEFINE_int32(batch_size, 10,
+    "Number of images of the inner product and layer kernels, as in the "
+    "deploy nets of the bundled models");
+DEFINE_double(min_time_ms, 200,
+    "Minimum time each kernel is run for, after one warm-up call");
+DEFINE_double(peak_gflops, 0,
+    "The machine's peak GFLOP/s; if 0, the best GEMM throughput measured");
+DEFINE_double(peak_gbps, 0,
+    "The machine's peak memory bandwidth in GB/s; if 0, the bandwidth of a "
+    "large caffe_copy");
+DEFINE_string(filter, "",
+    "Optional; only run the kernels whose name or shape contains this string");
+DEFINE_string(output, "",
+    "Optional; write the results to this file as CSV");
+
+// One kernel run on one shape, with its floating point operations and the
+// bytes it has to read and write at least, which place it on the roofline.
+class KernelBenchmark {
+ public:
+  KernelBenchmark(const string& kernel, const string& shape, double flops,
+      double bytes)
+      : kernel_(kernel), shape_(shape), flops_(flops), bytes_(bytes) {}
+  virtual ~KernelBenchmark() {}
+  virtual void Run() = 0;
+
+  const string& kernel() const { return kernel_; }
+  const string& shape() const { return shape_; }
+  double flops() const { return flops_; }
+  double bytes() const { return bytes_; }
+
+ protected:
+  // Returns count random values.
+  static vector<float> RandomData(int count) {
+    vector<float> data(std::max(count, 1));
+    caffe_rng_gaussian<float>(data.size(), 0, 1, &data[0]);
+    return data;
+  }
+
+  string kernel_;
+  string shape_;
+  double flops_;
+  double bytes_;
+};
+
+class CopyBenchmark : public KernelBenchmark {
+ public:
+  explicit CopyBenchmark(int n)
+      : KernelBenchmark("caffe_copy", Shape(n), 0, 2. * n * sizeof(float)),
+        n_(n), x_(RandomData(n)), y_(n) {}
+  virtual void Run() { caffe_copy(n_, &x_[0], &y_[0]); }
+  static string Shape(int n) {
+    char shape[64];
+    snprintf(shape, sizeof(shape), "n=%d", n);
+    return shape;
+  }
+
+ private:
+  int n_;
+  vector<float> x_, y_;
+};
+
+class AxpyBenchmark : public KernelBenchmark {
+ public:
+  explicit AxpyBenchmark(int n)
+      : KernelBenchmark("caffe_axpy", CopyBenchmark::Shape(n), 2. * n,
+            3. * n * sizeof(float)),
+        n_(n), x_(RandomData(n)), y_(RandomData(n)) {}
+  virtual void Run() { caffe_axpy<float>(n_, 1e-3, &x_[0], &y_[0]); }
+
+ private:
+  int n_;
+  vector<float> x_, y_;
+};
+
+// Counts one operation per exponential.
+class ExpBenchmark : public KernelBenchmark {
+ public:
+  explicit ExpBenchmark(int n)
+      : KernelBenchmark("caffe_exp", CopyBenchmark::Shape(n), n,
+            2. * n * sizeof(float)),
+        n_(n), x_(RandomData(n)), y_(n) {}
+  virtual void Run() { caffe_exp<float>(n_, &x_[0], &y_[0]); }
+
+ private:
+  int n_;
+  vector<float> x_, y_;
+};
+
+class GemmBenchmark : public KernelBenchmark {
+ public:
+  GemmBenchmark(const string& layer, int M, int N, int K)
+      : KernelBenchmark("caffe_cpu_gemm", Shape(layer, M, N, K), 2. * M * N * K,
+            (1. * M * K + 1. * K * N + 1. * M * N) * sizeof(float)),
+        M_(M), N_(N), K_(K), a_(RandomData(M * K)), b_(RandomData(K * N)),
+        c_(M * N) {}
+  virtual void Run() {
+    caffe_cpu_gemm<float>(CblasNoTrans, CblasNoTrans, M_, N_, K_, 1.,
+        &a_[0], &b_[0], 0., &c_[0]);
+  }
+  static string Shape(const string& layer, int M, int N, int K) {
+    char shape[128];
+    snprintf(shape, sizeof(shape), "%s M=%d N=%d K=%d", layer.c_str(), M, N,
+        K);
+    return shape;
+  }
+
+ private:
+  int M_, N_, K_;
+  vector<float> a_, b_, c_;
+};
+
+class GemvBenchmark : public KernelBenchmark {
+ public:
+  GemvBenchmark(const string& layer, int M, int N)
+      : KernelBenchmark("caffe_cpu_gemv", GemmBenchmark::Shape(layer, M, N, 1),
+            2. * M * N, (1. * M * N + M + N) * sizeof(float)),
+        M_(M), N_(N), a_(RandomData(M * N)), x_(RandomData(N)), y_(M) {}
+  virtual void Run() {
+    caffe_cpu_gemv<float>(CblasNoTrans, M_, N_, 1., &a_[0], &x_[0], 0.,
+        &y_[0]);
+  }
+
+ private:
+  int M_, N_;
+  vector<float> a_, x_, y_;
+};
+
+// The shape of a convolution layer of one of the bundled models.
+struct ConvShape {
+  const char* layer;
+  int channels, height, width, num_output, kernel, pad, stride, group;
+
+  int height_out() const { return (height + 2 * pad - kernel) / stride + 1; }
+  int width_out() const { return (width + 2 * pad - kernel) / stride + 1; }
+  int col_count() const {
+    return channels * kernel * kernel * height_out() * width_out();
+  }
+};
+
+// im2col_cpu, or col2im_cpu if backward, on one image.
+class Im2colBenchmark : public KernelBenchmark {
+ public:
+  Im2colBenchmark(const ConvShape& conv, bool backward)
+      : KernelBenchmark(backward ? "col2im_cpu" : "im2col_cpu", conv.layer, 0,
+            (1. * conv.channels * conv.height * conv.width + conv.col_count())
+            * sizeof(float)),
+        conv_(conv), backward_(backward),
+        im_(RandomData(conv.channels * conv.height * conv.width)),
+        col_(RandomData(conv.col_count())) {}
+  virtual void Run() {
+    if (backward_) {
+      col2im_cpu(&col_[0], conv_.channels, conv_.height, conv_.width,
+          conv_.kernel, conv_.kernel, conv_.pad, conv_.pad, conv_.stride,
+          conv_.stride, &im_[0]);
+    } else {
+      im2col_cpu(&im_[0], conv_.channels, conv_.height, conv_.width,
+          conv_.kernel, conv_.kernel, conv_.pad, conv_.pad, conv_.stride,
+          conv_.stride, &col_[0]);
+    }
+  }
+
+ private:
+  ConvShape conv_;
+  bool backward_;
+  vector<float> im_, col_;
+};
+
+// The CPU forward pass of a layer, whose operations are estimated as by the
+// NetProfiler.
+class LayerBenchmark : public KernelBenchmark {
+ public:
+  LayerBenchmark(const string& layer_text, const string& shape,
+      int channels, int height, int width)
+      : KernelBenchmark("", shape, 0, 0),
+        bottom_(new Blob<float>(FLAGS_batch_size, channels, height, width)),
+        top_(new Blob<float>()) {
+    LayerParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(layer_text, &param));
+    FillerParameter filler_param;
+    GaussianFiller<float>(filler_param).Fill(bottom_.get());
+    bottom_vec_.push_back(bottom_.get());
+    top_vec_.push_back(top_.get());
+    layer_ = LayerRegistry<float>::CreateLayer(param);
+    layer_->SetUp(bottom_vec_, top_vec_);
+    kernel_ = string(layer_->type()) + "Layer";
+    flops_ = NetProfiler<float>::EstimateFlops(NetProfiler<float>::FORWARD,
+        *layer_, bottom_vec_, top_vec_);
+    bytes_ = (1. * bottom_->count() + top_->count()) * sizeof(float);
+  }
+  virtual void Run() { layer_->Forward(bottom_vec_, top_vec_); }
+
+ private:
+  scoped_ptr<Blob<float> > bottom_, top_;
+  vector<Blob<float>*> bottom_vec_, top_vec_;
+  shared_ptr<Layer<float> > layer_;
+};
+
+// Returns the mean time of one call in seconds.
+double TimeKernel(KernelBenchmark* benchmark) {
+  benchmark->Run();
+  CPUTimer timer;
+  double total_us = 0;
+  int calls = 0;
+  do {
+    timer.Start();
+    benchmark->Run();
+    total_us += timer.MicroSeconds();
+    ++calls;
+  } while (total_us < FLAGS_min_time_ms * 1000);
+  return total_us / calls / 1e6;
+}
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  // Print output to stderr (while still logging).
+  FLAGS_alsologtostderr = 1;
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Benchmark the CPU math kernels on the layer shapes"
+        " of the bundled models and report their throughput against the"
+        " machine's peak\n"
+        "Usage:\n"
+        "    benchmark_math [FLAGS]\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  if (argc != 1) {
+    gflags::ShowUsageWithFlagsRestrict(argv[0], "tools/benchmark_math");
+    return 1;
+  }
+  Caffe::set_mode(Caffe::CPU);
+
+  // Convolutions of CaffeNet (models/bvlc_reference_caffenet), which AlexNet
+  // shares up to grouping, and of LeNet (examples/mnist).
+  const ConvShape convs[] = {
+    {"caffenet/conv1", 3, 227, 227, 96, 11, 0, 4, 1},
+    {"caffenet/conv2", 96, 27, 27, 256, 5, 2, 1, 2},
+    {"caffenet/conv3", 256, 13, 13, 384, 3, 1, 1, 1},
+    {"caffenet/conv4", 384, 13, 13, 384, 3, 1, 1, 2},
+    {"caffenet/conv5", 384, 13, 13, 256, 3, 1, 1, 2},
+    {"lenet/conv1", 1, 28, 28, 20, 5, 0, 1, 1},
+    {"lenet/conv2", 20, 12, 12, 50, 5, 0, 1, 1},
+  };
+  const int num_convs = sizeof(convs) / sizeof(convs[0]);
+  // Inner products of CaffeNet and LeNet, as (layer, inputs, outputs).
+  const struct { const char* layer; int inputs, outputs; } fcs[] = {
+    {"caffenet/fc6", 9216, 4096},
+    {"caffenet/fc7", 4096, 4096},
+    {"caffenet/fc8", 4096, 1000},
+    {"lenet/ip1", 800, 500},
+  };
+  const int num_fcs = sizeof(fcs) / sizeof(fcs[0]);
+
+  vector<shared_ptr<KernelBenchmark> > benchmarks;
+  // A copy too large for the caches gives the memory bandwidth.
+  const int kCopySize = 32 << 20;
+  benchmarks.push_back(shared_ptr<KernelBenchmark>(
+      new CopyBenchmark(kCopySize)));
+  for (int i = 0; i < num_convs; ++i) {
+    // The convolution of one image and group: weights x columns.
+    const ConvShape& conv = convs[i];
+    benchmarks.push_back(shared_ptr<KernelBenchmark>(new GemmBenchmark(
+        conv.layer, conv.num_output / conv.group,
+        conv.height_out() * conv.width_out(),
+        conv.channels / conv.group * conv.kernel * conv.kernel)));
+    benchmarks.push_back(shared_ptr<KernelBenchmark>(
+        new Im2colBenchmark(conv, false)));
+    benchmarks.push_back(shared_ptr<KernelBenchmark>(
+        new Im2colBenchmark(conv, true)));
+  }
+  for (int i = 0; i < num_fcs; ++i) {
+    benchmarks.push_back(shared_ptr<KernelBenchmark>(new GemmBenchmark(
+        fcs[i].layer, FLAGS_batch_size, fcs[i].outputs, fcs[i].inputs)));
+    benchmarks.push_back(shared_ptr<KernelBenchmark>(
+        new GemvBenchmark(fcs[i].layer, fcs[i].outputs, fcs[i].inputs)));
+  }
+  // Element-wise kernels on the sizes of a small, a conv1-sized and a
+  // larger than cache blob.
+  const int vector_sizes[] = {4096, 96 * 55 * 55, 16 << 20};
+  for (int i = 0; i < 3; ++i) {
+    benchmarks.push_back(shared_ptr<KernelBenchmark>(
+        new AxpyBenchmark(vector_sizes[i])));
+    benchmarks.push_back(shared_ptr<KernelBenchmark>(
+        new ExpBenchmark(vector_sizes[i])));
+  }
+  benchmarks.push_back(shared_ptr<KernelBenchmark>(new LayerBenchmark(
+      "type: 'ReLU' relu_param { engine: CAFFE }", "caffenet/relu1",
+      96, 55, 55)));
+  benchmarks.push_back(shared_ptr<KernelBenchmark>(new LayerBenchmark(
+      "type: 'Pooling' pooling_param { pool: MAX kernel_size: 3 stride: 2 "
+      "engine: CAFFE }",
+      "caffenet/pool1", 96, 55, 55)));
+  benchmarks.push_back(shared_ptr<KernelBenchmark>(new LayerBenchmark(
+      "type: 'LRN' lrn_param { local_size: 5 alpha: 0.0001 beta: 0.75 }",
+      "caffenet/norm1", 96, 27, 27)));
+
+  vector<double> seconds(benchmarks.size(), 0);
+  double best_gemm_gflops = 0;
+  double copy_gbps = 0;
+  for (int i = 0; i < benchmarks.size(); ++i) {
+    KernelBenchmark* benchmark = benchmarks[i].get();
+    // The copy is always timed, as the default bandwidth peak.
+    if (i > 0 && (benchmark->kernel() + " " + benchmark->shape())
+        .find(FLAGS_filter) == string::npos) {
+      continue;
+    }
+    seconds[i] = TimeKernel(benchmark);
+    if (benchmark->kernel() == "caffe_cpu_gemm") {
+      best_gemm_gflops = std::max(best_gemm_gflops,
+          benchmark->flops() / seconds[i] / 1e9);
+    } else if (benchmark->kernel() == "caffe_copy") {
+      copy_gbps = benchmark->bytes() / seconds[i] / 1e9;
+    }
+  }
+  const double peak_gflops = FLAGS_peak_gflops > 0 ?
+      FLAGS_peak_gflops : best_gemm_gflops;
+  const double peak_gbps = FLAGS_peak_gbps > 0 ? FLAGS_peak_gbps : copy_gbps;
+  LOG(INFO) << "Peak: " << peak_gflops << " GFLOP/s" <<
+      (FLAGS_peak_gflops > 0 ? "" : " (best GEMM)") << ", " << peak_gbps <<
+      " GB/s" << (FLAGS_peak_gbps > 0 ? "" : " (caffe_copy)");
+
+  std::ofstream csv;
+  if (FLAGS_output.size()) {
+    csv.open(FLAGS_output.c_str());
+    CHECK(csv) << "Failed to open " << FLAGS_output;
+    csv << "kernel,shape,flops,bytes,seconds,gflops,gbps,"
+        "gflops_of_peak,gbps_of_peak\n";
+  }
+  for (int i = 0; i < benchmarks.size(); ++i) {
+    const KernelBenchmark& benchmark = *benchmarks[i];
+    if (seconds[i] == 0) {
+      continue;
+    }
+    const double gflops = benchmark.flops() / seconds[i] / 1e9;
+    const double gbps = benchmark.bytes() / seconds[i] / 1e9;
+    const double gflops_of_peak = peak_gflops > 0 ? gflops / peak_gflops : 0;
+    const double gbps_of_peak = peak_gbps > 0 ? gbps / peak_gbps : 0;
+    LOG(INFO) << benchmark.kernel() << " " << benchmark.shape() << ": " <<
+        seconds[i] * 1000 << " ms, " << gflops << " GFLOP/s (" <<
+        100 * gflops_of_peak << "% of peak), " << gbps << " GB/s (" <<
+        100 * gbps_of_peak << "% of peak)";
+    if (csv.is_open()) {
+      csv << benchmark.kernel() << "," << benchmark.shape() << "," <<
+          benchmark.flops() << "," << benchmark.bytes() << "," <<
+          seconds[i] << "," << gflops << "," << gbps << "," <<
+          gflops_of_peak << "," << gbps_of_peak << "\n";
+    }
+  }
+  if (csv.is_open()) {
+    CHECK(csv) << "Failed to write " << FLAGS_output;
+    LOG(INFO) << "Wrote the results to " << FLAGS_output;
+  }
+  return 0;
+}
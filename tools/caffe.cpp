@@ -12,6 +12,7 @@ using caffe::Blob;
 using caffe::Caffe;
 using caffe::Net;
 using caffe::Layer;
+using caffe::NetProfiler;
 using caffe::shared_ptr;
 using caffe::Timer;
 using caffe::vector;
@@ -30,6 +31,9 @@ DEFINE_string(weights, "",
     "Cannot be set simultaneously with snapshot.");
 DEFINE_int32(iterations, 50,
     "The number of iterations to run.");
+DEFINE_string(profile, "",
+    "Optional; profile the layers of the train or test net, log a per-layer "
+    "summary and write a Chrome trace of every layer pass to this file.");
 
 // A simple registry for caffe commands.
 typedef int (*BrewFunction)();
@@ -91,6 +95,24 @@ void CopyLayers(caffe::Solver<float>* solver, const std::string& model_list) {
   }
 }
 
+// Attaches a profiler to net if --profile is set.
+shared_ptr<NetProfiler<float> > StartProfile(Net<float>* net) {
+  shared_ptr<NetProfiler<float> > profiler;
+  if (FLAGS_profile.size()) {
+    profiler.reset(new NetProfiler<float>());
+    net->set_profiler(profiler);
+  }
+  return profiler;
+}
+
+void ReportProfile(const shared_ptr<NetProfiler<float> >& profiler) {
+  if (profiler) {
+    LOG(INFO) << "Layer profile:\n" << profiler->Summary();
+    LOG(INFO) << "Writing trace to " << FLAGS_profile;
+    profiler->WriteChromeTrace(FLAGS_profile);
+  }
+}
+
 // Train / Finetune a model.
 int train() {
   CHECK_GT(FLAGS_solver.size(), 0) << "Need a solver definition to train.";
@@ -121,6 +143,7 @@ int train() {
   LOG(INFO) << "Starting Optimization";
   shared_ptr<caffe::Solver<float> >
     solver(caffe::GetSolver<float>(solver_param));
+  shared_ptr<NetProfiler<float> > profiler = StartProfile(&*solver->net());
 
   if (FLAGS_snapshot.size()) {
     LOG(INFO) << "Resuming from " << FLAGS_snapshot;
@@ -132,6 +155,7 @@ int train() {
     solver->Solve();
   }
   LOG(INFO) << "Optimization Done.";
+  ReportProfile(profiler);
   return 0;
 }
 RegisterBrewFunction(train);
@@ -154,6 +178,7 @@ int test() {
   // Instantiate the caffe net.
   Net<float> caffe_net(FLAGS_model, caffe::TEST);
   caffe_net.CopyTrainedLayersFrom(FLAGS_weights);
+  shared_ptr<NetProfiler<float> > profiler = StartProfile(&caffe_net);
   LOG(INFO) << "Running for " << FLAGS_iterations << " iterations.";
 
   vector<Blob<float>* > bottom_vec;
@@ -197,6 +222,7 @@ int test() {
     }
     LOG(INFO) << output_name << " = " << mean_score << loss_msg_stream.str();
   }
+  ReportProfile(profiler);
 
   return 0;
 }
@@ -9,8 +9,10 @@
 #include "glog/logging.h"
 
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/benchmark.hpp"
 #include "caffe/util/db.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 using namespace caffe;  // NOLINT(build/namespaces)
 
@@ -20,6 +22,95 @@ using boost::scoped_ptr;
 
 DEFINE_string(backend, "lmdb",
         "The backend {leveldb, lmdb} containing the images");
+DEFINE_int32(threads, 0,
+    "Number of threads decoding and summing the images; 0 uses one per core");
+DEFINE_bool(channel_mean_only, false,
+    "When this option is on, only compute the mean of every channel, which "
+    "allows images of different sizes, and write it as mean_value fields of "
+    "a transform_param to OUTPUT_FILE");
+
+// Number of Datums read from the DB before they are summed in parallel.
+const int kChunkSize = 1024;
+
+// Sums a chunk of serialized Datums, split in one slice per thread. Every
+// slice is added into partial sums of its own, kept in double so that the
+// result does not depend on the number of images, then the partial sums are
+// reduced once at the end.
+class ChunkSummer {
+ public:
+  ChunkSummer(const vector<string>* values, int num_values,
+      vector<vector<double> >* sums, vector<int64_t>* pixels,
+      int data_size, int channels, bool channel_mean_only)
+      : values_(values), num_values_(num_values), sums_(sums),
+        pixels_(pixels), data_size_(data_size), channels_(channels),
+        channel_mean_only_(channel_mean_only) {}
+
+  void operator()(int slice) const {
+    const int num_slices = sums_->size();
+    const int begin = num_values_ * slice / num_slices;
+    const int end = num_values_ * (slice + 1) / num_slices;
+    double* sums = &(*sums_)[slice][0];
+    Datum datum;
+    for (int n = begin; n < end; ++n) {
+      datum.ParseFromString((*values_)[n]);
+      DecodeDatumNative(&datum);
+      const int size_in_datum = std::max<int>(datum.data().size(),
+          datum.float_data_size());
+      if (channel_mean_only_) {
+        CHECK_EQ(datum.channels(), channels_) << "Incorrect channels " <<
+            datum.channels();
+        CHECK_EQ(size_in_datum,
+            datum.channels() * datum.height() * datum.width()) <<
+            "Incorrect data field size " << size_in_datum;
+        const int dim = datum.height() * datum.width();
+        (*pixels_)[slice] += dim;
+        for (int c = 0; c < channels_; ++c) {
+          sums[c] += ChannelSum(datum, c * dim, dim);
+        }
+      } else {
+        CHECK_EQ(size_in_datum, data_size_) << "Incorrect data field size " <<
+            size_in_datum;
+        const string& data = datum.data();
+        if (data.size() != 0) {
+          for (int i = 0; i < size_in_datum; ++i) {
+            sums[i] += static_cast<uint8_t>(data[i]);
+          }
+        } else {
+          for (int i = 0; i < size_in_datum; ++i) {
+            sums[i] += datum.float_data(i);
+          }
+        }
+      }
+    }
+  }
+
+ private:
+  static double ChannelSum(const Datum& datum, int offset, int dim) {
+    const string& data = datum.data();
+    double sum = 0;
+    if (data.size() != 0) {
+      // The bytes of one channel add up exactly in an integer.
+      int64_t byte_sum = 0;
+      for (int i = offset; i < offset + dim; ++i) {
+        byte_sum += static_cast<uint8_t>(data[i]);
+      }
+      sum = byte_sum;
+    } else {
+      for (int i = offset; i < offset + dim; ++i) {
+        sum += datum.float_data(i);
+      }
+    }
+    return sum;
+  }
+
+  const vector<string>* values_;
+  int num_values_;
+  vector<vector<double> >* sums_;
+  vector<int64_t>* pixels_;
+  int data_size_;
+  int channels_;
+  bool channel_mean_only_;
+};
 
 int main(int argc, char** argv) {
   ::google::InitGoogleLogging(argv[0]);
@@ -58,54 +149,74 @@ int main(int argc, char** argv) {
   sum_blob.set_channels(datum.channels());
   sum_blob.set_height(datum.height());
   sum_blob.set_width(datum.width());
+  const int channels = datum.channels();
   const int data_size = datum.channels() * datum.height() * datum.width();
-  int size_in_datum = std::max<int>(datum.data().size(),
-                                    datum.float_data_size());
-  for (int i = 0; i < size_in_datum; ++i) {
-    sum_blob.add_data(0.);
-  }
-  LOG(INFO) << "Starting Iteration";
+
+  // The cursor is read on this thread, while the images are decoded and
+  // summed by the pool, one chunk at a time.
+  ThreadPool pool(FLAGS_threads);
+  const int num_sums = FLAGS_channel_mean_only ? channels : data_size;
+  vector<vector<double> > partial_sums(pool.num_threads(),
+      vector<double>(num_sums, 0.));
+  vector<int64_t> partial_pixels(pool.num_threads(), 0);
+  vector<string> values(kChunkSize);
+  LOG(INFO) << "Starting Iteration using " << pool.num_threads() <<
+      " threads";
+  CPUTimer timer;
+  timer.Start();
   while (cursor->valid()) {
-    Datum datum;
-    datum.ParseFromString(cursor->value());
-    DecodeDatumNative(&datum);
-
-    const std::string& data = datum.data();
-    size_in_datum = std::max<int>(datum.data().size(),
-        datum.float_data_size());
-    CHECK_EQ(size_in_datum, data_size) << "Incorrect data field size " <<
-        size_in_datum;
-    if (data.size() != 0) {
-      CHECK_EQ(data.size(), size_in_datum);
-      for (int i = 0; i < size_in_datum; ++i) {
-        sum_blob.set_data(i, sum_blob.data(i) + (uint8_t)data[i]);
-      }
-    } else {
-      CHECK_EQ(datum.float_data_size(), size_in_datum);
-      for (int i = 0; i < size_in_datum; ++i) {
-        sum_blob.set_data(i, sum_blob.data(i) +
-            static_cast<float>(datum.float_data(i)));
-      }
+    int num_values = 0;
+    for (; num_values < kChunkSize && cursor->valid(); ++num_values) {
+      values[num_values] = cursor->value();
+      cursor->Next();
     }
-    ++count;
-    if (count % 10000 == 0) {
-      LOG(INFO) << "Processed " << count << " files.";
+    pool.Run(pool.num_threads(), ChunkSummer(&values, num_values,
+        &partial_sums, &partial_pixels, data_size, channels,
+        FLAGS_channel_mean_only));
+    const int previous_count = count;
+    count += num_values;
+    if (count / 10000 != previous_count / 10000) {
+      LOG(INFO) << "Processed " << count << " files (" <<
+          count / timer.Seconds() << " files/s).";
     }
-    cursor->Next();
   }
 
   if (count % 10000 != 0) {
-    LOG(INFO) << "Processed " << count << " files.";
+    LOG(INFO) << "Processed " << count << " files (" <<
+        count / timer.Seconds() << " files/s).";
   }
-  for (int i = 0; i < sum_blob.data_size(); ++i) {
-    sum_blob.set_data(i, sum_blob.data(i) / count);
+  vector<double> sums(num_sums, 0.);
+  int64_t pixels = 0;
+  for (int t = 0; t < pool.num_threads(); ++t) {
+    for (int i = 0; i < num_sums; ++i) {
+      sums[i] += partial_sums[t][i];
+    }
+    pixels += partial_pixels[t];
+  }
+
+  if (FLAGS_channel_mean_only) {
+    TransformationParameter transform_param;
+    LOG(INFO) << "Number of channels: " << channels;
+    for (int c = 0; c < channels; ++c) {
+      const float mean_value = sums[c] / pixels;
+      transform_param.add_mean_value(mean_value);
+      LOG(INFO) << "mean_value channel [" << c << "]:" << mean_value;
+    }
+    if (argc == 3) {
+      LOG(INFO) << "Write to " << argv[2];
+      WriteProtoToTextFile(transform_param, argv[2]);
+    }
+    return 0;
+  }
+
+  for (int i = 0; i < data_size; ++i) {
+    sum_blob.add_data(sums[i] / count);
   }
   // Write to disk
   if (argc == 3) {
     LOG(INFO) << "Write to " << argv[2];
     WriteProtoToBinaryFile(sum_blob, argv[2]);
   }
-  const int channels = sum_blob.channels();
   const int dim = sum_blob.height() * sum_blob.width();
   std::vector<float> mean_values(channels, 0.0);
   LOG(INFO) << "Number of channels: " << channels;
@@ -3,24 +3,240 @@
 #include <vector>
 
 #include "boost/algorithm/string.hpp"
+#include "boost/bind.hpp"
 #include "google/protobuf/text_format.h"
+#include "hdf5.h"
 
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
+#include "caffe/data_layers.hpp"
+#include "caffe/internal_thread.hpp"
 #include "caffe/net.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/blocking_queue.hpp"
 #include "caffe/util/db.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
 #include "caffe/vision_layers.hpp"
 
+using caffe::Batch;
 using caffe::Blob;
+using caffe::BlockingQueue;
 using caffe::Caffe;
 using caffe::Datum;
 using caffe::Net;
+using caffe::ThreadPool;
 using boost::shared_ptr;
 using std::string;
+using std::vector;
 namespace db = caffe::db;
 
+// Number of feature batches of one blob that can wait to be written before
+// the forward passes block.
+const int kQueueSize = 4;
+// Number of features Put into a DB transaction between two commits.
+const int kCommitInterval = 1000;
+// Number of rows per chunk of the HDF5 feature datasets.
+const int kHDF5ChunkRows = 1024;
+
+// Writes the features extracted for one blob to one output, on a thread of
+// its own, so that the forward passes of the net are not held up by
+// serialization and disk I/O. The features are copied into one of a fixed
+// set of batches, which bounds the memory used when the output is slower
+// than the net.
+template <typename Dtype>
+class FeatureWriter : public caffe::InternalThread {
+ public:
+  FeatureWriter(const string& blob_name, const string& dataset_name)
+      : blob_name_(blob_name), dataset_name_(dataset_name), num_written_(0),
+        batches_(kQueueSize) {
+    for (int i = 0; i < batches_.size(); ++i) {
+      batches_[i].reset(new Batch<Dtype>());
+      free_.push(batches_[i].get());
+    }
+  }
+  virtual ~FeatureWriter() {}
+
+  void Start() {
+    CHECK(StartInternalThread()) << "Thread execution failed";
+  }
+  // Queues a copy of the features for writing. Waits while the writer is
+  // kQueueSize batches behind.
+  void Push(const Blob<Dtype>& features) {
+    Batch<Dtype>* batch = free_.pop();
+    batch->data_.ReshapeLike(features);
+    caffe::caffe_copy(features.count(), features.cpu_data(),
+        batch->data_.mutable_cpu_data());
+    full_.push(batch);
+  }
+  // Writes the queued features and closes the output.
+  void Finish() {
+    full_.push(NULL);
+    CHECK(WaitForInternalThreadToExit()) << "Thread joining failed";
+    Close();
+    LOG(ERROR)<< "Extracted features of " << num_written_ <<
+        " query images for feature blob " << blob_name_;
+  }
+
+ protected:
+  virtual void InternalThreadEntry() {
+    Batch<Dtype>* batch;
+    while ((batch = full_.pop()) != NULL) {
+      Write(batch->data_);
+      num_written_ += batch->data_.num();
+      free_.push(batch);
+    }
+  }
+  // Called on the writer thread for every batch of features, in order.
+  virtual void Write(const Blob<Dtype>& features) = 0;
+  virtual void Close() = 0;
+
+  string blob_name_;
+  string dataset_name_;
+  int num_written_;
+
+ private:
+  vector<shared_ptr<Batch<Dtype> > > batches_;
+  BlockingQueue<Batch<Dtype>*> free_;
+  BlockingQueue<Batch<Dtype>*> full_;
+};
+
+// Stores every feature as a Datum of float_data in a leveldb or lmdb, keyed
+// by its index. The Datums of a batch are serialized in parallel on a pool
+// shared by all the DB writers, then Put in order.
+template <typename Dtype>
+class DBFeatureWriter : public FeatureWriter<Dtype> {
+ public:
+  DBFeatureWriter(const string& blob_name, const string& dataset_name,
+      const string& db_type, ThreadPool* pool)
+      : FeatureWriter<Dtype>(blob_name, dataset_name), pool_(pool) {
+    db_.reset(db::GetDB(db_type));
+    db_->Open(dataset_name, db::NEW);
+    txn_.reset(db_->NewTransaction());
+  }
+
+ protected:
+  virtual void Write(const Blob<Dtype>& features) {
+    features_ = &features;
+    values_.resize(features.num());
+    pool_->Run(features.num(),
+        boost::bind(&DBFeatureWriter<Dtype>::Serialize, this, _1));
+    const int kMaxKeyStrLength = 100;
+    char key_str[kMaxKeyStrLength];
+    for (int n = 0; n < features.num(); ++n) {
+      const int index = this->num_written_ + n;
+      int length = snprintf(key_str, kMaxKeyStrLength, "%d", index);
+      txn_->Put(string(key_str, length), values_[n]);
+      if ((index + 1) % kCommitInterval == 0) {
+        txn_->Commit();
+        txn_.reset(db_->NewTransaction());
+        LOG(ERROR)<< "Extracted features of " << index + 1 <<
+            " query images for feature blob " << this->blob_name_;
+      }
+    }
+  }
+  virtual void Close() {
+    if (this->num_written_ % kCommitInterval != 0) {
+      txn_->Commit();
+    }
+    txn_.reset();
+    db_->Close();
+  }
+  // Serializes the n-th feature of the current batch into values_[n].
+  void Serialize(int n) {
+    const int dim_features = features_->count() / features_->num();
+    const Dtype* feature_data = features_->cpu_data() + features_->offset(n);
+    Datum datum;
+    datum.set_channels(features_->channels());
+    datum.set_height(features_->height());
+    datum.set_width(features_->width());
+    datum.mutable_float_data()->Reserve(dim_features);
+    for (int d = 0; d < dim_features; ++d) {
+      datum.mutable_float_data()->AddAlreadyReserved(feature_data[d]);
+    }
+    CHECK(datum.SerializeToString(&values_[n]));
+  }
+
+  ThreadPool* pool_;
+  shared_ptr<db::DB> db_;
+  shared_ptr<db::Transaction> txn_;
+  const Blob<Dtype>* features_;
+  vector<string> values_;
+};
+
+// Appends the features to the "data" dataset of an HDF5 file, as one
+// num x channels x height x width array, without going through Datum. The
+// writers of several blobs run at once, so every HDF5 call holds the HDF5Lock.
+template <typename Dtype>
+class HDF5FeatureWriter : public FeatureWriter<Dtype> {
+ public:
+  HDF5FeatureWriter(const string& blob_name, const string& dataset_name)
+      : FeatureWriter<Dtype>(blob_name, dataset_name) {
+    caffe::HDF5Lock lock;
+    file_id_ = H5Fcreate(dataset_name.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT,
+        H5P_DEFAULT);
+    CHECK_GE(file_id_, 0) << "Failed to open HDF5 file " << dataset_name;
+  }
+
+ protected:
+  virtual void Write(const Blob<Dtype>& features) {
+    caffe::hdf5_append_nd_dataset(file_id_, "data", features, kHDF5ChunkRows);
+  }
+  virtual void Close() {
+    caffe::HDF5Lock lock;
+    herr_t status = H5Fclose(file_id_);
+    CHECK_GE(status, 0) << "Failed to close HDF5 file " << this->dataset_name_;
+  }
+
+  hid_t file_id_;
+};
+
+// Writes the features back to back as raw float32 values, in the
+// num x channels x height x width order of the blob, without any header;
+// the shape of one feature is logged when the file is closed.
+template <typename Dtype>
+class RawFeatureWriter : public FeatureWriter<Dtype> {
+ public:
+  RawFeatureWriter(const string& blob_name, const string& dataset_name)
+      : FeatureWriter<Dtype>(blob_name, dataset_name) {
+    file_ = fopen(dataset_name.c_str(), "wb");
+    CHECK(file_) << "Failed to open raw feature file " << dataset_name;
+  }
+
+ protected:
+  virtual void Write(const Blob<Dtype>& features) {
+    shape_ = features.shape_string();
+    const Dtype* data = features.cpu_data();
+    values_.resize(features.count());
+    for (int i = 0; i < features.count(); ++i) {
+      values_[i] = static_cast<float>(data[i]);
+    }
+    CHECK_EQ(fwrite(&values_[0], sizeof(float), values_.size(), file_),
+        values_.size()) << "Failed to write to " << this->dataset_name_;
+  }
+  virtual void Close() {
+    CHECK_EQ(fclose(file_), 0) << "Failed to close " << this->dataset_name_;
+    LOG(ERROR)<< "Wrote " << this->num_written_ << " float32 features to "
+        << this->dataset_name_ << " (last batch shape " << shape_ << ")";
+  }
+
+  FILE* file_;
+  string shape_;
+  vector<float> values_;
+};
+
+template <typename Dtype>
+FeatureWriter<Dtype>* GetFeatureWriter(const string& blob_name,
+    const string& dataset_name, const string& db_type, ThreadPool* pool) {
+  if (db_type == "hdf5") {
+    return new HDF5FeatureWriter<Dtype>(blob_name, dataset_name);
+  } else if (db_type == "raw") {
+    return new RawFeatureWriter<Dtype>(blob_name, dataset_name);
+  }
+  return new DBFeatureWriter<Dtype>(blob_name, dataset_name, db_type, pool);
+}
+
 template<typename Dtype>
 int feature_extraction_pipeline(int argc, char** argv);
 
@@ -44,7 +260,10 @@ int feature_extraction_pipeline(int argc, char** argv) {
     "Note: you can extract multiple features in one pass by specifying"
     " multiple feature blob names and dataset names seperated by ','."
     " The names cannot contain white space characters and the number of blobs"
-    " and datasets must be equal.";
+    " and datasets must be equal.\n"
+    "db_type is leveldb or lmdb to store the features as Datums, hdf5 to"
+    " append them to the \"data\" dataset of an HDF5 file, or raw to write"
+    " them as consecutive float32 values.";
     return 1;
   }
   int arg_pos = num_required_args;
@@ -119,70 +338,35 @@ int feature_extraction_pipeline(int argc, char** argv) {
   }
 
   int num_mini_batches = atoi(argv[++arg_pos]);
+  std::string db_type(argv[++arg_pos]);
 
-  std::vector<shared_ptr<db::DB> > feature_dbs;
-  std::vector<shared_ptr<db::Transaction> > txns;
+  // Every output is written by a thread of its own while the net computes
+  // the next batches; the Datums are serialized on one thread per core.
+  ThreadPool serialization_pool(0);
+  std::vector<shared_ptr<FeatureWriter<Dtype> > > feature_writers;
   for (size_t i = 0; i < num_features; ++i) {
     LOG(INFO)<< "Opening dataset " << dataset_names[i];
-    shared_ptr<db::DB> db(db::GetDB(argv[++arg_pos]));
-    db->Open(dataset_names.at(i), db::NEW);
-    feature_dbs.push_back(db);
-    shared_ptr<db::Transaction> txn(db->NewTransaction());
-    txns.push_back(txn);
+    feature_writers.push_back(shared_ptr<FeatureWriter<Dtype> >(
+        GetFeatureWriter<Dtype>(blob_names[i], dataset_names[i], db_type,
+            &serialization_pool)));
+    feature_writers[i]->Start();
   }
 
   LOG(ERROR)<< "Extacting Features";
 
-  Datum datum;
-  const int kMaxKeyStrLength = 100;
-  char key_str[kMaxKeyStrLength];
-  std::vector<Blob<float>*> input_vec;
-  std::vector<int> image_indices(num_features, 0);
+  std::vector<Blob<Dtype>*> input_vec;
   for (int batch_index = 0; batch_index < num_mini_batches; ++batch_index) {
     feature_extraction_net->Forward(input_vec);
     for (int i = 0; i < num_features; ++i) {
-      const shared_ptr<Blob<Dtype> > feature_blob = feature_extraction_net
-          ->blob_by_name(blob_names[i]);
-      int batch_size = feature_blob->num();
-      int dim_features = feature_blob->count() / batch_size;
-      const Dtype* feature_blob_data;
-      for (int n = 0; n < batch_size; ++n) {
-        datum.set_height(feature_blob->height());
-        datum.set_width(feature_blob->width());
-        datum.set_channels(feature_blob->channels());
-        datum.clear_data();
-        datum.clear_float_data();
-        feature_blob_data = feature_blob->cpu_data() +
-            feature_blob->offset(n);
-        for (int d = 0; d < dim_features; ++d) {
-          datum.add_float_data(feature_blob_data[d]);
-        }
-        int length = snprintf(key_str, kMaxKeyStrLength, "%d",
-            image_indices[i]);
-        string out;
-        CHECK(datum.SerializeToString(&out));
-        txns.at(i)->Put(std::string(key_str, length), out);
-        ++image_indices[i];
-        if (image_indices[i] % 1000 == 0) {
-          txns.at(i)->Commit();
-          txns.at(i).reset(feature_dbs.at(i)->NewTransaction());
-          LOG(ERROR)<< "Extracted features of " << image_indices[i] <<
-              " query images for feature blob " << blob_names[i];
-        }
-      }  // for (int n = 0; n < batch_size; ++n)
-    }  // for (int i = 0; i < num_features; ++i)
+      feature_writers[i]->Push(
+          *feature_extraction_net->blob_by_name(blob_names[i]));
+    }
   }  // for (int batch_index = 0; batch_index < num_mini_batches; ++batch_index)
-  // write the last batch
+  // write the last batches
   for (int i = 0; i < num_features; ++i) {
-    if (image_indices[i] % 1000 != 0) {
-      txns.at(i)->Commit();
-    }
-    LOG(ERROR)<< "Extracted features of " << image_indices[i] <<
-        " query images for feature blob " << blob_names[i];
-    feature_dbs.at(i)->Close();
+    feature_writers[i]->Finish();
   }
 
   LOG(ERROR)<< "Successfully extracted the features!";
   return 0;
 }
-
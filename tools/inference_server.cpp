@@ -0,0 +1,506 @@
+// Serves the predictions of a deploy net over HTTP, coalescing concurrent
+// requests into batches.
+// Usage:
+//    inference_server --model=deploy.prototxt --weights=net.caffemodel
+//        [--port=8000] [--max_delay_ms=5] [--gpu=0]
+//
+// POST /predict takes one input item, i.e. the net's input blob without its
+// first axis, as raw native-endian float32. It returns the matching item of
+// every output blob of the net, in their order, also as raw float32.
+// GET /info describes these shapes and GET /stats the latency of each stage
+// of the requests served so far.
+//
+// Requests arriving together are run as one batch of up to the num of the
+// input blob in the prototxt. A request waits at most --max_delay_ms for
+// others to join its batch, and smaller batches are run as such.
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>  // for snprintf
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "boost/algorithm/string.hpp"
+#include "boost/date_time/posix_time/posix_time.hpp"
+#include "boost/thread.hpp"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/net.hpp"
+#include "caffe/util/math_functions.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+using boost::posix_time::ptime;
+
+DEFINE_string(model, "",
+    "The deploy net definition protocol buffer text file.");
+DEFINE_string(weights, "",
+    "The trained weights of the net.");
+DEFINE_int32(gpu, -1,
+    "Optional; run in GPU mode on given device ID.");
+DEFINE_string(host, "127.0.0.1",
+    "The IPv4 address to listen on; 0.0.0.0 for every interface.");
+DEFINE_int32(port, 8000,
+    "The TCP port to listen on.");
+DEFINE_double(max_delay_ms, 5,
+    "The longest a request waits for others to fill its batch.");
+
+// Requests with bodies larger than this are refused.
+const int kMaxBodyBytes = 1 << 28;
+
+double Microseconds(const boost::posix_time::time_duration& duration) {
+  return duration.total_microseconds();
+}
+
+// Counts latencies in buckets of powers of 2 microseconds.
+class LatencyHistogram {
+ public:
+  LatencyHistogram() : count_(0), total_us_(0), max_us_(0),
+      buckets_(kNumBuckets, 0) {}
+
+  void Add(double us) {
+    int bucket = 0;
+    while (bucket < kNumBuckets - 1 && us >= BucketEnd(bucket)) {
+      ++bucket;
+    }
+    boost::mutex::scoped_lock lock(mutex_);
+    ++count_;
+    total_us_ += us;
+    max_us_ = std::max(max_us_, us);
+    ++buckets_[bucket];
+  }
+
+  // One line with the mean, the upper bounds of the buckets of the
+  // percentiles and the max, then one line per non-empty bucket.
+  string Summary(const string& name) const {
+    boost::mutex::scoped_lock lock(mutex_);
+    char line[256];
+    snprintf(line, sizeof(line), "%-10s count %lld", name.c_str(),
+        static_cast<long long>(count_));  // NOLINT(runtime/int)
+    string summary = line;
+    if (count_) {
+      snprintf(line, sizeof(line), " mean %.3f ms p50 < %.3f ms "
+          "p90 < %.3f ms p99 < %.3f ms max %.3f ms",
+          total_us_ / count_ / 1000, Percentile(0.5) / 1000,
+          Percentile(0.9) / 1000, Percentile(0.99) / 1000, max_us_ / 1000);
+      summary += line;
+    }
+    summary += "\n";
+    for (int i = 0; i < kNumBuckets; ++i) {
+      if (buckets_[i]) {
+        snprintf(line, sizeof(line), "  < %10.3f ms %lld\n",
+            BucketEnd(i) / 1000,
+            static_cast<long long>(buckets_[i]));  // NOLINT(runtime/int)
+        summary += line;
+      }
+    }
+    return summary;
+  }
+
+ private:
+  static const int kNumBuckets = 32;
+
+  static double BucketEnd(int bucket) {
+    return static_cast<double>(int64_t(2) << bucket);
+  }
+
+  // The end of the bucket holding the q-quantile.
+  double Percentile(double q) const {
+    int64_t seen = 0;
+    for (int i = 0; i < kNumBuckets; ++i) {
+      seen += buckets_[i];
+      if (seen >= q * count_) {
+        return BucketEnd(i);
+      }
+    }
+    return BucketEnd(kNumBuckets - 1);
+  }
+
+  mutable boost::mutex mutex_;
+  int64_t count_;
+  double total_us_;
+  double max_us_;
+  vector<int64_t> buckets_;
+};
+
+// One POST /predict, owned by the connection thread waiting for it.
+struct Prediction {
+  explicit Prediction(const string* input)
+      : input(input), arrival(boost::get_system_time()), done(false) {}
+
+  const string* input;
+  string output;
+  const ptime arrival;
+  bool done;
+};
+
+// Runs the predictions queued by any thread through the net, in batches.
+class Batcher {
+ public:
+  explicit Batcher(Net<float>* net) : net_(net), num_batches_(0),
+      num_predictions_(0) {
+    CHECK_EQ(net_->num_inputs(), 1) << "The net must have a single input.";
+    CHECK_GT(net_->num_outputs(), 0) << "The net has no output.";
+    input_ = net_->input_blobs()[0];
+    CHECK_GT(input_->num_axes(), 0) << "The input blob has no batch axis.";
+    max_batch_ = input_->shape(0);
+    input_bytes_ = input_->count(1) * sizeof(float);
+    output_bytes_ = 0;
+    std::ostringstream info;
+    info << "input " << net_->blob_names()[net_->input_blob_indices()[0]]
+        << " " << ItemShape(*input_) << ", batches of at most " << max_batch_
+        << "\n";
+    for (int i = 0; i < net_->num_outputs(); ++i) {
+      const Blob<float>& output = *net_->output_blobs()[i];
+      output_bytes_ += output.count(1) * sizeof(float);
+      info << "output " << net_->blob_names()[net_->output_blob_indices()[i]]
+          << " " << ItemShape(output) << "\n";
+    }
+    info << "request " << input_bytes_ << " bytes, response " << output_bytes_
+        << " bytes\n";
+    info_ = info.str();
+  }
+
+  int input_bytes() const { return input_bytes_; }
+
+  // Runs prediction, blocking until it is done.
+  void Predict(Prediction* prediction) {
+    boost::mutex::scoped_lock lock(mutex_);
+    queue_.push_back(prediction);
+    queued_.notify_one();
+    while (!prediction->done) {
+      done_.wait(lock);
+    }
+    total_.Add(Microseconds(boost::get_system_time() - prediction->arrival));
+  }
+
+  // Runs the queued predictions forever, on the calling thread.
+  void Run() {
+    const boost::posix_time::time_duration max_delay =
+        boost::posix_time::microseconds(
+            static_cast<int64_t>(FLAGS_max_delay_ms * 1000));
+    vector<Prediction*> batch;
+    for (;;) {
+      {
+        boost::mutex::scoped_lock lock(mutex_);
+        while (queue_.empty()) {
+          queued_.wait(lock);
+        }
+        const ptime deadline = queue_.front()->arrival + max_delay;
+        while (queue_.size() < max_batch_ &&
+            boost::get_system_time() < deadline) {
+          queued_.timed_wait(lock, deadline);
+        }
+        const int size = std::min<int>(queue_.size(), max_batch_);
+        batch.assign(queue_.begin(), queue_.begin() + size);
+        queue_.erase(queue_.begin(), queue_.begin() + size);
+      }
+      RunBatch(batch);
+      boost::mutex::scoped_lock lock(mutex_);
+      for (int i = 0; i < batch.size(); ++i) {
+        batch[i]->done = true;
+      }
+      done_.notify_all();
+    }
+  }
+
+  // Fixed at construction, as the batch thread reshapes the blobs.
+  const string& info() const { return info_; }
+
+  string Stats() const {
+    std::ostringstream stats;
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      stats << num_predictions_ << " predictions in " << num_batches_
+          << " batches of at most " << max_batch_ << "\n";
+    }
+    stats << queue_wait_.Summary("queue") << input_copy_.Summary("input")
+        << forward_.Summary("forward") << output_copy_.Summary("output")
+        << total_.Summary("total");
+    return stats.str();
+  }
+
+ private:
+  // The shape of one item of blob, e.g. 3x227x227.
+  static string ItemShape(const Blob<float>& blob) {
+    std::ostringstream shape;
+    for (int i = 1; i < blob.num_axes(); ++i) {
+      shape << (i > 1 ? "x" : "") << blob.shape(i);
+    }
+    return blob.num_axes() > 1 ? shape.str() : "scalar";
+  }
+
+  void RunBatch(const vector<Prediction*>& batch) {
+    const ptime start = boost::get_system_time();
+    for (int i = 0; i < batch.size(); ++i) {
+      queue_wait_.Add(Microseconds(start - batch[i]->arrival));
+    }
+    if (input_->shape(0) != batch.size()) {
+      vector<int> shape = input_->shape();
+      shape[0] = batch.size();
+      input_->Reshape(shape);
+      net_->Reshape();
+    }
+    const int item_count = input_->count(1);
+    float* input_data = input_->mutable_cpu_data();
+    for (int i = 0; i < batch.size(); ++i) {
+      caffe_copy(item_count,
+          reinterpret_cast<const float*>(batch[i]->input->data()),
+          input_data + i * item_count);
+    }
+    const ptime forward_start = boost::get_system_time();
+    net_->ForwardPrefilled();
+    const ptime forward_end = boost::get_system_time();
+    for (int i = 0; i < batch.size(); ++i) {
+      batch[i]->output.resize(output_bytes_);
+    }
+    int offset = 0;
+    for (int j = 0; j < net_->num_outputs(); ++j) {
+      const Blob<float>* output = net_->output_blobs()[j];
+      const int output_count = output->count(1);
+      const float* output_data = output->cpu_data();
+      for (int i = 0; i < batch.size(); ++i) {
+        caffe_copy(output_count, output_data + i * output_count,
+            reinterpret_cast<float*>(&batch[i]->output[offset]));
+      }
+      offset += output_count * sizeof(float);
+    }
+    const ptime end = boost::get_system_time();
+    input_copy_.Add(Microseconds(forward_start - start));
+    forward_.Add(Microseconds(forward_end - forward_start));
+    output_copy_.Add(Microseconds(end - forward_end));
+    boost::mutex::scoped_lock lock(mutex_);
+    ++num_batches_;
+    num_predictions_ += batch.size();
+  }
+
+  Net<float>* net_;
+  Blob<float>* input_;
+  int max_batch_;
+  int input_bytes_;
+  int output_bytes_;
+  string info_;
+
+  mutable boost::mutex mutex_;
+  boost::condition_variable queued_;
+  boost::condition_variable done_;
+  std::deque<Prediction*> queue_;
+  int64_t num_batches_;
+  int64_t num_predictions_;
+
+  LatencyHistogram queue_wait_;
+  LatencyHistogram input_copy_;
+  LatencyHistogram forward_;
+  LatencyHistogram output_copy_;
+  LatencyHistogram total_;
+};
+
+// Just enough HTTP/1.1 for POST and GET with keep-alive.
+struct HttpRequest {
+  string method;
+  string path;
+  string body;
+  bool keep_alive;
+};
+
+bool WriteAll(int fd, const char* data, size_t size) {
+  while (size) {
+    const ssize_t written = write(fd, data, size);
+    if (written <= 0) {
+      return false;
+    }
+    data += written;
+    size -= written;
+  }
+  return true;
+}
+
+// Reads the next request of the connection into request, keeping the bytes
+// read past it in buffer. Clients sending Expect: 100-continue, as curl does
+// for large uploads, are told to go on before the body is read. Returns false
+// when the connection is closed or the request is malformed.
+bool ReadRequest(int fd, string* buffer, HttpRequest* request) {
+  char chunk[64 * 1024];
+  size_t header_end;
+  while ((header_end = buffer->find("\r\n\r\n")) == string::npos) {
+    if (buffer->size() > 64 * 1024) {
+      return false;
+    }
+    const ssize_t received = read(fd, chunk, sizeof(chunk));
+    if (received <= 0) {
+      return false;
+    }
+    buffer->append(chunk, received);
+  }
+  vector<string> lines;
+  const string header = buffer->substr(0, header_end);
+  boost::split(lines, header, boost::is_any_of("\n"));
+  vector<string> request_line;
+  boost::split(request_line, boost::trim_copy(lines[0]),
+      boost::is_any_of(" "), boost::token_compress_on);
+  if (request_line.size() != 3) {
+    return false;
+  }
+  request->method = request_line[0];
+  request->path = request_line[1];
+  request->keep_alive = request_line[2] != "HTTP/1.0";
+  int64_t content_length = 0;
+  bool expect_continue = false;
+  for (int i = 1; i < lines.size(); ++i) {
+    const size_t colon = lines[i].find(':');
+    if (colon == string::npos) {
+      continue;
+    }
+    const string name = boost::to_lower_copy(
+        boost::trim_copy(lines[i].substr(0, colon)));
+    const string value = boost::to_lower_copy(
+        boost::trim_copy(lines[i].substr(colon + 1)));
+    if (name == "content-length") {
+      content_length = atoll(value.c_str());
+    } else if (name == "connection") {
+      request->keep_alive = value != "close";
+    } else if (name == "expect") {
+      expect_continue = value == "100-continue";
+    }
+  }
+  if (content_length < 0 || content_length > kMaxBodyBytes) {
+    return false;
+  }
+  buffer->erase(0, header_end + 4);
+  if (expect_continue && buffer->size() < content_length) {
+    static const char kContinue[] = "HTTP/1.1 100 Continue\r\n\r\n";
+    if (!WriteAll(fd, kContinue, sizeof(kContinue) - 1)) {
+      return false;
+    }
+  }
+  while (buffer->size() < content_length) {
+    const ssize_t received = read(fd, chunk, sizeof(chunk));
+    if (received <= 0) {
+      return false;
+    }
+    buffer->append(chunk, received);
+  }
+  request->body.assign(*buffer, 0, content_length);
+  buffer->erase(0, content_length);
+  return true;
+}
+
+bool WriteResponse(int fd, const string& status, const string& content_type,
+    const string& body, bool keep_alive) {
+  std::ostringstream header;
+  header << "HTTP/1.1 " << status << "\r\n"
+      << "Content-Type: " << content_type << "\r\n"
+      << "Content-Length: " << body.size() << "\r\n"
+      << "Connection: " << (keep_alive ? "keep-alive" : "close") << "\r\n\r\n";
+  const string header_string = header.str();
+  return WriteAll(fd, header_string.data(), header_string.size()) &&
+      WriteAll(fd, body.data(), body.size());
+}
+
+// Serves the requests of one connection until it is closed.
+void ServeConnection(Batcher* batcher, int fd) {
+  string buffer;
+  HttpRequest request;
+  bool open = true;
+  while (open && ReadRequest(fd, &buffer, &request)) {
+    open = request.keep_alive;
+    if (request.method == "POST" && request.path == "/predict") {
+      if (request.body.size() != batcher->input_bytes()) {
+        std::ostringstream message;
+        message << "Expected " << batcher->input_bytes()
+            << " bytes of float32 input, got " << request.body.size() << "\n";
+        open = WriteResponse(fd, "400 Bad Request", "text/plain",
+            message.str(), open) && open;
+        continue;
+      }
+      Prediction prediction(&request.body);
+      batcher->Predict(&prediction);
+      open = WriteResponse(fd, "200 OK", "application/octet-stream",
+          prediction.output, open) && open;
+    } else if (request.method == "GET" && request.path == "/info") {
+      open = WriteResponse(fd, "200 OK", "text/plain", batcher->info(),
+          open) && open;
+    } else if (request.method == "GET" && request.path == "/stats") {
+      open = WriteResponse(fd, "200 OK", "text/plain", batcher->Stats(),
+          open) && open;
+    } else {
+      open = WriteResponse(fd, "404 Not Found", "text/plain",
+          "Try POST /predict, GET /info or GET /stats\n", open) && open;
+    }
+  }
+  close(fd);
+}
+
+// Accepts connections forever, serving each from a thread of its own.
+void AcceptConnections(Batcher* batcher, int listen_fd) {
+  for (;;) {
+    const int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0) {
+      LOG(WARNING) << "accept failed: " << strerror(errno);
+      continue;
+    }
+    boost::thread(&ServeConnection, batcher, fd).detach();
+  }
+}
+
+int Listen(const string& host, int port) {
+  sockaddr_in address = sockaddr_in();
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  CHECK_EQ(inet_pton(AF_INET, host.c_str(), &address.sin_addr), 1)
+      << "Invalid IPv4 address " << host;
+  const int fd = socket(AF_INET, SOCK_STREAM, 0);
+  CHECK_GE(fd, 0) << "socket failed: " << strerror(errno);
+  const int reuse = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  CHECK_EQ(bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)),
+      0) << "Cannot bind to " << host << ":" << port << ": " << strerror(errno);
+  CHECK_EQ(listen(fd, SOMAXCONN), 0) << "listen failed: " << strerror(errno);
+  return fd;
+}
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  gflags::SetUsageMessage("Serve the predictions of a deploy net over HTTP.\n"
+      "Usage:\n"
+      "    inference_server --model=deploy.prototxt "
+      "--weights=net.caffemodel [--port=8000]");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to serve.";
+  CHECK_GT(FLAGS_weights.size(), 0) << "Need model weights to serve.";
+
+  if (FLAGS_gpu >= 0) {
+    LOG(INFO) << "Use GPU with device ID " << FLAGS_gpu;
+    Caffe::SetDevice(FLAGS_gpu);
+    Caffe::set_mode(Caffe::GPU);
+  } else {
+    LOG(INFO) << "Use CPU.";
+    Caffe::set_mode(Caffe::CPU);
+  }
+  Net<float> net(FLAGS_model, caffe::TEST);
+  net.CopyTrainedLayersFrom(FLAGS_weights);
+  Batcher batcher(&net);
+  LOG(INFO) << "Serving\n" << batcher.info();
+
+  // Clients closing their connection early must not kill the server.
+  signal(SIGPIPE, SIG_IGN);
+  const int listen_fd = Listen(FLAGS_host, FLAGS_port);
+  LOG(INFO) << "Listening on " << FLAGS_host << ":" << FLAGS_port;
+  boost::thread acceptor(&AcceptConnections, &batcher, listen_fd);
+  // The net runs in this thread, which made the GPU device current above.
+  batcher.Run();
+  return 0;
+}